@@ -0,0 +1,301 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * http_parser_benchmark.cc
+ *
+ * throughput of http::Parser on responses fed in segments, one line per scenario and segment size:
+ *   http_parser_benchmark [-n responses] [-b body bytes] [-g segment bytes] [-s length|chunked|headers|all]
+ * length   a Content-Length body of b bytes.
+ * chunked  the same body in chunks of 1k to 4k.
+ * headers  a body of 16 bytes after 40 header fields.
+ * every response is fed in segments of g bytes, 0 runs 64, 1460 and the whole response,
+ * latency is of one response. before timing each scenario checks that a byte by byte feed of both
+ * Recv overloads gets the same body and headers as the whole one, and that malformed chunk sizes,
+ * each in a buffer of its exact size, fail the body. it exits 1 when they don't.
+ *
+ * it is a host tool and not a part of the comm library, build it from mars/comm with the sources it needs:
+ *   gcc -O2 -c -I. -I.. -I../.. xlogger/xloggerbase.c xlogger/loginfo_extract.c assert/__assert.c
+ *   g++ -O2 -I. -I.. -I../.. benchmark/http_parser_benchmark.cc http.cc strutil.cc autobuffer.cc
+ *       boost_exception.cc xloggerbase.o loginfo_extract.o __assert.o -lz -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mars/comm/autobuffer.h"
+#include "mars/comm/http.h"
+
+extern "C" {
+intmax_t xlogger_pid() { return getpid(); }
+intmax_t xlogger_tid() { return (intmax_t)pthread_self(); }
+intmax_t xlogger_maintid() { return 0; }
+}
+
+static uint64_t __NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+class Benchmark {
+  public:
+    typedef std::map<const std::string, std::string, http::less> Headers;
+
+  public:
+    explicit Benchmark(unsigned int _count): count_(_count) {}
+
+    static std::string LengthResponse(size_t _body_size) {
+        std::string body = __Body(_body_size);
+        char length[32] = {0};
+        snprintf(length, sizeof(length), "%u", (unsigned int)body.size());
+
+        return std::string("HTTP/1.1 200 OK\r\n")
+               + "Content-Type: application/octet-stream\r\n"
+               + "Content-Length: " + length + "\r\n"
+               + "Connection: keep-alive\r\n"
+               + "\r\n" + body;
+    }
+
+    static std::string ChunkedResponse(size_t _body_size) {
+        std::string body = __Body(_body_size);
+        std::string response = std::string("HTTP/1.1 200 OK\r\n")
+                               + "Content-Type: application/octet-stream\r\n"
+                               + "Transfer-Encoding: chunked\r\n"
+                               + "\r\n";
+
+        for (size_t offset = 0, i = 0; offset < body.size(); ++i) {
+            size_t chunk = std::min<size_t>(1024 * (1 + i % 4), body.size() - offset);
+            char size[32] = {0};
+            snprintf(size, sizeof(size), "%x\r\n", (unsigned int)chunk);
+
+            response += size;
+            response.append(body, offset, chunk);
+            response += "\r\n";
+            offset += chunk;
+        }
+
+        return response + "0\r\n\r\n";
+    }
+
+    static std::string HeadersResponse() {
+        std::string response = "HTTP/1.1 200 OK\r\n";
+
+        for (int i = 0; i < 40; ++i) {
+            char field[64] = {0};
+            snprintf(field, sizeof(field), "X-Field-%d: value-of-the-field-%d\r\n", i, i * 7919);
+            response += field;
+        }
+
+        return response + "Content-Length: 16\r\n\r\n" + __Body(16);
+    }
+
+    // byte by byte through both overloads against the whole response at once.
+    static bool Check(const char* _name, const std::string& _response) {
+        std::string body;
+        Headers headers;
+        if (!__Parse(_response, _response.size(), body, headers)) {
+            printf("%s: the whole response fails to parse\n", _name);
+            return false;
+        }
+
+        std::string split_body;
+        Headers split_headers;
+        if (!__Parse(_response, 1, split_body, split_headers) || split_body != body || split_headers != headers) {
+            printf("%s: byte by byte differs from the whole response\n", _name);
+            return false;
+        }
+
+        AutoBuffer out;
+        http::Parser parser(new http::MemoryBodyReceiver(out), true);
+        AutoBuffer in;
+        for (size_t i = 0; i < _response.size(); ++i) {
+            in.Seek(0, AutoBuffer::ESeekEnd);
+            in.Write(&_response[i], 1);
+            in.Seek(0, AutoBuffer::ESeekStart);
+            parser.Recv(in);
+        }
+
+        if (!parser.Success() || 0 != in.Length() || std::string((const char*)out.Ptr(), out.Length()) != body
+                || parser.Fields().GetHeaders() != headers) {
+            printf("%s: Recv(AutoBuffer&) differs from the whole response\n", _name);
+            return false;
+        }
+
+        return true;
+    }
+
+    // every malformed chunk size has to end in kBodyError without reading past the buffer, with asan it tells.
+    static bool CheckMalformedChunkSize() {
+        static const char* const kSizes[] = {
+            "\r\n", " 5\r\n", "+5\r\n", "-5\r\n", "5 \r\n", "0x5\r\n", "g\r\n", ";ext\r\n",
+            "10000000000000000\r\n", "\r\n0123456789abcdefABCDEF", "5\r\nhello\r\n\r\n0123456789abcdef",
+        };
+
+        for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+            std::string response = std::string("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n") + kSizes[i];
+
+            for (size_t segment = 1; segment <= response.size(); segment = (1 == segment ? response.size() : segment + 1)) {
+                http::Parser parser;
+
+                for (size_t offset = 0; offset < response.size(); offset += segment) {
+                    size_t length = std::min(segment, response.size() - offset);
+                    char* buffer = (char*)malloc(length);
+                    memcpy(buffer, response.data() + offset, length);
+                    parser.Recv(buffer, length);
+                    free(buffer);
+                }
+
+                if (http::Parser::kBodyError != parser.RecvStatus()) {
+                    printf("malformed chunk size %u: status:%d, segment:%u\n", (unsigned int)i, parser.RecvStatus(), (unsigned int)segment);
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    void Run(const char* _name, const std::string& _response, size_t _segment) {
+        std::vector<uint32_t> latency_ns;
+        latency_ns.reserve(count_);
+
+        AutoBuffer out;
+        uint64_t begin = __NowNs();
+
+        for (unsigned int i = 0; i < count_; ++i) {
+            uint64_t start = __NowNs();
+            out.Reset();
+            http::Parser parser(new http::MemoryBodyReceiver(out), true);
+
+            for (size_t offset = 0; offset < _response.size(); offset += _segment) {
+                parser.Recv(_response.data() + offset, std::min(_segment, _response.size() - offset));
+            }
+
+            if (!parser.Success()) {
+                printf("%s: fails to parse, status:%d\n", _name, parser.RecvStatus());
+                exit(1);
+            }
+
+            latency_ns.push_back((uint32_t)(__NowNs() - start));
+        }
+
+        __Print(_name, _segment, _response.size(), __NowNs() - begin, latency_ns);
+    }
+
+    static void PrintHeader() {
+        printf("%-10s %8s %9s %9s %11s %9s %9s %9s\n", "scenario", "segment", "responses", "MB/s", "resp/s", "p50 us", "p99 us", "max us");
+    }
+
+  private:
+    static std::string __Body(size_t _size) {
+        std::string body(_size, '\0');
+        for (size_t i = 0; i < _size; ++i) body[i] = (char)(i * 131 + 7);  // crlf and nul included
+        return body;
+    }
+
+    static bool __Parse(const std::string& _response, size_t _segment, std::string& _body, Headers& _headers) {
+        AutoBuffer out;
+        http::Parser parser(new http::MemoryBodyReceiver(out), true);
+
+        for (size_t offset = 0; offset < _response.size(); offset += _segment) {
+            parser.Recv(_response.data() + offset, std::min(_segment, _response.size() - offset));
+        }
+
+        _body.assign((const char*)out.Ptr(), out.Length());
+        _headers = parser.Fields().GetHeaders();
+        return parser.Success();
+    }
+
+    template <typename T>
+    static T __Percentile(const std::vector<T>& _sorted, double _p) {
+        if (_sorted.empty()) return 0;
+        size_t index = (size_t)(_sorted.size() * _p);
+        return _sorted[std::min(index, _sorted.size() - 1)];
+    }
+
+    void __Print(const char* _name, size_t _segment, size_t _response_size, uint64_t _elapsed_ns, std::vector<uint32_t> _latency_ns) {
+        std::sort(_latency_ns.begin(), _latency_ns.end());
+        double seconds = _elapsed_ns / 1e9;
+        printf("%-10s %8u %9u %9.1f %11.0f %9.2f %9.2f %9.2f\n", _name, (unsigned int)_segment, count_,
+               0 < seconds ? (double)_response_size * count_ / seconds / (1024 * 1024) : 0.0,
+               0 < seconds ? count_ / seconds : 0.0,
+               __Percentile(_latency_ns, 0.5) / 1000.0, __Percentile(_latency_ns, 0.99) / 1000.0,
+               _latency_ns.empty() ? 0.0 : _latency_ns.back() / 1000.0);
+        fflush(stdout);
+    }
+
+  private:
+    unsigned int count_;
+};
+
+int main(int argc, char* argv[]) {
+    unsigned int count = 10000;
+    size_t body_size = 64 * 1024;
+    size_t segment = 0;
+    std::string scenario = "all";
+
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (0 == strcmp("-n", argv[i]) && has_value) {
+            count = (unsigned int)atoi(argv[++i]);
+        } else if (0 == strcmp("-b", argv[i]) && has_value) {
+            body_size = (size_t)atoi(argv[++i]);
+        } else if (0 == strcmp("-g", argv[i]) && has_value) {
+            segment = (size_t)atoi(argv[++i]);
+        } else if (0 == strcmp("-s", argv[i]) && has_value) {
+            scenario = argv[++i];
+        } else {
+            printf("usage: %s [-n responses] [-b body bytes] [-g segment bytes] [-s length|chunked|headers|all]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<std::pair<const char*, std::string> > responses;
+    if ("length" == scenario || "all" == scenario) responses.push_back(std::make_pair("length", Benchmark::LengthResponse(body_size)));
+    if ("chunked" == scenario || "all" == scenario) responses.push_back(std::make_pair("chunked", Benchmark::ChunkedResponse(body_size)));
+    if ("headers" == scenario || "all" == scenario) responses.push_back(std::make_pair("headers", Benchmark::HeadersResponse()));
+
+    for (size_t i = 0; i < responses.size(); ++i) {
+        if (!Benchmark::Check(responses[i].first, responses[i].second)) return 1;
+    }
+
+    if (!Benchmark::CheckMalformedChunkSize()) return 1;
+
+    Benchmark benchmark(count);
+    Benchmark::PrintHeader();
+
+    for (size_t i = 0; i < responses.size(); ++i) {
+        const std::string& response = responses[i].second;
+
+        if (0 != segment) {
+            benchmark.Run(responses[i].first, response, segment);
+            continue;
+        }
+
+        benchmark.Run(responses[i].first, response, 64);
+        benchmark.Run(responses[i].first, response, 1460);
+        benchmark.Run(responses[i].first, response, response.size());
+    }
+
+    return 0;
+}
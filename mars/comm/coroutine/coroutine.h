@@ -73,10 +73,8 @@ inline void Yield() {
 
 inline void Resume(const boost::intrusive_ptr<Wrapper>& _wrapper, int64_t _after=0) {
     
-    MessageQueue::Message message;
-    message.body1 = boost::make_shared<MessageQueue::AsyncInvokeFunction>([_wrapper](){ _wrapper->push_obj_(); });
+    MessageQueue::Message message(_wrapper.get(), [_wrapper](){ _wrapper->push_obj_(); });
     message.body2 = _wrapper;
-    message.title = _wrapper.get();
     
     MessageQueue::PostMessage(_wrapper->handler_, message, _after);
 }
@@ -20,7 +20,13 @@
 #include "http.h"
 
 #include <cstddef>
+#include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <zlib.h>
 
 #include "comm/strutil.h"
 #include "comm/xlogger/xlogger.h"
@@ -31,28 +37,18 @@ static const char* const KStringSpace = " ";
 static const char* const KStringCRLF = "\r\n";
 static const char* const KStringColon = ":";
 
-inline char* string_strnstr(const char* src, const char* sfind, int pos1) {
-    xassert2(src != NULL && sfind != NULL);
-
-    if (src == NULL || sfind == NULL)
-        return NULL;
-
-    int l1, l2;
-    l2 = (int)strlen(sfind);
+// the "\r\n" ending the first line of [_begin, _end), looking for '\n' from _begin + _scan_from.
+// memchr takes a word or a vector at a time where a byte compare loop would take one.
+static const char* __FindCRLF(const char* _begin, const char* _end, size_t _scan_from) {
+    const char* from = _begin + _scan_from;
 
-    if (!l2)
-        return (char*)src;
+    while (from < _end) {
+        const char* lf = (const char*)memchr(from, '\n', (size_t)(_end - from));
 
-    l1 = (int)strnlen(src, pos1);
-    pos1 = (pos1 > l1) ? l1 : pos1;
+        if (NULL == lf) return NULL;
+        if (lf > _begin && '\r' == *(lf - 1)) return lf - 1;
 
-    while (pos1 >= l2) {
-        pos1--;
-
-        if (!memcmp(src, sfind, (size_t)l2))
-            return (char*)src;
-
-        src++;
+        from = lf + 1;
     }
 
     return NULL;
@@ -69,36 +65,45 @@ static THttpVersion __GetHttpVersion(const std::string& _strVersion) {
     return kVersion_Unknow;
 }
 
-static bool __ParserHeaders(const std::string& _strHeaders, HeaderFields& _headers) {
-    
-    std::string::size_type linebegin = 0;
-    std::string::size_type lineend = 0;
-    
-    while ((lineend = _strHeaders.find(KStringCRLF, lineend, strlen(KStringCRLF))) != std::string::npos){
-        
-        std::string line = _strHeaders.substr(linebegin, lineend - linebegin);
-        
-        std::string::size_type namebegin = line.find_first_not_of(KStringColon, 0, strlen(KStringColon));
-        if (namebegin != std::string::npos){
-            std::string::size_type nameend = line.find_first_of(KStringColon, 0, strlen(KStringColon));
-            std::string name = line.substr(0, nameend);
-            if (line.length() > nameend + strlen(KStringColon)){
-                std::string value = line.substr(nameend + strlen(KStringColon));
-                
-                strutil::Trim(name);
-                strutil::Trim(value);
-                
-                _headers.HeaderFiled(name.c_str(), value.c_str());
-            }
-        }
-        
-        lineend += strlen(KStringCRLF);
-        linebegin = lineend;
+// hex digits only, ending at _end or at a chunk extension, no sign, no space and no overflow.
+static bool __ParseChunkSize(const char* _begin, const char* _end, int64_t& _size) {
+    const char* pos = _begin;
+    int64_t size = 0;
+
+    for (; pos < _end && ';' != *pos; ++pos) {
+        int digit = 0;
+
+        if ('0' <= *pos && *pos <= '9') digit = *pos - '0';
+        else if ('a' <= *pos && *pos <= 'f') digit = *pos - 'a' + 10;
+        else if ('A' <= *pos && *pos <= 'F') digit = *pos - 'A' + 10;
+        else return false;
+
+        if (0 != (size >> 59)) return false;  // one more digit would pass int64_t
+        size = (size << 4) | digit;
     }
-    
+
+    if (pos == _begin) return false;
+
+    _size = size;
     return true;
 }
 
+// one "name: value" line without its "\r\n", name and value trimmed, a line without a value is skipped.
+static void __ParseHeaderLine(const char* _begin, const char* _end, HeaderFields& _headers) {
+    const char* colon = (const char*)memchr(_begin, ':', (size_t)(_end - _begin));
+    if (NULL == colon || colon + 1 == _end) return;
+
+    const char* name_end = colon;
+    while (_begin < name_end && isspace((unsigned char)*_begin)) ++_begin;
+    while (_begin < name_end && isspace((unsigned char)*(name_end - 1))) --name_end;
+
+    const char* value_begin = colon + 1;
+    while (value_begin < _end && isspace((unsigned char)*value_begin)) ++value_begin;
+    while (value_begin < _end && isspace((unsigned char)*(_end - 1))) --_end;
+
+    _headers.HeaderFiled(std::make_pair(std::string(_begin, name_end), std::string(value_begin, _end)));
+}
+
 // implement of RequestLine
 
 const char* const RequestLine::kHttpMethodString[kMax] = {
@@ -305,7 +310,10 @@ const char* const KStringChunked = "chunked";
 const char* const KStringClose = "close";
 const char* const KStringKeepalive = "Keep-Alive";
 const char* const KStringAcceptAll = "*/*";
-const char* const KStringAcceptEncodingDefalte = "defalte";
+const char* const KStringAcceptEncodingGzipDeflate = "gzip, deflate";
+const char* const KStringIdentity = "identity";
+const char* const KStringGzip = "gzip";
+const char* const KStringDeflate = "deflate";
 const char* const KStringNoCache = "no-cache";
 const char* const KStringOctetType = "application/octet-stream";
 
@@ -332,7 +340,16 @@ std::pair<const std::string, std::string> HeaderFields::MakeAcceptAll() {
 }
 
 std::pair<const std::string, std::string> HeaderFields::MakeAcceptEncodingDefalte() {
-    return std::make_pair(KStringAcceptEncoding, KStringAcceptEncodingDefalte);
+    return std::make_pair(KStringAcceptEncoding, KStringDeflate);
+}
+
+std::pair<const std::string, std::string> HeaderFields::MakeAcceptEncodingGzipDeflate() {
+    return std::make_pair(KStringAcceptEncoding, KStringAcceptEncodingGzipDeflate);
+}
+
+std::pair<const std::string, std::string> HeaderFields::MakeContentEncoding(TContentEncoding _encoding) {
+    xassert2(kContentEncodingGzip == _encoding || kContentEncodingDeflate == _encoding, TSF"encoding:%_", _encoding);
+    return std::make_pair(kStringContentEncoding, kContentEncodingDeflate == _encoding ? KStringDeflate : KStringGzip);
 }
 
 std::pair<const std::string, std::string> HeaderFields::MakeCacheControlNoCache() {
@@ -366,7 +383,7 @@ const char* HeaderFields::HeaderField(const char* _key) const {
     return NULL;
 }
 
-bool HeaderFields::IsTransferEncodingChunked() {
+bool HeaderFields::IsTransferEncodingChunked() const {
     const char* transferEncoding = HeaderField(HeaderFields::KStringTransferEncoding);
 
     if (transferEncoding && 0 == strcasecmp(transferEncoding, KStringChunked)) return true;
@@ -374,6 +391,32 @@ bool HeaderFields::IsTransferEncodingChunked() {
     return false;
 }
 
+bool HeaderFields::IsConnectionClose() const {
+    const char* connection = HeaderField(HeaderFields::KStringConnection);
+
+    if (connection && 0 == strcasecmp(connection, KStringClose)) return true;
+
+    return false;
+}
+
+bool HeaderFields::IsConnectionKeepalive() const {
+    const char* connection = HeaderField(HeaderFields::KStringConnection);
+
+    if (connection && 0 == strcasecmp(connection, KStringKeepalive)) return true;
+
+    return false;
+}
+
+TContentEncoding HeaderFields::ContentEncoding() const {
+    const char* contentEncoding = HeaderField(HeaderFields::kStringContentEncoding);
+
+    if (NULL == contentEncoding || '\0' == *contentEncoding || 0 == strcasecmp(contentEncoding, KStringIdentity)) return kContentEncodingIdentity;
+    if (0 == strcasecmp(contentEncoding, KStringGzip) || 0 == strcasecmp(contentEncoding, "x-gzip")) return kContentEncodingGzip;
+    if (0 == strcasecmp(contentEncoding, KStringDeflate)) return kContentEncodingDeflate;
+
+    return kContentEncodingUnknown;
+}
+
 int HeaderFields::ContentLength() {
     const char* strContentLength = HeaderField(HeaderFields::KStringContentLength);
     int contentLength = 0;
@@ -561,6 +604,81 @@ const IStreamBodyProvider* Builder::StreamBody() const {
     return streambody_;
 }
 
+// window bits of zlib for a Content-Encoding, gzip wraps the stream in a gzip header and deflate in a zlib one.
+static int __WindowBits(TContentEncoding _encoding) {
+    return kContentEncodingGzip == _encoding ? MAX_WBITS + 16 : MAX_WBITS;
+}
+
+bool Compress(const void* _data, size_t _length, TContentEncoding _encoding, AutoBuffer& _out) {
+    _out.Reset();
+
+    if (kContentEncodingGzip != _encoding && kContentEncodingDeflate != _encoding) {
+        xerror2(TSF"can't compress, encoding:%_", _encoding);
+        return false;
+    }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    if (Z_OK != deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, __WindowBits(_encoding), 8, Z_DEFAULT_STRATEGY)) {
+        xerror2(TSF"deflateInit2 fail, encoding:%_", _encoding);
+        return false;
+    }
+
+    _out.AllocWrite(deflateBound(&stream, (uLong)_length));
+
+    stream.next_in = (Bytef*)_data;
+    stream.avail_in = (uInt)_length;
+    stream.next_out = (Bytef*)_out.Ptr();
+    stream.avail_out = (uInt)_out.Length();
+
+    int ret = deflate(&stream, Z_FINISH);
+    _out.Length(0, stream.total_out);
+    deflateEnd(&stream);
+
+    if (Z_STREAM_END != ret) {
+        xerror2(TSF"deflate fail, ret:%_, in:%_", ret, _length);
+        return false;
+    }
+
+    return true;
+}
+
+bool Builder::CompressBlockBody(TContentEncoding _encoding) {
+    if (kContentEncodingGzip != _encoding && kContentEncodingDeflate != _encoding) {
+        xerror2(TSF"can't compress body, encoding:%_", _encoding);
+        return false;
+    }
+
+    if (NULL == blockbody_) return false;
+
+    AutoBuffer body;
+    if (0 < blockbody_->Length() && !blockbody_->Data(body)) return false;
+
+    BufferBodyProvider* compressed = new BufferBodyProvider();
+    bool ret = Compress(body.Ptr(), body.Length(), _encoding, compressed->Buffer());
+
+    // the body is read out already, so it goes on as it was
+    if (!ret) {
+        compressed->Buffer().Reset();
+        compressed->Buffer().Write(body.Ptr(), body.Length());
+    }
+
+    xdebug2(TSF"compress body %_ -> %_, encoding:%_, ret:%_", body.Length(), compressed->Length(), _encoding, ret);
+
+    if (is_manage_body_) delete blockbody_;
+    blockbody_ = compressed;
+    is_manage_body_ = true;
+
+    if (!ret) return false;
+
+    headfields_.GetHeaders().erase(HeaderFields::KStringContentLength);
+    headfields_.GetHeaders().erase(HeaderFields::kStringContentEncoding);
+    headfields_.HeaderFiled(HeaderFields::MakeContentLength((int)compressed->Length()));
+    headfields_.HeaderFiled(HeaderFields::MakeContentEncoding(_encoding));
+    return true;
+}
+
 bool Builder::HeaderToBuffer(AutoBuffer& _header) {
     std::string firstline;
 
@@ -603,6 +721,121 @@ bool Builder::HttpToBuffer(AutoBuffer& _http) {
 }
 
 
+// implement of InflateBodyReceiver
+InflateBodyReceiver::InflateBodyReceiver(BodyReceiver* _body, bool _manage)
+    : body_(_body)
+    , is_manage_body_(_manage)
+    , encoding_(kContentEncodingIdentity)
+    , stream_(NULL)
+    , stream_end_(false)
+    , error_(false) {
+    xassert2(body_);
+}
+
+InflateBodyReceiver::~InflateBodyReceiver() {
+    if (NULL != stream_) {
+        inflateEnd(stream_);
+        delete stream_;
+        stream_ = NULL;
+    }
+
+    if (is_manage_body_) {
+        delete body_;
+        body_ = NULL;
+    }
+}
+
+bool InflateBodyReceiver::BeginData(const HeaderFields& _fields) {
+    encoding_ = _fields.ContentEncoding();
+
+    if (kContentEncodingUnknown == encoding_) {
+        xerror2(TSF"unsupported content encoding:%_", _fields.HeaderField(HeaderFields::kStringContentEncoding));
+        error_ = true;
+        return false;
+    }
+
+    if (kContentEncodingIdentity == encoding_) return body_->BeginData(_fields);
+
+    xassert2(NULL == stream_);
+    stream_ = new z_stream;
+    memset(stream_, 0, sizeof(*stream_));
+
+    if (Z_OK != inflateInit2(stream_, __WindowBits(encoding_))) {
+        xerror2(TSF"inflateInit2 fail, encoding:%_", encoding_);
+        delete stream_;
+        stream_ = NULL;
+        error_ = true;
+        return false;
+    }
+
+    return body_->BeginData(_fields);
+}
+
+void InflateBodyReceiver::AppendData(const void* _body, size_t _length) {
+    BodyReceiver::AppendData(_body, _length);
+
+    if (error_) return;
+
+    if (NULL == stream_) {
+        body_->AppendData(_body, _length);
+        return;
+    }
+
+    if (stream_end_) {
+        xerror2(TSF"%_ bytes after the end of the %_ stream", _length, encoding_);
+        error_ = true;
+        return;
+    }
+
+    char out[16 * 1024];
+    stream_->next_in = (Bytef*)_body;
+    stream_->avail_in = (uInt)_length;
+
+    while (true) {
+        stream_->next_out = (Bytef*)out;
+        stream_->avail_out = sizeof(out);
+
+        int ret = inflate(stream_, Z_NO_FLUSH);
+
+        if (Z_OK != ret && Z_STREAM_END != ret && Z_BUF_ERROR != ret) {
+            xerror2(TSF"inflate fail, ret:%_, msg:%_, in:%_", ret, NULL == stream_->msg ? "" : stream_->msg, stream_->total_in);
+            error_ = true;
+            return;
+        }
+
+        if (0 < sizeof(out) - stream_->avail_out) body_->AppendData(out, sizeof(out) - stream_->avail_out);
+
+        // a full output may leave more in the stream even with no input left
+        if (Z_STREAM_END != ret) {
+            if (0 == stream_->avail_in && 0 != stream_->avail_out) return;
+            continue;
+        }
+
+        // a gzip body may be several members one after another
+        if (0 < stream_->avail_in && kContentEncodingGzip == encoding_ && Z_OK == inflateReset(stream_)) continue;
+
+        stream_end_ = true;
+
+        if (0 < stream_->avail_in) {
+            xerror2(TSF"%_ bytes after the end of the %_ stream", stream_->avail_in, encoding_);
+            error_ = true;
+        }
+
+        return;
+    }
+}
+
+void InflateBodyReceiver::EndData() {
+    if (NULL != stream_ && !stream_end_ && !error_) {
+        xerror2(TSF"%_ body ends before its stream, in:%_, out:%_", encoding_, stream_->total_in, stream_->total_out);
+        error_ = true;
+    }
+
+    body_->EndData();
+}
+
+
+
 // implement of Parser
 Parser::Parser(BodyReceiver* _body, bool _manage)
     : recvstatus_(kStart)
@@ -610,7 +843,10 @@ Parser::Parser(BodyReceiver* _body, bool _manage)
     , headfields_()
     , bodyreceiver_(_body)
     , is_manage_body_(_manage)
-    , headerlength_(0){
+    , headerlength_(0)
+    , scan_from_(0)
+    , chunkstatus_(kChunkSize)
+    , body_left_(0) {
 }
 
 Parser::~Parser() {
@@ -630,169 +866,17 @@ Parser::TRecvStatus Parser::Recv(const void* _buffer, size_t _length) {
         return recvstatus_;
     }
     
-    recvbuf_.Write(_buffer, _length);
-    
-    while (true) {
-        switch (recvstatus_) {
-            case kStart:
-            case kFirstLine: {
-                char* pBuf = (char*)recvbuf_.Ptr();
-                char* pos = string_strnstr(pBuf, KStringCRLF, (int)recvbuf_.Length());
-                
-                if (NULL == pos && 8 * 1024 < recvbuf_.Length()) {
-                    xerror2(TSF"wrong first line 8k buffer no found CRLF");
-                    recvstatus_ = kFirstLineError;
-                    return recvstatus_;
-                }
-                
-                if (NULL == pos) {
-                    recvstatus_ = kFirstLine;
-                    return recvstatus_;
-                }
-                
-                ptrdiff_t firstlinelength = pos - pBuf + 2;
-                std::string firstline = std::string(pBuf, (size_t)firstlinelength);
-                
-                bool parseFirstlineSuc = false;
-                
-                if (strutil::StartsWith(firstline, "HTTP/")) {
-                    if (statusline_.FromString(firstline)) {
-                        csmode_ = kRespond;
-                        parseFirstlineSuc = true;
-                    }
-                } else {
-                    if (requestline_.FromString(firstline)) {
-                        csmode_ = kRequest;
-                        parseFirstlineSuc = true;
-                    }
-                }
-                
-                if (!parseFirstlineSuc) {
-                    xerror2(TSF"wrong first line: %0", firstline);
-                    recvstatus_ = kFirstLineError;
-                    return recvstatus_;
-                }
-                
-                recvstatus_ = kHeaderFields;
-                recvbuf_.Move(- firstlinelength);
-            }
-                break;
-                
-            case kHeaderFields: {
-                char* pBuf = (char*)recvbuf_.Ptr();
-                char* pos = string_strnstr(pBuf, "\r\n\r\n", (int)recvbuf_.Length());
-                
-                if (NULL == pos && 128 * 1024 < recvbuf_.Length()) {
-                    xerror2(TSF"wrong header fields 128k buffer no found CRLFCRLF");
-                    recvstatus_ = kHeaderFieldsError;
-                    return recvstatus_;
-                }
-                
-                if (NULL == pos) return recvstatus_;
-                
-                ptrdiff_t headerslength = pos - pBuf + 4;
-                std::string headers = std::string(pBuf, (size_t)headerslength);
-                
-                bool ret = __ParserHeaders(headers, headfields_);
-                
-                if (false == ret) {
-                    recvstatus_ = kHeaderFieldsError;
-                    return recvstatus_;
-                }
-                
-                recvstatus_ = kBody;
-                recvbuf_.Move(-headerslength);
-            }
-                break;
-                
-            case kBody: {
-                xassert2(bodyreceiver_);
-                
-                if (bodyreceiver_) {
-                    // chunked
-                    
-                    if (headfields_.IsTransferEncodingChunked()) {
-                        char* chunkSizeBegin = (char*)recvbuf_.Ptr();
-                        char* chunkSizeEnd = string_strnstr(chunkSizeBegin, KStringCRLF, (int)recvbuf_.Length());
-                        
-                        if (NULL == chunkSizeEnd) {
-                            return recvstatus_;
-                        }
-                        
-                        std::string strChunkSize = std::string(chunkSizeBegin, chunkSizeEnd);
-                        strutil::Trim(strChunkSize);
-                        
-                        int64_t chunkSize = strtol(strChunkSize.c_str(), NULL, 16);
-                        
-                        ptrdiff_t sizeLen = chunkSizeEnd - chunkSizeBegin;
-                        
-                        if (0 != chunkSize) {
-                            if ((ptrdiff_t)recvbuf_.Length() < chunkSize + sizeLen + 4)  return recvstatus_;
-                            
-                            char* chunkBegin = chunkSizeEnd + 2;
-                            char* chunkEnd = chunkBegin + chunkSize;
-                            
-                            if (*chunkEnd != '\r' || *(chunkEnd + 1) != '\n') {
-                                recvstatus_ = kBodyError;
-                                return recvstatus_;
-                            }
-                            
-                            bodyreceiver_->AppendData(chunkBegin, (size_t)chunkSize);
-                            
-                            recvbuf_.Move(-(chunkEnd - chunkSizeBegin + 2));
-                        } else {  // last chunk
-                            char* trailerBegin = chunkSizeEnd + 2;
-                            
-                            if (recvbuf_.Length() < (unsigned int)(sizeLen + 4)) return recvstatus_;
-                            
-                            char* trailerEnd = string_strnstr(trailerBegin, KStringCRLF, (int)recvbuf_.Length());
-                            
-                            if (NULL == trailerEnd)
-                                return recvstatus_;
-                            
-                            recvstatus_ = kEnd;
-                            bodyreceiver_->EndData();
-                            
-                            
-                            recvbuf_.Move(-(trailerEnd - chunkSizeBegin + 2));
-                        }
-                    } else {  // no chunk
-                        int contentLength = headfields_.ContentLength();
-                        int appendlen = 0;
-                        
-                        if (int(recvbuf_.Length() + bodyreceiver_->Length()) <= contentLength)
-                            appendlen = int(recvbuf_.Length());
-                        else
-                            appendlen = contentLength - int(bodyreceiver_->Length());
-                        
-                        
-                        bodyreceiver_->AppendData(recvbuf_.Ptr(), (size_t)appendlen);
-                        recvbuf_.Move(-appendlen);
-                        
-                        if ((int)bodyreceiver_->Length() == contentLength) {
-                            recvstatus_ = kEnd;
-                            bodyreceiver_->EndData();
-                            return  recvstatus_;
-                        }
-                    }
-                }
-                
-                if (0 == recvbuf_.Length())
-                    return recvstatus_;
-            }
-                break;
-                
-            case kEnd: {
-                return recvstatus_;
-            }
-                break;
-                
-            default:
-                break;
-        }
+    // parse straight from the caller, only an unfinished line or what follows the message is kept.
+    if (0 == recvbuf_.Length()) {
+        size_t used = __Parse((const char*)_buffer, _length);
+        if (used < _length) recvbuf_.Write((const char*)_buffer + used, _length - used);
+        return recvstatus_;
     }
-    
-    xassert2(false, TSF"status:%_", recvstatus_);
+
+    recvbuf_.Write(_buffer, _length);
+    size_t used = __Parse((const char*)recvbuf_.Ptr(), recvbuf_.Length());
+    if (0 < used) recvbuf_.Move(-(off_t)used);
+
     return recvstatus_;
 }
 
@@ -804,27 +888,37 @@ Parser::TRecvStatus Parser::Recv(AutoBuffer& _recv_buffer) {
         return recvstatus_;
     }
 
+    if (scan_from_ > _recv_buffer.Length()) scan_from_ = 0;
+
+    size_t used = __Parse((const char*)_recv_buffer.Ptr(), _recv_buffer.Length());
+    if (0 < used) _recv_buffer.Move(-(off_t)used);
+
+    return recvstatus_;
+}
+
+size_t Parser::__Parse(const char* _data, size_t _length) {
+    const char* pos = _data;
+    const char* const end = _data + _length;
 
     while (true) {
         switch (recvstatus_) {
         case kStart:
         case kFirstLine: {
-            char* pBuf = (char*)_recv_buffer.Ptr();
-            char* pos = string_strnstr(pBuf, KStringCRLF, (int)_recv_buffer.Length());
+            const char* crlf = __FindCRLF(pos, end, scan_from_);
 
-            if (NULL == pos && 8 * 1024 < _recv_buffer.Length()) {
+            if (NULL == crlf && 8 * 1024 < end - pos) {
                 xerror2(TSF"wrong first line 8k buffer no found CRLF");
                 recvstatus_ = kFirstLineError;
-                return recvstatus_;
+                return (size_t)(pos - _data);
             }
 
-            if (NULL == pos) {
+            if (NULL == crlf) {
                 recvstatus_ = kFirstLine;
-                return recvstatus_;
+                scan_from_ = (size_t)(end - pos);
+                return (size_t)(pos - _data);
             }
 
-            ptrdiff_t firstlinelength = pos - pBuf + 2;
-            std::string firstline = std::string(pBuf, (size_t)firstlinelength);
+            std::string firstline = std::string(pos, (size_t)(crlf + 2 - pos));
 
             bool parseFirstlineSuc = false;
 
@@ -843,131 +937,188 @@ Parser::TRecvStatus Parser::Recv(AutoBuffer& _recv_buffer) {
             if (!parseFirstlineSuc) {
                 xerror2(TSF"wrong first line: %0", firstline);
                 recvstatus_ = kFirstLineError;
-                return recvstatus_;
+                return (size_t)(pos - _data);
             }
 
             recvstatus_ = kHeaderFields;
-            _recv_buffer.Move(- firstlinelength);
+            scan_from_ = 0;
+            pos = crlf + 2;
         }
         break;
 
         case kHeaderFields: {
-            char* pBuf = (char*)_recv_buffer.Ptr();
-            char* pos = string_strnstr(pBuf, "\r\n\r\n", (int)_recv_buffer.Length());
+            const char* crlf = __FindCRLF(pos, end, scan_from_);
 
-            if (NULL == pos && 128 * 1024 < _recv_buffer.Length()) {
+            if (NULL == crlf && 128 * 1024 < headerlength_ + (end - pos)) {
                 xerror2(TSF"wrong header fields 128k buffer no found CRLFCRLF");
                 recvstatus_ = kHeaderFieldsError;
-                return recvstatus_;
+                return (size_t)(pos - _data);
             }
 
-            if (NULL == pos) return recvstatus_;
-
-            ptrdiff_t headerslength = pos - pBuf + 4;
-            std::string headers = std::string(pBuf, (size_t)headerslength);
+            if (NULL == crlf) {
+                scan_from_ = (size_t)(end - pos);
+                return (size_t)(pos - _data);
+            }
 
-            bool ret = __ParserHeaders(headers, headfields_);
+            headerlength_ += (size_t)(crlf + 2 - pos);
+            scan_from_ = 0;
 
-            if (false == ret) {
-                recvstatus_ = kHeaderFieldsError;
-                return recvstatus_;
+            if (crlf != pos) {
+                __ParseHeaderLine(pos, crlf, headfields_);
+                pos = crlf + 2;
+                break;
             }
 
+            // the empty line ends the header fields
+            pos = crlf + 2;
             recvstatus_ = kBody;
-            _recv_buffer.Move(-headerslength);
-            headerlength_ = headerslength;
+
+            if (headfields_.IsTransferEncodingChunked()) {
+                chunkstatus_ = kChunkSize;
+                body_left_ = 0;
+            } else {
+                body_left_ = headfields_.ContentLength();
+
+                if (0 > body_left_) {
+                    xerror2(TSF"wrong content length:%_", body_left_);
+                    recvstatus_ = kBodyError;
+                    return (size_t)(pos - _data);
+                }
+            }
+
+            if (NULL != bodyreceiver_ && !bodyreceiver_->BeginData(headfields_)) {
+                xerror2(TSF"body receiver refuses the body, content encoding:%_", headfields_.HeaderField(HeaderFields::kStringContentEncoding));
+                recvstatus_ = kBodyError;
+                return (size_t)(pos - _data);
+            }
         }
         break;
 
         case kBody: {
             xassert2(bodyreceiver_);
 
-            if (bodyreceiver_) {
-                // chunked
+            if (NULL == bodyreceiver_) return (size_t)(pos - _data);
 
-                if (headfields_.IsTransferEncodingChunked()) {
-                    char* chunkSizeBegin = (char*)_recv_buffer.Ptr();
-                    char* chunkSizeEnd = string_strnstr(chunkSizeBegin, KStringCRLF, (int)_recv_buffer.Length());
+            bool more = headfields_.IsTransferEncodingChunked() ? __ParseChunked(pos, end) : __ParseLength(pos, end);
 
-                    if (NULL == chunkSizeEnd) {
-                        return recvstatus_;
-                    }
+            if (bodyreceiver_->Error()) {
+                xerror2(TSF"body receiver fails, content encoding:%_", headfields_.HeaderField(HeaderFields::kStringContentEncoding));
+                recvstatus_ = kBodyError;
+            }
 
-                    std::string strChunkSize = std::string(chunkSizeBegin, chunkSizeEnd);
-                    strutil::Trim(strChunkSize);
+            if (!more) return (size_t)(pos - _data);
+        }
+        break;
 
-                    int64_t chunkSize = strtol(strChunkSize.c_str(), NULL, 16);
+        case kEnd:
+        default:
+            return (size_t)(pos - _data);
+        }
+    }
+}
 
-                    ptrdiff_t sizeLen = chunkSizeEnd - chunkSizeBegin;
+// a body of Content-Length, false when it needs more data.
+bool Parser::__ParseLength(const char*& _pos, const char* _end) {
+    size_t appendlen = (size_t)std::min<int64_t>(body_left_, _end - _pos);
 
-                    if (0 != chunkSize) {
-                        if ((ptrdiff_t)_recv_buffer.Length() < chunkSize + sizeLen + 4)  return recvstatus_;
+    if (0 < appendlen) bodyreceiver_->AppendData(_pos, appendlen);
 
-                        char* chunkBegin = chunkSizeEnd + 2;
-                        char* chunkEnd = chunkBegin + chunkSize;
+    _pos += appendlen;
+    body_left_ -= (int64_t)appendlen;
 
-                        if (*chunkEnd != '\r' || *(chunkEnd + 1) != '\n') {
-                            recvstatus_ = kBodyError;
-                            return recvstatus_;
-                        }
+    if (0 < body_left_) return false;
 
-                        bodyreceiver_->AppendData(chunkBegin, (size_t)chunkSize);
+    recvstatus_ = kEnd;
+    bodyreceiver_->EndData();
+    return true;
+}
 
-                        _recv_buffer.Move(-(chunkEnd - chunkSizeBegin + 2));
-                    } else {  // last chunk
-                        char* trailerBegin = chunkSizeEnd + 2;
+// one step of a chunked body, false when it needs more data or failed.
+bool Parser::__ParseChunked(const char*& _pos, const char* _end) {
+    switch (chunkstatus_) {
+    case kChunkSize: {
+        const char* crlf = __FindCRLF(_pos, _end, scan_from_);
 
-                        if (recvbuf_.Length() < (unsigned int)(sizeLen + 4)) return recvstatus_;
+        if (NULL == crlf && 8 * 1024 < _end - _pos) {
+            xerror2(TSF"wrong chunk size 8k buffer no found CRLF");
+            recvstatus_ = kBodyError;
+            return false;
+        }
 
-                        char* trailerEnd = string_strnstr(trailerBegin, KStringCRLF, (int)_recv_buffer.Length());
+        if (NULL == crlf) {
+            scan_from_ = (size_t)(_end - _pos);
+            return false;
+        }
 
-                        if (NULL == trailerEnd)
-                            return recvstatus_;
+        int64_t chunk_size = 0;
 
-                        recvstatus_ = kEnd;
-                        bodyreceiver_->EndData();
+        if (!__ParseChunkSize(_pos, crlf, chunk_size)) {
+            xerror2(TSF"wrong chunk size:%_", std::string(_pos, crlf));
+            recvstatus_ = kBodyError;
+            return false;
+        }
 
+        scan_from_ = 0;
+        _pos = crlf + 2;
+        body_left_ = chunk_size;
+        chunkstatus_ = (0 == chunk_size) ? kChunkTrailer : kChunkData;
+    }
+    return true;
 
-                        _recv_buffer.Move(-(trailerEnd - chunkSizeBegin + 2));
-                    }
-                } else {  // no chunk
-                    int contentLength = headfields_.ContentLength();
-                    int appendlen = 0;
+    case kChunkData: {
+        size_t appendlen = (size_t)std::min<int64_t>(body_left_, _end - _pos);
 
-                    if (int(_recv_buffer.Length() + bodyreceiver_->Length()) <= contentLength)
-                        appendlen = int(_recv_buffer.Length());
-                    else
-                        appendlen = contentLength - int(bodyreceiver_->Length());
+        if (0 < appendlen) bodyreceiver_->AppendData(_pos, appendlen);
 
+        _pos += appendlen;
+        body_left_ -= (int64_t)appendlen;
 
-                    bodyreceiver_->AppendData(_recv_buffer.Ptr(), (size_t)appendlen);
-                    _recv_buffer.Move(-appendlen);
+        if (0 < body_left_) return false;
 
-                    if ((int)bodyreceiver_->Length() == contentLength) {
-                        recvstatus_ = kEnd;
-                        bodyreceiver_->EndData();
-                        return  recvstatus_;
-                    }
-                }
-            }
+        chunkstatus_ = kChunkDataEnd;
+    }
+    return true;
+
+    case kChunkDataEnd: {
+        if (_end - _pos < 2) return false;
 
-            if (0 == _recv_buffer.Length())
-                return recvstatus_;
+        if ('\r' != _pos[0] || '\n' != _pos[1]) {
+            recvstatus_ = kBodyError;
+            return false;
         }
-        break;
 
-        case kEnd: {
-            return recvstatus_;
+        _pos += 2;
+        chunkstatus_ = kChunkSize;
+    }
+    return true;
+
+    case kChunkTrailer: {
+        const char* crlf = __FindCRLF(_pos, _end, scan_from_);
+
+        if (NULL == crlf) {
+            scan_from_ = (size_t)(_end - _pos);
+            return false;
         }
-        break;
 
-        default:
-            break;
+        scan_from_ = 0;
+
+        // trailer fields are skipped until the empty line
+        if (crlf != _pos) {
+            _pos = crlf + 2;
+            return true;
         }
+
+        _pos = crlf + 2;
+        recvstatus_ = kEnd;
+        bodyreceiver_->EndData();
     }
+    return true;
 
-    xassert2(false, TSF"status:%_", recvstatus_);
-    return recvstatus_;
+    default:
+        xassert2(false, TSF"chunk status:%_", chunkstatus_);
+        recvstatus_ = kBodyError;
+        return false;
+    }
 }
 
 Parser::TRecvStatus Parser::RecvStatus() const {
@@ -1022,6 +1173,18 @@ bool Parser::BodyRecving() const{
     return kBody == recvstatus_;
 }
 
+bool Parser::KeepAlive() const {
+    if (kEnd != recvstatus_ || 0 != recvbuf_.Length()) return false;
+    if (!headfields_.IsTransferEncodingChunked() && NULL == headfields_.HeaderField(HeaderFields::KStringContentLength)) return false;
+    if (headfields_.IsConnectionClose()) return false;
+
+    THttpVersion version = (kRespond == csmode_) ? statusline_.Version() : requestline_.Version();
+    if (kVersion_1_1 == version) return true;
+    if (kVersion_1_0 == version) return headfields_.IsConnectionKeepalive();
+
+    return false;
+}
+
 bool Parser::Error() const {
     return kFirstLineError == recvstatus_
            || kHeaderFieldsError == recvstatus_
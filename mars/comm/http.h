@@ -26,6 +26,8 @@
 
 #include "autobuffer.h"
 
+struct z_stream_s;
+
 namespace http {
 
 struct less {
@@ -54,6 +56,13 @@ enum TCsMode {
     kRespond,
 };
 
+enum TContentEncoding {
+    kContentEncodingIdentity,
+    kContentEncodingGzip,
+    kContentEncodingDeflate,
+    kContentEncodingUnknown,
+};
+
 class RequestLine {
   public:
     enum THttpMethod {
@@ -135,6 +144,8 @@ class HeaderFields {
     static std::pair<const std::string, std::string> MakeConnectionKeepalive();
     static std::pair<const std::string, std::string> MakeAcceptAll();
     static std::pair<const std::string, std::string> MakeAcceptEncodingDefalte();
+    static std::pair<const std::string, std::string> MakeAcceptEncodingGzipDeflate();
+    static std::pair<const std::string, std::string> MakeContentEncoding(TContentEncoding _encoding);
     static std::pair<const std::string, std::string> MakeCacheControlNoCache();
     static std::pair<const std::string, std::string> MakeContentTypeOctetStream();
 
@@ -160,7 +171,11 @@ class HeaderFields {
     const char* HeaderField(const char* _key) const;
     std::map<const std::string, std::string, less>& GetHeaders() {return headers_;}
 
-    bool IsTransferEncodingChunked();
+    bool IsTransferEncodingChunked() const;
+    bool IsConnectionClose() const;
+    bool IsConnectionKeepalive() const;
+    // identity when there is no Content-Encoding, unknown for anything but a single gzip or deflate.
+    TContentEncoding ContentEncoding() const;
     int ContentLength();
 
     bool ContentRange(int* start, int* end, int* total);
@@ -242,6 +257,10 @@ class Builder {
     const IBlockBodyProvider* BlockBody() const;
     const IStreamBodyProvider* StreamBody() const;
 
+    // reads the block body out and replaces it with its gzip or deflate form, which the builder manages,
+    // and sets Content-Encoding and Content-Length to match. on failure the new body is the old one as it was.
+    bool CompressBlockBody(TContentEncoding _encoding);
+
     bool HeaderToBuffer(AutoBuffer& _header);
     bool HttpToBuffer(AutoBuffer& _http);
 
@@ -263,8 +282,12 @@ class BodyReceiver {
     BodyReceiver(): total_length_(0) {}
     virtual ~BodyReceiver() {}
 
+    // once the header fields are in, false makes the body fail.
+    virtual bool BeginData(const HeaderFields&) { return true; }
     virtual void AppendData(const void* _body, size_t _length) { total_length_ += _length;}
     virtual void EndData() {}
+    // the parser stops with kBodyError once it is true.
+    virtual bool Error() const { return false; }
     size_t Length() const {return total_length_;}
 
   private:
@@ -285,6 +308,37 @@ class MemoryBodyReceiver : public BodyReceiver {
     AutoBuffer& body_;
 };
 
+// inflates a gzip or deflate body on its way to _body, an identity one goes through as it is.
+// Length() is of the body as it came, _body sees it inflated.
+class InflateBodyReceiver : public BodyReceiver {
+  public:
+    InflateBodyReceiver(BodyReceiver* _body, bool _manage);
+    virtual ~InflateBodyReceiver();
+
+  private:
+    InflateBodyReceiver(const InflateBodyReceiver&);
+    InflateBodyReceiver& operator=(const InflateBodyReceiver&);
+
+  public:
+    virtual bool BeginData(const HeaderFields& _fields);
+    virtual void AppendData(const void* _body, size_t _length);
+    virtual void EndData();
+    virtual bool Error() const { return error_ || body_->Error(); }
+
+    TContentEncoding Encoding() const { return encoding_; }
+
+  private:
+    BodyReceiver* body_;
+    bool is_manage_body_;
+    TContentEncoding encoding_;
+    z_stream_s* stream_;
+    bool stream_end_;
+    bool error_;
+};
+
+// _out is replaced with _data as a gzip or deflate stream.
+bool Compress(const void* _data, size_t _length, TContentEncoding _encoding, AutoBuffer& _out);
+
 class Parser {
   public:
     enum TRecvStatus {
@@ -307,7 +361,9 @@ class Parser {
     Parser& operator=(const Parser&);
 
   public:
+    // the body goes to the receiver from the buffers it came in, only an unfinished line is kept.
     TRecvStatus Recv(const void* _buffer, size_t _length);
+    // takes what it parsed out of _recv_buffer, the rest has to stay in front of the next bytes.
     TRecvStatus Recv(AutoBuffer& _recv_buffer);
     TRecvStatus RecvStatus() const;
 
@@ -323,12 +379,28 @@ class Parser {
 
     bool BodyReady() const;
     bool BodyRecving() const;
+    // the whole message is in, framed by its length or chunks, with nothing after it,
+    // and its version and Connection field let the connection carry the next one.
+    // with Recv(AutoBuffer&) what is left after the message stays in the caller's buffer.
+    bool KeepAlive() const;
     BodyReceiver& Body();
     const BodyReceiver& Body() const;
 
     bool Error() const;
     bool Success() const;
 
+  private:
+    enum TChunkStatus {
+        kChunkSize,
+        kChunkData,
+        kChunkDataEnd,
+        kChunkTrailer,
+    };
+
+    size_t __Parse(const char* _data, size_t _length);
+    bool   __ParseLength(const char*& _pos, const char* _end);
+    bool   __ParseChunked(const char*& _pos, const char* _end);
+
   private:
     TRecvStatus recvstatus_;
     AutoBuffer    recvbuf_;
@@ -342,6 +414,10 @@ class Parser {
     BodyReceiver* bodyreceiver_;
     bool is_manage_body_;
     size_t headerlength_;
+
+    size_t scan_from_;  // bytes of the unfinished line already searched for its end
+    TChunkStatus chunkstatus_;
+    int64_t body_left_;  // of the content length, or of the current chunk
 };
 
 // void testChunk();
@@ -0,0 +1,337 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * messagequeue_benchmark.cc
+ *
+ * throughput and latency of the message queue, one line per scenario:
+ *   messagequeue_benchmark [-t max producers] [-n messages] [-p pool threads] [-s post|timer|cancel|wait|all]
+ * post     producers 1, 2, 4 ... up to max post n messages each, latency is from the post to the dispatch.
+ * timer    n kAfter messages spread over 1s and 64 kPeriod messages of 10ms, latency is how late they run.
+ * cancel   n kAfter messages posted and canceled one by one, then by handler and by title,
+ *          with n messages of a far deadline queued, latency is of one CancelMessage.
+ * wait     n WaitInvoke from a thread off the queue, latency is the round trip.
+ * ops/s counts until the last message is dispatched. -p runs the scenarios on a pool of that many threads,
+ * 0 is a queue of its own thread.
+ *
+ * it is a host tool and not a part of the comm library, build it from mars/comm with the sources it needs:
+ *   gcc -O2 -c -I. -I.. -I../.. time_utils.c xlogger/xloggerbase.c xlogger/loginfo_extract.c assert/__assert.c
+ *   g++ -O2 -I. -I.. -I../.. messagequeue/benchmark/messagequeue_benchmark.cc messagequeue/message_queue.cc
+ *       anr.cc boost_exception.cc time_utils.o xloggerbase.o loginfo_extract.o __assert.o -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "boost/bind.hpp"
+
+#include "mars/comm/thread/thread.h"
+#include "mars/comm/thread/lock.h"
+#include "mars/comm/thread/condition.h"
+#include "mars/comm/thread/atomic_oper.h"
+#include "mars/comm/messagequeue/message_queue.h"
+#include "mars/comm/xlogger/xlogger.h"
+
+using namespace MessageQueue;
+
+extern "C" {
+intmax_t xlogger_pid() { return getpid(); }
+intmax_t xlogger_tid() { return (intmax_t)pthread_self(); }
+intmax_t xlogger_maintid() { return 0; }
+}
+
+static uint64_t __NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+class Benchmark {
+  public:
+    static const int64_t kTimerSpan = 1000;     // ms
+    static const unsigned int kPeriodCount = 64;
+    static const int64_t kPeriod = 10;          // ms
+
+  public:
+    explicit Benchmark(unsigned int _pool_threads)
+        : started_(false), producer_count_(0), expected_(0), done_(0) {
+        queue_ = 0 == _pool_threads ? MessageQueueCreater::CreateNewMessageQueue("mq_bench")
+                                    : MessageQueueCreater::CreateNewMessageQueuePool(_pool_threads, "mq_bench");
+        handler_ = DefAsyncInvokeHandler(queue_);
+    }
+
+    ~Benchmark() { MessageQueueCreater::ReleaseNewMessageQueue(queue_); }
+
+  public:
+    void Post(unsigned int _producers, unsigned int _count) {
+        producer_count_ = _count;
+        __Begin(_producers * _count);
+
+        std::vector<Thread*> threads;
+        for (unsigned int i = 0; i < _producers; ++i) {
+            Thread* thread = new Thread(boost::bind(&Benchmark::__Producer, this), "mq_bench");
+            thread->start();
+            threads.push_back(thread);
+        }
+
+        uint64_t begin = __NowNs();
+        {
+            ScopedLock lock(mutex_);
+            started_ = true;
+            cond_.notifyAll(lock);
+        }
+
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i]->join();
+            delete threads[i];
+        }
+        __WaitDone();
+
+        __Print("post", _producers, expected_, __NowNs() - begin, latency_ns_);
+    }
+
+    void Timer(unsigned int _count) {
+        __Begin(_count);
+        period_last_ns_.assign(kPeriodCount, 0);
+        period_late_ns_.clear();
+
+        std::vector<uint32_t> post_ns;
+        post_ns.reserve(_count);
+
+        uint64_t begin = __NowNs();
+        for (unsigned int i = 0; i < _count; ++i) {
+            int64_t after = (int64_t)((uint64_t)i * 7919 % _count * kTimerSpan / _count);
+            uint64_t post_begin = __NowNs();
+            AsyncInvokeAfter(after, boost::bind(&Benchmark::__OnTimer, this, post_begin + after * 1000000), handler_);
+            post_ns.push_back(__Span32(post_begin));
+        }
+        uint64_t posted = __NowNs() - begin;
+
+        std::vector<MessagePost_t> periods;
+        for (unsigned int i = 0; i < kPeriodCount; ++i) {
+            period_last_ns_[i] = __NowNs();
+            periods.push_back(AsyncInvokePeriod(kPeriod, kPeriod, boost::bind(&Benchmark::__OnPeriod, this, i), handler_));
+        }
+
+        __WaitDone();
+        uint64_t elapsed = __NowNs() - begin;
+        for (size_t i = 0; i < periods.size(); ++i) CancelMessage(periods[i]);
+        WaitInvoke(boost::bind(&Benchmark::__Nop), handler_);
+
+        __Print("timer post", 1, _count, posted, post_ns);
+        __Print("timer after", 1, _count, elapsed, latency_ns_);
+        __Print("timer period", 1, period_late_ns_.size(), elapsed, period_late_ns_);
+    }
+
+    void Cancel(unsigned int _count) {
+        std::vector<uint32_t> latency;
+        latency.reserve(_count);
+
+        // a backlog of far deadlines the cancels have to look past.
+        MessageHandler_t backlog = InstallAsyncHandler(queue_);
+        for (unsigned int i = 0; i < _count; ++i) AsyncInvokeAfter(3600 * 1000, boost::bind(&Benchmark::__Nop), backlog);
+
+        uint64_t begin = __NowNs();
+        for (unsigned int i = 0; i < _count; ++i) {
+            MessagePost_t post = AsyncInvokeAfter(1000, boost::bind(&Benchmark::__Nop), handler_);
+            uint64_t cancel_begin = __NowNs();
+            CancelMessage(post);
+            latency.push_back(__Span32(cancel_begin));
+        }
+        __Print("cancel id", 1, _count, __NowNs() - begin, latency);
+
+        latency.clear();
+        begin = __NowNs();
+        for (unsigned int i = 0; i < _count; ++i) {
+            AsyncInvokeAfter(1000, boost::bind(&Benchmark::__Nop), (uintptr_t)(i % 16 + 1), handler_);
+        }
+        for (uintptr_t title = 1; title <= 16; ++title) {
+            uint64_t cancel_begin = __NowNs();
+            CancelMessage(handler_, title);
+            latency.push_back(__Span32(cancel_begin));
+        }
+        __Print("cancel title", 1, _count, __NowNs() - begin, latency);
+
+        latency.clear();
+        MessageHandler_t handler = InstallAsyncHandler(queue_);
+        begin = __NowNs();
+        for (unsigned int i = 0; i < _count; ++i) AsyncInvokeAfter(1000, boost::bind(&Benchmark::__Nop), handler);
+        uint64_t cancel_begin = __NowNs();
+        CancelMessage(handler);
+        latency.push_back(__Span32(cancel_begin));
+        __Print("cancel handler", 1, _count, __NowNs() - begin, latency);
+
+        CancelMessage(backlog);
+        UnInstallMessageHandler(handler);
+        UnInstallMessageHandler(backlog);
+    }
+
+    void Wait(unsigned int _count) {
+        std::vector<uint32_t> latency;
+        latency.reserve(_count);
+
+        uint64_t begin = __NowNs();
+        for (unsigned int i = 0; i < _count; ++i) {
+            uint64_t call_begin = __NowNs();
+            WaitInvoke(boost::bind(&Benchmark::__Nop), handler_);
+            latency.push_back(__Span32(call_begin));
+        }
+        __Print("waitinvoke", 1, _count, __NowNs() - begin, latency);
+    }
+
+    static void PrintHeader() {
+        printf("%-15s %3s %9s %11s %9s %9s %9s %9s\n", "scenario", "thr", "ops", "ops/s", "p50 us", "p99 us", "p999 us", "max us");
+    }
+
+  private:
+    void __Producer() {
+        ScopedLock lock(mutex_);
+        while (!started_) cond_.wait(lock);
+        lock.unlock();
+
+        for (unsigned int i = 0; i < producer_count_; ++i) {
+            AsyncInvoke(boost::bind(&Benchmark::__OnDispatch, this, __NowNs()), handler_);
+        }
+    }
+
+    void __OnDispatch(uint64_t _post_ns) { __Done(__Span32(_post_ns)); }
+
+    void __OnTimer(uint64_t _due_ns) {
+        uint64_t now = __NowNs();
+        __Done(now > _due_ns ? (uint32_t)std::min(now - _due_ns, (uint64_t)0xFFFFFFFF) : 0);
+    }
+
+    // a period is due a period after its last run began.
+    void __OnPeriod(unsigned int _index) {
+        uint64_t now = __NowNs();
+        uint64_t due = period_last_ns_[_index] + kPeriod * 1000000;
+        period_last_ns_[_index] = now;
+
+        ScopedLock lock(mutex_);
+        period_late_ns_.push_back(now > due ? (uint32_t)std::min(now - due, (uint64_t)0xFFFFFFFF) : 0);
+    }
+
+    static void __Nop() {}
+
+    void __Begin(unsigned int _expected) {
+        started_ = false;
+        expected_ = _expected;
+        done_ = 0;
+        latency_ns_.assign(_expected, 0);
+    }
+
+    // a pool dispatches on several threads, each takes its own slot.
+    void __Done(uint32_t _latency_ns) {
+        uint32_t index = atomic_inc32(&done_) - 1;
+        if (index < latency_ns_.size()) latency_ns_[index] = _latency_ns;
+
+        if (index + 1 == expected_) {
+            ScopedLock lock(mutex_);
+            cond_.notifyAll(lock);
+        }
+    }
+
+    void __WaitDone() {
+        ScopedLock lock(mutex_);
+        while (atomic_read32(&done_) < expected_) cond_.wait(lock, 100);
+    }
+
+    static uint32_t __Span32(uint64_t _begin_ns) {
+        uint64_t span = __NowNs() - _begin_ns;
+        return span > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)span;
+    }
+
+    template <typename T>
+    static T __Percentile(const std::vector<T>& _sorted, double _p) {
+        if (_sorted.empty()) return 0;
+        size_t index = (size_t)(_sorted.size() * _p);
+        return _sorted[std::min(index, _sorted.size() - 1)];
+    }
+
+    static void __Print(const char* _name, unsigned int _threads, uint64_t _ops, uint64_t _elapsed_ns, std::vector<uint32_t> _latency_ns) {
+        std::sort(_latency_ns.begin(), _latency_ns.end());
+        double seconds = _elapsed_ns / 1e9;
+        printf("%-15s %3u %9llu %11.0f %9.2f %9.2f %9.2f %9.2f\n", _name, _threads, (unsigned long long)_ops,
+               0 < seconds ? _ops / seconds : 0.0,
+               __Percentile(_latency_ns, 0.5) / 1000.0, __Percentile(_latency_ns, 0.99) / 1000.0,
+               __Percentile(_latency_ns, 0.999) / 1000.0, _latency_ns.empty() ? 0.0 : _latency_ns.back() / 1000.0);
+        fflush(stdout);
+    }
+
+  private:
+    MessageQueue_t queue_;
+    MessageHandler_t handler_;
+
+    Mutex mutex_;
+    Condition cond_;
+    bool started_;
+
+    unsigned int producer_count_;
+    uint32_t expected_;
+    volatile uint32_t done_;
+    std::vector<uint32_t> latency_ns_;
+
+    std::vector<uint64_t> period_last_ns_;
+    std::vector<uint32_t> period_late_ns_;
+};
+
+int main(int argc, char* argv[]) {
+    unsigned int max_producers = 4;
+    unsigned int count = 100000;
+    unsigned int pool_threads = 0;
+    std::string scenario = "all";
+
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (0 == strcmp("-t", argv[i]) && has_value) {
+            max_producers = (unsigned int)atoi(argv[++i]);
+        } else if (0 == strcmp("-n", argv[i]) && has_value) {
+            count = (unsigned int)atoi(argv[++i]);
+        } else if (0 == strcmp("-p", argv[i]) && has_value) {
+            pool_threads = (unsigned int)atoi(argv[++i]);
+        } else if (0 == strcmp("-s", argv[i]) && has_value) {
+            scenario = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-t max producers] [-n messages] [-p pool threads] [-s post|timer|cancel|wait|all]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (0 == max_producers) max_producers = 1;
+    if (0 == count) count = 1;
+
+    xlogger_SetLevel(kLevelNone);
+
+    Benchmark benchmark(pool_threads);
+    Benchmark::PrintHeader();
+
+    if ("post" == scenario || "all" == scenario) {
+        for (unsigned int producers = 1; ; producers = std::min(producers * 2, max_producers)) {
+            benchmark.Post(producers, count);
+            if (producers == max_producers) break;
+        }
+    }
+    if ("timer" == scenario || "all" == scenario) benchmark.Timer(count);
+    if ("cancel" == scenario || "all" == scenario) benchmark.Cancel(count);
+    if ("wait" == scenario || "all" == scenario) benchmark.Wait(count);
+
+    return 0;
+}
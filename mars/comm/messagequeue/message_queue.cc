@@ -20,8 +20,10 @@
 
 #include <map>
 #include <list>
+#include <vector>
 #include <string>
 #include <algorithm>
+#include <sys/time.h>
 #ifndef _WIN32
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
@@ -30,9 +32,12 @@
 #include "boost/bind.hpp"
 
 #include "comm/thread/lock.h"
+#include "comm/thread/spinlock.h"
+#include "comm/thread/atomic_oper.h"
 #include "comm/anr.h"
 #include "comm/messagequeue/message_queue.h"
 #include "comm/time_utils.h"
+#include "comm/xlogger/xlogger.h"
 #ifdef __APPLE__
 #include "comm/debugger/debugger_utils.h"
 #endif
@@ -41,14 +46,115 @@
 namespace MessageQueue {
 
 static unsigned int __MakeSeq() {
-    static unsigned int s_seq = 0;
+    static uint32_t s_seq = 0;
 
-    return ++s_seq;
+    return atomic_inc32(&s_seq) + 1;
 }
 
+// the stats only take short differences of it.
+static uint64_t __TickUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * hash table linked through its items, so it only allocates when the buckets grow. Traits provides
+ *   Item, Key, static const Key& (or Key) GetKey(const Item&), static size_t Hash(const Key&), static Item*& Next(Item&)
+ */
+template <typename Traits>
+class IntrusiveHash {
+  public:
+    typedef typename Traits::Item Item;
+    typedef typename Traits::Key Key;
+
+  public:
+    IntrusiveHash(): buckets_(16, (Item*)NULL), size_(0) {}
+
+    size_t Size() const { return size_; }
+
+    Item* Find(const Key& _key) const {
+        return __Match(buckets_[__Bucket(_key)], _key);
+    }
+
+    void Insert(Item* _item) {
+        if (size_ >= buckets_.size()) __Rehash(buckets_.size() * 2);
+
+        Item*& bucket = buckets_[__Bucket(Traits::GetKey(*_item))];
+        Traits::Next(*_item) = bucket;
+        bucket = _item;
+        ++size_;
+    }
+
+    void Erase(Item* _item) {
+        for (Item** it = &buckets_[__Bucket(Traits::GetKey(*_item))]; NULL != *it; it = &Traits::Next(**it)) {
+            if (*it == _item) {
+                *it = Traits::Next(*_item);
+                Traits::Next(*_item) = NULL;
+                --size_;
+                return;
+            }
+        }
+        ASSERT(false);
+    }
+
+    // _visitor must not change the hash.
+    template <typename F>
+    void Visit(const F& _visitor) const {
+        for (size_t i = 0; i < buckets_.size(); ++i) {
+            for (Item* it = buckets_[i]; NULL != it; it = Traits::Next(*it)) _visitor(it);
+        }
+    }
+
+  private:
+    size_t __Bucket(const Key& _key) const {
+        return Traits::Hash(_key) & (buckets_.size() - 1);
+    }
+
+    static Item* __Match(Item* _item, const Key& _key) {
+        for (; NULL != _item; _item = Traits::Next(*_item)) {
+            if (_key == Traits::GetKey(*_item)) return _item;
+        }
+        return NULL;
+    }
+
+    void __Rehash(size_t _bucket_count) {
+        std::vector<Item*> buckets;
+        buckets.swap(buckets_);
+        buckets_.assign(_bucket_count, (Item*)NULL);
+
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            for (Item* it = buckets[i]; NULL != it;) {
+                Item* next = Traits::Next(*it);
+                Item*& bucket = buckets_[__Bucket(Traits::GetKey(*it))];
+                Traits::Next(*it) = bucket;
+                bucket = it;
+                it = next;
+            }
+        }
+    }
+
+  private:
+    IntrusiveHash(const IntrusiveHash&);
+    IntrusiveHash& operator=(const IntrusiveHash&);
+
+  private:
+    std::vector<Item*> buckets_;
+    size_t size_;
+};
+
 struct MessageWrapper {
+    enum TState {
+        kReady,     // in the ready list
+        kTimer,     // in the timer heap
+        kRunning,   // a period message whose handlers are running
+        kRemoved,   // canceled while running, its runloop deletes it
+        kParked,    // waiting for the message running on its serial handler
+    };
+
     MessageWrapper(const MessageHandler_t& _handlerid, const Message& _message, const MessageTiming& _timing, unsigned int _seq)
-        : message(_message), timing(_timing) {
+        : message(_message), timing(_timing)
+        , state(kReady), due_time(0), ready_time(0), ready_us(0), order(0), heap_index(0), prev(NULL), next(NULL), post_next(NULL), key_bucket_next(NULL), key_prev(NULL), key_next(NULL) {
         postid.reg = _handlerid;
         postid.seq = _seq;
         periodstatus = kImmediately;
@@ -72,11 +178,264 @@ struct MessageWrapper {
     TMessageTiming periodstatus;
     uint64_t record_time;
     boost::shared_ptr<Condition> wait_end_cond;
+
+    TState state;
+    uint64_t due_time;          // tick of a timer
+    uint64_t ready_time;        // tick it became ready, for the aging of priorities
+    uint64_t ready_us;          // for the stats
+    uint64_t order;             // of queueing, it breaks the ties of due_time
+    size_t heap_index;
+    MessageWrapper* prev;       // in the ready list or the parked list of its handler
+    MessageWrapper* next;
+    MessageWrapper* post_next;  // in MessagePostIndex
+    MessageWrapper* key_bucket_next;    // in MessageKeyIndex
+    MessageWrapper* key_prev;           // of the same key, the first one points to the last
+    MessageWrapper* key_next;
+};
+
+// FIFO of the messages to run now, linked through the messages.
+class MessageList {
+  public:
+    MessageList(): head_(NULL), tail_(NULL) {}
+
+    bool Empty() const { return NULL == head_; }
+    MessageWrapper* Front() const { return head_; }
+
+    void PushBack(MessageWrapper* _wrapper) {
+        _wrapper->prev = tail_;
+        _wrapper->next = NULL;
+        if (NULL != tail_) tail_->next = _wrapper;
+        else head_ = _wrapper;
+        tail_ = _wrapper;
+    }
+
+    void PushFront(MessageWrapper* _wrapper) {
+        _wrapper->prev = NULL;
+        _wrapper->next = head_;
+        if (NULL != head_) head_->prev = _wrapper;
+        else tail_ = _wrapper;
+        head_ = _wrapper;
+    }
+
+    void Erase(MessageWrapper* _wrapper) {
+        if (NULL != _wrapper->prev) _wrapper->prev->next = _wrapper->next;
+        else head_ = _wrapper->next;
+        if (NULL != _wrapper->next) _wrapper->next->prev = _wrapper->prev;
+        else tail_ = _wrapper->prev;
+        _wrapper->prev = NULL;
+        _wrapper->next = NULL;
+    }
+
+  private:
+    MessageWrapper* head_;
+    MessageWrapper* tail_;
+};
+
+/*
+ * the messages to run now, one list for each priority. the highest one runs first, unless a lower one has been
+ * ready for kAgingTime, then the longest waiting of those runs. bulk messages are delayed but never starved.
+ */
+class ReadyMessages {
+  public:
+    static const int kPriorityCount = kPriorityHigh + 1;
+    static const uint64_t kAgingTime = 100;
+
+  public:
+    bool Empty() const {
+        for (int i = 0; i < kPriorityCount; ++i) {
+            if (!lists_[i].Empty()) return false;
+        }
+        return true;
+    }
+
+    MessageWrapper* Front(uint64_t _now) const {
+        MessageWrapper* first = NULL;
+        MessageWrapper* aged = NULL;
+
+        for (int i = kPriorityCount - 1; 0 <= i; --i) {
+            MessageWrapper* front = lists_[i].Front();
+            if (NULL == front) continue;
+
+            if (NULL == first) first = front;
+            else if (_now >= front->ready_time + kAgingTime && front->ready_time < (NULL != aged ? aged : first)->ready_time) aged = front;
+        }
+
+        return NULL != aged ? aged : first;
+    }
+
+    void PushBack(MessageWrapper* _wrapper, uint64_t _ready_time) {
+        _wrapper->ready_time = _ready_time;
+        lists_[__Priority(*_wrapper)].PushBack(_wrapper);
+    }
+
+    // it keeps its ready time.
+    void PushFront(MessageWrapper* _wrapper) { lists_[__Priority(*_wrapper)].PushFront(_wrapper); }
+    void Erase(MessageWrapper* _wrapper) { lists_[__Priority(*_wrapper)].Erase(_wrapper); }
+
+  private:
+    static int __Priority(const MessageWrapper& _wrapper) {
+        int priority = _wrapper.timing.priority;
+        return priority < 0 ? 0 : (priority < kPriorityCount ? priority : kPriorityCount - 1);
+    }
+
+  private:
+    MessageList lists_[kPriorityCount];
+};
+
+// min-heap of the delayed and period messages by due time, then by the order of queueing.
+class TimerHeap {
+  public:
+    bool Empty() const { return heap_.empty(); }
+    MessageWrapper* Top() const { return heap_.front(); }
+
+    void Push(MessageWrapper* _wrapper) {
+        _wrapper->heap_index = heap_.size();
+        heap_.push_back(_wrapper);
+        __SiftUp(_wrapper->heap_index);
+    }
+
+    void Erase(MessageWrapper* _wrapper) {
+        size_t index = _wrapper->heap_index;
+        ASSERT(index < heap_.size() && heap_[index] == _wrapper);
+
+        MessageWrapper* last = heap_.back();
+        heap_.pop_back();
+        if (last == _wrapper) return;
+
+        heap_[index] = last;
+        last->heap_index = index;
+        __SiftUp(index);
+        __SiftDown(last->heap_index);
+    }
+
+  private:
+    static bool __Less(const MessageWrapper* _lhs, const MessageWrapper* _rhs) {
+        return _lhs->due_time < _rhs->due_time || (_lhs->due_time == _rhs->due_time && _lhs->order < _rhs->order);
+    }
+
+    void __Place(size_t _index, MessageWrapper* _wrapper) {
+        heap_[_index] = _wrapper;
+        _wrapper->heap_index = _index;
+    }
+
+    void __SiftUp(size_t _index) {
+        MessageWrapper* wrapper = heap_[_index];
+        while (0 < _index) {
+            size_t parent = (_index - 1) / 2;
+            if (!__Less(wrapper, heap_[parent])) break;
+            __Place(_index, heap_[parent]);
+            _index = parent;
+        }
+        __Place(_index, wrapper);
+    }
+
+    void __SiftDown(size_t _index) {
+        MessageWrapper* wrapper = heap_[_index];
+        size_t size = heap_.size();
+        while (true) {
+            size_t child = 2 * _index + 1;
+            if (child >= size) break;
+            if (child + 1 < size && __Less(heap_[child + 1], heap_[child])) ++child;
+            if (!__Less(heap_[child], wrapper)) break;
+            __Place(_index, heap_[child]);
+            _index = child;
+        }
+        __Place(_index, wrapper);
+    }
+
+  private:
+    std::vector<MessageWrapper*> heap_;
+};
+
+struct MessagePostTraits {
+    typedef MessageWrapper Item;
+    typedef MessagePost_t Key;
+
+    static const Key& GetKey(const Item& _item) { return _item.postid; }
+    static size_t Hash(const Key& _key) { return _key.seq; }
+    static Item*& Next(Item& _item) { return _item.post_next; }
+};
+
+// the queued messages by post id.
+typedef IntrusiveHash<MessagePostTraits> MessagePostIndex;
+
+// messages are equal by title, a handler and a title identify the messages which are coalesced or canceled together.
+struct MessageKey {
+    MessageKey(const MessageHandler_t& _reg, const MessageTitle_t& _title): reg(_reg), title(_title) {}
+    bool operator == (const MessageKey& _rhs) const { return reg == _rhs.reg && title == _rhs.title; }
+
+    MessageHandler_t reg;
+    MessageTitle_t title;
+};
+
+struct MessageKeyTraits {
+    typedef MessageWrapper Item;
+    typedef MessageKey Key;
+
+    static Key GetKey(const Item& _item) { return MessageKey(_item.postid.reg, _item.message.title); }
+    static size_t Hash(const Key& _key) {
+        // titles are often pointers with the same low bits, the high half of the product mixes them
+        uint64_t hash = ((uint64_t)_key.title.title ^ ((uint64_t)_key.reg.seq << 32)) * 0x9E3779B97F4A7C15ULL;
+        return (size_t)(hash >> 32);
+    }
+    static Item*& Next(Item& _item) { return _item.key_bucket_next; }
+};
+
+/*
+ * the queued messages by handler and title, so singleton, faster and canceling by title do not scan the queue.
+ * the hash holds the earliest posted message of a key, the later ones are linked to it in the order of posting,
+ * many messages of one key (all the async invokes of a queue) cost nothing to the lookup of the others.
+ */
+class MessageKeyIndex {
+  public:
+    // the earliest posted message of _key.
+    MessageWrapper* Find(const MessageKey& _key) const { return heads_.Find(_key); }
+    static MessageWrapper* FindNext(const MessageWrapper* _wrapper) { return _wrapper->key_next; }
+
+    void Insert(MessageWrapper* _wrapper) {
+        _wrapper->key_next = NULL;
+
+        MessageWrapper* head = heads_.Find(MessageKeyTraits::GetKey(*_wrapper));
+        if (NULL == head) {
+            _wrapper->key_prev = _wrapper;
+            heads_.Insert(_wrapper);
+            return;
+        }
+
+        MessageWrapper* tail = head->key_prev;
+        tail->key_next = _wrapper;
+        _wrapper->key_prev = tail;
+        head->key_prev = _wrapper;
+    }
+
+    void Erase(MessageWrapper* _wrapper) {
+        MessageWrapper* prev = _wrapper->key_prev;
+        MessageWrapper* next = _wrapper->key_next;
+
+        if (prev->key_next != _wrapper) {
+            // the head, prev is the tail
+            heads_.Erase(_wrapper);
+            if (NULL != next) {
+                next->key_prev = prev;
+                heads_.Insert(next);
+            }
+        } else {
+            prev->key_next = next;
+            if (NULL != next) next->key_prev = prev;
+            else heads_.Find(MessageKeyTraits::GetKey(*_wrapper))->key_prev = prev;
+        }
+
+        _wrapper->key_prev = NULL;
+        _wrapper->key_next = NULL;
+    }
+
+  private:
+    IntrusiveHash<MessageKeyTraits> heads_;
 };
 
 struct HandlerWrapper {
-    HandlerWrapper(const MessageHandler& _handler, bool _recvbroadcast, const MessageQueue_t& _messagequeueid, unsigned int _seq)
-        : handler(_handler), recvbroadcast(_recvbroadcast) {
+    HandlerWrapper(const MessageHandler& _handler, bool _recvbroadcast, bool _serial, const MessageQueue_t& _messagequeueid, unsigned int _seq)
+        : handler(_handler), recvbroadcast(_recvbroadcast), serial(_serial), serial_running(false), running(0), removed(false), index_next(NULL) {
         reg.seq = _seq;
         reg.queue = _messagequeueid;
     }
@@ -84,15 +443,37 @@ struct HandlerWrapper {
     MessageHandler_t reg;
     MessageHandler handler;
     bool recvbroadcast;
+
+    bool serial;                    // a pool queue runs its messages one by one in order
+    bool serial_running;
+    MessageList parked_messages;    // taken while one of them is running
+
+    int running;                // runloops calling it, it is called without the lock of the queue
+    bool removed;               // uninstalled while running, the last runloop deletes it
+    HandlerWrapper* index_next; // in HandlerIndex
+};
+
+struct HandlerTraits {
+    typedef HandlerWrapper Item;
+    typedef MessageHandler_t Key;
+
+    static const Key& GetKey(const Item& _item) { return _item.reg; }
+    static size_t Hash(const Key& _key) { return _key.seq; }
+    static Item*& Next(Item& _item) { return _item.index_next; }
 };
 
+// the handlers of a queue by MessageHandler_t, a unicast message finds its handler without a scan.
+typedef IntrusiveHash<HandlerTraits> HandlerIndex;
+
 struct RunLoopInfo {
-    RunLoopInfo():runing_message(NULL) { runing_cond = boost::make_shared<Condition>();}
+    RunLoopInfo():tid(ThreadUtil::currentthreadid()), runing_message(NULL), serial_handler(NULL) { runing_cond = boost::make_shared<Condition>();}
     
+    thread_tid tid;     // the threads of a pool queue run their runloops side by side
     boost::shared_ptr<Condition> runing_cond;
     MessagePost_t runing_message_id;
     Message* runing_message;
-    std::list <MessageHandler_t> runing_handler;
+    std::vector<HandlerWrapper*> runing_handler;  // keeps its capacity, dispatching does not allocate
+    HandlerWrapper* serial_handler;                 // the serial handler of the running message
 };
     
 class Cond : public RunloopCond {
@@ -119,54 +500,312 @@ private:
     Condition cond_;
 };
     
+// raw memory of a deleted MessageWrapper kept for the next post.
+struct FreeWrapper {
+    FreeWrapper* next;
+};
+
 struct MessageQueueContent {
 public:
-    MessageQueueContent(): breakflag(false), anr_timeout(-1) {}
+    static const size_t kMaxFreeWrappers = 128;
+
+    MessageQueueContent(): id(KInvalidQueueID), breakflag(false), released(false), anr_timeout(-1), message_order(0), free_wrappers(NULL), free_wrapper_count(0) {}
+    ~MessageQueueContent() {
+        while (NULL != free_wrappers) {
+            FreeWrapper* next = free_wrappers->next;
+            ::operator delete(free_wrappers);
+            free_wrappers = next;
+        }
+    }
 
+    Mutex mutex;    // guards the queue, the runloop of one queue never blocks the others
+    MessageQueue_t id;
+    std::vector<thread_tid> workers;    // the threads of a pool queue, the map holds the queue under each of them. empty for one thread
     MessageHandler_t invoke_reg;
     bool breakflag;
+    bool released;  // removed from the map, lookups which raced with the release see it
     boost::shared_ptr<RunloopCond> breaker;
-    std::list<MessageWrapper*> lst_message;
-    std::list<HandlerWrapper*> lst_handler;
+    ReadyMessages ready_messages;
+    TimerHeap timer_messages;
+    MessagePostIndex post_index;    // every message in ready_messages, timer_messages and running period messages
+    MessageKeyIndex key_index;      // the same messages as post_index
+    HandlerIndex handlers;
+    std::vector<HandlerWrapper*> broadcast_handlers;    // receivers of broadcasts in the order of installing
     int anr_timeout;
+    uint64_t message_order;
+    FreeWrapper* free_wrappers;     // posting reuses them, the steady post and dispatch do not allocate
+    size_t free_wrapper_count;
     
     std::list<RunLoopInfo> lst_runloop_info;
+    MessageQueueStats stats;
+
+private:
+    MessageQueueContent(const MessageQueueContent&);
+    MessageQueueContent& operator=(const MessageQueueContent&);
 };
 
+static MessageWrapper* __NewMessageWrapper(MessageQueueContent& _content, const MessageHandler_t& _handlerid, const Message& _message, const MessageTiming& _timing, unsigned int _seq) {
+    if (NULL == _content.free_wrappers) return new MessageWrapper(_handlerid, _message, _timing, _seq);
+
+    void* memory = _content.free_wrappers;
+    _content.free_wrappers = _content.free_wrappers->next;
+    --_content.free_wrapper_count;
+    return new (memory) MessageWrapper(_handlerid, _message, _timing, _seq);
+}
+
+// _memory of a destroyed MessageWrapper.
+static void __FreeMessageWrapper(MessageQueueContent& _content, void* _memory) {
+    if (_content.free_wrapper_count >= MessageQueueContent::kMaxFreeWrappers) {
+        ::operator delete(_memory);
+        return;
+    }
+
+    FreeWrapper* free_wrapper = static_cast<FreeWrapper*>(_memory);
+    free_wrapper->next = _content.free_wrappers;
+    _content.free_wrappers = free_wrapper;
+    ++_content.free_wrapper_count;
+}
+
+static void __DeleteMessageWrapper(MessageQueueContent& _content, MessageWrapper* _wrapper) {
+    _wrapper->~MessageWrapper();
+    __FreeMessageWrapper(_content, _wrapper);
+}
+
+static void __QueueMessage(MessageQueueContent& _content, MessageWrapper* _wrapper) {
+    _wrapper->order = ++_content.message_order;
+
+    if (kImmediately == _wrapper->timing.type) {
+        _wrapper->state = MessageWrapper::kReady;
+        _wrapper->ready_us = __TickUs();
+        _content.ready_messages.PushBack(_wrapper, ::gettickcount());
+        return;
+    }
+
+    int64_t delay = kPeriod == _wrapper->periodstatus ? _wrapper->timing.period : _wrapper->timing.after;
+    _wrapper->due_time = _wrapper->record_time + (0 < delay ? delay : 0);
+    _wrapper->state = MessageWrapper::kTimer;
+    _content.timer_messages.Push(_wrapper);
+}
+
+static void __AddMessage(MessageQueueContent& _content, MessageWrapper* _wrapper) {
+    _content.post_index.Insert(_wrapper);
+    _content.key_index.Insert(_wrapper);
+    __QueueMessage(_content, _wrapper);
+
+    ++_content.stats.posted;
+    _content.stats.depth_high_water = std::max(_content.stats.depth_high_water, _content.post_index.Size());
+}
+
+// a running period message is only marked, its runloop deletes it when the handlers return.
+static void __RemoveMessage(MessageQueueContent& _content, MessageWrapper* _wrapper) {
+    _content.post_index.Erase(_wrapper);
+    _content.key_index.Erase(_wrapper);
+    ++_content.stats.removed;
+
+    switch (_wrapper->state) {
+    case MessageWrapper::kReady:
+        _content.ready_messages.Erase(_wrapper);
+        __DeleteMessageWrapper(_content, _wrapper);
+        break;
+    case MessageWrapper::kTimer:
+        _content.timer_messages.Erase(_wrapper);
+        __DeleteMessageWrapper(_content, _wrapper);
+        break;
+    case MessageWrapper::kRunning:
+        _wrapper->state = MessageWrapper::kRemoved;
+        break;
+    case MessageWrapper::kParked: {
+        HandlerWrapper* handler = _content.handlers.Find(_wrapper->postid.reg);
+        ASSERT(NULL != handler);
+        handler->parked_messages.Erase(_wrapper);
+        __DeleteMessageWrapper(_content, _wrapper);
+        break;
+    }
+    default:
+        ASSERT(false);
+        break;
+    }
+}
+
+// the earliest posted one of the messages of _handlerid equal to _message.
+static MessageWrapper* __FindMessage(const MessageQueueContent& _content, const MessageHandler_t& _handlerid, const Message& _message) {
+    return _content.key_index.Find(MessageKey(_handlerid, _message.title));
+}
+
+// the handler of a unicast message to a pool queue if it is serial.
+static HandlerWrapper* __SerialHandler(const MessageQueueContent& _content, const MessageWrapper& _wrapper) {
+    if (_content.workers.empty() || _wrapper.postid.reg.isbroadcast()) return NULL;
+
+    HandlerWrapper* handler = _content.handlers.Find(_wrapper.postid.reg);
+    return NULL != handler && handler->serial ? handler : NULL;
+}
+
+// due timers join the ready lists in the order of due time, so equal deadlines keep the order of posting.
+static MessageWrapper* __TakeReadyMessage(MessageQueueContent& _content, int64_t& _wait_time) {
+    uint64_t now = ::gettickcount();
+    uint64_t now_us = 0;
+
+    while (!_content.timer_messages.Empty() && _content.timer_messages.Top()->due_time <= now) {
+        MessageWrapper* wrapper = _content.timer_messages.Top();
+        _content.timer_messages.Erase(wrapper);
+        wrapper->state = MessageWrapper::kReady;
+        if (0 == now_us) now_us = __TickUs();
+        wrapper->ready_us = now_us - (now - wrapper->due_time) * 1000;
+        // a timer has been ready since it was due, the runloop may be late.
+        _content.ready_messages.PushBack(wrapper, wrapper->due_time);
+    }
+
+    while (!_content.ready_messages.Empty()) {
+        MessageWrapper* wrapper = _content.ready_messages.Front(now);
+        _content.ready_messages.Erase(wrapper);
+
+        HandlerWrapper* serial_handler = __SerialHandler(_content, *wrapper);
+        if (NULL != serial_handler) {
+            if (serial_handler->serial_running) {
+                // it stays in the indexes, so it can be waited and canceled
+                wrapper->state = MessageWrapper::kParked;
+                serial_handler->parked_messages.PushBack(wrapper);
+                continue;
+            }
+            serial_handler->serial_running = true;
+        }
+
+        if (kPeriod == wrapper->timing.type) {
+            // it stays in post_index and key_index while it runs, so it can be found and canceled.
+            wrapper->state = MessageWrapper::kRunning;
+            wrapper->record_time = now;
+            wrapper->periodstatus = kPeriod;
+        } else {
+            _content.post_index.Erase(wrapper);
+            _content.key_index.Erase(wrapper);
+        }
+        return wrapper;
+    }
+
+    if (!_content.timer_messages.Empty()) _wait_time = std::min(_wait_time, (int64_t)(_content.timer_messages.Top()->due_time - now));
+    return NULL;
+}
+
+// the next parked message of the serial handler is the first to take.
+static void __ReleaseSerialHandler(MessageQueueContent& _content, RunLoopInfo& _info) {
+    HandlerWrapper* handler = _info.serial_handler;
+    if (NULL == handler) return;
+
+    _info.serial_handler = NULL;
+    handler->serial_running = false;
+    if (handler->parked_messages.Empty()) return;
+
+    MessageWrapper* wrapper = handler->parked_messages.Front();
+    handler->parked_messages.Erase(wrapper);
+    wrapper->state = MessageWrapper::kReady;
+    _content.ready_messages.PushFront(wrapper);
+}
+
+static void __AddHandler(MessageQueueContent& _content, HandlerWrapper* _handler) {
+    _content.handlers.Insert(_handler);
+    if (_handler->recvbroadcast) _content.broadcast_handlers.push_back(_handler);
+}
+
+// a running handler is only marked, the last runloop calling it deletes it.
+static void __RemoveHandler(MessageQueueContent& _content, HandlerWrapper* _handler) {
+    _content.handlers.Erase(_handler);
+    if (_handler->recvbroadcast) {
+        _content.broadcast_handlers.erase(std::find(_content.broadcast_handlers.begin(), _content.broadcast_handlers.end(), _handler));
+    }
+
+    // they are dropped as the messages of any handler uninstalled
+    while (!_handler->parked_messages.Empty()) {
+        MessageWrapper* wrapper = _handler->parked_messages.Front();
+        _handler->parked_messages.Erase(wrapper);
+        wrapper->state = MessageWrapper::kReady;
+        _content.ready_messages.PushBack(wrapper, wrapper->ready_time);
+    }
+
+    if (0 < _handler->running) _handler->removed = true;
+    else delete _handler;
+}
+
+// the titles beyond kMaxTitles, often pointers, are counted together.
+static MessageQueueStats::TitleStats& __TitleStats(MessageQueueStats& _stats, uintptr_t _title) {
+    std::map<uintptr_t, MessageQueueStats::TitleStats>::iterator it = _stats.titles.find(_title);
+    if (it != _stats.titles.end()) return it->second;
+    if (_stats.titles.size() >= MessageQueueStats::kMaxTitles) return _stats.other_titles;
+
+    return _stats.titles[_title];
+}
+
+static void __ReleaseRuningHandlers(RunLoopInfo& _info) {
+    for (std::vector<HandlerWrapper*>::iterator it = _info.runing_handler.begin(); it != _info.runing_handler.end(); ++it) {
+        if (0 == --(*it)->running && (*it)->removed) delete *it;
+    }
+    _info.runing_handler.clear();
+}
+
+typedef std::map<MessageQueue_t, boost::shared_ptr<MessageQueueContent> > MessageQueueMap;
+
+/*
+ * the map is copied on write: queues are created and released rarely, while every call looks one up.
+ * a reader only copies the current map under a spin lock, then finds the queue and takes its lock without it.
+ */
 #define sg_messagequeue_map_mutex messagequeue_map_mutex()
-static Mutex& messagequeue_map_mutex() {
+static Mutex& messagequeue_map_mutex() {    // serializes the writers of the map
     static Mutex* mutex = new Mutex;
     return *mutex;
 }
+#define sg_messagequeue_map_spinlock messagequeue_map_spinlock()
+static SpinLock& messagequeue_map_spinlock() {
+    static SpinLock* spinlock = new SpinLock;
+    return *spinlock;
+}
 #define sg_messagequeue_map messagequeue_map()
-static std::map<MessageQueue_t, MessageQueueContent>& messagequeue_map() {
-    static std::map<MessageQueue_t, MessageQueueContent>* mq_map = new std::map<MessageQueue_t, MessageQueueContent>;
+static boost::shared_ptr<const MessageQueueMap>& messagequeue_map() {
+    static boost::shared_ptr<const MessageQueueMap>* mq_map = new boost::shared_ptr<const MessageQueueMap>(new MessageQueueMap);
     return *mq_map;
 }
 
-MessageQueue_t CurrentThreadMessageQueue() {
+static boost::shared_ptr<MessageQueueContent> __FindContent(const MessageQueue_t& _id) {
+    boost::shared_ptr<const MessageQueueMap> mq_map;
+    {
+        ScopedSpinLock lock(sg_messagequeue_map_spinlock);
+        mq_map = sg_messagequeue_map;
+    }
+
+    MessageQueueMap::const_iterator it = mq_map->find(_id);
+    if (mq_map->end() == it) return boost::shared_ptr<MessageQueueContent>();
+    return it->second;
+}
+
+// the lock of the queue must be held, or no other thread knows the queue yet.
+static void __UpdateContent(const MessageQueue_t& _id, const boost::shared_ptr<MessageQueueContent>& _content) {
     ScopedLock lock(sg_messagequeue_map_mutex);
-    MessageQueue_t id = (MessageQueue_t)ThreadUtil::currentthreadid();
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) id = KInvalidQueueID;
+    MessageQueueMap* mq_map = new MessageQueueMap(*sg_messagequeue_map);
+    if (_content) (*mq_map)[_id] = _content;
+    else mq_map->erase(_id);
 
-    return id;
+    // the old map is freed out of the spin lock.
+    boost::shared_ptr<const MessageQueueMap> old_map(mq_map);
+    {
+        ScopedSpinLock spinlock(sg_messagequeue_map_spinlock);
+        sg_messagequeue_map.swap(old_map);
+    }
 }
 
-MessageQueue_t TID2MessageQueue(thread_tid _tid) {
-    ScopedLock lock(sg_messagequeue_map_mutex);
-    MessageQueue_t id = (MessageQueue_t)_tid;
+MessageQueue_t CurrentThreadMessageQueue() {
+    return TID2MessageQueue(ThreadUtil::currentthreadid());
+}
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id))id = KInvalidQueueID;
+MessageQueue_t TID2MessageQueue(thread_tid _tid) {
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent((MessageQueue_t)_tid);
 
-    return id;
+    // the id is set before the queue is published and never changes.
+    return content_ptr ? content_ptr->id : KInvalidQueueID;
 }
     
 thread_tid  MessageQueue2TID(MessageQueue_t _id) {
-    ScopedLock lock(sg_messagequeue_map_mutex);
     MessageQueue_t& id = _id;
     
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) return 0;
+    if (!__FindContent(id)) return 0;
     
     return (thread_tid)id;
 }
@@ -174,11 +813,11 @@ thread_tid  MessageQueue2TID(MessageQueue_t _id) {
 void WaitForRuningLockEnd(const MessagePost_t&  _message) {
     if (Handler2Queue(Post2Handler(_message)) == CurrentThreadMessageQueue()) return;
 
-    ScopedLock lock(sg_messagequeue_map_mutex);
-    const MessageQueue_t& id = Handler2Queue(Post2Handler(_message));
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(Handler2Queue(Post2Handler(_message)));
+    if (!content_ptr) return;
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) return;
-    MessageQueueContent& content = sg_messagequeue_map[id];
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
     
     if (content.lst_runloop_info.empty()) return;
     
@@ -194,11 +833,11 @@ void WaitForRuningLockEnd(const MessagePost_t&  _message) {
 void WaitForRuningLockEnd(const MessageQueue_t&  _messagequeueid) {
     if (_messagequeueid == CurrentThreadMessageQueue()) return;
 
-    ScopedLock lock(sg_messagequeue_map_mutex);
-    const MessageQueue_t& id = _messagequeueid;
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(_messagequeueid);
+    if (!content_ptr) return;
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) return;
-    MessageQueueContent& content = sg_messagequeue_map[id];
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
 
     if (content.lst_runloop_info.empty()) return;
     if (KNullPost == content.lst_runloop_info.front().runing_message_id) return;
@@ -210,16 +849,16 @@ void WaitForRuningLockEnd(const MessageQueue_t&  _messagequeueid) {
 void WaitForRuningLockEnd(const MessageHandler_t&  _handler) {
     if (Handler2Queue(_handler) == CurrentThreadMessageQueue()) return;
 
-    ScopedLock lock(sg_messagequeue_map_mutex);
-    const MessageQueue_t& id = Handler2Queue(_handler);
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(Handler2Queue(_handler));
+    if (!content_ptr) return;
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) { return; }
-    MessageQueueContent& content = sg_messagequeue_map[id];
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
     if (content.lst_runloop_info.empty()) return;
 
     for(auto& i : content.lst_runloop_info) {
         for (auto& x : i.runing_handler) {
-            if (_handler==x) {
+            if (_handler==x->reg) {
                 boost::shared_ptr<Condition> runing_cond = i.runing_cond;
                 runing_cond->wait(lock);
                 return;
@@ -231,31 +870,39 @@ void WaitForRuningLockEnd(const MessageHandler_t&  _handler) {
 void BreakMessageQueueRunloop(const MessageQueue_t&  _messagequeueid) {
     ASSERT(0 != _messagequeueid);
 
-    ScopedLock lock(sg_messagequeue_map_mutex);
     const MessageQueue_t& id = _messagequeueid;
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(id);
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) {
+    if (!content_ptr) {
         ASSERT2(false, "%" PRIu64, id);
         return;
     }
 
-    sg_messagequeue_map[id].breakflag = true;
-    sg_messagequeue_map[id].breaker->Notify(lock);
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
+    if (content.released) return;
+
+    content.breakflag = true;
+    content.breaker->Notify(lock);
 }
 
-MessageHandler_t InstallMessageHandler(const MessageHandler& _handler, bool _recvbroadcast, const MessageQueue_t& _messagequeueid) {
+MessageHandler_t InstallMessageHandler(const MessageHandler& _handler, bool _recvbroadcast, const MessageQueue_t& _messagequeueid, bool _serial) {
     ASSERT(bool(_handler));
 
-    ScopedLock lock(sg_messagequeue_map_mutex);
     const MessageQueue_t& id = _messagequeueid;
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(id);
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) {
+    if (!content_ptr) {
         ASSERT2(false, "%" PRIu64, id);
         return KNullHandler;
     }
 
-    HandlerWrapper* handler = new HandlerWrapper(_handler, _recvbroadcast, _messagequeueid, __MakeSeq());
-    sg_messagequeue_map[id].lst_handler.push_back(handler);
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
+    if (content.released) return KNullHandler;
+
+    HandlerWrapper* handler = new HandlerWrapper(_handler, _recvbroadcast, _serial, _messagequeueid, __MakeSeq());
+    __AddHandler(content, handler);
     return handler->reg;
 }
 
@@ -265,86 +912,79 @@ void UnInstallMessageHandler(const MessageHandler_t& _handlerid) {
 
     if (0 == _handlerid.queue || 0 == _handlerid.seq) return;
 
-    ScopedLock lock(sg_messagequeue_map_mutex);
-    const MessageQueue_t& id = _handlerid.queue;
-
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) return;
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(_handlerid.queue);
+    if (!content_ptr) return;
 
-    MessageQueueContent& content = sg_messagequeue_map[id];
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
 
-    for (std::list<HandlerWrapper*>::iterator it = content.lst_handler.begin(); it != content.lst_handler.end(); ++it) {
-        if (_handlerid == (*it)->reg) {
-            delete(*it);
-            content.lst_handler.erase(it);
-            break;
-        }
-    }
+    HandlerWrapper* handler = content.handlers.Find(_handlerid);
+    if (NULL != handler) __RemoveHandler(content, handler);
 }
 
 MessagePost_t PostMessage(const MessageHandler_t& _handlerid, const Message& _message, const MessageTiming& _timing) {
-    ScopedLock lock(sg_messagequeue_map_mutex);
     const MessageQueue_t& id = _handlerid.queue;
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(id);
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) {
+    if (!content_ptr) {
         ASSERT2(false, "%" PRIu64, id);
         return KNullPost;
     }
 
-    MessageQueueContent& content = sg_messagequeue_map[id];
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
+    if (content.released) return KNullPost;
 
-    MessageWrapper* messagewrapper = new MessageWrapper(_handlerid, _message, _timing, __MakeSeq());
+    MessageWrapper* messagewrapper = __NewMessageWrapper(content, _handlerid, _message, _timing, __MakeSeq());
 
-    content.lst_message.push_back(messagewrapper);
+    __AddMessage(content, messagewrapper);
     content.breaker->Notify(lock);
     return messagewrapper->postid;
 }
 
 MessagePost_t SingletonMessage(bool _replace, const MessageHandler_t& _handlerid, const Message& _message, const MessageTiming& _timing) {
-    ScopedLock lock(sg_messagequeue_map_mutex);
-    const MessageQueue_t& id = _handlerid.queue;
-
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) return KNullPost;
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(_handlerid.queue);
+    if (!content_ptr) return KNullPost;
 
-    MessageQueueContent& content = sg_messagequeue_map[id];
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
+    if (content.released) return KNullPost;
 
     MessagePost_t post_id;
+    MessageWrapper* found = __FindMessage(content, _handlerid, _message);
 
-    for (std::list<MessageWrapper*>::iterator it = content.lst_message.begin(); it != content.lst_message.end(); ++it) {
-        if ((*it)->postid.reg == _handlerid && (*it)->message == _message) {
-            if (_replace) {
-                post_id = (*it)->postid;
-                delete(*it);
-                content.lst_message.erase(it);
-                break;
-            } else {
-                return (*it)->postid;
-            }
-        }
+    if (NULL != found) {
+        if (!_replace) return found->postid;
+
+        post_id = found->postid;
+        __RemoveMessage(content, found);
     }
 
-    MessageWrapper* messagewrapper = new MessageWrapper(_handlerid, _message, _timing, 0 != post_id.seq ? post_id.seq : __MakeSeq());
-    content.lst_message.push_back(messagewrapper);
+    MessageWrapper* messagewrapper = __NewMessageWrapper(content, _handlerid, _message, _timing, 0 != post_id.seq ? post_id.seq : __MakeSeq());
+    __AddMessage(content, messagewrapper);
     content.breaker->Notify(lock);
     return messagewrapper->postid;
 }
 
 MessagePost_t BroadcastMessage(const MessageQueue_t& _messagequeueid,  const Message& _message, const MessageTiming& _timing) {
-    ScopedLock lock(sg_messagequeue_map_mutex);
     const MessageQueue_t& id = _messagequeueid;
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(id);
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) {
+    if (!content_ptr) {
         ASSERT2(false, "%" PRIu64, id);
         return KNullPost;
     }
 
-    MessageQueueContent& content = sg_messagequeue_map[id];
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
+    if (content.released) return KNullPost;
 
     MessageHandler_t reg;
     reg.queue = _messagequeueid;
     reg.seq = 0;
-    MessageWrapper* messagewrapper = new MessageWrapper(reg, _message, _timing, __MakeSeq());
+    MessageWrapper* messagewrapper = __NewMessageWrapper(content, reg, _message, _timing, __MakeSeq());
 
-    content.lst_message.push_back(messagewrapper);
+    __AddMessage(content, messagewrapper);
     content.breaker->Notify(lock);
     return messagewrapper->postid;
 }
@@ -371,48 +1011,89 @@ static int64_t __ComputerWaitTime(const MessageWrapper& _wrap) {
 }
 
 MessagePost_t FasterMessage(const MessageHandler_t& _handlerid, const Message& _message, const MessageTiming& _timing) {
-    ScopedLock lock(sg_messagequeue_map_mutex);
-    const MessageQueue_t& id = _handlerid.queue;
-
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) return KNullPost;
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(_handlerid.queue);
+    if (!content_ptr) return KNullPost;
 
-    MessageQueueContent& content = sg_messagequeue_map[id];
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
+    if (content.released) return KNullPost;
 
-    MessageWrapper* messagewrapper = new MessageWrapper(_handlerid, _message, _timing, __MakeSeq());
+    MessageWrapper* messagewrapper = __NewMessageWrapper(content, _handlerid, _message, _timing, __MakeSeq());
 
-    for (std::list<MessageWrapper*>::iterator it = content.lst_message.begin(); it != content.lst_message.end(); ++it) {
-        if ((*it)->postid.reg == _handlerid && (*it)->message == _message) {
-            if (__ComputerWaitTime(**it) < __ComputerWaitTime(*messagewrapper)) {
-                delete messagewrapper;
-                return (*it)->postid;
-            }
+    MessageWrapper* found = __FindMessage(content, _handlerid, _message);
 
-            messagewrapper->postid = (*it)->postid;
-            delete(*it);
-            content.lst_message.erase(it);
-            break;
+    if (NULL != found) {
+        if (__ComputerWaitTime(*found) < __ComputerWaitTime(*messagewrapper)) {
+            __DeleteMessageWrapper(content, messagewrapper);
+            return found->postid;
         }
+
+        messagewrapper->postid = found->postid;
+        __RemoveMessage(content, found);
     }
 
-    content.lst_message.push_back(messagewrapper);
+    __AddMessage(content, messagewrapper);
     content.breaker->Notify(lock);
     return messagewrapper->postid;
 }
 
+MessageBatch::MessageBatch(): messagequeue_id_(KInvalidQueueID) {}
+
+MessageBatch::~MessageBatch() {
+    Commit();
+}
+
+MessagePost_t MessageBatch::Post(const MessageHandler_t& _handlerid, const Message& _message, const MessageTiming& _timing) {
+    if (_handlerid.queue != messagequeue_id_) {
+        Commit();
+        messagequeue_id_ = _handlerid.queue;
+    }
+
+    MessageWrapper* messagewrapper = new MessageWrapper(_handlerid, _message, _timing, __MakeSeq());
+    wrappers_.push_back(messagewrapper);
+    return messagewrapper->postid;
+}
+
+void MessageBatch::Commit() {
+    if (wrappers_.empty()) return;
+
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(messagequeue_id_);
+    ASSERT2(content_ptr, "%" PRIu64, messagequeue_id_);
+
+    if (content_ptr) {
+        MessageQueueContent& content = *content_ptr;
+        ScopedLock lock(content.mutex);
+
+        if (!content.released) {
+            for (std::vector<MessageWrapper*>::iterator it = wrappers_.begin(); it != wrappers_.end(); ++it) {
+                __AddMessage(content, *it);
+            }
+            content.breaker->Notify(lock);
+            wrappers_.clear();
+            return;
+        }
+    }
+
+    for (std::vector<MessageWrapper*>::iterator it = wrappers_.begin(); it != wrappers_.end(); ++it) {
+        delete *it;
+    }
+    wrappers_.clear();
+}
+
+
 bool WaitMessage(const MessagePost_t& _message) {
     bool is_in_mq = Handler2Queue(Post2Handler(_message)) == CurrentThreadMessageQueue();
 
-    ScopedLock lock(sg_messagequeue_map_mutex);
-    const MessageQueue_t& id = Handler2Queue(Post2Handler(_message));
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) return false;
-    MessageQueueContent& content = sg_messagequeue_map[id];
-
-    auto find_it = std::find_if(content.lst_message.begin(), content.lst_message.end(),
-                                [&_message](const MessageWrapper * const &_v) {
-                                    return _message == _v->postid;
-                                });
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(Handler2Queue(Post2Handler(_message)));
+    if (!content_ptr) return false;
+
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
+    if (content.released) return false;
+
+    MessageWrapper* found = content.post_index.Find(_message);
     
-    if (find_it == content.lst_message.end()) {
+    if (NULL == found) {
         auto find_it = std::find_if(content.lst_runloop_info.begin(), content.lst_runloop_info.end(),
                      [&_message](const RunLoopInfo& _v){ return _message == _v.runing_message_id; });
         
@@ -426,18 +1107,15 @@ bool WaitMessage(const MessagePost_t& _message) {
         
         if (is_in_mq) {
             lock.unlock();
-            RunLoop( [&_message](){
-                        MessageQueueContent& content = sg_messagequeue_map[Handler2Queue(Post2Handler(_message))];
-                        return content.lst_message.end() == std::find_if(content.lst_message.begin(), content.lst_message.end(),
-                                                                [&_message](const MessageWrapper *  const &_v) {
-                                                                    return _message == _v->postid;
-                                                                });
+            // the breaker is called with the lock of the queue held.
+            RunLoop( [&content, &_message](){
+                        return NULL == content.post_index.Find(_message);
             }).Run();
             
         } else {
-            if (!((*find_it)->wait_end_cond))(*find_it)->wait_end_cond = boost::make_shared<Condition>();
+            if (!(found->wait_end_cond)) found->wait_end_cond = boost::make_shared<Condition>();
 
-            boost::shared_ptr<Condition> wait_end_cond = (*find_it)->wait_end_cond;
+            boost::shared_ptr<Condition> wait_end_cond = found->wait_end_cond;
             wait_end_cond->wait(lock);
         }
     }
@@ -446,11 +1124,11 @@ bool WaitMessage(const MessagePost_t& _message) {
 }
 
 bool FoundMessage(const MessagePost_t& _message) {
-    ScopedLock lock(sg_messagequeue_map_mutex);
-    const MessageQueue_t& id = Handler2Queue(Post2Handler(_message));
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(Handler2Queue(Post2Handler(_message)));
+    if (!content_ptr) return false;
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) return false;
-    MessageQueueContent& content = sg_messagequeue_map[id];
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
     if (content.lst_runloop_info.empty()) return false;
 
     auto find_it = std::find_if(content.lst_runloop_info.begin(), content.lst_runloop_info.end(),
@@ -458,11 +1136,7 @@ bool FoundMessage(const MessagePost_t& _message) {
     
     if (find_it != content.lst_runloop_info.end())  { return true; }
 
-    for (std::list<MessageWrapper*>::iterator it = content.lst_message.begin(); it != content.lst_message.end(); ++it) {
-        if (_message == (*it)->postid) { return true;}
-    }
-
-    return false;
+    return NULL != content.post_index.Find(_message);
 }
 
 bool CancelMessage(const MessagePost_t& _postid) {
@@ -472,25 +1146,22 @@ bool CancelMessage(const MessagePost_t& _postid) {
     // 0==_postid.reg.seq for BroadcastMessage
     if (0 == _postid.reg.queue || 0 == _postid.seq) return false;
 
-    ScopedLock lock(sg_messagequeue_map_mutex);
     const MessageQueue_t& id = _postid.reg.queue;
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(id);
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) {
+    if (!content_ptr) {
         ASSERT2(false, "%" PRIu64, id);
         return false;
     }
 
-    MessageQueueContent& content = sg_messagequeue_map[id];
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
 
-    for (std::list<MessageWrapper*>::iterator it = content.lst_message.begin(); it != content.lst_message.end(); ++it) {
-        if (_postid == (*it)->postid) {
-            delete(*it);
-            content.lst_message.erase(it);
-            return true;
-        }
-    }
+    MessageWrapper* found = content.post_index.Find(_postid);
+    if (NULL == found) return false;
 
-    return false;
+    __RemoveMessage(content, found);
+    return true;
 }
 
 void CancelMessage(const MessageHandler_t& _handlerid) {
@@ -499,23 +1170,23 @@ void CancelMessage(const MessageHandler_t& _handlerid) {
     // 0==_handlerid.seq for BroadcastMessage
     if (0 == _handlerid.queue) return;
 
-    ScopedLock lock(sg_messagequeue_map_mutex);
-    const MessageQueue_t& id = _handlerid.queue;
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(_handlerid.queue);
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) {
+    if (!content_ptr) {
         //        ASSERT2(false, "%lu", id);
         return;
     }
 
-    MessageQueueContent& content = sg_messagequeue_map[id];
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
 
-    for (std::list<MessageWrapper*>::iterator it = content.lst_message.begin(); it != content.lst_message.end();) {
-        if (_handlerid == (*it)->postid.reg) {
-            delete(*it);
-            it = content.lst_message.erase(it);
-        } else {
-            ++it;
-        }
+    std::vector<MessageWrapper*> found;
+    content.post_index.Visit([&](MessageWrapper* _wrapper) {
+        if (_handlerid == _wrapper->postid.reg) found.push_back(_wrapper);
+    });
+
+    for (std::vector<MessageWrapper*>::iterator it = found.begin(); it != found.end(); ++it) {
+        __RemoveMessage(content, *it);
     }
 }
 
@@ -525,36 +1196,109 @@ void CancelMessage(const MessageHandler_t& _handlerid, const MessageTitle_t& _ti
     // 0==_handlerid.seq for BroadcastMessage
     if (0 == _handlerid.queue) return;
 
-    ScopedLock lock(sg_messagequeue_map_mutex);
     const MessageQueue_t& id = _handlerid.queue;
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(id);
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) {
+    if (!content_ptr) {
         ASSERT2(false, "%" PRIu64, id);
         return;
     }
 
-    MessageQueueContent& content = sg_messagequeue_map[id];
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
 
-    for (std::list<MessageWrapper*>::iterator it = content.lst_message.begin(); it != content.lst_message.end();) {
-        if (_handlerid == (*it)->postid.reg && _title == (*it)->message.title) {
-            delete(*it);
-            it = content.lst_message.erase(it);
-        } else {
-            ++it;
-        }
+    for (MessageWrapper* it = content.key_index.Find(MessageKey(_handlerid, _title)); NULL != it;) {
+        MessageWrapper* next = MessageKeyIndex::FindNext(it);
+        __RemoveMessage(content, it);
+        it = next;
     }
 }
+
+bool GetMessageQueueStats(const MessageQueue_t& _messagequeueid, MessageQueueStats& _stats) {
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(_messagequeueid);
+    if (!content_ptr) return false;
+
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
+    _stats = content.stats;
+    _stats.depth = content.post_index.Size();
+    return true;
+}
+
+void ResetMessageQueueStats(const MessageQueue_t& _messagequeueid) {
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(_messagequeueid);
+    if (!content_ptr) return;
+
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
+    content.stats = MessageQueueStats();
+}
+
+static bool __MoreCost(const std::pair<uintptr_t, const MessageQueueStats::TitleStats*>& _lhs,
+                       const std::pair<uintptr_t, const MessageQueueStats::TitleStats*>& _rhs) {
+    return _lhs.second->cost.Sum() > _rhs.second->cost.Sum();
+}
+
+void DumpMessageQueueStats(const MessageQueue_t& _messagequeueid) {
+    MessageQueueStats stats;
+    if (!GetMessageQueueStats(_messagequeueid, stats)) return;
+
+    xinfo2(TSF"messagequeue:%_ posted:%_, dispatched:%_, removed:%_, depth:%_, high water:%_, wait p50/p99/max:%_/%_/%_us, cost p50/p99/max:%_/%_/%_us",
+           _messagequeueid, stats.posted, stats.dispatched, stats.removed, stats.depth, stats.depth_high_water,
+           stats.wait.Percentile(50), stats.wait.Percentile(99), stats.wait.Max(),
+           stats.cost.Percentile(50), stats.cost.Percentile(99), stats.cost.Max());
+
+    std::vector<std::pair<uintptr_t, const MessageQueueStats::TitleStats*> > titles;
+    for (std::map<uintptr_t, MessageQueueStats::TitleStats>::const_iterator it = stats.titles.begin(); it != stats.titles.end(); ++it) {
+        titles.push_back(std::make_pair(it->first, &it->second));
+    }
+    std::sort(titles.begin(), titles.end(), &__MoreCost);
+
+    for (size_t i = 0; i < titles.size(); ++i) {
+        const MessageQueueStats::TitleStats& title = *titles[i].second;
+        xinfo2(TSF"messagequeue:%_ title:%_, dispatched:%_, wait p50/p99/max:%_/%_/%_us, cost p50/p99/max/sum:%_/%_/%_/%_us",
+               _messagequeueid, titles[i].first, title.wait.Count(),
+               title.wait.Percentile(50), title.wait.Percentile(99), title.wait.Max(),
+               title.cost.Percentile(50), title.cost.Percentile(99), title.cost.Max(), title.cost.Sum());
+    }
+
+    if (0 < stats.other_titles.wait.Count()) {
+        const MessageQueueStats::TitleStats& title = stats.other_titles;
+        xinfo2(TSF"messagequeue:%_ other titles, dispatched:%_, wait p50/p99/max:%_/%_/%_us, cost p50/p99/max/sum:%_/%_/%_/%_us",
+               _messagequeueid, title.wait.Count(),
+               title.wait.Percentile(50), title.wait.Percentile(99), title.wait.Max(),
+               title.cost.Percentile(50), title.cost.Percentile(99), title.cost.Max(), title.cost.Sum());
+    }
+}
+
+MessagePost_t DumpMessageQueueStatsPeriod(const MessageQueue_t& _messagequeueid, int64_t _period) {
+    return AsyncInvokePeriod(_period, _period, boost::bind(&DumpMessageQueueStats, _messagequeueid), DefAsyncInvokeHandler(_messagequeueid));
+}
     
+// the innermost runloop of the current thread, NULL if the thread runs none of the queue.
+static RunLoopInfo* __CurrentRunLoopInfo(MessageQueueContent& _content) {
+    thread_tid tid = ThreadUtil::currentthreadid();
+
+    for (std::list<RunLoopInfo>::reverse_iterator it = _content.lst_runloop_info.rbegin(); it != _content.lst_runloop_info.rend(); ++it) {
+        if (tid == it->tid) return &*it;
+    }
+    return NULL;
+}
+
 const Message& RuningMessage() {
     MessageQueue_t id = (MessageQueue_t)ThreadUtil::currentthreadid();
-    ScopedLock lock(sg_messagequeue_map_mutex);
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(id);
     
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) {
+    if (!content_ptr) {
         return KNullMessage;
     }
     
-    MessageQueueContent& content = sg_messagequeue_map[id];
-    return *(content.lst_runloop_info.back().runing_message);
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
+    RunLoopInfo* info = __CurrentRunLoopInfo(content);
+    if (NULL == info) return KNullMessage;
+
+    return *(info->runing_message);
 }
     
 MessagePost_t RuningMessageID() {
@@ -563,163 +1307,188 @@ MessagePost_t RuningMessageID() {
 }
 
 MessagePost_t RuningMessageID(const MessageQueue_t& _id) {
-    ScopedLock lock(sg_messagequeue_map_mutex);
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(_id);
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(_id)) {
+    if (!content_ptr) {
         return KNullPost;
     }
 
-    MessageQueueContent& content = sg_messagequeue_map[_id];
-    return content.lst_runloop_info.back().runing_message_id;
+    MessageQueueContent& content = *content_ptr;
+    ScopedLock lock(content.mutex);
+    RunLoopInfo* info = __CurrentRunLoopInfo(content);
+    if (NULL != info) return info->runing_message_id;
+
+    return content.lst_runloop_info.empty() ? KNullPost : content.lst_runloop_info.back().runing_message_id;
 }
 
 static void __AsyncInvokeHandler(const MessagePost_t& _id, Message& _message) {
+    if (!_message.invoke.Empty()) {
+        _message.invoke();
+        return;
+    }
+
     (*boost::any_cast<boost::shared_ptr<AsyncInvokeFunction> >(_message.body1))();
 }
 
-MessageHandler_t InstallAsyncHandler(const MessageQueue_t& id) {
+MessageHandler_t InstallAsyncHandler(const MessageQueue_t& id, bool _serial) {
     ASSERT(0 != id);
-    return InstallMessageHandler(__AsyncInvokeHandler, false, id);
+    return InstallMessageHandler(__AsyncInvokeHandler, false, id, _serial);
 }
     
 
-static MessageQueue_t __CreateMessageQueueInfo(boost::shared_ptr<RunloopCond>& _breaker, thread_tid _tid, int _anr_timeout = 10*60*1000) {
-    ScopedLock lock(sg_messagequeue_map_mutex);
+static boost::shared_ptr<MessageQueueContent> __NewMessageQueueContent(boost::shared_ptr<RunloopCond>& _breaker, MessageQueue_t _id, int _anr_timeout) {
+    boost::shared_ptr<MessageQueueContent> content_ptr = boost::make_shared<MessageQueueContent>();
+    MessageQueueContent& content = *content_ptr;
+    content.id = _id;
+    HandlerWrapper* handler = new HandlerWrapper(&__AsyncInvokeHandler, false, false, _id, __MakeSeq());
+    __AddHandler(content, handler);
+    content.invoke_reg = handler->reg;
+    content.anr_timeout = _anr_timeout;
+    if (_breaker)
+        content.breaker = _breaker;
+    else
+        content.breaker = boost::make_shared<Cond>();
+    content.breakflag = false;
+
+    return content_ptr;
+}
 
+static MessageQueue_t __CreateMessageQueueInfo(boost::shared_ptr<RunloopCond>& _breaker, thread_tid _tid, int _anr_timeout = 10*60*1000) {
     MessageQueue_t id = (MessageQueue_t)_tid;
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) {
-        MessageQueueContent& content = sg_messagequeue_map[id];
-        HandlerWrapper* handler = new HandlerWrapper(&__AsyncInvokeHandler, false, id, __MakeSeq());
-        content.lst_handler.push_back(handler);
-        content.invoke_reg = handler->reg;
-        content.anr_timeout = _anr_timeout;
-        if (_breaker)
-            content.breaker = _breaker;
-        else
-            content.breaker = boost::make_shared<Cond>();
-        content.breakflag = false;
+    if (!__FindContent(id)) {
+        __UpdateContent(id, __NewMessageQueueContent(_breaker, id, _anr_timeout));
+    }
+
+    return id;
+}
+
+// the queue is known by the first thread, and found from each of them.
+static MessageQueue_t __CreateMessageQueuePoolInfo(const std::vector<thread_tid>& _tids, int _anr_timeout = 10*60*1000) {
+    boost::shared_ptr<RunloopCond> breaker;
+    MessageQueue_t id = (MessageQueue_t)_tids.front();
+
+    boost::shared_ptr<MessageQueueContent> content_ptr = __NewMessageQueueContent(breaker, id, _anr_timeout);
+    content_ptr->workers = _tids;
+
+    for (std::vector<thread_tid>::const_iterator it = _tids.begin(); it != _tids.end(); ++it) {
+        __UpdateContent((MessageQueue_t)*it, content_ptr);
     }
 
     return id;
 }
     
-static void __ReleaseMessageQueueInfo() {
+// the lock of the queue is held.
+static void __ReleaseMessageQueueInfo(MessageQueueContent& _content) {
 
-    MessageQueue_t id = (MessageQueue_t)ThreadUtil::currentthreadid();
+    std::vector<MessageWrapper*> messages;
+    _content.post_index.Visit([&](MessageWrapper* _wrapper) { messages.push_back(_wrapper); });
 
-    if (sg_messagequeue_map.end() != sg_messagequeue_map.find(id)) {
-        MessageQueueContent& content = sg_messagequeue_map[id];
+    for (std::vector<MessageWrapper*>::iterator it = messages.begin(); it != messages.end(); ++it) {
+        __RemoveMessage(_content, *it);
+    }
 
-        for (std::list<MessageWrapper*>::iterator it = content.lst_message.begin(); it != content.lst_message.end(); ++it) {
-            delete(*it);
-        }
+    std::vector<HandlerWrapper*> handlers;
+    _content.handlers.Visit([&](HandlerWrapper* _handler) { handlers.push_back(_handler); });
 
-        for (std::list<HandlerWrapper*>::iterator it = content.lst_handler.begin(); it != content.lst_handler.end(); ++it) {
-            delete(*it);
-        }
+    for (std::vector<HandlerWrapper*>::iterator it = handlers.begin(); it != handlers.end(); ++it) {
+        __RemoveHandler(_content, *it);
+    }
+
+    _content.released = true;
+    __UpdateContent(_content.id, boost::shared_ptr<MessageQueueContent>());
 
-        sg_messagequeue_map.erase(id);
+    for (std::vector<thread_tid>::iterator it = _content.workers.begin(); it != _content.workers.end(); ++it) {
+        if (_content.id != (MessageQueue_t)*it) __UpdateContent((MessageQueue_t)*it, boost::shared_ptr<MessageQueueContent>());
     }
 }
 
 void RunLoop::Run() {
     MessageQueue_t id = CurrentThreadMessageQueue();
     ASSERT(0 != id);
+
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(id);
+    if (!content_ptr) return;
+
+    MessageQueueContent& content = *content_ptr;
+    std::list<RunLoopInfo>::iterator info_it;
     {
-        ScopedLock lock(sg_messagequeue_map_mutex);
-        sg_messagequeue_map[id].lst_runloop_info.push_back(RunLoopInfo());
+        ScopedLock lock(content.mutex);
+        info_it = content.lst_runloop_info.insert(content.lst_runloop_info.end(), RunLoopInfo());
     }
+    RunLoopInfo& info = *info_it;
+
+    // a message is destroyed without the lock, its memory goes back to the queue on the next round.
+    void* free_wrapper = NULL;
+    // so is the cost of its handlers counted.
+    bool has_cost = false;
+    uintptr_t cost_title = 0;
+    uint64_t cost_us = 0;
 
     while (true) {
-        ScopedLock lock(sg_messagequeue_map_mutex);
-        MessageQueueContent& content = sg_messagequeue_map[id];
-        content.lst_runloop_info.back().runing_message_id = KNullPost;
-        content.lst_runloop_info.back().runing_message = NULL;
-        content.lst_runloop_info.back().runing_handler.clear();
-        content.lst_runloop_info.back().runing_cond->notifyAll(lock);
+        ScopedLock lock(content.mutex);
+        if (NULL != free_wrapper) {
+            __FreeMessageWrapper(content, free_wrapper);
+            free_wrapper = NULL;
+        }
+
+        if (has_cost) {
+            content.stats.cost.Record(cost_us);
+            __TitleStats(content.stats, cost_title).cost.Record(cost_us);
+            has_cost = false;
+        }
+
+        info.runing_message_id = KNullPost;
+        info.runing_message = NULL;
+        __ReleaseSerialHandler(content, info);
+        __ReleaseRuningHandlers(info);
+        info.runing_cond->notifyAll(lock);
 
         if ((content.breakflag || (breaker_func_ && breaker_func_()))) {
-            content.lst_runloop_info.pop_back();
+            content.lst_runloop_info.erase(info_it);
             if (content.lst_runloop_info.empty())
-                __ReleaseMessageQueueInfo();
+                __ReleaseMessageQueueInfo(content);
             break;
         }
 
         int64_t wait_time = 10 * 60 * 1000;
-        MessageWrapper* messagewrapper = NULL;
-        bool delmessage = true;
-
-        for (std::list<MessageWrapper*>::iterator it = content.lst_message.begin(); it != content.lst_message.end(); ++it) {
-            if (kImmediately == (*it)->timing.type) {
-                messagewrapper = *it;
-                content.lst_message.erase(it);
-                break;
-            } else if (kAfter == (*it)->timing.type) {
-                int64_t time_cost = ::gettickspan((*it)->record_time);
-
-                if ((*it)->timing.after <= time_cost) {
-                    messagewrapper = *it;
-                    content.lst_message.erase(it);
-                    break;
-                } else {
-                    wait_time = std::min(wait_time, (*it)->timing.after - time_cost);
-                }
-            } else if (kPeriod == (*it)->timing.type) {
-                if (kAfter == (*it)->periodstatus) {
-                    int64_t time_cost = ::gettickspan((*it)->record_time);
-
-                    if ((*it)->timing.after <= time_cost) {
-                        messagewrapper = *it;
-                        (*it)->record_time = ::gettickcount();
-                        (*it)->periodstatus = kPeriod;
-                        delmessage = false;
-                        break;
-                    } else {
-                        wait_time = std::min(wait_time, (*it)->timing.after - time_cost);
-                    }
-                } else if (kPeriod == (*it)->periodstatus) {
-                    int64_t time_cost = ::gettickspan((*it)->record_time);
-
-                    if ((*it)->timing.period <= time_cost) {
-                        messagewrapper = *it;
-                        (*it)->record_time = ::gettickcount();
-                        delmessage = false;
-                        break;
-                    } else {
-                        wait_time = std::min(wait_time, (*it)->timing.period - time_cost);
-                    }
-                } else {
-                    ASSERT(false);
-                }
-            } else {
-                ASSERT(false);
-            }
-        }
+        MessageWrapper* messagewrapper = __TakeReadyMessage(content, wait_time);
 
         if (NULL == messagewrapper) {
             content.breaker->Wait(lock, (long)wait_time);
             continue;
         }
 
-        std::list<HandlerWrapper> fit_handler;
+        info.serial_handler = __SerialHandler(content, *messagewrapper);
+        std::vector<HandlerWrapper*>& fit_handler = info.runing_handler;
 
-        for (std::list<HandlerWrapper*>::iterator it = content.lst_handler.begin(); it != content.lst_handler.end(); ++it) {
-            if (messagewrapper->postid.reg == (*it)->reg || ((*it)->recvbroadcast && messagewrapper->postid.reg.isbroadcast())) {
-                fit_handler.push_back(**it);
-                content.lst_runloop_info.back().runing_handler.push_back((*it)->reg);
-            }
+        if (messagewrapper->postid.reg.isbroadcast()) {
+            fit_handler.assign(content.broadcast_handlers.begin(), content.broadcast_handlers.end());
+        } else {
+            HandlerWrapper* handler = content.handlers.Find(messagewrapper->postid.reg);
+            if (NULL != handler) fit_handler.push_back(handler);
+        }
+
+        for (std::vector<HandlerWrapper*>::iterator it = fit_handler.begin(); it != fit_handler.end(); ++it) {
+            ++(*it)->running;
         }
 
-        content.lst_runloop_info.back().runing_message_id = messagewrapper->postid;
-        content.lst_runloop_info.back().runing_message = &messagewrapper->message;
+        info.runing_message_id = messagewrapper->postid;
+        info.runing_message = &messagewrapper->message;
         int anr_timeout = content.anr_timeout;
+
+        uint64_t dispatch_us = __TickUs();
+        uint64_t wait_us = dispatch_us > messagewrapper->ready_us ? dispatch_us - messagewrapper->ready_us : 0;
+        cost_title = messagewrapper->message.title.title;
+        ++content.stats.dispatched;
+        content.stats.wait.Record(wait_us);
+        __TitleStats(content.stats, cost_title).wait.Record(wait_us);
         lock.unlock();
 
-        for (std::list<HandlerWrapper>::iterator it = fit_handler.begin(); it != fit_handler.end(); ++it) {
+        for (std::vector<HandlerWrapper*>::iterator it = fit_handler.begin(); it != fit_handler.end(); ++it) {
             SCOPE_ANR_AUTO(anr_timeout);
             uint64_t timestart = ::clock_app_monotonic();
-            (*it).handler(messagewrapper->postid, messagewrapper->message);
+            (*it)->handler(messagewrapper->postid, messagewrapper->message);
             uint64_t timeend = ::clock_app_monotonic();
 #if defined(DEBUG) && defined(__APPLE__)
 
@@ -728,19 +1497,32 @@ void RunLoop::Run() {
                 ASSERT2(0 >= anr_timeout || anr_timeout >= (int)(timeend - timestart), "anr_timeout:%d < cost:%" PRIu64", timestart:%" PRIu64", timeend:%" PRIu64, anr_timeout, timeend - timestart, timestart, timeend);
         }
 
-        if (delmessage) {
-            delete messagewrapper;
+        uint64_t end_us = __TickUs();
+        cost_us = end_us > dispatch_us ? end_us - dispatch_us : 0;
+        has_cost = true;
+
+        if (kPeriod != messagewrapper->timing.type) {
+            messagewrapper->~MessageWrapper();
+            free_wrapper = messagewrapper;
+            continue;
+        }
+
+        lock.lock();
+        if (MessageWrapper::kRemoved == messagewrapper->state) {
+            __DeleteMessageWrapper(content, messagewrapper);
+        } else {
+            __QueueMessage(content, messagewrapper);
         }
     }
 }
 
 boost::shared_ptr<RunloopCond> RunloopCond::CurrentCond() {
-    ScopedLock lock(sg_messagequeue_map_mutex);
     MessageQueue_t id = (MessageQueue_t)ThreadUtil::currentthreadid();
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(id);
     
-    if (sg_messagequeue_map.end() != sg_messagequeue_map.find(id)) {
-        MessageQueueContent& content = sg_messagequeue_map[id];
-        return content.breaker;
+    if (content_ptr) {
+        // the breaker is set before the queue is published and never changes.
+        return content_ptr->breaker;
     } else {
         return boost::shared_ptr<RunloopCond>();
     }
@@ -812,14 +1594,61 @@ MessageQueue_t MessageQueueCreater::CreateNewMessageQueue(boost::shared_ptr<Runl
 MessageQueue_t MessageQueueCreater::CreateNewMessageQueue(const char* _messagequeue_name) {
     return CreateNewMessageQueue(boost::shared_ptr<RunloopCond>(), _messagequeue_name);
 }
+
+MessageQueue_t MessageQueueCreater::CreateNewMessageQueuePool(unsigned int _thread_count, const char* _messagequeue_name) {
+    ASSERT(0 < _thread_count);
+
+    std::vector<SpinLock*> sps;
+    std::vector<thread_tid> tids;
+
+    for (unsigned int i = 0; i < _thread_count; ++i) {
+        SpinLock* sp = new SpinLock;
+        sp->lock();
+
+        Thread thread(boost::bind(&__ThreadNewRunloop, sp), _messagequeue_name);
+        thread.outside_join();
+
+        if (0 != thread.start()) {
+            sp->unlock();
+            delete sp;
+            break;
+        }
+
+        sps.push_back(sp);
+        tids.push_back(thread.tid());
+    }
+
+    MessageQueue_t id = KInvalidQueueID;
+    if (!tids.empty()) id = __CreateMessageQueuePoolInfo(tids);
+
+    // the threads delete their spinlocks
+    for (std::vector<SpinLock*>::iterator it = sps.begin(); it != sps.end(); ++it) {
+        (*it)->unlock();
+    }
+
+    return id;
+}
     
 void MessageQueueCreater::ReleaseNewMessageQueue(MessageQueue_t _messagequeue_id){
     
     if (KInvalidQueueID == _messagequeue_id) return;
+
+    std::vector<thread_tid> workers;
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(_messagequeue_id);
+    // set before the queue is published and never changes.
+    if (content_ptr) workers = content_ptr->workers;
     
     BreakMessageQueueRunloop(_messagequeue_id);
     WaitForRuningLockEnd(_messagequeue_id);
-    ThreadUtil::join((thread_tid)_messagequeue_id);
+
+    if (workers.empty()) {
+        ThreadUtil::join((thread_tid)_messagequeue_id);
+        return;
+    }
+
+    for (std::vector<thread_tid>::iterator it = workers.begin(); it != workers.end(); ++it) {
+        ThreadUtil::join(*it);
+    }
 }
 
 void MessageQueueCreater::__ThreadNewRunloop(SpinLock* _sp) {
@@ -841,13 +1670,12 @@ MessageQueue_t GetDefTaskQueue() {
 }
 
 MessageHandler_t DefAsyncInvokeHandler(const MessageQueue_t& _messagequeue) {
-    ScopedLock lock(sg_messagequeue_map_mutex);
-    const MessageQueue_t& id = _messagequeue;
+    boost::shared_ptr<MessageQueueContent> content_ptr = __FindContent(_messagequeue);
 
-    if (sg_messagequeue_map.end() == sg_messagequeue_map.find(id)) return KNullHandler;
+    if (!content_ptr) return KNullHandler;
 
-    MessageQueueContent& content = sg_messagequeue_map[id];
-    return content.invoke_reg;
+    // set before the queue is published and never changes.
+    return content_ptr->invoke_reg;
 }
 
 }  // namespace MessageQueue
@@ -21,9 +21,14 @@
 #ifndef MESSAGEQUEUE_H_
 #define MESSAGEQUEUE_H_
 
+#include <new>
+#include <map>
+#include <vector>
+
 #include "boost/function.hpp"
 #include "boost/any.hpp"
 #include "boost/smart_ptr.hpp"
+#include "boost/type_traits/alignment_of.hpp"
 
 #if __cplusplus >= 201103L
 #include "boost/static_assert.hpp"
@@ -67,22 +72,109 @@ struct MessageTitle_t {
 };
 
 
+/*
+ * void() function object of an async invoke, one of up to kInlineSize bytes is kept inline,
+ * so the lambdas and binds usually posted are copied into a message without a heap allocation.
+ */
+class MessageFunction {
+  public:
+    static const size_t kInlineSize = 6 * sizeof(void*);
+
+  public:
+    MessageFunction(): ops_(NULL) {}
+
+    template <class F>
+    MessageFunction(const F& _func): ops_(NULL) {
+        if (sizeof(F) <= kInlineSize && boost::alignment_of<F>::value <= boost::alignment_of<Storage>::value) {
+            new (storage_.buffer) F(_func);
+            ops_ = InlineOps<F>::Get();
+        } else {
+            storage_.heap = new F(_func);
+            ops_ = HeapOps<F>::Get();
+        }
+    }
+
+    MessageFunction(const MessageFunction& _rhs): ops_(NULL) {
+        if (NULL == _rhs.ops_) return;
+        _rhs.ops_->copy(_rhs.storage_, storage_);
+        ops_ = _rhs.ops_;
+    }
+
+    MessageFunction& operator=(const MessageFunction& _rhs) {
+        if (this == &_rhs) return *this;
+
+        Clear();
+        if (NULL != _rhs.ops_) {
+            _rhs.ops_->copy(_rhs.storage_, storage_);
+            ops_ = _rhs.ops_;
+        }
+        return *this;
+    }
+
+    ~MessageFunction() { Clear(); }
+
+    bool Empty() const { return NULL == ops_; }
+    void operator()() { ops_->invoke(storage_); }
+
+    void Clear() {
+        if (NULL == ops_) return;
+        ops_->destroy(storage_);
+        ops_ = NULL;
+    }
+
+  private:
+    union Storage {
+        void* heap;
+        char buffer[kInlineSize];
+        long double align1;
+        int64_t align2;
+        void (*align3)();
+    };
+
+    struct Ops {
+        void (*invoke)(Storage& _storage);
+        void (*copy)(const Storage& _from, Storage& _to);
+        void (*destroy)(Storage& _storage);
+    };
+
+    template <class F>
+    struct InlineOps {
+        static F& Object(Storage& _storage) { return *reinterpret_cast<F*>(_storage.buffer); }
+        static void Invoke(Storage& _storage) { Object(_storage)(); }
+        static void Copy(const Storage& _from, Storage& _to) { new (_to.buffer) F(*reinterpret_cast<const F*>(_from.buffer)); }
+        static void Destroy(Storage& _storage) { Object(_storage).~F(); }
+        static const Ops* Get() { static const Ops ops = {&Invoke, &Copy, &Destroy}; return &ops; }
+    };
+
+    template <class F>
+    struct HeapOps {
+        static void Invoke(Storage& _storage) { (*static_cast<F*>(_storage.heap))(); }
+        static void Copy(const Storage& _from, Storage& _to) { _to.heap = new F(*static_cast<const F*>(_from.heap)); }
+        static void Destroy(Storage& _storage) { delete static_cast<F*>(_storage.heap); }
+        static const Ops* Get() { static const Ops ops = {&Invoke, &Copy, &Destroy}; return &ops; }
+    };
+
+  private:
+    Storage storage_;
+    const Ops* ops_;
+};
+
 struct Message {
     Message(): title(0) {}
     Message(const MessageTitle_t& _title, const boost::any& _body1, const boost::any& _body2)
         : title(_title), body1(_body1), body2(_body2) {}
 
+    // the function is kept in invoke, body1 holding a boost::shared_ptr<AsyncInvokeFunction> is still run by the async handler.
     template <class F>
     Message(const MessageTitle_t& _title, const F& _func)
-    : title(_title), body1(boost::make_shared<AsyncInvokeFunction>()), body2() {
-        *boost::any_cast<boost::shared_ptr<AsyncInvokeFunction> >(body1) = _func;
-    }
+    : title(_title), body1(), body2(), invoke(_func) {}
 
     bool operator == (const Message& _rhs) const {return title == _rhs.title;}
 
     MessageTitle_t title;
     boost::any body1;
     boost::any body2;
+    MessageFunction invoke;
 };
 
 enum TMessageTiming {
@@ -90,36 +182,55 @@ enum TMessageTiming {
     kPeriod,
     kImmediately,
 };
+
+// the ready messages run by priority and then in order. a lower one waiting long runs before the higher ones.
+enum TMessagePriority {
+    kPriorityLow,
+    kPriorityNormal,
+    kPriorityHigh,
+};
     
 struct MessageTiming {
     
-    MessageTiming(TMessageTiming _timing, int64_t _after, int64_t _period)
+    MessageTiming(TMessageTiming _timing, int64_t _after, int64_t _period, TMessagePriority _priority = kPriorityNormal)
         : type(_timing)
         , after(_after)
         , period(_period)
+        , priority(_priority)
     {}
 
     MessageTiming(int64_t _after, int64_t _period)
     : type(TMessageTiming::kPeriod)
         , after(_after)
         , period(_period)
+        , priority(kPriorityNormal)
     {}
 
     MessageTiming(int64_t _after)
     : type(TMessageTiming::kAfter)
         , after(_after)
         , period(0)
+        , priority(kPriorityNormal)
+    {}
+
+    explicit MessageTiming(TMessagePriority _priority)
+    : type(TMessageTiming::kImmediately)
+        , after(0)
+        , period(0)
+        , priority(_priority)
     {}
 
     MessageTiming()
     : type(TMessageTiming::kImmediately)
         , after(0)
         , period(0)
+        , priority(kPriorityNormal)
     {}
 
     TMessageTiming type;
     int64_t after;
     int64_t period;
+    TMessagePriority priority;
 };
 
 typedef boost::function<void (const MessagePost_t& _id, Message& _message)> MessageHandler;
@@ -149,7 +260,12 @@ void WaitForRuningLockEnd(const MessageHandler_t&  _handler);
 void WaitForRuningLockEnd(const MessageQueue_t&  _messagequeueid);
 void BreakMessageQueueRunloop(const MessageQueue_t&  _messagequeueid);
 
-MessageHandler_t InstallMessageHandler(const MessageHandler& _handler, bool _recvbroadcast = false, const MessageQueue_t& _messagequeueid = GetDefMessageQueue());
+/*
+ * the threads of a pool queue run the messages side by side. the messages of a _serial handler still run one by one
+ * in the order of posting, it must not wait in the queue for a message of its own. broadcasts are not serialized.
+ * _serial makes no difference to a queue of one thread.
+ */
+MessageHandler_t InstallMessageHandler(const MessageHandler& _handler, bool _recvbroadcast = false, const MessageQueue_t& _messagequeueid = GetDefMessageQueue(), bool _serial = false);
 void UnInstallMessageHandler(const MessageHandler_t& _handlerid);
 
 MessagePost_t PostMessage(const MessageHandler_t& _handlerid, const Message& _message, const MessageTiming& _timing = KDefTiming);
@@ -157,6 +273,39 @@ MessagePost_t SingletonMessage(bool _replace, const MessageHandler_t& _handlerid
 MessagePost_t BroadcastMessage(const MessageQueue_t& _messagequeueid,  const Message& _message, const MessageTiming& _timing = KDefTiming);
 MessagePost_t FasterMessage(const MessageHandler_t& _handlerid, const Message& _message, const MessageTiming& _timing = KDefTiming);
 
+struct MessageWrapper;
+
+/*
+ * posts are held until Commit or the destruction of the batch, then the messages of one queue are queued
+ * under one lock with one wakeup of its runloop. the post ids are valid at once, a message is found, waited
+ * or canceled only after the commit. a post to another queue commits the messages held before it.
+ */
+class MessageBatch {
+  public:
+    MessageBatch();
+    ~MessageBatch();
+
+    MessagePost_t Post(const MessageHandler_t& _handlerid, const Message& _message, const MessageTiming& _timing = KDefTiming);
+    void Commit();
+    size_t Size() const { return wrappers_.size(); }
+
+  private:
+    MessageBatch(const MessageBatch&);
+    MessageBatch& operator=(const MessageBatch&);
+
+  private:
+    MessageQueue_t messagequeue_id_;
+    std::vector<MessageWrapper*> wrappers_;
+};
+
+template <class InputIterator>
+void PostMessages(const MessageHandler_t& _handlerid, InputIterator _begin, InputIterator _end, const MessageTiming& _timing = KDefTiming) {
+    MessageBatch batch;
+    for (; _begin != _end; ++_begin) {
+        batch.Post(_handlerid, *_begin, _timing);
+    }
+}
+
 bool WaitMessage(const MessagePost_t& _message);
 bool FoundMessage(const MessagePost_t& _message);
 
@@ -165,7 +314,7 @@ void CancelMessage(const MessageHandler_t& _handlerid);
 void CancelMessage(const MessageHandler_t& _handlerid, const MessageTitle_t& _title);
 
 //AsyncInvoke
-MessageHandler_t InstallAsyncHandler(const MessageQueue_t& id);
+MessageHandler_t InstallAsyncHandler(const MessageQueue_t& id, bool _serial = false);
 
 template<class F>
 MessagePost_t AsyncInvoke(const F& _func, const MessageHandler_t& _handlerid = DefAsyncInvokeHandler()) {
@@ -245,6 +394,8 @@ class MessageQueueCreater {
 
     static MessageQueue_t CreateNewMessageQueue(const char* _messagequeue_name = NULL);
     static MessageQueue_t CreateNewMessageQueue(boost::shared_ptr<RunloopCond> _breaker, const char* _messagequeue_name = NULL);
+    // a queue run by _thread_count threads, its id is the tid of the first one. see InstallMessageHandler for serial handlers.
+    static MessageQueue_t CreateNewMessageQueuePool(unsigned int _thread_count, const char* _messagequeue_name = NULL);
     static void ReleaseNewMessageQueue(MessageQueue_t _messagequeue_id); // block api
 
   private:
@@ -261,6 +412,104 @@ class MessageQueueCreater {
     boost::shared_ptr<RunloopCond>   breaker_;
 };
 
+// log-linear histogram of microseconds, 8 buckets for each power of two, a percentile is off by 1/16 at most.
+class MessageQueueHistogram {
+  public:
+    static const int kSubBuckets = 8;
+    static const int kBucketCount = (32 - 2) * kSubBuckets;    // up to 2^32 us
+
+  public:
+    MessageQueueHistogram() { Reset(); }
+
+    void Reset() {
+        for (int i = 0; i < kBucketCount; ++i) buckets_[i] = 0;
+        count_ = 0;
+        sum_ = 0;
+        max_ = 0;
+    }
+
+    void Record(uint64_t _us) {
+        ++buckets_[__Bucket(_us)];
+        ++count_;
+        sum_ += _us;
+        if (_us > max_) max_ = _us;
+    }
+
+    uint64_t Count() const { return count_; }
+    uint64_t Sum() const { return sum_; }
+    uint64_t Max() const { return max_; }
+
+    // _percent in [0, 100], the middle of the bucket holding it.
+    uint64_t Percentile(double _percent) const {
+        if (0 == count_) return 0;
+
+        uint64_t rank = (uint64_t)(_percent / 100 * count_ + 0.5);
+        if (rank < 1) rank = 1;
+
+        uint64_t seen = 0;
+        for (int i = 0; i < kBucketCount; ++i) {
+            seen += buckets_[i];
+            if (seen >= rank) {
+                uint64_t value = __Lower(i) + (__Lower(i + 1) - __Lower(i)) / 2;
+                return value < max_ ? value : max_;
+            }
+        }
+        return max_;
+    }
+
+  private:
+    static int __Bucket(uint64_t _us) {
+        if (_us < (uint64_t)kSubBuckets) return (int)_us;
+        if (_us >= ((uint64_t)1 << 32)) return kBucketCount - 1;
+
+        int msb = 31;
+        while (0 == (_us >> msb)) --msb;
+        return (msb - 2) * kSubBuckets + (int)((_us >> (msb - 3)) & (kSubBuckets - 1));
+    }
+
+    static uint64_t __Lower(int _bucket) {
+        if (_bucket < kSubBuckets) return _bucket;
+
+        int msb = _bucket / kSubBuckets + 2;
+        return (uint64_t)(kSubBuckets + _bucket % kSubBuckets) << (msb - 3);
+    }
+
+  private:
+    uint32_t buckets_[kBucketCount];
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+};
+
+struct MessageQueueStats {
+    static const size_t kMaxTitles = 64;
+
+    struct TitleStats {
+        MessageQueueHistogram wait;     // from ready to dispatched, us
+        MessageQueueHistogram cost;     // of the handlers, us
+    };
+
+    MessageQueueStats(): posted(0), dispatched(0), removed(0), depth(0), depth_high_water(0) {}
+
+    uint64_t posted;
+    uint64_t dispatched;
+    uint64_t removed;           // canceled, replaced or dropped with the queue
+    size_t depth;               // queued now, delayed and period messages included
+    size_t depth_high_water;
+    MessageQueueHistogram wait;
+    MessageQueueHistogram cost;
+    std::map<uintptr_t, TitleStats> titles;     // the first kMaxTitles titles seen
+    TitleStats other_titles;
+};
+
+// the stats are kept from the creation of the queue or the last reset.
+bool GetMessageQueueStats(const MessageQueue_t& _messagequeueid, MessageQueueStats& _stats);
+void ResetMessageQueueStats(const MessageQueue_t& _messagequeueid);
+// to xlog, the titles of the most handler time first.
+void DumpMessageQueueStats(const MessageQueue_t& _messagequeueid);
+// dumps on the queue every _period ms until the returned message is canceled.
+MessagePost_t DumpMessageQueueStatsPeriod(const MessageQueue_t& _messagequeueid, int64_t _period);
+
 template <typename R>
 class AsyncResult {
   private:
@@ -20,6 +20,8 @@
 
 #include "complexconnect.h"
 
+#include <limits.h>
+
 #include <algorithm>
 
 #include "comm/xlogger/xlogger.h"
@@ -36,15 +38,19 @@ namespace COMPLEX_CONNECT_NAMESPACE {
 ComplexConnect::ComplexConnect(unsigned int _timeout, unsigned int _interval)
     : timeout_(_timeout), interval_(_interval), error_interval_(_interval), max_connect_(3), trycount_(0), index_(-1), errcode_(0)
     , index_conn_rtt_(0), index_conn_totalcost_(0), totalcost_(0)
+    , observer_(NULL), starttime_(0), laststart_connecttime_(0), lasterror_(0), started_(0), round_timeout_(0), retsocket_(INVALID_SOCKET)
 {}
 
 ComplexConnect::ComplexConnect(unsigned int _timeout /*ms*/, unsigned int _interval /*ms*/, unsigned int _error_interval /*ms*/, unsigned int _max_connect)
     : timeout_(_timeout), interval_(_interval), error_interval_(_error_interval), max_connect_(_max_connect),  trycount_(0), index_(-1), errcode_(0)
     , index_conn_rtt_(0), index_conn_totalcost_(0), totalcost_(0)
+    , observer_(NULL), starttime_(0), laststart_connecttime_(0), lasterror_(0), started_(0), round_timeout_(0), retsocket_(INVALID_SOCKET)
 {}
 
-ComplexConnect::~ComplexConnect()
-{}
+ComplexConnect::~ComplexConnect() {
+    __CloseAll();
+    if (INVALID_SOCKET != retsocket_) ::socket_close(retsocket_);
+}
 
 int ComplexConnect::__ConnectTime(unsigned int _index) const {
     return _index * interval_;
@@ -54,8 +60,6 @@ int ComplexConnect::__ConnectTimeout(unsigned int _index) const {
     return __ConnectTime(_index) + timeout_;
 }
 
-namespace {
-
 class ConnectCheckFSM : public TcpClientFSM {
   public:
     enum TCheckStatus {
@@ -129,183 +133,211 @@ class ConnectCheckFSM : public TcpClientFSM {
     uint64_t m_checkfintime;
 };
 
+namespace {
 static bool __isconnecting(const ConnectCheckFSM* _ref) { return NULL != _ref && INVALID_SOCKET != _ref->Socket(); }
 }
 
 SOCKET ComplexConnect::ConnectImpatient(const std::vector<socket_address>& _vecaddr, SocketSelectBreaker& _breaker, MComplexConnect* _observer) {
+    if (!Begin(_vecaddr, _observer)) return INVALID_SOCKET;
+
+    while (!IsEnd()) {
+        SocketSelect sel(_breaker);
+        sel.PreSelect();
+        PreSelect(sel);
+
+        int timeout = Timeout();
+        xdebug2(TSF"timeout:%_, @%_", timeout, this);
+        int ret = 0;
+
+        if (INT_MAX == timeout) {
+            ret = sel.Select();
+        } else {
+            timeout = std::max(0, timeout);
+            ret = sel.Select(timeout);
+        }
+
+        // select error
+        if (ret < 0) {
+            xerror2(TSF"sel ret:(%_, %_, %_), @%_", ret, sel.Errno(), socket_strerror(sel.Errno()), this);
+            break;
+        }
+
+        // user break
+        if (sel.IsException()) {
+            xerror2(TSF"sel exception @%_", this);
+            break;
+        }
+
+        if (sel.IsBreak()) {
+            xinfo2(TSF"sel breaker @%_", this);
+            break;
+        }
+
+        AfterSelect(sel);
+    }
+
+    return End();
+}
+
+bool ComplexConnect::Begin(const std::vector<socket_address>& _vecaddr, MComplexConnect* _observer) {
+    __CloseAll();
+    if (INVALID_SOCKET != retsocket_) ::socket_close(retsocket_);
+    retsocket_ = INVALID_SOCKET;
+
     trycount_ = 0;
     index_ = -1;
     errcode_ = 0;
     index_conn_rtt_ = 0;
     index_conn_totalcost_ = 0;
     totalcost_ = 0;
+    observer_ = _observer;
+    lasterror_ = 0;
+    started_ = 0;
+    round_timeout_ = (int)timeout_;
 
     if (_vecaddr.empty()) {
         xwarn2(TSF"_vecaddr size:%_, m_timeout:%_, m_interval:%_, m_error_interval:%_, m_max_connect:%_, @%_", _vecaddr.size(), timeout_, interval_, error_interval_, max_connect_, this);
-        return INVALID_SOCKET;
+        return false;
     }
 
     xinfo2(TSF"_vecaddr size:%_, m_timeout:%_, m_interval:%_, m_error_interval:%_, m_max_connect:%_, @%_", _vecaddr.size(), timeout_, interval_, error_interval_, max_connect_, this);
     
-    uint64_t  starttime = gettickcount();
-    std::vector<ConnectCheckFSM*> vecsocketfsm;
+    starttime_ = gettickcount();
 
     for (unsigned int i = 0; i < _vecaddr.size(); ++i) {
         xinfo2(TSF"complex.conn %_", _vecaddr[i].url());
 
         ConnectCheckFSM* ic = new ConnectCheckFSM(_vecaddr[i], timeout_, i, _observer);
-        vecsocketfsm.push_back(ic);
+        vecsocketfsm_.push_back(ic);
     }
 
     uint64_t  curtime = gettickcount();
-    uint64_t  laststart_connecttime = curtime - std::max(interval_, error_interval_);
+    laststart_connecttime_ = curtime - std::max(interval_, error_interval_);
 
-    xdebug2(TSF"curtime:%_, laststart_connecttime:%_, @%_", curtime, laststart_connecttime, this);
+    xdebug2(TSF"curtime:%_, laststart_connecttime:%_, @%_", curtime, laststart_connecttime_, this);
+    return true;
+}
 
-    int lasterror = 0;
-    unsigned int index = 0;
-    SOCKET retsocket = INVALID_SOCKET;
+void ComplexConnect::PreSelect(SocketSelect& _sel) {
+    uint64_t curtime = gettickcount();
+    // timeout and connect
+    int next_connect_timeout = int(((0 == lasterror_) ? interval_ : error_interval_) - (curtime - laststart_connecttime_));
 
-    do {
-        curtime = gettickcount();
-        // timeout and connect
-        SocketSelect sel(_breaker);
-        sel.PreSelect();
+    int timeout = (int)timeout_;
+    unsigned int runing_count = (unsigned int)std::count_if(vecsocketfsm_.begin(), vecsocketfsm_.end(), &__isconnecting);
 
-        int next_connect_timeout = int(((0 == lasterror) ? interval_ : error_interval_) - (curtime - laststart_connecttime));
+    if (started_ < vecsocketfsm_.size()
+            && 0 < next_connect_timeout
+            && runing_count < max_connect_) {
+        timeout = std::min(timeout, next_connect_timeout);
+    }
 
-        int timeout = (int)timeout_;
-        unsigned int runing_count = (unsigned int)std::count_if(vecsocketfsm.begin(), vecsocketfsm.end(), &__isconnecting);
+    // connect
+    if (started_ < vecsocketfsm_.size()
+            && 0 >= next_connect_timeout
+            && runing_count < max_connect_) {
+        if (runing_count + 1 < max_connect_) timeout = std::min(timeout, (int)interval_);
 
-        if (index < vecsocketfsm.size()
-                && 0 < next_connect_timeout
-                && runing_count < max_connect_) {
-            timeout = std::min(timeout, next_connect_timeout);
-        }
+        laststart_connecttime_ = gettickcount();
+        lasterror_ = 0;
 
-        // connect
-        if (index < vecsocketfsm.size()
-                && 0 >= next_connect_timeout
-                && runing_count < max_connect_) {
-            if (runing_count + 1 < max_connect_) timeout = std::min(timeout, (int)interval_);
+        trycount_ = (unsigned int)(started_ + 1);
+        ++started_;
+    }
 
-            laststart_connecttime = gettickcount();
-            lasterror = 0;
+    for (unsigned int i = 0; i < started_; ++i) {
+        if (NULL == vecsocketfsm_[i]) continue;
 
-            trycount_ = (unsigned int)(index + 1);
-            ++index;
-        }
+        xgroup2_define(group);
+        vecsocketfsm_[i]->PreSelect(_sel, group);
+        xgroup2_if(!group.Empty(), TSF"index:%_, @%_, ", i, this) << group;
+        timeout = std::min(timeout, vecsocketfsm_[i]->Timeout());
+    }
 
-        for (unsigned int i = 0; i < index; ++i) {
-            if (NULL == vecsocketfsm[i]) continue;
+    round_timeout_ = timeout;
+}
 
-            xgroup2_define(group);
-            vecsocketfsm[i]->PreSelect(sel, group);
-            xgroup2_if(!group.Empty(), TSF"index:%_, @%_, ", i, this) << group;
-            timeout = std::min(timeout, vecsocketfsm[i]->Timeout());
-        }
+void ComplexConnect::AfterSelect(SocketSelect& _sel) {
+    // socket
+    for (unsigned int i = 0; i < started_; ++i) {
+        if (NULL == vecsocketfsm_[i]) continue;
 
-        xdebug2(TSF"timeout:%_, @%_", timeout, this);
-        int ret = 0;
+        xgroup2_define(group);
+        vecsocketfsm_[i]->AfterSelect(_sel, group);
+        xgroup2_if(!group.Empty(), TSF"index:%_, @%_, ", i, this) << group;
 
-        if (INT_MAX == timeout) {
-            ret = sel.Select();
-        } else {
-            timeout = std::max(0, timeout);
-            ret = sel.Select(timeout);
-        }
+        if (TcpClientFSM::EEnd == vecsocketfsm_[i]->Status()) {
+            if (observer_) observer_->OnFinished(i, socket_address(&vecsocketfsm_[i]->Address()), vecsocketfsm_[i]->Socket(), vecsocketfsm_[i]->Error(),
+                                                 vecsocketfsm_[i]->Rtt(), vecsocketfsm_[i]->TotalRtt(), (int)(gettickcount() - starttime_));
 
-        // select error
-        if (ret < 0) {
-            xerror2(TSF"sel ret:(%_, %_, %_), @%_", ret, sel.Errno(), socket_strerror(sel.Errno()), this);
-            break;
+            vecsocketfsm_[i]->Close();
+            delete vecsocketfsm_[i];
+            vecsocketfsm_[i] = NULL;
+            lasterror_ = -1;
+            continue;
         }
 
-        // user break
-        if (sel.IsException()) {
-            xerror2(TSF"sel exception @%_", this);
-            break;
+        if (TcpClientFSM::EReadWrite == vecsocketfsm_[i]->Status() && ConnectCheckFSM::ECheckFail == vecsocketfsm_[i]->CheckStatus()) {
+            if (observer_) observer_->OnFinished(i, socket_address(&vecsocketfsm_[i]->Address()), vecsocketfsm_[i]->Socket(), vecsocketfsm_[i]->Error(),
+                                                 vecsocketfsm_[i]->Rtt(), vecsocketfsm_[i]->TotalRtt(), (int)(gettickcount() - starttime_));
+
+            vecsocketfsm_[i]->Close();
+            delete vecsocketfsm_[i];
+            vecsocketfsm_[i] = NULL;
+            lasterror_ = -1;
+            continue;
         }
 
-        if (sel.IsBreak()) {
-            xinfo2(TSF"sel breaker @%_", this);
+        if (TcpClientFSM::EReadWrite == vecsocketfsm_[i]->Status() && ConnectCheckFSM::ECheckOK == vecsocketfsm_[i]->CheckStatus()) {
+            if (observer_) observer_->OnFinished(i, socket_address(&vecsocketfsm_[i]->Address()), vecsocketfsm_[i]->Socket(), vecsocketfsm_[i]->Error(),
+                                                 vecsocketfsm_[i]->Rtt(), vecsocketfsm_[i]->TotalRtt(), (int)(gettickcount() - starttime_));
+
+            xinfo2(TSF"index:%_, sock:%_, suc ConnectImpatient:%_:%_, RTT:(%_, %_), @%_", i, vecsocketfsm_[i]->Socket(),
+                   vecsocketfsm_[i]->IP(), vecsocketfsm_[i]->Port(), vecsocketfsm_[i]->Rtt(), vecsocketfsm_[i]->TotalRtt(), this);
+            retsocket_ = vecsocketfsm_[i]->Socket();
+            index_ = i;
+            index_conn_rtt_ = vecsocketfsm_[i]->Rtt();
+            index_conn_totalcost_ = vecsocketfsm_[i]->TotalRtt();
+            vecsocketfsm_[i]->Socket(INVALID_SOCKET);
+            delete vecsocketfsm_[i];
+            vecsocketfsm_[i] = NULL;
             break;
         }
+    }
+}
 
-        // socket
-        for (unsigned int i = 0; i < index; ++i) {
-            if (NULL == vecsocketfsm[i]) continue;
-
-            xgroup2_define(group);
-            vecsocketfsm[i]->AfterSelect(sel, group);
-            xgroup2_if(!group.Empty(), TSF"index:%_, @%_, ", i, this) << group;
-
-            if (TcpClientFSM::EEnd == vecsocketfsm[i]->Status()) {
-                if (_observer) _observer->OnFinished(i, socket_address(&vecsocketfsm[i]->Address()), vecsocketfsm[i]->Socket(), vecsocketfsm[i]->Error(),
-                                                         vecsocketfsm[i]->Rtt(), vecsocketfsm[i]->TotalRtt(), (int)(gettickcount() - starttime));
-
-                vecsocketfsm[i]->Close();
-                delete vecsocketfsm[i];
-                vecsocketfsm[i] = NULL;
-                lasterror = -1;
-                continue;
-            }
+bool ComplexConnect::IsEnd() const {
+    if (INVALID_SOCKET != retsocket_) return true;
 
-            if (TcpClientFSM::EReadWrite == vecsocketfsm[i]->Status() && ConnectCheckFSM::ECheckFail == vecsocketfsm[i]->CheckStatus()) {
-                if (_observer) _observer->OnFinished(i, socket_address(&vecsocketfsm[i]->Address()), vecsocketfsm[i]->Socket(), vecsocketfsm[i]->Error(),
-                                                         vecsocketfsm[i]->Rtt(), vecsocketfsm[i]->TotalRtt(), (int)(gettickcount() - starttime));
+    for (unsigned int i = 0; i < vecsocketfsm_.size(); ++i) {
+        if (NULL != vecsocketfsm_[i]) return false;
+    }
 
-                vecsocketfsm[i]->Close();
-                delete vecsocketfsm[i];
-                vecsocketfsm[i] = NULL;
-                lasterror = -1;
-                continue;
-            }
+    return true;
+}
 
-            if (TcpClientFSM::EReadWrite == vecsocketfsm[i]->Status() && ConnectCheckFSM::ECheckOK == vecsocketfsm[i]->CheckStatus()) {
-                if (_observer) _observer->OnFinished(i, socket_address(&vecsocketfsm[i]->Address()), vecsocketfsm[i]->Socket(), vecsocketfsm[i]->Error(),
-                                                         vecsocketfsm[i]->Rtt(), vecsocketfsm[i]->TotalRtt(), (int)(gettickcount() - starttime));
-
-                xinfo2(TSF"index:%_, sock:%_, suc ConnectImpatient:%_:%_, RTT:(%_, %_), @%_", i, vecsocketfsm[i]->Socket(),
-                       vecsocketfsm[i]->IP(), vecsocketfsm[i]->Port(), vecsocketfsm[i]->Rtt(), vecsocketfsm[i]->TotalRtt(), this);
-                retsocket = vecsocketfsm[i]->Socket();
-                index_ = i;
-                index_conn_rtt_ = vecsocketfsm[i]->Rtt();
-                index_conn_totalcost_ = vecsocketfsm[i]->TotalRtt();
-                vecsocketfsm[i]->Socket(INVALID_SOCKET);
-                delete vecsocketfsm[i];
-                vecsocketfsm[i] = NULL;
-                break;
-            }
-        }
+SOCKET ComplexConnect::End() {
+    __CloseAll();
 
-        // end of loop
-        bool all_invalid = true;
+    SOCKET retsocket = retsocket_;
+    retsocket_ = INVALID_SOCKET;
 
-        for (unsigned int i = 0; i < vecsocketfsm.size(); ++i) {
-            if (NULL != vecsocketfsm[i]) {
-                all_invalid = false;
-                break;
-            }
-        }
+    totalcost_ = (int)(::gettickcount() - starttime_);
+    xinfo2(TSF"retsocket:%_, connrtt:%_, conntotalrtt:%_, totalcost:%_, @%_", retsocket, index_conn_rtt_, index_conn_totalcost_, totalcost_, this);
 
-        if (all_invalid || INVALID_SOCKET != retsocket) break;
-    } while (true);
+    return retsocket;
+}
 
-    for (unsigned int i = 0; i < vecsocketfsm.size(); ++i) {
-        if (NULL != vecsocketfsm[i]) {
-            vecsocketfsm[i]->Close();
-            delete vecsocketfsm[i];
-            vecsocketfsm[i] = NULL;
+void ComplexConnect::__CloseAll() {
+    for (unsigned int i = 0; i < vecsocketfsm_.size(); ++i) {
+        if (NULL != vecsocketfsm_[i]) {
+            vecsocketfsm_[i]->Close();
+            delete vecsocketfsm_[i];
+            vecsocketfsm_[i] = NULL;
         }
     }
 
-    vecsocketfsm.clear();
-
-    totalcost_ = (int)(::gettickcount() - starttime);
-    xinfo2(TSF"retsocket:%_, connrtt:%_, conntotalrtt:%_, totalcost:%_, @%_", retsocket, index_conn_rtt_, index_conn_totalcost_, totalcost_, this);
-
-    return retsocket;
+    vecsocketfsm_.clear();
 }
 
 #ifdef COMPLEX_CONNECT_NAMESPACE
@@ -27,6 +27,7 @@
 #include "unix_socket.h"
 
 class SocketSelectBreaker;
+class SocketSelect;
 class socket_address;
 class AutoBuffer;
 
@@ -34,6 +35,8 @@ class AutoBuffer;
 namespace COMPLEX_CONNECT_NAMESPACE {
 #endif
 
+class ConnectCheckFSM;
+
 class MComplexConnect {
   public:
     virtual ~MComplexConnect() {}
@@ -59,6 +62,15 @@ class ComplexConnect {
 
     SOCKET ConnectImpatient(const std::vector<socket_address>& _vecaddr, SocketSelectBreaker& _breaker, MComplexConnect* _observer = NULL);
 
+    // ConnectImpatient step by step, so one select loop can drive many of them:
+    // Begin, then PreSelect, select for Timeout() and AfterSelect until IsEnd, then End gives the socket.
+    bool   Begin(const std::vector<socket_address>& _vecaddr, MComplexConnect* _observer = NULL);
+    void   PreSelect(SocketSelect& _sel);
+    void   AfterSelect(SocketSelect& _sel);
+    int    Timeout() const { return round_timeout_;}
+    bool   IsEnd() const;
+    SOCKET End();
+
     unsigned int TryCount() const { return trycount_;}
     int Index() const { return index_;}
     int ErrorCode() const { return errcode_;}
@@ -70,6 +82,7 @@ class ComplexConnect {
   private:
     int __ConnectTime(unsigned int _index) const;
     int __ConnectTimeout(unsigned int _index) const;
+    void __CloseAll();
 
   private:
     ComplexConnect(const ComplexConnect&);
@@ -88,6 +101,15 @@ class ComplexConnect {
     int index_conn_rtt_;
     int index_conn_totalcost_;
     int totalcost_;
+
+    std::vector<ConnectCheckFSM*> vecsocketfsm_;
+    MComplexConnect* observer_;
+    uint64_t starttime_;
+    uint64_t laststart_connecttime_;
+    int lasterror_;
+    unsigned int started_;  // connects started, in the order of the addresses
+    int round_timeout_;
+    SOCKET retsocket_;
 };
 
 #ifdef COMPLEX_CONNECT_NAMESPACE
@@ -135,6 +135,10 @@ uint64_t gettickcount() {//todoyy
     return 0;
 }
 
+uint64_t clock_app_monotonic() {
+    return gettickcount();
+}
+
 #elif WINAPI_FAMILY == WINAPI_FAMILY_PHONE_APP
 
 #include "unistd.h"
@@ -0,0 +1,258 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * socketselect_benchmark.cc
+ *
+ * cost of one round of SocketSelect over many sockets, one line per backend and socket count:
+ *   socketselect_benchmark [-s count,count,...] [-a active sockets] [-r rounds]
+ * each round sets every socket for read, makes the active ones readable and checks every socket,
+ * as the loops of the network code do.
+ * poll/new is a SocketSelect made for each round, poll and epoll reuse one over the rounds.
+ * before timing it checks that epoll waits on a socket reopened on the fd of a closed one told to SocketClosed,
+ * and reports a closed fd set again as an exception. it exits 1 when it doesn't.
+ *
+ * it is a host tool and not a part of the comm library, build it from mars/comm with the sources it needs:
+ *   gcc -O2 -c -I. -I.. -I../.. time_utils.c xlogger/xloggerbase.c xlogger/loginfo_extract.c assert/__assert.c
+ *   g++ -O2 -I. -I.. -I../.. unix/socketselect/benchmark/socketselect_benchmark.cc unix/socketselect/socketselect.cc
+ *       boost_exception.cc time_utils.o xloggerbase.o loginfo_extract.o __assert.o -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "mars/comm/socket/socketselect.h"
+#include "mars/comm/xlogger/xlogger.h"
+
+extern "C" {
+intmax_t xlogger_pid() { return getpid(); }
+intmax_t xlogger_tid() { return (intmax_t)pthread_self(); }
+intmax_t xlogger_maintid() { return 0; }
+}
+
+static uint64_t __NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+enum TBackend {
+    kPollNew,
+    kPoll,
+    kEpoll,
+};
+
+static const char* const kBackendNames[] = {"poll/new", "poll", "epoll"};
+
+class Benchmark {
+  public:
+    explicit Benchmark(size_t _count) {
+        for (size_t i = 0; i < _count; ++i) {
+            int sv[2] = {-1, -1};
+            if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+                fprintf(stderr, "socketpair %lu errno:%d, raise ulimit -n\n", (unsigned long)i, errno);
+                exit(1);
+            }
+            fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL, 0) | O_NONBLOCK);
+            readers_.push_back(sv[0]);
+            writers_.push_back(sv[1]);
+        }
+    }
+
+    ~Benchmark() {
+        for (size_t i = 0; i < readers_.size(); ++i) {
+            close(readers_[i]);
+            close(writers_[i]);
+        }
+    }
+
+  public:
+#ifdef SOCKETSELECT_EPOLL
+    static bool CheckReusedFd() {
+        SocketSelectBreaker breaker;
+        SocketSelect sel(breaker, false, 1);
+
+        int old_sv[2] = {-1, -1};
+        if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, old_sv)) return false;
+        for (int round = 0; round < 2; ++round) {
+            sel.PreSelect();
+            sel.Read_FD_SET(old_sv[0]);
+            sel.Select(0);
+        }
+
+        sel.SocketClosed(old_sv[0]);
+        close(old_sv[0]);
+        int sv[2] = {-1, -1};
+        if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, sv) || old_sv[0] != sv[0]) {
+            printf("reused fd: the fd is not reused\n");
+            return false;
+        }
+
+        bool ok = 1 == write(sv[1], "x", 1);
+        sel.PreSelect();
+        sel.Read_FD_SET(sv[0]);
+        if (!ok || 0 >= sel.Select(100) || !sel.Read_FD_ISSET(sv[0])) {
+            printf("reused fd: a socket reopened on the fd is not waited on\n");
+            ok = false;
+        }
+
+        sel.SocketClosed(sv[0]);
+        close(sv[0]);
+        sel.PreSelect();
+        sel.Read_FD_SET(sv[0]);
+        if (ok && (0 >= sel.Select(100) || !sel.Exception_FD_ISSET(sv[0]))) {
+            printf("reused fd: a closed fd is not reported\n");
+            ok = false;
+        }
+
+        close(old_sv[1]);
+        close(sv[1]);
+        return ok;
+    }
+#endif
+
+    void Run(TBackend _backend, size_t _active, unsigned int _rounds) {
+        SocketSelectBreaker breaker;
+        SocketSelect reused(breaker, false, kEpoll == _backend ? 1 : 0);
+        std::vector<uint32_t> latency;
+        latency.reserve(_rounds);
+
+        unsigned int seed = 1;
+        size_t missed = 0;
+        uint64_t begin = __NowNs();
+        for (unsigned int round = 0; round < _rounds; ++round) {
+            for (size_t i = 0; i < _active; ++i) {
+                seed = seed * 1103515245 + 12345;
+                if (1 != write(writers_[(seed >> 8) % writers_.size()], "x", 1)) ++missed;
+            }
+
+            uint64_t round_begin = __NowNs();
+            if (kPollNew == _backend) {
+                SocketSelect sel(breaker, false);
+                __Round(sel);
+            } else {
+                __Round(reused);
+            }
+            uint64_t span = __NowNs() - round_begin;
+            latency.push_back(span > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)span);
+        }
+        uint64_t elapsed = __NowNs() - begin;
+
+        std::sort(latency.begin(), latency.end());
+        printf("%-9s %6lu %6lu %11.0f %9.2f %9.2f %9.2f\n", kBackendNames[_backend], (unsigned long)readers_.size(),
+               (unsigned long)_active, _rounds / (elapsed / 1e9),
+               __Percentile(latency, 0.5) / 1000.0, __Percentile(latency, 0.99) / 1000.0, latency.back() / 1000.0);
+        if (0 < missed) printf("  %lu writes missed\n", (unsigned long)missed);
+        fflush(stdout);
+    }
+
+    static void PrintHeader() {
+        printf("%-9s %6s %6s %11s %9s %9s %9s\n", "backend", "socks", "active", "rounds/s", "p50 us", "p99 us", "max us");
+    }
+
+  private:
+    void __Round(SocketSelect& _sel) {
+        _sel.PreSelect();
+        for (size_t i = 0; i < readers_.size(); ++i) {
+            _sel.Read_FD_SET(readers_[i]);
+            _sel.Exception_FD_SET(readers_[i]);
+        }
+
+        if (0 >= _sel.Select(1000)) return;
+
+        char buf[64];
+        for (size_t i = 0; i < readers_.size(); ++i) {
+            if (_sel.Exception_FD_ISSET(readers_[i])) continue;
+            if (_sel.Read_FD_ISSET(readers_[i])) {
+                while (0 < read(readers_[i], buf, sizeof(buf))) {}
+            }
+        }
+    }
+
+    template <typename T>
+    static T __Percentile(const std::vector<T>& _sorted, double _p) {
+        if (_sorted.empty()) return 0;
+        size_t index = (size_t)(_sorted.size() * _p);
+        return _sorted[std::min(index, _sorted.size() - 1)];
+    }
+
+  private:
+    std::vector<int> readers_;
+    std::vector<int> writers_;
+};
+
+int main(int argc, char* argv[]) {
+    std::vector<size_t> counts;
+    size_t active = 4;
+    unsigned int rounds = 20000;
+
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (0 == strcmp("-s", argv[i]) && has_value) {
+            for (char* count = strtok(argv[++i], ","); NULL != count; count = strtok(NULL, ",")) {
+                if (0 < atoi(count)) counts.push_back((size_t)atoi(count));
+            }
+        } else if (0 == strcmp("-a", argv[i]) && has_value) {
+            active = (size_t)atoi(argv[++i]);
+        } else if (0 == strcmp("-r", argv[i]) && has_value) {
+            rounds = (unsigned int)atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [-s count,count,...] [-a active sockets] [-r rounds]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (counts.empty()) {
+        counts.push_back(16);
+        counts.push_back(128);
+        counts.push_back(512);
+        counts.push_back(1000);
+    }
+    if (0 == active) active = 1;
+    if (0 == rounds) rounds = 1;
+
+    // two fds a socket pair.
+    struct rlimit limit;
+    if (0 == getrlimit(RLIMIT_NOFILE, &limit)) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    xlogger_SetLevel(kLevelNone);
+
+#ifdef SOCKETSELECT_EPOLL
+    if (!Benchmark::CheckReusedFd()) return 1;
+#endif
+
+    Benchmark::PrintHeader();
+    for (size_t c = 0; c < counts.size(); ++c) {
+        Benchmark benchmark(counts[c]);
+        benchmark.Run(kPollNew, active, rounds);
+        benchmark.Run(kPoll, active, rounds);
+#ifdef SOCKETSELECT_EPOLL
+        benchmark.Run(kEpoll, active, rounds);
+#endif
+    }
+
+    return 0;
+}
@@ -25,6 +25,9 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <algorithm>
+#ifdef SOCKETSELECT_EPOLL
+#include <sys/eventfd.h>
+#endif
 
 #include "mars/comm/xlogger/xlogger.h"
 
@@ -47,6 +50,19 @@ bool SocketSelectBreaker::ReCreate() {
     pipes_[0] = -1;
     pipes_[1] = -1;
 
+#ifdef SOCKETSELECT_EPOLL
+    // a counter instead of a pipe, one fd and no buffer to fill.
+    int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    xassert2(-1 != efd, "eventfd errno=%d", errno);
+
+    if (-1 == efd) {
+        create_success_ = false;
+        return create_success_;
+    }
+
+    pipes_[0] = efd;
+    pipes_[1] = efd;
+#else
     int Ret;
     Ret = pipe(pipes_);
     xassert2(-1 != Ret, "pipe errno=%d", errno);
@@ -85,6 +101,7 @@ bool SocketSelectBreaker::ReCreate() {
         create_success_ = false;
         return create_success_;
     }
+#endif
 
     create_success_ = true;
     return create_success_;
@@ -95,11 +112,18 @@ bool SocketSelectBreaker::Break() {
 
     if (broken_) return true;
 
+#ifdef SOCKETSELECT_EPOLL
+    uint64_t dummy = 1;
+    int ret = (int)write(pipes_[1], &dummy, sizeof(dummy));
+    int len = (int)sizeof(dummy);
+#else
     char dummy[] = "1";
     int ret = (int)write(pipes_[1], dummy, strlen(dummy));
+    int len = (int)strlen(dummy);
+#endif
     broken_ = true;
 
-    if (ret < 0 || ret != (int)strlen(dummy))
+    if (ret < 0 || ret != len)
     {
         xerror2(TSF"Ret:%_, errno:(%_, %_)", ret, errno, strerror(errno));
         broken_ =  false;
@@ -110,8 +134,13 @@ bool SocketSelectBreaker::Break() {
 
 bool SocketSelectBreaker::Clear() {
     ScopedLock lock(mutex_);
+#ifdef SOCKETSELECT_EPOLL
+    uint64_t dummy = 0;
+    int ret = (int)read(pipes_[0], &dummy, sizeof(dummy));
+#else
     char dummy[128];
     int ret = (int)read(pipes_[0], dummy, sizeof(dummy));
+#endif
 
     if (ret < 0) {
         xverbose2(TSF"Ret=%0", ret);
@@ -124,10 +153,12 @@ bool SocketSelectBreaker::Clear() {
 
 void SocketSelectBreaker::Close() {
     broken_ =  true;
-    if (pipes_[1] >= 0)
+    if (pipes_[1] >= 0 && pipes_[1] != pipes_[0])
         close(pipes_[1]);
     if (pipes_[0] >= 0)
         close(pipes_[0]);
+    pipes_[0] = -1;
+    pipes_[1] = -1;
 }
 
 int SocketSelectBreaker::BreakerFD() const {
@@ -302,20 +333,28 @@ int SocketSelect::Errno() const
 
 #else
 
-SocketSelect::SocketSelect(SocketSelectBreaker& _breaker, bool _autoclear)
-: breaker_(_breaker), ret_(0), errno_(0), autoclear_(_autoclear)
+SocketSelect::SocketSelect(SocketSelectBreaker& _breaker, bool _autoclear, size_t _epoll_threshold)
+: breaker_(_breaker), ret_(0), errno_(0), autoclear_(_autoclear), duplicate_fd_(false), rounds_(0)
+#ifdef SOCKETSELECT_EPOLL
+, epoll_threshold_(_epoll_threshold), epfd_(-1)
+#endif
 {}
 
-SocketSelect::~SocketSelect() {}
+SocketSelect::~SocketSelect() {
+#ifdef SOCKETSELECT_EPOLL
+    __EpollClose();
+#endif
+}
 
 void SocketSelect::PreSelect() {
+    for (size_t i = 0; i < vfds_.size(); ++i) {
+        if (0 <= vfds_[i].fd && (size_t)vfds_[i].fd < fd_index_.size()) fd_index_[vfds_[i].fd] = 0;
+    }
     vfds_.clear();
+    duplicate_fd_ = false;
+    ++rounds_;
 
-    int fd = breaker_.BreakerFD();
-    struct pollfd fditem = {0};
-    fditem.fd = fd;
-    fditem.events = POLLIN|POLLPRI|POLLERR;
-    vfds_.push_back(fditem);
+    __FdSet(breaker_.BreakerFD(), POLLIN|POLLPRI|POLLERR);
 
     ret_ = 0;
     errno_ = 0;
@@ -329,6 +368,14 @@ void SocketSelect::Consign(SocketSelect& _consignor) {
     vfds_.push_back(fditem);
     
     vfds_.insert(vfds_.end(), _consignor.vfds_.begin(), _consignor.vfds_.end());
+
+    for (size_t i = vfds_.size() - _consignor.vfds_.size() - 1; i < vfds_.size(); ++i) {
+        int sock = vfds_[i].fd;
+        if (0 > sock) continue;
+        if ((size_t)sock >= fd_index_.size()) fd_index_.resize(sock + 1, 0);
+        if (0 != fd_index_[sock]) duplicate_fd_ = true;
+        else fd_index_[sock] = i + 1;
+    }
 }
 
 int SocketSelect::Select() {
@@ -336,6 +383,19 @@ int SocketSelect::Select() {
 }
 
 int SocketSelect::Select(int _msec) {
+#ifdef SOCKETSELECT_EPOLL
+    if (0 < epoll_threshold_ && 1 < rounds_ && vfds_.size() >= epoll_threshold_ && !duplicate_fd_) {
+        ret_ = __EpollSelect(_msec);
+        if (0 > ret_) { errno_ = errno; }
+
+        if (autoclear_) Breaker().Clear();
+
+        return ret_;
+    }
+    // the kernel set is only kept in step while it is used.
+    __EpollClose();
+#endif
+
     ret_ = poll(&vfds_[0], (nfds_t)vfds_.size(), _msec);
     if (0 > ret_) { errno_ = errno; }
     
@@ -344,6 +404,97 @@ int SocketSelect::Select(int _msec) {
     return ret_;
 }
 
+#ifdef SOCKETSELECT_EPOLL
+// brings epfd_ to the sockets of this round, sockets with unchanged events cost nothing.
+bool SocketSelect::__EpollSync() {
+    if (0 > epfd_) {
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (0 > epfd_) {
+            xerror2(TSF"epoll_create1 errno:(%_, %_)", errno, strerror(errno));
+            return false;
+        }
+    }
+
+    // the sockets of the last round which are not set any more.
+    for (size_t i = 0; i < registered_fds_.size(); ++i) {
+        int fd = registered_fds_[i];
+        if ((size_t)fd < fd_index_.size() && 0 != fd_index_[fd]) continue;
+
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, NULL);
+        registered_[fd] = 0;
+    }
+    registered_fds_.clear();
+
+    for (size_t i = 0; i < vfds_.size(); ++i) {
+        struct pollfd& item = vfds_[i];
+        item.revents = 0;
+        if (0 > item.fd) continue;
+
+        if ((size_t)item.fd >= registered_.size()) registered_.resize(item.fd + 1, 0);
+        uint32_t& registered = registered_[item.fd];
+        uint32_t events = (uint32_t)(unsigned short)item.events;
+
+        if (registered != events) {
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = events;
+            ev.data.fd = item.fd;
+
+            int ret = epoll_ctl(epfd_, 0 == registered ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, item.fd, &ev);
+            // the kernel drops a closed fd by itself, and a new one may take its number.
+            if (0 > ret && ENOENT == errno) ret = epoll_ctl(epfd_, EPOLL_CTL_ADD, item.fd, &ev);
+            else if (0 > ret && EEXIST == errno) ret = epoll_ctl(epfd_, EPOLL_CTL_MOD, item.fd, &ev);
+
+            if (0 > ret) {
+                // like poll, a bad fd is reported and not waited on.
+                registered = 0;
+                item.revents = POLLNVAL;
+                continue;
+            }
+            registered = events;
+        }
+        registered_fds_.push_back(item.fd);
+    }
+
+    return true;
+}
+
+int SocketSelect::__EpollSelect(int _msec) {
+    if (!__EpollSync()) {
+        __EpollClose();
+        return poll(&vfds_[0], (nfds_t)vfds_.size(), _msec);
+    }
+
+    int invalid_count = 0;
+    for (size_t i = 0; i < vfds_.size(); ++i) {
+        if (0 != vfds_[i].revents) ++invalid_count;
+    }
+
+    events_.resize(registered_fds_.size() + 1);
+    int count = epoll_wait(epfd_, &events_[0], (int)events_.size(), 0 < invalid_count ? 0 : _msec);
+    if (0 > count) return count;
+
+    for (int i = 0; i < count; ++i) {
+        int fd = events_[i].data.fd;
+        if ((size_t)fd >= fd_index_.size() || 0 == fd_index_[fd]) continue;
+
+        struct pollfd& item = vfds_[fd_index_[fd] - 1];
+        item.revents = (short)(events_[i].events & ((unsigned short)item.events | POLLERR | POLLHUP));
+    }
+
+    return count + invalid_count;
+}
+
+void SocketSelect::__EpollClose() {
+    if (0 > epfd_) return;
+
+    close(epfd_);
+    epfd_ = -1;
+    registered_.clear();
+    registered_fds_.clear();
+}
+#endif
+
 bool SocketSelect::Report(SocketSelect& _consignor, int64_t _timeout) {
     int event_count = _consignor.Breaker().IsBreak()? 1:0;
     for (auto& x: vfds_) {
@@ -380,76 +531,57 @@ bool SocketSelect::Report(SocketSelect& _consignor, int64_t _timeout) {
     return false;
 }
 
-void SocketSelect::Read_FD_SET(int _socket) {
-    for (size_t i = 0; i < vfds_.size(); i++){
-        if (vfds_[i].fd == _socket){
-            vfds_[i].events |= POLLIN|POLLERR;
-            return;
-        }
+// a socket is looked up by fd_index_, hundreds of them no longer cost a scan each.
+void SocketSelect::__FdSet(int _socket, short _events) {
+    if (0 <= _socket && (size_t)_socket < fd_index_.size() && 0 != fd_index_[_socket]) {
+        vfds_[fd_index_[_socket] - 1].events |= _events;
+        return;
     }
 
     struct pollfd fditem = {0};
     fditem.fd = _socket;
-    fditem.events = POLLIN|POLLERR;
-
+    fditem.events = _events;
     vfds_.push_back(fditem);
+
+    if (0 > _socket) return;
+    if ((size_t)_socket >= fd_index_.size()) fd_index_.resize(_socket + 1, 0);
+    fd_index_[_socket] = vfds_.size();
 }
 
-void SocketSelect::Write_FD_SET(int _socket) {
+const struct pollfd* SocketSelect::__Find(int _socket) const {
+    if (0 <= _socket && (size_t)_socket < fd_index_.size() && 0 != fd_index_[_socket]) return &vfds_[fd_index_[_socket] - 1];
+
     for (size_t i = 0; i < vfds_.size(); i++){
-        if (vfds_[i].fd == _socket){
-            vfds_[i].events |= POLLOUT|POLLERR;
-            return;
-        }
+        if (vfds_[i].fd == _socket) return &vfds_[i];
     }
+    return NULL;
+}
 
-    struct pollfd fditem = {0};
-    fditem.fd = _socket;
-    fditem.events = POLLOUT|POLLERR;
+void SocketSelect::Read_FD_SET(int _socket) {
+    __FdSet(_socket, POLLIN|POLLERR);
+}
 
-    vfds_.push_back(fditem);
+void SocketSelect::Write_FD_SET(int _socket) {
+    __FdSet(_socket, POLLOUT|POLLERR);
 }
 
 void SocketSelect::Exception_FD_SET(int _socket) {
-    for (size_t i = 0; i < vfds_.size(); i++){
-        if (vfds_[i].fd == _socket){
-            vfds_[i].events |= POLLERR;
-            return;
-        }
-    }
-
-    struct pollfd fditem = {0};
-    fditem.fd = _socket;
-    fditem.events = POLLERR;
-
-    vfds_.push_back(fditem);
+    __FdSet(_socket, POLLERR);
 }
 
 int SocketSelect::Read_FD_ISSET(int _socket) const {
-    for (size_t i = 0; i < vfds_.size(); i++){
-        if (vfds_[i].fd == _socket)
-            return vfds_[i].revents & (POLLIN|POLLHUP);
-    }
-
-    return 0;
+    const struct pollfd* item = __Find(_socket);
+    return NULL == item ? 0 : item->revents & (POLLIN|POLLHUP);
 }
 
 int SocketSelect::Write_FD_ISSET(int _socket) const {
-    for (size_t i = 0; i < vfds_.size(); i++){
-        if (vfds_[i].fd == _socket)
-            return vfds_[i].revents & (POLLOUT);
-    }
-
-    return 0;
+    const struct pollfd* item = __Find(_socket);
+    return NULL == item ? 0 : item->revents & (POLLOUT);
 }
 
 int SocketSelect::Exception_FD_ISSET(int _socket) const {
-    for (size_t i = 0; i < vfds_.size(); i++){
-        if (vfds_[i].fd == _socket)
-            return vfds_[i].revents & (POLLERR|POLLNVAL);
-    }
-
-    return 0;
+    const struct pollfd* item = __Find(_socket);
+    return NULL == item ? 0 : item->revents & (POLLERR|POLLNVAL);
 }
 
 bool SocketSelect::IsException() const {
@@ -458,20 +590,24 @@ bool SocketSelect::IsException() const {
 }
 
 bool SocketSelect::IsBreak() const {
-    int breakfd = breaker_.BreakerFD();
-
-    for (size_t i = 0; i < vfds_.size(); i++){
-        if (vfds_[i].fd == breakfd)
-            return vfds_[i].revents & POLLIN;
-    }
-
-    return 0;
+    const struct pollfd* item = __Find(breaker_.BreakerFD());
+    return NULL == item ? 0 : item->revents & POLLIN;
 }
 
 SocketSelectBreaker& SocketSelect::Breaker() {
     return breaker_;
 }
 
+void SocketSelect::SocketClosed(int _socket) {
+#ifdef SOCKETSELECT_EPOLL
+    if (0 > epfd_ || 0 > _socket || (size_t)_socket >= registered_.size() || 0 == registered_[_socket]) return;
+
+    // fails once the socket is closed, the kernel has dropped it already.
+    epoll_ctl(epfd_, EPOLL_CTL_DEL, _socket, NULL);
+    registered_[_socket] = 0;
+#endif
+}
+
 int SocketSelect::Errno() const {
     return errno_;
 }
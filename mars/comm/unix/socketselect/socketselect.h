@@ -26,6 +26,13 @@
 #include <poll.h>
 #include <vector>
 
+// a select object reused round after round with many sockets can wait on epoll on linux and android,
+// see the _epoll_threshold of SocketSelect. define NO_SOCKETSELECT_EPOLL to leave it out.
+#if defined(__linux__) && !defined(NO_SOCKETSELECT_EPOLL)
+#define SOCKETSELECT_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #if __APPLE__
 #import <TargetConditionals.h>
 #if TARGET_OS_MAC
@@ -56,7 +63,7 @@ class SocketSelectBreaker {
     SocketSelectBreaker& operator=(const SocketSelectBreaker&);
 
   private:
-    int pipes_[2];
+    int pipes_[2];      // both ends are the same eventfd with epoll
     bool create_success_;
     bool broken_;
     Mutex mutex_;
@@ -105,7 +112,14 @@ class SocketSelect {
 #else
 class SocketSelect {
   public:
-    SocketSelect(SocketSelectBreaker& _breaker, bool _autoclear = false);
+    /*
+     * with _epoll_threshold, an object that has been selected before and watches at least that many sockets
+     * waits on epoll, and only the sockets whose events changed since the last round are passed to the kernel.
+     * 0, the default, always polls. the kernel forgets a closed socket by itself, so with epoll a socket set
+     * in an earlier round has to be told to SocketClosed when it is closed, or a new socket on the same fd
+     * would not be waited on and a closed fd set again would not be reported as invalid.
+     */
+    SocketSelect(SocketSelectBreaker& _breaker, bool _autoclear = false, size_t _epoll_threshold = 0);
     ~SocketSelect();
 
     void PreSelect();
@@ -129,10 +143,21 @@ class SocketSelect {
 
     SocketSelectBreaker& Breaker();
 
+    // _socket is about to be closed or has been closed, its fd is registered again when it is set next.
+    void SocketClosed(int _socket);
+
   private:
     SocketSelect(const SocketSelect&);
     SocketSelect& operator=(const SocketSelect&);
 
+    void __FdSet(int _socket, short _events);
+    const struct pollfd* __Find(int _socket) const;
+#ifdef SOCKETSELECT_EPOLL
+    bool __EpollSync();
+    int  __EpollSelect(int _msec);
+    void __EpollClose();
+#endif
+
   protected:
     SocketSelectBreaker&       breaker_;
     std::vector<struct pollfd> vfds_;
@@ -140,6 +165,18 @@ class SocketSelect {
     int         ret_;
     int         errno_;
     const bool  autoclear_;
+
+  private:
+    std::vector<size_t> fd_index_;      // fd -> 1 + its index in vfds_, 0 for none
+    bool        duplicate_fd_;          // Consign may bring a fd twice
+    unsigned int rounds_;
+#ifdef SOCKETSELECT_EPOLL
+    const size_t epoll_threshold_;
+    int         epfd_;
+    std::vector<uint32_t> registered_;  // fd -> the events of it in epfd_
+    std::vector<int> registered_fds_;
+    std::vector<struct epoll_event> events_;
+#endif
 };
 
 #endif
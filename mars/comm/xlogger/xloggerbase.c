@@ -6,14 +6,22 @@
 
 #include "comm/xlogger/xloggerbase.h"
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
 
 #include "comm/compiler_util.h"
 
 WEAK_FUNC  TLogLevel   __xlogger_Level_impl();
 WEAK_FUNC  void        __xlogger_SetLevel_impl(TLogLevel _level);
 WEAK_FUNC  int         __xlogger_IsEnabledFor_impl(TLogLevel _level);
+WEAK_FUNC  void        __xlogger_SetFilterLevel_impl(int _is_file, const char* _pattern, TLogLevel _level);
+WEAK_FUNC  void        __xlogger_ClearFilterLevels_impl();
+WEAK_FUNC  TLogLevel   __xlogger_FilterLevel_impl(const char* _tag, const char* _file);
+WEAK_FUNC  TLogLevel   __xlogger_UpdateFilterCache_impl(XLoggerFilterCache* _cache, const char* _tag, const char* _file);
 WEAK_FUNC xlogger_appender_t __xlogger_SetAppender_impl(xlogger_appender_t _appender);
 WEAK_FUNC void __xlogger_Write_impl(const XLoggerInfo* _info, const char* _log);
+WEAK_FUNC xlogger_deferred_appender_t __xlogger_SetDeferredAppender_impl(xlogger_deferred_appender_t _appender);
+WEAK_FUNC void __xlogger_WriteDeferred_impl(TLogLevel _level, XLoggerCallSite* _callsite, const void* _args, size_t _len);
 WEAK_FUNC void __xlogger_VPrint_impl(const XLoggerInfo* _info, const char* _format, va_list _list);
 
 WEAK_FUNC void __xlogger_AssertP_impl(const XLoggerInfo* _info, const char* _expression, const char* _format, va_list _list);
@@ -39,6 +47,35 @@ int  xlogger_IsEnabledFor(TLogLevel _level) {
 
 }
 
+void xlogger_SetTagLevel(const char* _tag_prefix, TLogLevel _level) {
+    if (NULL != &__xlogger_SetFilterLevel_impl)
+        __xlogger_SetFilterLevel_impl(0, _tag_prefix, _level);
+}
+
+void xlogger_SetFileLevel(const char* _file_pattern, TLogLevel _level) {
+    if (NULL != &__xlogger_SetFilterLevel_impl)
+        __xlogger_SetFilterLevel_impl(1, _file_pattern, _level);
+}
+
+void xlogger_ClearFilterLevels() {
+    if (NULL != &__xlogger_ClearFilterLevels_impl)
+        __xlogger_ClearFilterLevels_impl();
+}
+
+TLogLevel xlogger_FilterLevel(const char* _tag, const char* _file) {
+    if (NULL == &__xlogger_FilterLevel_impl)  return kLevelNone;
+    return __xlogger_FilterLevel_impl(_tag, _file);
+}
+
+int  xlogger_IsEnabledForTag(TLogLevel _level, const char* _tag, const char* _file) {
+    return xlogger_FilterLevel(_tag, _file) <= _level;
+}
+
+TLogLevel xlogger_UpdateFilterCache(XLoggerFilterCache* _cache, const char* _tag, const char* _file) {
+    if (NULL == &__xlogger_UpdateFilterCache_impl)  return kLevelNone;
+    return __xlogger_UpdateFilterCache_impl(_cache, _tag, _file);
+}
+
 xlogger_appender_t xlogger_SetAppender(xlogger_appender_t _appender) {
     if (NULL == &__xlogger_SetAppender_impl) { return NULL;}
     return __xlogger_SetAppender_impl(_appender);
@@ -49,6 +86,16 @@ void xlogger_Write(const XLoggerInfo* _info, const char* _log) {
 		__xlogger_Write_impl(_info, _log);
 }
 
+xlogger_deferred_appender_t xlogger_SetDeferredAppender(xlogger_deferred_appender_t _appender) {
+    if (NULL == &__xlogger_SetDeferredAppender_impl) { return NULL;}
+    return __xlogger_SetDeferredAppender_impl(_appender);
+}
+
+void xlogger_WriteDeferred(TLogLevel _level, XLoggerCallSite* _callsite, const void* _args, size_t _len) {
+	if (NULL != &__xlogger_WriteDeferred_impl)
+		__xlogger_WriteDeferred_impl(_level, _callsite, _args, _len);
+}
+
 void xlogger_VPrint(const XLoggerInfo* _info, const char* _format, va_list _list) {
 	if (NULL != &__xlogger_VPrint_impl)
 		__xlogger_VPrint_impl(_info, _format, _list);
@@ -82,10 +129,132 @@ void xlogger_Assert(const XLoggerInfo* _info, const char* _expression, const cha
 #ifndef USING_XLOG_WEAK_FUNC
 static TLogLevel gs_level = kLevelNone;
 static xlogger_appender_t gs_appender = NULL;
+static xlogger_deferred_appender_t gs_deferred_appender = NULL;
+
+#if defined(__GNUC__)
+#define XLOGGER_MEMORY_BARRIER()    __sync_synchronize()
+#elif defined(_MSC_VER)
+#include <windows.h>
+#define XLOGGER_MEMORY_BARRIER()    MemoryBarrier()
+#else
+#define XLOGGER_MEMORY_BARRIER()
+#endif
+
+#define XLOGGER_FILTER_MAX_RULES    (32)
+#define XLOGGER_FILTER_MAX_PATTERN  (64)
+#define XLOGGER_FILTER_GENERATION_MASK  (0x1FFFFFFF)    // the low 3 bits of a cache state hold the level
+
+typedef struct XLoggerFilterRule_t {
+    int is_file;
+    char pattern[XLOGGER_FILTER_MAX_PATTERN];
+    size_t len;
+    TLogLevel level;
+} XLoggerFilterRule;
+
+/*
+ * rules are changed rarely, by the thread that configures the log, and read by every thread on a cache miss.
+ * a reader loads the generation before the rules, so a decision made from rules being changed is cached
+ * with a stale generation and made again on the next call.
+ */
+static XLoggerFilterRule gs_filter_rules[XLOGGER_FILTER_MAX_RULES];
+static volatile int gs_filter_rule_count = 0;
+static volatile TLogLevel gs_filter_min_level = kLevelNone;    // lowest level of the rules
+volatile uint32_t xlogger_filter_generation = 1;
+
+static void __xlogger_filter_changed() {
+    TLogLevel min_level = kLevelNone;
+    int i;
+    for (i = 0; i < gs_filter_rule_count; ++i) {
+        if (gs_filter_rules[i].level < min_level) min_level = gs_filter_rules[i].level;
+    }
+    gs_filter_min_level = min_level;
+
+    XLOGGER_MEMORY_BARRIER();
+    uint32_t generation = (xlogger_filter_generation + 1) & XLOGGER_FILTER_GENERATION_MASK;
+    xlogger_filter_generation = 0 == generation ? 1 : generation;
+}
+
+static int __xlogger_tag_match(const XLoggerFilterRule* _rule, const char* _tag) {
+    if (0 != strncmp(_tag, _rule->pattern, _rule->len)) return 0;
+
+    // "mars::stn" stops at a separator of the tag, "mars::" ends with one itself.
+    char next = _tag[_rule->len];
+    return '\0' == next || !isalnum((unsigned char)next) || !isalnum((unsigned char)_rule->pattern[_rule->len - 1]);
+}
+
+static int __xlogger_file_match(const XLoggerFilterRule* _rule, const char* _file) {
+    const char* pos = _file;
+    while (NULL != (pos = strstr(pos, _rule->pattern))) {
+        if (pos == _file || '/' == pos[-1] || '\\' == pos[-1]) return 1;
+        ++pos;
+    }
+    return 0;
+}
 
 TLogLevel   __xlogger_Level_impl() {return gs_level;}
-void        __xlogger_SetLevel_impl(TLogLevel _level){ gs_level = _level;}
-int         __xlogger_IsEnabledFor_impl(TLogLevel _level) {return gs_level <= _level;}
+void        __xlogger_SetLevel_impl(TLogLevel _level){ gs_level = _level; __xlogger_filter_changed();}
+int         __xlogger_IsEnabledFor_impl(TLogLevel _level) {return gs_level <= _level || gs_filter_min_level <= _level;}
+
+void __xlogger_SetFilterLevel_impl(int _is_file, const char* _pattern, TLogLevel _level) {
+    if (NULL == _pattern || '\0' == _pattern[0] || strlen(_pattern) >= XLOGGER_FILTER_MAX_PATTERN) return;
+
+    int i;
+    for (i = 0; i < gs_filter_rule_count; ++i) {
+        if (gs_filter_rules[i].is_file == _is_file && 0 == strcmp(gs_filter_rules[i].pattern, _pattern)) break;
+    }
+
+    if (i == gs_filter_rule_count) {
+        if (XLOGGER_FILTER_MAX_RULES == i) return;
+
+        XLoggerFilterRule* rule = &gs_filter_rules[i];
+        rule->is_file = _is_file;
+        strcpy(rule->pattern, _pattern);
+        rule->len = strlen(_pattern);
+        rule->level = _level;
+
+        XLOGGER_MEMORY_BARRIER();
+        gs_filter_rule_count = i + 1;
+    } else {
+        gs_filter_rules[i].level = _level;
+    }
+
+    __xlogger_filter_changed();
+}
+
+void __xlogger_ClearFilterLevels_impl() {
+    gs_filter_rule_count = 0;
+    __xlogger_filter_changed();
+}
+
+TLogLevel __xlogger_FilterLevel_impl(const char* _tag, const char* _file) {
+    const XLoggerFilterRule* tag_rule = NULL;
+    const XLoggerFilterRule* file_rule = NULL;
+    int count = gs_filter_rule_count;
+    int i;
+
+    XLOGGER_MEMORY_BARRIER();
+    for (i = 0; i < count; ++i) {
+        const XLoggerFilterRule* rule = &gs_filter_rules[i];
+        if (rule->is_file) {
+            if (NULL != _file && (NULL == file_rule || file_rule->len < rule->len) && __xlogger_file_match(rule, _file)) file_rule = rule;
+        } else {
+            if (NULL != _tag && (NULL == tag_rule || tag_rule->len < rule->len) && __xlogger_tag_match(rule, _tag)) tag_rule = rule;
+        }
+    }
+
+    if (NULL != file_rule) return file_rule->level;
+    if (NULL != tag_rule) return tag_rule->level;
+    return gs_level;
+}
+
+TLogLevel __xlogger_UpdateFilterCache_impl(XLoggerFilterCache* _cache, const char* _tag, const char* _file) {
+    uint32_t generation = xlogger_filter_generation;
+    XLOGGER_MEMORY_BARRIER();
+
+    TLogLevel level = __xlogger_FilterLevel_impl(_tag, _file);
+    if (NULL != _cache) _cache->state = (generation << 3) | (uint32_t)level;
+    return level;
+}
 
 xlogger_appender_t __xlogger_SetAppender_impl(xlogger_appender_t _appender)  {
     xlogger_appender_t old_appender = gs_appender;
@@ -93,6 +262,17 @@ xlogger_appender_t __xlogger_SetAppender_impl(xlogger_appender_t _appender)  {
     return old_appender;
 }
 
+xlogger_deferred_appender_t __xlogger_SetDeferredAppender_impl(xlogger_deferred_appender_t _appender)  {
+    xlogger_deferred_appender_t old_appender = gs_deferred_appender;
+    gs_deferred_appender = _appender;
+    return old_appender;
+}
+
+void __xlogger_WriteDeferred_impl(TLogLevel _level, XLoggerCallSite* _callsite, const void* _args, size_t _len) {
+    if (!gs_deferred_appender || NULL == _callsite) return;
+    gs_deferred_appender(_level, _callsite, _args, _len);
+}
+
 void __xlogger_Write_impl(const XLoggerInfo* _info, const char* _log) {
     
     if (!gs_appender) return;
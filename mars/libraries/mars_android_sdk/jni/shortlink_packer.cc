@@ -20,7 +20,7 @@ void shortlink_pack(const std::string& _url, const std::map<std::string, std::st
 	req_builder.Fields().HeaderFiled(HeaderFields::KStringUserAgent, HeaderFields::KStringMicroMessenger);
 	req_builder.Fields().HeaderFiled(HeaderFields::MakeCacheControlNoCache());
 	req_builder.Fields().HeaderFiled(HeaderFields::MakeContentTypeOctetStream());
-	req_builder.Fields().HeaderFiled(HeaderFields::MakeConnectionClose());
+	if (_headers.end() == _headers.find(HeaderFields::KStringConnection)) req_builder.Fields().HeaderFiled(HeaderFields::MakeConnectionClose());
 
     char len_str[32] = {0};
 	snprintf(len_str, sizeof(len_str), "%u", (unsigned int)_body.Length());
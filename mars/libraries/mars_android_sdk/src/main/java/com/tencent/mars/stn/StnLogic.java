@@ -62,6 +62,8 @@ public class StnLogic {
             this.retryCount = -1;
             this.serverProcessCost = 0;
             this.totalTimeout = 0;
+            this.shortLinkAcceptEncoding = false;
+            this.shortLinkCompressBody = false;
             this.userContext = null;
         }
 
@@ -84,6 +86,8 @@ public class StnLogic {
         public int retryCount = -1;
         public int serverProcessCost;   //该TASK等待SVR处理的最长时间,也即预计的SVR处理耗时
         public int totalTimeout;    	//total timeout, in ms
+        public boolean shortLinkAcceptEncoding;     //ask for a gzip or deflate response body
+        public boolean shortLinkCompressBody;       //gzip the request body, only for a cgi that takes it
         public Object userContext;      //user context
         public String reportArg;
     }
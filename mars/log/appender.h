@@ -21,6 +21,7 @@
 #ifndef APPENDER_H_
 #define APPENDER_H_
 
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -30,8 +31,35 @@ enum TAppenderMode
     kAppednerSync,
 };
 
-void appender_open(TAppenderMode _mode, const char* _dir, const char* _nameprefix);
-void appender_open_with_cache(TAppenderMode _mode, const std::string& _cachedir, const std::string& _logdir, const char* _nameprefix);
+enum TCompressMode
+{
+    kCompressZlib,
+    kCompressZstd,  // only available when built with XLOG_USE_ZSTD
+};
+
+// what an async mode writer does with a line when the log buffer is full.
+enum TBackpressurePolicy
+{
+    kBackpressureDropNewest,    // the line is dropped
+    kBackpressureBlock,         // the writer waits for a flush up to _block_timeout ms, then the line is dropped
+    kBackpressureSpill,         // the line is written to <prefix>_<date>.spill.xlog, the writer waits for the file
+};
+
+struct XLogBackpressureStat
+{
+    uint64_t dropped_lines;
+    uint64_t dropped_bytes;
+    uint64_t blocked_lines;
+    uint64_t blocked_ms;
+    uint64_t block_timeouts;
+    uint64_t spilled_lines;
+    uint64_t spilled_bytes;
+};
+
+void appender_open(TAppenderMode _mode, const char* _dir, const char* _nameprefix,
+                   TBackpressurePolicy _policy = kBackpressureDropNewest, unsigned int _block_timeout = 100);
+void appender_open_with_cache(TAppenderMode _mode, const std::string& _cachedir, const std::string& _logdir, const char* _nameprefix,
+                              TBackpressurePolicy _policy = kBackpressureDropNewest, unsigned int _block_timeout = 100);
 void appender_flush();
 void appender_flush_sync();
 void appender_close();
@@ -40,6 +68,21 @@ bool appender_getfilepath_from_timespan(int _timespan, const char* _prefix, std:
 bool appender_get_current_log_path(char* _log_path, unsigned int _len);
 bool appender_get_current_log_cache_path(char* _logPath, unsigned int _len);
 void appender_set_console_log(bool _is_open);
+// async mode only: every thread formats into its own lock-free ring, the async thread drains them into the log buffer.
+void appender_set_thread_staging(bool _is_open);
+// async mode only: takes effect from the next log block. _flush_every_line false trades crash safety of the latest lines for ratio.
+bool appender_set_compress(TCompressMode _mode, int _level, bool _flush_every_line);
+// counters since the process started, to size the buffer from production data.
+void appender_get_backpressure_stat(XLogBackpressureStat& _stat);
+// every log statement, told apart by file and line, may log _lines_per_sec with bursts of _burst lines,
+// every _sample_interval-th line over the limit still goes, 0 for none. a summary of suppressed lines is logged every minute.
+// fatal lines are never limited, _lines_per_sec 0 turns it off which is the default.
+void appender_set_rate_limit(unsigned int _lines_per_sec, unsigned int _burst, unsigned int _sample_interval);
+
+// async mode only: called on the flushing thread after a log block is written to file,
+// with the time spent from the start of the flush and the length of the block. NULL to remove it.
+typedef void (*appender_flush_observer_t)(uint64_t _elapsed_us, size_t _len);
+void appender_set_flush_observer(appender_flush_observer_t _observer);
 
 
 #endif /* APPENDER_H_ */
@@ -0,0 +1,341 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * xlog_benchmark.cc
+ *
+ * throughput and latency of the appender, one line per scenario of mode, compression, line size and threads:
+ *   xlog_benchmark [-t max threads] [-n lines per thread] [-s size,size,...] [-m async|sync|all]
+ *                  [-c off|zlib|zstd|all] [-r] [-d dir]
+ * threads run 1, 2, 4 ... up to max threads. compression off is zlib level 0, the log buffer always deflates.
+ * -r turns on the per-thread staging rings. lines/s and bytes/s count the time until the last block is on disk,
+ * latency is of one xinfo2 call on the caller, flush is one block written by the async thread.
+ * lines dropped by a full log buffer are counted, a scenario with drops measures the drop path.
+ *
+ * it is a host tool and not a part of the log library, build it from mars/log with the sources of the library:
+ *   gcc -O2 -c -I. -I.. -I../.. -I../comm ../comm/time_utils.c ../comm/xlogger/xloggerbase.c
+ *       ../comm/xlogger/loginfo_extract.c ../comm/assert/__assert.c
+ *   g++ -O2 -I. -I.. -I../.. -I../comm benchmark/xlog_benchmark.cc src/appender.cc src/formater.cc
+ *       src/log_buffer.cc src/log_compress.cc src/log_index.cc src/log_rate_limiter.cc src/log_record.cc
+ *       src/log_staging_ring.cc crypt/log_crypt.cc ../comm/autobuffer.cc ../comm/ptrbuffer.cc ../comm/mmap_util.cc
+ *       ../comm/strutil.cc ../comm/tickcount.cc ../comm/boost_exception.cc
+ *       ../boost/libs/filesystem/src/codecvt_error_category.cpp ../boost/libs/filesystem/src/operations.cpp
+ *       ../boost/libs/filesystem/src/path.cpp ../boost/libs/filesystem/src/path_traits.cpp
+ *       ../boost/libs/filesystem/src/portability.cpp ../boost/libs/filesystem/src/unique_path.cpp
+ *       ../boost/libs/filesystem/src/utf8_codecvt_facet.cpp ../boost/libs/iostreams/src/mapped_file.cpp
+ *       ../boost/libs/system/src/error_code.cpp time_utils.o xloggerbase.o loginfo_extract.o __assert.o -lz -lpthread
+ * and -DXLOG_USE_ZSTD -lzstd on the g++ line for zstd.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "boost/bind.hpp"
+#include "boost/filesystem.hpp"
+
+#include "mars/comm/thread/thread.h"
+#include "mars/comm/thread/lock.h"
+#include "mars/comm/thread/condition.h"
+#include "mars/comm/xlogger/xlogger.h"
+#include "log/appender.h"
+
+// the appender wants the thread info and the console of the platform, the console is never opened here.
+extern "C" {
+intmax_t xlogger_pid() { return getpid(); }
+intmax_t xlogger_tid() { return (intmax_t)pthread_self(); }
+intmax_t xlogger_maintid() { return 0; }
+}
+
+void ConsoleLog(const XLoggerInfo*, const char*) {}
+
+struct Scenario {
+    TAppenderMode mode;
+    const char* compress_name;
+    TCompressMode compress;
+    int level;
+    size_t line_size;
+    unsigned int threads;
+};
+
+static uint64_t __NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// log text is words of a small vocabulary, so it compresses about as well as real logs.
+static std::string __MakeLine(size_t _size, unsigned int _seed) {
+    static const char* const kWords[] = {"net", "socket", "connect", "send", "recv", "timeout", "retry", "task",
+                                         "cgi", "cmdid", "seq", "err", "ok", "len", "host", "ip", "port", "rtt"};
+    static const size_t kWordCount = sizeof(kWords) / sizeof(kWords[0]);
+
+    std::string line;
+    while (line.size() < _size) {
+        _seed = _seed * 1103515245 + 12345;
+        line.append(kWords[(_seed >> 16) % kWordCount]);
+        line.append(0 == (_seed & 0x300) ? ":" : " ");
+        if (0 == (_seed & 0x3000)) {
+            char num[16] = {0};
+            snprintf(num, sizeof(num), "%u ", (_seed >> 8) & 0xFFFF);
+            line.append(num);
+        }
+    }
+    line.resize(_size);
+    return line;
+}
+
+class Benchmark {
+  public:
+    Benchmark(): started_(false) {}
+
+  public:
+    void Run(const Scenario& _scenario, unsigned int _lines, bool _staging, const std::string& _dir) {
+        boost::filesystem::remove_all(_dir);
+
+        appender_open(_scenario.mode, _dir.c_str(), "bench");
+        appender_set_console_log(false);
+        appender_set_thread_staging(_staging);
+        if (kAppednerAsync == _scenario.mode) appender_set_compress(_scenario.compress, _scenario.level, false);
+        appender_flush_sync();
+
+        XLogBackpressureStat stat_before;
+        appender_get_backpressure_stat(stat_before);
+        sg_flush_us.clear();
+        appender_set_flush_observer(&Benchmark::__OnFlush);
+
+        lines_ = _lines;
+        line_size_ = _scenario.line_size;
+        started_ = false;
+        latency_ns_.assign(_scenario.threads, std::vector<uint32_t>());
+
+        std::vector<Thread*> threads;
+        for (unsigned int i = 0; i < _scenario.threads; ++i) {
+            Thread* thread = new Thread(boost::bind(&Benchmark::__Writer, this, i), "xlog_bench");
+            thread->start();
+            threads.push_back(thread);
+        }
+
+        uint64_t begin = __NowNs();
+        {
+            ScopedLock lock(mutex_);
+            started_ = true;
+            cond_start_.notifyAll(lock);
+        }
+
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i]->join();
+            delete threads[i];
+        }
+        appender_flush_sync();
+        uint64_t elapsed = __NowNs() - begin;
+
+        appender_set_flush_observer(NULL);
+        XLogBackpressureStat stat_after;
+        appender_get_backpressure_stat(stat_after);
+        appender_close();
+
+        uintmax_t file_bytes = __LogSize(_dir);
+        boost::filesystem::remove_all(_dir);
+
+        std::vector<uint32_t> latency;
+        for (size_t i = 0; i < latency_ns_.size(); ++i) {
+            latency.insert(latency.end(), latency_ns_[i].begin(), latency_ns_[i].end());
+            std::vector<uint32_t>().swap(latency_ns_[i]);
+        }
+        std::sort(latency.begin(), latency.end());
+
+        std::vector<uint64_t> flush_us;
+        {
+            ScopedLock lock(sg_mutex_flush);
+            flush_us.swap(sg_flush_us);
+        }
+        std::sort(flush_us.begin(), flush_us.end());
+
+        double seconds = elapsed / 1e9;
+        double total_lines = (double)_lines * _scenario.threads;
+        printf("%-5s %-5s %6lu %3u %11.0f %8.2f %8.2f %8.2f %8.2f %5lu %8.2f %8.2f %8llu %8.2f\n",
+               kAppednerAsync == _scenario.mode ? "async" : "sync", _scenario.compress_name,
+               (unsigned long)_scenario.line_size, _scenario.threads,
+               total_lines / seconds, total_lines * _scenario.line_size / seconds / (1024 * 1024),
+               __Percentile(latency, 0.5) / 1000.0, __Percentile(latency, 0.99) / 1000.0, __Percentile(latency, 0.999) / 1000.0,
+               (unsigned long)flush_us.size(), __Percentile(flush_us, 0.5) / 1000.0, __Percentile(flush_us, 0.99) / 1000.0,
+               (unsigned long long)(stat_after.dropped_lines - stat_before.dropped_lines),
+               file_bytes / (1024.0 * 1024));
+        fflush(stdout);
+    }
+
+    static void PrintHeader() {
+        printf("%-5s %-5s %6s %3s %11s %8s %8s %8s %8s %5s %8s %8s %8s %8s\n",
+               "mode", "zip", "size", "thr", "lines/s", "MB/s", "p50 us", "p99 us", "p999 us",
+               "flush", "p50 ms", "p99 ms", "dropped", "file MB");
+    }
+
+  private:
+    void __Writer(unsigned int _index) {
+        std::string line = __MakeLine(line_size_, _index + 1);
+        std::vector<uint32_t>& latency = latency_ns_[_index];
+        latency.reserve(lines_);
+
+        ScopedLock lock(mutex_);
+        while (!started_) cond_start_.wait(lock);
+        lock.unlock();
+
+        for (unsigned int i = 0; i < lines_; ++i) {
+            uint64_t begin = __NowNs();
+            xinfo2("%s", line.c_str());
+            uint64_t span = __NowNs() - begin;
+            latency.push_back(span > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)span);
+        }
+    }
+
+    static void __OnFlush(uint64_t _elapsed_us, size_t) {
+        ScopedLock lock(sg_mutex_flush);
+        sg_flush_us.push_back(_elapsed_us);
+    }
+
+    template <typename T>
+    static T __Percentile(const std::vector<T>& _sorted, double _p) {
+        if (_sorted.empty()) return 0;
+        size_t index = (size_t)(_sorted.size() * _p);
+        return _sorted[std::min(index, _sorted.size() - 1)];
+    }
+
+    static uintmax_t __LogSize(const std::string& _dir) {
+        uintmax_t size = 0;
+        boost::system::error_code ec;
+        for (boost::filesystem::directory_iterator it(_dir, ec), end; !ec && it != end; it.increment(ec)) {
+            if (".xlog" == it->path().extension().string()) size += boost::filesystem::file_size(it->path(), ec);
+        }
+        return size;
+    }
+
+  private:
+    Mutex mutex_;
+    Condition cond_start_;
+    bool started_;
+
+    unsigned int lines_;
+    size_t line_size_;
+    std::vector<std::vector<uint32_t> > latency_ns_;
+
+    static Mutex sg_mutex_flush;
+    static std::vector<uint64_t> sg_flush_us;
+};
+
+Mutex Benchmark::sg_mutex_flush;
+std::vector<uint64_t> Benchmark::sg_flush_us;
+
+static void __AddCompress(const char* _name, std::vector<Scenario>& _compresses) {
+    Scenario scenario = {kAppednerAsync, _name, kCompressZlib, 0, 0, 0};
+    if (0 == strcmp("zlib", _name)) {
+        scenario.level = -1;    // Z_DEFAULT_COMPRESSION
+    } else if (0 == strcmp("zstd", _name)) {
+#ifdef XLOG_USE_ZSTD
+        scenario.compress = kCompressZstd;
+        scenario.level = 3;
+#else
+        fprintf(stderr, "zstd is not supported, build with XLOG_USE_ZSTD\n");
+        return;
+#endif
+    }
+    _compresses.push_back(scenario);
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int max_threads = 4;
+    unsigned int lines = 100000;
+    std::vector<size_t> sizes;
+    std::string mode = "all";
+    std::string compress = "all";
+    bool staging = false;
+    std::string dir = "/tmp/xlog_benchmark";
+
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (0 == strcmp("-t", argv[i]) && has_value) {
+            max_threads = (unsigned int)atoi(argv[++i]);
+        } else if (0 == strcmp("-n", argv[i]) && has_value) {
+            lines = (unsigned int)atoi(argv[++i]);
+        } else if (0 == strcmp("-s", argv[i]) && has_value) {
+            for (char* size = strtok(argv[++i], ","); NULL != size; size = strtok(NULL, ",")) {
+                if (0 < atoi(size)) sizes.push_back((size_t)atoi(size));
+            }
+        } else if (0 == strcmp("-m", argv[i]) && has_value) {
+            mode = argv[++i];
+        } else if (0 == strcmp("-c", argv[i]) && has_value) {
+            compress = argv[++i];
+        } else if (0 == strcmp("-r", argv[i])) {
+            staging = true;
+        } else if (0 == strcmp("-d", argv[i]) && has_value) {
+            dir = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-t max threads] [-n lines per thread] [-s size,size,...] [-m async|sync|all]"
+                    " [-c off|zlib|zstd|all] [-r] [-d dir]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (sizes.empty()) {
+        sizes.push_back(32);
+        sizes.push_back(128);
+        sizes.push_back(512);
+    }
+    if (0 == max_threads) max_threads = 1;
+
+    std::vector<Scenario> modes;
+    if ("async" == mode || "all" == mode) {
+        if ("off" == compress || "all" == compress) __AddCompress("off", modes);
+        if ("zlib" == compress || "all" == compress) __AddCompress("zlib", modes);
+#ifdef XLOG_USE_ZSTD
+        if ("zstd" == compress || "all" == compress) __AddCompress("zstd", modes);
+#else
+        if ("zstd" == compress) __AddCompress("zstd", modes);
+#endif
+    }
+    if ("sync" == mode || "all" == mode) {
+        // sync mode writes plain text, compression does not apply.
+        Scenario scenario = {kAppednerSync, "-", kCompressZlib, 0, 0, 0};
+        modes.push_back(scenario);
+    }
+    if (modes.empty()) {
+        fprintf(stderr, "no scenario for mode %s and compression %s\n", mode.c_str(), compress.c_str());
+        return 1;
+    }
+
+    xlogger_SetLevel(kLevelInfo);
+
+    Benchmark benchmark;
+    Benchmark::PrintHeader();
+    for (size_t m = 0; m < modes.size(); ++m) {
+        for (size_t s = 0; s < sizes.size(); ++s) {
+            for (unsigned int threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+                Scenario scenario = modes[m];
+                scenario.line_size = sizes[s];
+                scenario.threads = threads;
+                benchmark.Run(scenario, lines, staging, dir);
+
+                if (threads == max_threads) break;
+            }
+        }
+    }
+
+    return 0;
+}
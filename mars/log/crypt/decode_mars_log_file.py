@@ -7,9 +7,15 @@ import zlib
 import struct
 #import base64
 
+try:
+    import zstandard
+except ImportError:
+    zstandard = None
+
 MAGIC_NO_COMPRESS_START = 0x03;
 MAGIC_COMPRESS_START = 0x04;
 MAGIC_COMPRESS_START1 = 0x05;
+MAGIC_COMPRESS_ZSTD_START = 0x06;
 
 MAGIC_END  = 0x00;
 
@@ -19,7 +25,7 @@ def IsGoodLogBuffer(_buffer, _offset, count):
 
     if _offset == len(_buffer): return (True, '')
 
-    if MAGIC_NO_COMPRESS_START==_buffer[_offset] or MAGIC_COMPRESS_START==_buffer[_offset] or MAGIC_COMPRESS_START1==_buffer[_offset]:
+    if MAGIC_NO_COMPRESS_START==_buffer[_offset] or MAGIC_COMPRESS_START==_buffer[_offset] or MAGIC_COMPRESS_START1==_buffer[_offset] or MAGIC_COMPRESS_ZSTD_START==_buffer[_offset]:
         headerLen = 1 + 2 + 1 + 1 + 4 + 4
     else:
         return (False, '_buffer[%d]:%d != MAGIC_NUM_START'%(_offset, _buffer[_offset]))
@@ -40,7 +46,7 @@ def GetLogStartPos(_buffer, _count):
     while True:
         if offset >= len(_buffer) : break
         
-        if MAGIC_NO_COMPRESS_START==_buffer[offset] or MAGIC_COMPRESS_START==_buffer[offset] or MAGIC_COMPRESS_START1==_buffer[offset]: 
+        if MAGIC_NO_COMPRESS_START==_buffer[offset] or MAGIC_COMPRESS_START==_buffer[offset] or MAGIC_COMPRESS_START1==_buffer[offset] or MAGIC_COMPRESS_ZSTD_START==_buffer[offset]: 
             if IsGoodLogBuffer(_buffer, offset, _count)[0]: return offset
         offset+=1
         
@@ -59,7 +65,7 @@ def DecodeBuffer(_buffer, _offset, _outbuffer):
             _outbuffer.extend("[F]decode_log_file.py decode error len=%d, result:%s \n"%(fixpos, ret[1]))
             _offset += fixpos 
 
-    if MAGIC_NO_COMPRESS_START==_buffer[_offset] or MAGIC_COMPRESS_START==_buffer[_offset] or MAGIC_COMPRESS_START1==_buffer[_offset]:
+    if MAGIC_NO_COMPRESS_START==_buffer[_offset] or MAGIC_COMPRESS_START==_buffer[_offset] or MAGIC_COMPRESS_START1==_buffer[_offset] or MAGIC_COMPRESS_ZSTD_START==_buffer[_offset]:
         headerLen = 1 + 2 + 1 + 1 + 4 + 4
     else:
         _outbuffer.extend('in DecodeBuffer _buffer[%d]:%d != MAGIC_NUM_START'%(_offset, _buffer[_offset]))
@@ -89,7 +95,7 @@ def DecodeBuffer(_buffer, _offset, _outbuffer):
 	    tmpbuffer = decompressor.decompress(str(tmpbuffer))
 
 
-        elif MAGIC_COMPRESS_START1==_buffer[_offset]:
+        elif MAGIC_COMPRESS_START1==_buffer[_offset] or MAGIC_COMPRESS_ZSTD_START==_buffer[_offset]:
             decompressor = zlib.decompressobj(-zlib.MAX_WBITS)
             decompress_data = bytearray()
             while len(tmpbuffer) > 0:
@@ -100,7 +106,11 @@ def DecodeBuffer(_buffer, _offset, _outbuffer):
 
 
 
-            tmpbuffer = decompressor.decompress(str(decompress_data))
+            if MAGIC_COMPRESS_ZSTD_START==_buffer[_offset]:
+                if zstandard is None: raise Exception("zstandard module is required for zstd compressed logs")
+                tmpbuffer = zstandard.ZstdDecompressor().decompressobj().decompress(str(decompress_data))
+            else:
+                tmpbuffer = decompressor.decompress(str(decompress_data))
         else:
             pass
 
@@ -27,8 +27,13 @@
 
 static const char kMagicSyncStart = '\x03';
 static const char kMagicAsyncStart ='\x05';
+static const char kMagicAsyncZstdStart ='\x06';
 static const char kMagicEnd  = '\0';
 
+static bool __IsGoodMagic(char _start) {
+    return kMagicSyncStart == _start || kMagicAsyncStart == _start || kMagicAsyncZstdStart == _start;
+}
+
 static uint16_t __GetSeq(bool _is_async) {
     
     if (!_is_async) {
@@ -58,10 +63,12 @@ uint32_t LogCrypt::GetTailerLen() {
     return sizeof(kMagicEnd);
 }
 
-void LogCrypt::SetHeaderInfo(char* _data, bool _is_async) {
+void LogCrypt::SetHeaderInfo(char* _data, bool _is_async, bool _is_zstd) {
 
     
-    if (_is_async) {
+    if (_is_async && _is_zstd) {
+        memcpy(_data, &kMagicAsyncZstdStart, sizeof(kMagicAsyncZstdStart));
+    } else if (_is_async) {
         memcpy(_data, &kMagicAsyncStart, sizeof(kMagicAsyncStart));
     } else {
         memcpy(_data, &kMagicSyncStart, sizeof(kMagicSyncStart));
@@ -97,13 +104,24 @@ uint32_t LogCrypt::GetLogLen(const char*  const _data, size_t _len) {
     if (_len < GetHeaderLen()) return 0;
     
     char start = _data[0];
-    if (kMagicAsyncStart != start && kMagicSyncStart != start) return 0;
+    if (!__IsGoodMagic(start)) return 0;
     
     uint32_t len = 0;
     memcpy(&len, _data + GetHeaderLen() - sizeof(uint32_t) * 2, sizeof(len));
     return len;
 }
 
+uint16_t LogCrypt::GetLogSeq(const char* const _data, size_t _len) {
+    if (_len < GetHeaderLen()) return 0;
+
+    char start = _data[0];
+    if (!__IsGoodMagic(start)) return 0;
+
+    uint16_t seq = 0;
+    memcpy(&seq, _data + sizeof(start), sizeof(seq));
+    return seq;
+}
+
 void LogCrypt::UpdateLogLen(char* _data, uint32_t _add_len) {
 
     uint32_t currentlen = (uint32_t)(GetLogLen(_data, GetHeaderLen()) + _add_len);
@@ -116,7 +134,7 @@ bool LogCrypt::GetLogHour(const char* const _data, size_t _len, int& _begin_hour
     if (_len < GetHeaderLen()) return false;
     
     char start = _data[0];
-    if (kMagicAsyncStart != start && kMagicSyncStart != start) return false;
+    if (!__IsGoodMagic(start)) return false;
     
     char begin_hour = _data[sizeof(char)+sizeof(uint16_t)];
     char end_hour = _data[sizeof(char)+sizeof(uint16_t)+sizeof(char)];
@@ -196,7 +214,7 @@ bool LogCrypt::GetPeriodLogs(const char* const _log_path, int _begin_hour, int _
         bool fix = false;
         
         char start = *header_buff;
-        if (start != kMagicSyncStart && start != kMagicAsyncStart) {
+        if (!__IsGoodMagic(start)) {
             fix = true;
         } else {
             uint32_t len = GetLogLen(header_buff, GetHeaderLen());
@@ -319,7 +337,7 @@ bool LogCrypt::Fix(char* _data, size_t _data_len, bool& _is_async, uint32_t& _ra
     }
     
     char start = _data[0];
-    if (kMagicAsyncStart != start && kMagicSyncStart != start) {
+    if (!__IsGoodMagic(start)) {
         return false;
     }
     
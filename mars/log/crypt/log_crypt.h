@@ -37,10 +37,11 @@ public:
     uint32_t GetHeaderLen();
     uint32_t GetTailerLen();
     
-    void SetHeaderInfo(char* _data, bool _is_async);
+    void SetHeaderInfo(char* _data, bool _is_async, bool _is_zstd = false);
     void SetTailerInfo(char* _data);
     
     uint32_t GetLogLen(const char* const _data, size_t _len);
+    uint16_t GetLogSeq(const char* const _data, size_t _len);
     void UpdateLogLen(char* _data, uint32_t _add_len);
     
     bool GetLogHour(const char* const _data, size_t _len, int& _begin_hour, int& _end_hour);
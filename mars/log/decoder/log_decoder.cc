@@ -0,0 +1,363 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * log_decoder.cc
+ */
+
+#include "log_decoder.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#ifdef XLOG_USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "boost/bind.hpp"
+
+#include "mars/comm/thread/thread.h"
+#include "log/crypt/log_crypt.h"
+#include "log/src/log_record.h"
+
+static const char kMagicSyncStart = '\x03';
+static const char kMagicCompressStart = '\x04';
+static const char kMagicAsyncStart = '\x05';
+static const char kMagicAsyncZstdStart = '\x06';
+static const char kMagicEnd = '\0';
+
+static const char kMagics[] = {kMagicSyncStart, kMagicCompressStart, kMagicAsyncStart, kMagicAsyncZstdStart};
+static const size_t kMagicCount = sizeof(kMagics) / sizeof(kMagics[0]);
+
+static const size_t kDecodeWindow = 64;    // blocks in flight per thread
+
+static bool __IsMagic(char _c) {
+    return NULL != memchr(kMagics, _c, kMagicCount);
+}
+
+/*
+ * |magic start(char)|seq(uint16_t)|begin hour(char)|end hour(char)|length(uint32_t)|crypt key(uint32_t)|
+ */
+static uint16_t __GetSeq(const char* _header) {
+    uint16_t seq = 0;
+    memcpy(&seq, _header + sizeof(char), sizeof(seq));
+    return seq;
+}
+
+static uint32_t __GetLength(const char* _header) {
+    uint32_t len = 0;
+    memcpy(&len, _header + sizeof(char) + sizeof(uint16_t) + sizeof(char) * 2, sizeof(len));
+    return len;
+}
+
+// |len(uint16_t)|data(len)|... of async blocks. CryptAsyncLog does not encrypt, so the data is used as it is.
+static bool __JoinChunks(const char* _data, size_t _len, std::string& _out) {
+    size_t pos = 0;
+    while (pos + sizeof(uint16_t) <= _len) {
+        uint16_t chunk_len = 0;
+        memcpy(&chunk_len, _data + pos, sizeof(chunk_len));
+        pos += sizeof(chunk_len);
+
+        if (pos + chunk_len > _len) return false;
+        _out.append(_data + pos, chunk_len);
+        pos += chunk_len;
+    }
+    return pos == _len;
+}
+
+static bool __Inflate(const std::string& _in, std::string& _out, std::string& _err) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (Z_OK != inflateInit2(&stream, -MAX_WBITS)) {
+        _err = "inflateInit2 failed";
+        return false;
+    }
+
+    stream.next_in = (Bytef*)_in.data();
+    stream.avail_in = (uInt)_in.size();
+
+    char buffer[64 * 1024];
+    int ret = Z_OK;
+    do {
+        stream.next_out = (Bytef*)buffer;
+        stream.avail_out = sizeof(buffer);
+
+        ret = inflate(&stream, Z_SYNC_FLUSH);
+        _out.append(buffer, sizeof(buffer) - stream.avail_out);
+    } while (Z_OK == ret && (0 != stream.avail_in || 0 == stream.avail_out));
+
+    inflateEnd(&stream);
+
+    // a block ends with a sync flush instead of the end of stream.
+    if (Z_OK == ret || Z_STREAM_END == ret || Z_BUF_ERROR == ret) return true;
+
+    _err = NULL != stream.msg ? stream.msg : "inflate failed";
+    return false;
+}
+
+#ifdef XLOG_USE_ZSTD
+static bool __ZstdDecompress(const std::string& _in, std::string& _out, std::string& _err) {
+    ZSTD_DStream* stream = ZSTD_createDStream();
+    if (NULL == stream) {
+        _err = "ZSTD_createDStream failed";
+        return false;
+    }
+
+    ZSTD_inBuffer input = {_in.data(), _in.size(), 0};
+    char buffer[64 * 1024];
+    size_t ret = 0;
+    do {
+        ZSTD_outBuffer output = {buffer, sizeof(buffer), 0};
+        ret = ZSTD_decompressStream(stream, &output, &input);
+        if (ZSTD_isError(ret)) break;
+        _out.append(buffer, output.pos);
+        if (0 == output.pos && input.pos == input.size) break;
+    } while (0 != ret);
+
+    ZSTD_freeDStream(stream);
+
+    if (!ZSTD_isError(ret)) return true;
+
+    _err = ZSTD_getErrorName(ret);
+    return false;
+}
+#else
+static bool __ZstdDecompress(const std::string&, std::string&, std::string& _err) {
+    _err = "zstd is not supported, build with XLOG_USE_ZSTD";
+    return false;
+}
+#endif
+
+LogDecoder::LogDecoder(unsigned int _thread_count)
+: thread_count_(_thread_count), crypt_(new LogCrypt()), data_(NULL), last_seq_(0), next_block_(0), written_block_(0) {
+    if (0 == thread_count_) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count_ = 0 < cpus ? (unsigned int)cpus : 1;
+    }
+}
+
+LogDecoder::~LogDecoder() {
+    delete crypt_;
+}
+
+bool LogDecoder::DecodeFile(const char* _log_path, const char* _out_path) {
+    FILE* file = fopen(_log_path, "rb");
+    if (NULL == file) return false;
+
+    std::string data;
+    char buffer[64 * 1024];
+    size_t read_len = 0;
+    while (0 < (read_len = fread(buffer, 1, sizeof(buffer), file))) {
+        data.append(buffer, read_len);
+    }
+    fclose(file);
+
+    FILE* out = fopen(_out_path, "wb");
+    if (NULL == out) return false;
+
+    bool ret = Decode(data.data(), data.size(), out);
+    long out_len = ftell(out);
+    fclose(out);
+
+    if (0 >= out_len) remove(_out_path);
+    return ret;
+}
+
+bool LogDecoder::Decode(const char* _data, size_t _len, FILE* _out) {
+    data_ = _data;
+    blocks_.clear();
+    last_seq_ = 0;
+    next_block_ = 0;
+    written_block_ = 0;
+
+    __ScanBlocks(_data, _len);
+    if (blocks_.empty()) return false;
+
+    std::vector<Thread*> threads;
+    for (unsigned int i = 0; i < thread_count_; ++i) {
+        Thread* thread = new Thread(boost::bind(&LogDecoder::__Worker, this), "log_decoder");
+        thread->start();
+        threads.push_back(thread);
+    }
+
+    // call sites are described once per file, so records are rendered in order on this thread.
+    LogRecordDecoder record_decoder;
+    std::string out;
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+        ScopedLock lock(mutex_);
+        while (!blocks_[i].done) cond_decoded_.wait(lock);
+        lock.unlock();
+
+        out.clear();
+        out.append(blocks_[i].tips);
+        record_decoder.Decode(blocks_[i].text.data(), blocks_[i].text.size(), out);
+        fwrite(out.data(), 1, out.size(), _out);
+        std::string().swap(blocks_[i].text);
+
+        lock.lock();
+        written_block_ = i + 1;
+        cond_written_.notifyAll(lock);
+    }
+
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->join();
+        delete threads[i];
+    }
+
+    data_ = NULL;
+    return true;
+}
+
+bool LogDecoder::__IsGoodBlock(const char* _data, size_t _len, size_t _offset, int _count) const {
+    while (0 < _count--) {
+        if (_offset == _len) return true;
+        if (!__IsMagic(_data[_offset])) return false;
+
+        size_t header_len = crypt_->GetHeaderLen();
+        if (_offset + header_len + crypt_->GetTailerLen() > _len) return false;
+
+        size_t end = _offset + header_len + __GetLength(_data + _offset);
+        if (end + crypt_->GetTailerLen() > _len || kMagicEnd != _data[end]) return false;
+
+        _offset = end + crypt_->GetTailerLen();
+    }
+    return true;
+}
+
+// returns _len if there is no good block behind _offset.
+size_t LogDecoder::__FindBlock(const char* _data, size_t _len, size_t _offset, int _count) const {
+    // next position of every magic, memchr is vectorized by libc.
+    const char* next[kMagicCount] = {NULL};
+    const char* end = _data + _len;
+
+    const char* current = _data + _offset;
+    while (current < end) {
+        const char* candidate = end;
+        for (size_t i = 0; i < kMagicCount; ++i) {
+            if (NULL != next[i] && next[i] < current) next[i] = NULL;
+            if (NULL == next[i]) {
+                next[i] = (const char*)memchr(current, kMagics[i], end - current);
+                if (NULL == next[i]) next[i] = end;
+            }
+            if (next[i] < candidate) candidate = next[i];
+        }
+
+        if (candidate == end) break;
+        if (__IsGoodBlock(_data, _len, candidate - _data, _count)) return candidate - _data;
+        current = candidate + 1;
+    }
+
+    return _len;
+}
+
+void LogDecoder::__ScanBlocks(const char* _data, size_t _len) {
+    size_t offset = __FindBlock(_data, _len, 0, 2);
+    std::string tips;
+
+    while (offset < _len) {
+        if (!__IsGoodBlock(_data, _len, offset, 1)) {
+            size_t fix_offset = __FindBlock(_data, _len, offset, 1);
+
+            char msg[128] = {0};
+            snprintf(msg, sizeof(msg), "[F]log_decoder decode error len=%lu\n", (unsigned long)(fix_offset - offset));
+            tips.append(msg);
+
+            if (fix_offset >= _len) break;
+            offset = fix_offset;
+        }
+
+        Block block;
+        block.magic = _data[offset];
+        block.seq = __GetSeq(_data + offset);
+        block.length = __GetLength(_data + offset);
+        block.offset = offset + crypt_->GetHeaderLen();
+
+        // seq is 0 for sync blocks, and it skips 0 when it wraps around.
+        int seq = block.seq;
+        if (0 != seq && 1 != seq && 0 != last_seq_ && seq != last_seq_ + 1) {
+            char msg[128] = {0};
+            snprintf(msg, sizeof(msg), "[F]log_decoder log seq:%d-%d is missing\n", last_seq_ + 1, seq - 1);
+            tips.append(msg);
+        }
+        if (0 != seq) last_seq_ = seq;
+
+        block.tips.swap(tips);
+        blocks_.push_back(block);
+
+        offset = block.offset + block.length + crypt_->GetTailerLen();
+    }
+
+    // errors behind the last block go out with an empty one.
+    if (!tips.empty() && !blocks_.empty()) {
+        Block block;
+        block.magic = kMagicSyncStart;
+        block.offset = offset;
+        block.tips.swap(tips);
+        blocks_.push_back(block);
+    }
+}
+
+void LogDecoder::__Worker() {
+    while (true) {
+        ScopedLock lock(mutex_);
+        while (next_block_ < blocks_.size() && next_block_ >= written_block_ + kDecodeWindow * thread_count_) {
+            cond_written_.wait(lock);
+        }
+        if (next_block_ >= blocks_.size()) return;
+
+        Block& block = blocks_[next_block_++];
+        lock.unlock();
+
+        __DecodeBlock(block);
+
+        lock.lock();
+        block.done = true;
+        cond_decoded_.notifyAll(lock);
+    }
+}
+
+void LogDecoder::__DecodeBlock(Block& _block) const {
+    const char* data = data_ + _block.offset;
+    std::string err;
+    bool ret = true;
+
+    switch (_block.magic) {
+    case kMagicSyncStart:
+        _block.text.assign(data, _block.length);
+        break;
+    case kMagicCompressStart:
+        ret = __Inflate(std::string(data, _block.length), _block.text, err);
+        break;
+    case kMagicAsyncStart:
+    case kMagicAsyncZstdStart: {
+        std::string compressed;
+        if (!__JoinChunks(data, _block.length, compressed)) {
+            err = "bad chunk length";
+            ret = false;
+            break;
+        }
+
+        if (kMagicAsyncStart == _block.magic) ret = __Inflate(compressed, _block.text, err);
+        else ret = __ZstdDecompress(compressed, _block.text, err);
+        break;
+    }
+    default:
+        err = "unknown magic";
+        ret = false;
+        break;
+    }
+
+    if (!ret) {
+        _block.text.append("[F]log_decoder decompress err, ").append(err).append("\n");
+    }
+}
@@ -0,0 +1,84 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * log_decoder.h
+ *
+ * native decoder of xlog files, the same output as decode_mars_log_file.py.
+ * blocks are located in one pass, then inflated by a pool of threads and written out in order.
+ */
+
+#ifndef LOG_DECODER_H_
+#define LOG_DECODER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "mars/comm/thread/lock.h"
+#include "mars/comm/thread/condition.h"
+
+class LogCrypt;
+
+class LogDecoder {
+  public:
+    // 0 means one thread per core.
+    explicit LogDecoder(unsigned int _thread_count = 0);
+    ~LogDecoder();
+
+  public:
+    bool DecodeFile(const char* _log_path, const char* _out_path);
+    // _data is the content of a whole xlog file.
+    bool Decode(const char* _data, size_t _len, FILE* _out);
+
+  private:
+    struct Block {
+        Block(): offset(0), length(0), magic(0), seq(0), done(false) {}
+
+        size_t offset;    // of the log data, behind the header
+        uint32_t length;
+        char magic;
+        uint16_t seq;
+        std::string tips;    // decode errors and missing seqs before this block
+        std::string text;
+        bool done;
+    };
+
+  private:
+    bool __IsGoodBlock(const char* _data, size_t _len, size_t _offset, int _count) const;
+    size_t __FindBlock(const char* _data, size_t _len, size_t _offset, int _count) const;
+    void __ScanBlocks(const char* _data, size_t _len);
+
+    void __Worker();
+    void __DecodeBlock(Block& _block) const;
+
+  private:
+    LogDecoder(const LogDecoder&);
+    LogDecoder& operator=(const LogDecoder&);
+
+  private:
+    unsigned int thread_count_;
+    LogCrypt* crypt_;
+
+    const char* data_;
+    std::vector<Block> blocks_;
+    int last_seq_;
+
+    Mutex mutex_;
+    Condition cond_decoded_;
+    Condition cond_written_;
+    size_t next_block_;
+    size_t written_block_;
+};
+
+#endif /* LOG_DECODER_H_ */
@@ -0,0 +1,105 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * xlog_decoder.cc
+ *
+ * command line of LogDecoder, the same arguments as decode_mars_log_file.py:
+ *   xlog_decoder [-j threads]                  decodes *.xlog of the current directory
+ *   xlog_decoder [-j threads] dir|file.xlog    decodes *.xlog of dir, or file.xlog to file.xlog.log
+ *   xlog_decoder [-j threads] file.xlog out    decodes file.xlog to out
+ *
+ * it is a host tool and not a part of the log library, build it from mars/log with the sources it uses:
+ *   gcc -O2 -c -I. -I.. -I../.. -I../comm ../comm/xlogger/xloggerbase.c ../comm/xlogger/loginfo_extract.c ../comm/assert/__assert.c
+ *   g++ -O2 -I. -I.. -I../.. -I../comm decoder/log_decoder.cc decoder/xlog_decoder.cc src/log_record.cc
+ *       crypt/log_crypt.cc ../comm/ptrbuffer.cc xloggerbase.o loginfo_extract.o __assert.o -lz -lpthread
+ * and -DXLOG_USE_ZSTD -lzstd on the g++ line for logs compressed with zstd.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "log_decoder.h"
+
+// xloggerbase.c and __assert.c want the thread info of the platform, the decoder never logs itself.
+extern "C" {
+intmax_t xlogger_pid() { return getpid(); }
+intmax_t xlogger_tid() { return 0; }
+intmax_t xlogger_maintid() { return 0; }
+}
+
+static void __ListXlogFiles(const std::string& _dir, std::vector<std::string>& _files) {
+    DIR* dir = opendir(_dir.c_str());
+    if (NULL == dir) return;
+
+    struct dirent* entry = NULL;
+    while (NULL != (entry = readdir(dir))) {
+        std::string name = entry->d_name;
+        if (name.size() > 5 && 0 == name.compare(name.size() - 5, 5, ".xlog")) {
+            _files.push_back(_dir + "/" + name);
+        }
+    }
+    closedir(dir);
+}
+
+static bool __IsDir(const char* _path) {
+    struct stat st;
+    return 0 == stat(_path, &st) && S_ISDIR(st.st_mode);
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int thread_count = 0;
+    std::vector<const char*> args;
+
+    for (int i = 1; i < argc; ++i) {
+        if (0 == strcmp("-j", argv[i]) && i + 1 < argc) {
+            thread_count = (unsigned int)atoi(argv[++i]);
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+
+    std::vector<std::string> files;
+    if (2 == args.size()) {
+        LogDecoder decoder(thread_count);
+        return decoder.DecodeFile(args[0], args[1]) ? 0 : 1;
+    } else if (1 == args.size() && !__IsDir(args[0])) {
+        files.push_back(args[0]);
+    } else if (1 == args.size()) {
+        __ListXlogFiles(args[0], files);
+    } else if (0 == args.size()) {
+        __ListXlogFiles(".", files);
+    } else {
+        fprintf(stderr, "usage: %s [-j threads] [dir | file.xlog [out]]\n", argv[0]);
+        return 1;
+    }
+
+    int ret = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        // seq gaps are reported per file
+        LogDecoder decoder(thread_count);
+        if (!decoder.DecodeFile(files[i].c_str(), (files[i] + ".log").c_str())) {
+            fprintf(stderr, "no log found in %s\n", files[i].c_str());
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
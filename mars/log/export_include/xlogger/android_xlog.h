@@ -59,8 +59,8 @@ static void __ComLog(int level, const char *tag, const char* file, const char* f
 
 
 
-#define __LOG__(LEVEL, LOG_TAG, FMT, ...)  if ((!xlogger_IsEnabledFor(LEVEL))); else __ComLog(LEVEL, LOG_TAG , __FILE__, __FUNCTION__, __LINE__, FMT,## __VA_ARGS__)
-#define __LOGV__(LEVEL, LOG_TAG, FMT, VA_LIST)  if ((!xlogger_IsEnabledFor(LEVEL))); else __ComLogV(LEVEL, LOG_TAG , __FILE__, __FUNCTION__, __LINE__, FMT, VA_LIST)
+#define __LOG__(LEVEL, LOG_TAG, FMT, ...)  if ((!xlogger_IsEnabledForTag(LEVEL, LOG_TAG, __FILE__))); else __ComLog(LEVEL, LOG_TAG , __FILE__, __FUNCTION__, __LINE__, FMT,## __VA_ARGS__)
+#define __LOGV__(LEVEL, LOG_TAG, FMT, VA_LIST)  if ((!xlogger_IsEnabledForTag(LEVEL, LOG_TAG, __FILE__))); else __ComLogV(LEVEL, LOG_TAG , __FILE__, __FUNCTION__, __LINE__, FMT, VA_LIST)
 
 #define LOGV(LOG_TAG, FMT, ...)  __LOG__(kLevelVerbose, LOG_TAG, FMT, ##__VA_ARGS__)
 #define LOGD(LOG_TAG, FMT, ...)  __LOG__(kLevelDebug, LOG_TAG, FMT, ##__VA_ARGS__)
@@ -31,6 +31,8 @@
 
 #ifdef XLOGGER_DISABLE
 #define  xlogger_IsEnabledFor(_level)	(false)
+#define  xlogger_IsEnabledForTag(...)	(false)
+#define  __xlogger_IsEnabledForCallSite(...)	(false)
 #define  xlogger_AssertP(...) 		 	((void)0)
 #define  xlogger_Assert(...)			((void)0)
 #define  xlogger_VPrint(...)			((void)0)
@@ -334,7 +336,7 @@ class XScopeTracer
 {
 public:
     XScopeTracer(TLogLevel _level, const char* _tag, const char* _name, const char* _file, const char* _func, int _line, const char* _log)
-    :m_enable(xlogger_IsEnabledFor(_level)), m_info(), m_tv()
+    :m_enable(xlogger_IsEnabledForTag(_level, _tag, _file)), m_info(), m_tv()
     {
     	m_info.level = _level;
 
@@ -391,6 +393,113 @@ private:
     std::string m_exitmsg;
 };
 
+enum XDeferredArgType {
+    kDeferredArgBool = 1,
+    kDeferredArgChar,
+    kDeferredArgInt,
+    kDeferredArgUInt,
+    kDeferredArgDouble,
+    kDeferredArgPointer,
+    kDeferredArgString,
+};
+
+/*
+ * raw typed argument of a deferred log statement, rendered later like TVariant does.
+ * |type(uint8_t)|value(int64_t/uint64_t/double)| or |type(uint8_t)|len(uint16_t)|string(len)|
+ */
+class XDeferredArg
+{
+public:
+    enum { kMaxStringLength = 1024 };
+
+public:
+    XDeferredArg(bool aBool):m_type(kDeferredArgBool), m_str(NULL), m_len(0) { m_value.u = aBool ? 1 : 0; }
+    XDeferredArg(char aChar):m_type(kDeferredArgChar), m_str(NULL), m_len(0) { m_value.i = aChar; }
+    XDeferredArg(signed char aSChar):m_type(kDeferredArgChar), m_str(NULL), m_len(0) { m_value.i = aSChar; }
+    XDeferredArg(unsigned char aUChar):m_type(kDeferredArgUInt), m_str(NULL), m_len(0) { m_value.u = aUChar; }
+    XDeferredArg(short aShort):m_type(kDeferredArgInt), m_str(NULL), m_len(0) { m_value.i = aShort; }
+    XDeferredArg(unsigned short aUShort):m_type(kDeferredArgUInt), m_str(NULL), m_len(0) { m_value.u = aUShort; }
+    XDeferredArg(int aInt):m_type(kDeferredArgInt), m_str(NULL), m_len(0) { m_value.i = aInt; }
+    XDeferredArg(unsigned int aUInt):m_type(kDeferredArgUInt), m_str(NULL), m_len(0) { m_value.u = aUInt; }
+    XDeferredArg(long aLong):m_type(kDeferredArgInt), m_str(NULL), m_len(0) { m_value.i = aLong; }
+    XDeferredArg(unsigned long aULong):m_type(kDeferredArgUInt), m_str(NULL), m_len(0) { m_value.u = aULong; }
+    XDeferredArg(long long aLongLong):m_type(kDeferredArgInt), m_str(NULL), m_len(0) { m_value.i = aLongLong; }
+    XDeferredArg(unsigned long long aULongLong):m_type(kDeferredArgUInt), m_str(NULL), m_len(0) { m_value.u = aULongLong; }
+    XDeferredArg(float aFloat):m_type(kDeferredArgDouble), m_str(NULL), m_len(0) { m_value.d = aFloat; }
+    XDeferredArg(double aDouble):m_type(kDeferredArgDouble), m_str(NULL), m_len(0) { m_value.d = aDouble; }
+    XDeferredArg(long double aLongDouble):m_type(kDeferredArgDouble), m_str(NULL), m_len(0) { m_value.d = (double)aLongDouble; }
+    XDeferredArg(const void* aVoidPtr):m_type(kDeferredArgPointer), m_str(NULL), m_len(0) { m_value.u = (uintptr_t)aVoidPtr; }
+    XDeferredArg(const char* aCharPtr):m_type(kDeferredArgString), m_str(NULL), m_len(0) { SetString(aCharPtr, NULL == aCharPtr ? 0 : strnlen(aCharPtr, kMaxStringLength)); }
+    XDeferredArg(char* _ptr):m_type(kDeferredArgString), m_str(NULL), m_len(0) { SetString(_ptr, NULL == _ptr ? 0 : strnlen(_ptr, kMaxStringLength)); }
+    XDeferredArg(const unsigned char* aUCharPtr):m_type(kDeferredArgString), m_str(NULL), m_len(0) { SetString((const char*)aUCharPtr, NULL == aUCharPtr ? 0 : strnlen((const char*)aUCharPtr, kMaxStringLength)); }
+    XDeferredArg(const std::string& aValue):m_type(kDeferredArgString), m_str(NULL), m_len(0) { SetString(aValue.data(), aValue.size()); }
+    ~XDeferredArg() {}
+
+    // returns the encoded length, 0 if _len is not enough
+    size_t Encode(char* _buf, size_t _len) const;
+
+private:
+    void SetString(const char* _str, size_t _len) {
+        m_str = NULL == _str ? "(null)" : _str;
+        m_len = NULL == _str ? 6 : (uint16_t)(_len > kMaxStringLength ? (size_t)kMaxStringLength : _len);
+    }
+
+private:
+    XDeferredArg(const XDeferredArg&);
+    XDeferredArg& operator=(const XDeferredArg&);
+
+private:
+    uint8_t m_type;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+    } m_value;
+    const char* m_str;
+    uint16_t m_len;
+};
+
+/*
+ * writes a compact record instead of formatting on the caller thread.
+ * |count(uint8_t)|arg|arg|...
+ */
+class XDeferredLogger
+{
+public:
+    XDeferredLogger(TLogLevel _level, XLoggerCallSite* _callsite): m_level(_level), m_callsite(_callsite) {}
+
+#define XLOGGER_DEFERRED_ARGS(n) PP_ENUM_PARAMS(n, const XDeferredArg& a)
+	void  operator()(XLOGGER_DEFERRED_ARGS(0));
+	void  operator()(XLOGGER_DEFERRED_ARGS(1));
+	void  operator()(XLOGGER_DEFERRED_ARGS(2));
+	void  operator()(XLOGGER_DEFERRED_ARGS(3));
+	void  operator()(XLOGGER_DEFERRED_ARGS(4));
+	void  operator()(XLOGGER_DEFERRED_ARGS(5));
+	void  operator()(XLOGGER_DEFERRED_ARGS(6));
+	void  operator()(XLOGGER_DEFERRED_ARGS(7));
+	void  operator()(XLOGGER_DEFERRED_ARGS(8));
+	void  operator()(XLOGGER_DEFERRED_ARGS(9));
+	void  operator()(XLOGGER_DEFERRED_ARGS(10));
+	void  operator()(XLOGGER_DEFERRED_ARGS(11));
+	void  operator()(XLOGGER_DEFERRED_ARGS(12));
+	void  operator()(XLOGGER_DEFERRED_ARGS(13));
+	void  operator()(XLOGGER_DEFERRED_ARGS(14));
+	void  operator()(XLOGGER_DEFERRED_ARGS(15));
+	void  operator()(XLOGGER_DEFERRED_ARGS(16));
+#undef XLOGGER_DEFERRED_ARGS
+
+private:
+	void DoWrite(const XDeferredArg** _args, int _count);
+
+private:
+    XDeferredLogger(const XDeferredLogger&);
+    XDeferredLogger& operator=(const XDeferredLogger&);
+
+private:
+    TLogLevel m_level;
+    XLoggerCallSite* m_callsite;
+};
+
 ///////////////////////////XMessage////////////////////
 inline XMessage& XMessage::operator<<(const TVariant& _value)
 {
@@ -670,6 +779,69 @@ inline void XLogger::DoTypeSafeFormat(const char* _format, const TVariant** _arg
 	}
 }
 
+///////////////////////////XDeferredLogger////////////////////
+inline size_t XDeferredArg::Encode(char* _buf, size_t _len) const {
+    if (kDeferredArgString == m_type) {
+        if (_len < sizeof(m_type) + sizeof(m_len) + m_len) return 0;
+        memcpy(_buf, &m_type, sizeof(m_type));
+        memcpy(_buf + sizeof(m_type), &m_len, sizeof(m_len));
+        memcpy(_buf + sizeof(m_type) + sizeof(m_len), m_str, m_len);
+        return sizeof(m_type) + sizeof(m_len) + m_len;
+    }
+
+    if (_len < sizeof(m_type) + sizeof(m_value)) return 0;
+    memcpy(_buf, &m_type, sizeof(m_type));
+    memcpy(_buf + sizeof(m_type), &m_value, sizeof(m_value));
+    return sizeof(m_type) + sizeof(m_value);
+}
+
+#define XLOGGER_DEFERRED_ARGS(n) PP_ENUM_PARAMS(n, const XDeferredArg& a)
+#define XLOGGER_DEFERRED_ARGS_PTR(n) PP_ENUM_PARAMS(n, &a)
+#define XLOGGER_DEFERRED_IMPLEMENT(n) \
+		inline void XDeferredLogger::operator()(XLOGGER_DEFERRED_ARGS(n)) { \
+			const XDeferredArg* args[17] = { XLOGGER_DEFERRED_ARGS_PTR(n) PP_COMMA_IF(n) NULL }; \
+			DoWrite(args, n); \
+	}
+
+XLOGGER_DEFERRED_IMPLEMENT(0)
+XLOGGER_DEFERRED_IMPLEMENT(1)
+XLOGGER_DEFERRED_IMPLEMENT(2)
+XLOGGER_DEFERRED_IMPLEMENT(3)
+XLOGGER_DEFERRED_IMPLEMENT(4)
+XLOGGER_DEFERRED_IMPLEMENT(5)
+XLOGGER_DEFERRED_IMPLEMENT(6)
+XLOGGER_DEFERRED_IMPLEMENT(7)
+XLOGGER_DEFERRED_IMPLEMENT(8)
+XLOGGER_DEFERRED_IMPLEMENT(9)
+XLOGGER_DEFERRED_IMPLEMENT(10)
+XLOGGER_DEFERRED_IMPLEMENT(11)
+XLOGGER_DEFERRED_IMPLEMENT(12)
+XLOGGER_DEFERRED_IMPLEMENT(13)
+XLOGGER_DEFERRED_IMPLEMENT(14)
+XLOGGER_DEFERRED_IMPLEMENT(15)
+XLOGGER_DEFERRED_IMPLEMENT(16)
+
+#undef XLOGGER_DEFERRED_ARGS
+#undef XLOGGER_DEFERRED_ARGS_PTR
+#undef XLOGGER_DEFERRED_IMPLEMENT
+
+inline void XDeferredLogger::DoWrite(const XDeferredArg** _args, int _count) {
+    char buffer[4096];
+    uint8_t count = 0;
+    size_t len = sizeof(count);
+
+    for (int i = 0; i < _count; ++i) {
+        size_t arg_len = _args[i]->Encode(buffer + len, sizeof(buffer) - len);
+        if (0 == arg_len) break;
+
+        len += arg_len;
+        ++count;
+    }
+
+    memcpy(buffer, &count, sizeof(count));
+    xlogger_WriteDeferred(m_level, m_callsite, buffer, len);
+}
+
 #endif //cpp
 
 
@@ -705,6 +877,18 @@ static const char* __my_xlogger_tag = "prefix_"XLOGGER_TAG"_suffix";
 */
 
 #define xdump xlogger_dump
+
+#ifndef XLOGGER_DISABLE
+// one load and one compare of the generation while no filter level changes.
+static __inline int __xlogger_IsEnabledForCallSite(XLoggerFilterCache* _cache, TLogLevel _level, const char* _tag, const char* _file) {
+    uint32_t state = _cache->state;
+#ifdef __GNUC__
+    if (NULL == &xlogger_filter_generation) return 0;
+#endif
+    if ((state >> 3) == xlogger_filter_generation) return (uint32_t)_level >= (state & 0x7);
+    return xlogger_UpdateFilterCache(_cache, _tag, _file) <= _level;
+}
+#endif
 #define XLOGGER_ROUTER_OUTPUT(op1,op,...) PP_IF(PP_NUM_PARAMS(__VA_ARGS__),PP_IF(PP_DEC(PP_NUM_PARAMS(__VA_ARGS__)),op,op1), )
 
 #if !defined(__cplusplus)
@@ -714,15 +898,17 @@ __attribute__((__format__ (printf, 2, 3)))
 #endif
 __inline void  __xlogger_c_write(const XLoggerInfo* _info, const char* _log, ...) { xlogger_Write(_info, _log); }
 
-#define xlogger2(level, tag, file, func, line, ...)      if ((!xlogger_IsEnabledFor(level)));\
+#define xlogger2(level, tag, file, func, line, ...)      do { static XLoggerFilterCache __xlogger_filter__ = {0};\
+															  if ((!__xlogger_IsEnabledForCallSite(&__xlogger_filter__, level, tag, file)));\
 															  else { XLoggerInfo info= {level, tag, file, func, line,\
-																	 {0, 0}, -1, -1, -1};\ gettimeofday(&info.m_tv, NULL);\
-																	 XLOGGER_ROUTER_OUTPUT(__xlogger_c_write(&info, __VA_ARGS__),xlogger_Print(&info, __VA_ARGS__), __VA_ARGS__);}
+																	 {0, 0}, -1, -1, -1}; gettimeofday(&info.timeval, NULL);\
+																	 XLOGGER_ROUTER_OUTPUT(__xlogger_c_write(&info, __VA_ARGS__),xlogger_Print(&info, __VA_ARGS__), __VA_ARGS__);} } while (0)
 
-#define xlogger2_if(exp, level, tag, file, func, line, ...)    if (!(exp) || !xlogger_IsEnabledFor(level));\
+#define xlogger2_if(exp, level, tag, file, func, line, ...)    do { static XLoggerFilterCache __xlogger_filter__ = {0};\
+																	if (!(exp) || !__xlogger_IsEnabledForCallSite(&__xlogger_filter__, level, tag, file));\
 																	else { XLoggerInfo info= {level, tag, file, func, line,\
 																		   {0, 0}, -1, -1, -1}; gettimeofday(&info.timeval, NULL);\
-																		   XLOGGER_ROUTER_OUTPUT(__xlogger_c_write(&info, __VA_ARGS__),xlogger_Print(&info, __VA_ARGS__), __VA_ARGS__);}
+																		   XLOGGER_ROUTER_OUTPUT(__xlogger_c_write(&info, __VA_ARGS__),xlogger_Print(&info, __VA_ARGS__), __VA_ARGS__);} } while (0)
 
 #define __xlogger_c_impl(level,  ...) 			xlogger2(level, XLOGGER_TAG, __XFILE__, __XFUNCTION__, __LINE__, __VA_ARGS__)
 #define __xlogger_c_impl_if(level, exp, ...) 	xlogger2_if(exp, level, XLOGGER_TAG, __XFILE__, __XFUNCTION__, __LINE__, __VA_ARGS__)
@@ -744,7 +930,7 @@ __inline void  __xlogger_c_write(const XLoggerInfo* _info, const char* _log, ...
 #define xassert2(exp, ...)    if (((exp) || !xlogger_IsEnabledFor(kLevelFatal)));else {\
                                     XLoggerInfo info= {kLevelFatal, XLOGGER_TAG, __XFILE__, __XFUNCTION__, __LINE__,\
                                     {0, 0}, -1, -1, -1};\
-                                    gettimeofday(&info.m_tv, NULL);\
+                                    gettimeofday(&info.timeval, NULL);\
                                     xlogger_AssertP(&info, #exp, __VA_ARGS__);}
 //"##__VA_ARGS__" remove "," if NULL
 #else
@@ -753,15 +939,27 @@ __inline void  __xlogger_c_write(const XLoggerInfo* _info, const char* _log, ...
 #define XLOGGER_HOOK NULL
 #endif
 
-#define xlogger(level, tag, file, func, line, ...)     if ((!xlogger_IsEnabledFor(level)));\
+/*
+ * the statements below are expressions that go on with "<<" or "()", so the filter cache of a statement
+ * can't be a local static. it is a static member of a template instantiated once per statement,
+ * __COUNTER__ is unique in a translation unit and the anonymous namespace keeps units apart.
+ */
+namespace {
+template <int N> struct XLoggerFilterSite { static XLoggerFilterCache cache; };
+template <int N> XLoggerFilterCache XLoggerFilterSite<N>::cache = {0};
+}
+
+#define __xlogger_filter_enabled(level, tag, file)    __xlogger_IsEnabledForCallSite(&XLoggerFilterSite<__COUNTER__>::cache, level, tag, file)
+
+#define xlogger(level, tag, file, func, line, ...)     if ((!__xlogger_filter_enabled(level, tag, file)));\
 													   else XLogger(level, tag, file, func, line, XLOGGER_HOOK)\
 													   	     XLOGGER_ROUTER_OUTPUT(.WriteNoFormat(TSF __VA_ARGS__),(TSF __VA_ARGS__), __VA_ARGS__)
 
-#define xlogger2(level, tag, file, func, line, ...)     if ((!xlogger_IsEnabledFor(level)));\
+#define xlogger2(level, tag, file, func, line, ...)     if ((!__xlogger_filter_enabled(level, tag, file)));\
 									 	 	 	   	    else XLogger(level, tag, file, func, line, XLOGGER_HOOK)\
 															 XLOGGER_ROUTER_OUTPUT(.WriteNoFormat(__VA_ARGS__),(__VA_ARGS__), __VA_ARGS__)
 
-#define xlogger2_if(exp, level, tag, file, func, line, ...)     if ((!(exp) || !xlogger_IsEnabledFor(level)));\
+#define xlogger2_if(exp, level, tag, file, func, line, ...)     if ((!(exp) || !__xlogger_filter_enabled(level, tag, file)));\
 																else XLogger(level, tag, file, func, line, XLOGGER_HOOK)\
 																 	 XLOGGER_ROUTER_OUTPUT(.WriteNoFormat(__VA_ARGS__),(__VA_ARGS__), __VA_ARGS__)
 
@@ -784,6 +982,22 @@ __inline void  __xlogger_c_write(const XLoggerInfo* _info, const char* _log, ...
 #define xfatal2_if(exp, ...)       __xlogger_cpp_impl_ifkLevelFatal, exp, __VA_ARGS__)
 #define xlog2_if(level, ...)	   __xlogger_cpp_impl_if(level, __VA_ARGS__)
 
+#define xlogger2_deferred(level, tag, file, func, line, format, ...)     do { static XLoggerFilterCache __xlogger_filter__ = {0};\
+													if (__xlogger_IsEnabledForCallSite(&__xlogger_filter__, level, tag, file)) {\
+														static XLoggerCallSite __xlogger_callsite__ = {0, 0, tag, file, func, line, format};\
+														XDeferredLogger(level, &__xlogger_callsite__)(__VA_ARGS__);\
+													} } while (0)
+
+#define __xlogger_cpp_impl_deferred(level, ...)     xlogger2_deferred(level, XLOGGER_TAG, __XFILE__, __XFUNCTION__, __LINE__, __VA_ARGS__)
+
+// format is a literal type safe format("%0", "%_"), the args are rendered when the log file is decoded.
+#define xverbose2_deferred(...)    __xlogger_cpp_impl_deferred(kLevelVerbose, __VA_ARGS__)
+#define xdebug2_deferred(...)      __xlogger_cpp_impl_deferred(kLevelDebug, __VA_ARGS__)
+#define xinfo2_deferred(...)       __xlogger_cpp_impl_deferred(kLevelInfo, __VA_ARGS__)
+#define xwarn2_deferred(...)       __xlogger_cpp_impl_deferred(kLevelWarn, __VA_ARGS__)
+#define xerror2_deferred(...)      __xlogger_cpp_impl_deferred(kLevelError, __VA_ARGS__)
+#define xfatal2_deferred(...)      __xlogger_cpp_impl_deferred(kLevelFatal, __VA_ARGS__)
+
 #define xgroup2_define(group)      XLogger group(kLevelAll, XLOGGER_TAG, __XFILE__, __XFUNCTION__, __LINE__, XLOGGER_HOOK)
 #define xgroup2(...)               XLogger(kLevelAll, XLOGGER_TAG, __XFILE__, __XFUNCTION__, __LINE__, XLOGGER_HOOK)(__VA_ARGS__)
 #define xgroup2_if(exp, ...)       if ((!(exp))); else XLogger(kLevelAll, XLOGGER_TAG, __XFILE__, __XFUNCTION__, __LINE__, XLOGGER_HOOK)(__VA_ARGS__)
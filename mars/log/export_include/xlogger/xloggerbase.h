@@ -52,16 +52,63 @@ typedef struct XLoggerInfo_t {
     intmax_t maintid;
 } XLoggerInfo;
 
+/*
+ * static description of a deferred log statement, one per call site.
+ * the appender writes it once into the log, later records only carry its id and the raw args.
+ */
+typedef struct XLoggerCallSite_t {
+    volatile uint32_t id;           // assigned by the appender on first use
+    volatile uint32_t generation;   // of the log block the description was last written into
+    const char* tag;
+    const char* filename;
+    const char* func_name;
+    int line;
+    const char* format;             // type safe format, "%0" "%_"
+} XLoggerCallSite;
+
+/*
+ * level filter of one log statement, kept until a filter level changes.
+ * state is (filter generation << 3 | lowest enabled level), 0 before the first check.
+ */
+typedef struct XLoggerFilterCache_t {
+    volatile uint32_t state;
+} XLoggerFilterCache;
+
+// bumped whenever the global level or a filter level changes, never 0.
+#ifdef __GNUC__
+extern volatile uint32_t xlogger_filter_generation __attribute__((weak));
+#else
+extern volatile uint32_t xlogger_filter_generation;
+#endif
+
 extern intmax_t xlogger_pid();
 extern intmax_t xlogger_tid();
 extern intmax_t xlogger_maintid();
 typedef void (*xlogger_appender_t)(const XLoggerInfo* _info, const char* _log);
+typedef void (*xlogger_deferred_appender_t)(TLogLevel _level, XLoggerCallSite* _callsite, const void* _args, size_t _len);
 extern const char* xlogger_dump(const void* _dumpbuffer, size_t _len);
 
 TLogLevel   xlogger_Level();
 void xlogger_SetLevel(TLogLevel _level);
+// _level is enabled for some tag, the global level or a lower filter level allows it.
 int  xlogger_IsEnabledFor(TLogLevel _level);
+
+/*
+ * filter levels override the global level.
+ * a tag prefix covers its sub modules, "mars::stn" covers "mars::stn" and "mars::stn::longlink", not "mars::stnx".
+ * a file pattern matches from the start of a path component, "stn/" covers every file under a stn directory.
+ * the longest matching file pattern wins, then the longest matching tag prefix, then the global level.
+ */
+void xlogger_SetTagLevel(const char* _tag_prefix, TLogLevel _level);
+void xlogger_SetFileLevel(const char* _file_pattern, TLogLevel _level);
+void xlogger_ClearFilterLevels();
+TLogLevel xlogger_FilterLevel(const char* _tag, const char* _file);
+int  xlogger_IsEnabledForTag(TLogLevel _level, const char* _tag, const char* _file);
+// slow path of a log statement, returns the lowest enabled level and caches it in _cache.
+TLogLevel xlogger_UpdateFilterCache(XLoggerFilterCache* _cache, const char* _tag, const char* _file);
+
 xlogger_appender_t xlogger_SetAppender(xlogger_appender_t _appender);
+xlogger_deferred_appender_t xlogger_SetDeferredAppender(xlogger_deferred_appender_t _appender);
 
 // no level filter
 #ifdef __GNUC__
@@ -78,6 +125,7 @@ __attribute__((__format__(printf, 2, 3)))
 #endif
 void        xlogger_Print(const XLoggerInfo* _info, const char* _format, ...);
 void        xlogger_Write(const XLoggerInfo* _info, const char* _log);
+void        xlogger_WriteDeferred(TLogLevel _level, XLoggerCallSite* _callsite, const void* _args, size_t _len);
 
 #ifdef __cplusplus
 }
@@ -100,6 +100,10 @@ JNIEXPORT void JNICALL Java_com_tencent_mars_xlog_Xlog_logWrite
 	xlog_info.filename = filename_jstr.GetChar();
 	xlog_info.func_name = funcname_jstr.GetChar();
 
+	if (!xlogger_IsEnabledForTag(xlog_info.level, xlog_info.tag, xlog_info.filename)) {
+		return;
+	}
+
 	xlogger_Write(&xlog_info, log_jst.GetChar());
 
 }
@@ -146,7 +150,9 @@ JNIEXPORT void JNICALL Java_com_tencent_mars_xlog_Xlog_logWrite2
 	xlog_info.filename = NULL == filename_cstr ? "" : filename_cstr;
 	xlog_info.func_name = NULL == funcname_cstr ? "" : funcname_cstr;
 
-	xlogger_Write(&xlog_info, NULL == log_cstr ? "NULL == log" : log_cstr);
+	if (xlogger_IsEnabledForTag(xlog_info.level, xlog_info.tag, xlog_info.filename)) {
+		xlogger_Write(&xlog_info, NULL == log_cstr ? "NULL == log" : log_cstr);
+	}
 
 	if (NULL != _tag) {
 		env->ReleaseStringUTFChars(_tag, tag_cstr);
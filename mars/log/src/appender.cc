@@ -46,6 +46,8 @@
 #include <zlib.h>
 
 #include <string>
+#include <list>
+#include <vector>
 #include <algorithm>
 
 #include "boost/bind.hpp"
@@ -55,6 +57,7 @@
 #include "mars/comm/thread/lock.h"
 #include "mars/comm/thread/condition.h"
 #include "mars/comm/thread/thread.h"
+#include "mars/comm/thread/atomic_oper.h"
 #include "mars/comm/scope_recursion_limit.h"
 #include "mars/comm/bootrun.h"
 #include "mars/comm/tickcount.h"
@@ -68,12 +71,19 @@
 #include "mars/comm/verinfo.h"
 
 #include "log_buffer.h"
+#include "log_compress.h"
+#include "log_index.h"
+#include "log_staging_ring.h"
+#include "log_rate_limiter.h"
+#include "log_record.h"
 
 #define LOG_EXT "xlog"
 
 extern void log_formater(const XLoggerInfo* _info, const char* _logbody, PtrBuffer& _log);
 extern void ConsoleLog(const XLoggerInfo* _info, const char* _log);
 
+static int __local_gmtoff();
+
 static TAppenderMode sg_mode = kAppednerAsync;
 
 static std::string sg_logdir;
@@ -82,6 +92,7 @@ static std::string sg_logfileprefix;
 
 static Mutex sg_mutex_log_file;
 static FILE* sg_logfile = NULL;
+static std::string sg_logfile_path;
 static time_t sg_openfiletime = 0;
 static std::string sg_current_dir;
 
@@ -91,8 +102,14 @@ static Condition& sg_cond_buffer_async = *(new Condition());  // 改成引用, 
 #else
 static Condition sg_cond_buffer_async;
 #endif
+static Condition sg_cond_buffer_drained;    // a flush swapped in an empty block, kBackpressureBlock writers wait for it
+
+static Mutex sg_mutex_flush_async;    // serializes the flushers, taken before sg_mutex_buffer_async
 
-static LogBuffer* sg_log_buff = NULL;
+static const unsigned int kBufferBlockCount = 2;
+static LogBuffer* sg_log_buffs[kBufferBlockCount] = {NULL};
+static unsigned int sg_active_buff = 0;
+static LogBuffer* sg_log_buff = NULL;    // the active one of sg_log_buffs, writers append to it
 
 static volatile bool sg_log_close = true;
 
@@ -105,6 +122,7 @@ static bool sg_consolelog_open = false;
 #endif
 
 static void __async_log_thread();
+static void __append_suppressed_report();
 static Thread sg_thread_async(&__async_log_thread);
 
 static const unsigned int kBufferBlockLength = 150 * 1024;
@@ -114,6 +132,45 @@ static std::string sg_log_extra_msg;
 
 static boost::iostreams::mapped_file sg_mmmap_file;
 
+static const uint32_t kStagingRingLength = 64 * 1024;
+static const long kStagingDrainInterval = 1000;  // ms
+
+static volatile bool sg_staging_open = false;
+static Mutex sg_mutex_staging;
+static std::list<LogStagingRing*> sg_staging_rings;
+
+static void __detach_staging_ring(void* _ring) {
+    ((LogStagingRing*)_ring)->Detach();
+}
+static Tss sg_tss_staging_ring(&__detach_staging_ring);
+
+static uint32_t sg_deferred_generation = 1;    // of the active block, bumped whenever an empty one is swapped in, guarded by sg_mutex_buffer_async
+static Mutex sg_mutex_deferred_callsites;
+static std::vector<XLoggerCallSite*> sg_deferred_callsites;    // by id - 1, call sites are static
+static int sg_deferred_gmtoff = 0;
+
+static TCompressMode sg_compress_mode = kCompressZlib;
+static int sg_compress_level = Z_BEST_COMPRESSION;
+static bool sg_compress_flush_every_line = true;
+
+static TBackpressurePolicy sg_backpressure_policy = kBackpressureDropNewest;
+static unsigned int sg_block_timeout = 100;  // ms
+static XLogBackpressureStat sg_backpressure_stat = {0, 0, 0, 0, 0, 0, 0};    // guarded by sg_mutex_buffer_async
+static uint32_t sg_block_dropped_lines = 0;    // of the active block, guarded by sg_mutex_buffer_async
+static uint32_t sg_block_spilled_lines = 0;
+static const size_t kMaxSpillPending = 1024 * 1024;    // a drain of the staging rings spills up to kStagingRingLength per ring
+static AutoBuffer sg_spill_pending;         // spilled lines not on disk yet, guarded by sg_mutex_buffer_async
+static uint32_t sg_spill_pending_lines = 0;
+static uint64_t sg_spill_pending_bytes = 0;
+static Mutex sg_mutex_spill_file;           // serializes the spill writers, taken before sg_mutex_buffer_async
+static FILE* sg_spill_file = NULL;          // guarded by sg_mutex_spill_file
+static time_t sg_spill_file_time = 0;
+
+static LogRateLimiter sg_rate_limiter;
+static const uint64_t kSuppressedReportInterval = 60 * 1000;  // ms
+
+static volatile appender_flush_observer_t sg_flush_observer = NULL;
+
 namespace {
 class ScopeErrno {
   public:
@@ -274,6 +331,7 @@ static void __move_old_files(const std::string& _src_path, const std::string& _d
         }
         
         boost::filesystem::remove(iter->path());
+        LogIndex::Remove(iter->path().string().c_str());
     }
 }
 
@@ -294,7 +352,8 @@ static void __writetips2console(const char* _tips_format, ...) {
     ConsoleLog(&info, tips_info);
 }
 
-static bool __writefile(const void* _data, size_t _len, FILE* _file) {
+// _line_count and _level_mask describe the log block in _data for the index of the file, 0 if unknown.
+static bool __writefile(const void* _data, size_t _len, FILE* _file, uint32_t _line_count = 0, uint8_t _level_mask = 0) {
     if (NULL == _file) {
         assert(false);
         return false;
@@ -324,6 +383,8 @@ static bool __writefile(const void* _data, size_t _len, FILE* _file) {
         return false;
     }
 
+    if (_file == sg_logfile) LogIndex::Append(sg_logfile_path.c_str(), before_len, _data, _len, _line_count, _level_mask);
+
     return true;
 }
 
@@ -359,6 +420,7 @@ static bool __openlogfile(const std::string& _log_dir) {
 
     if (now_time < s_last_time) {
         sg_logfile = fopen(s_last_file_path, "ab");
+        sg_logfile_path = s_last_file_path;
 
 		if (NULL == sg_logfile) {
             __writetips2console("open file error:%d %s, path:%s", errno, strerror(errno), s_last_file_path);
@@ -371,6 +433,7 @@ static bool __openlogfile(const std::string& _log_dir) {
     }
 
     sg_logfile = fopen(logfilepath, "ab");
+    sg_logfile_path = logfilepath;
 
 	if (NULL == sg_logfile) {
         __writetips2console("open file error:%d %s, path:%s", errno, strerror(errno), logfilepath);
@@ -395,6 +458,10 @@ static bool __openlogfile(const std::string& _log_dir) {
         __writefile(tmp, len, sg_logfile);
     }
 
+    if (0 != strncmp(s_last_file_path, logfilepath, sizeof(s_last_file_path))) {
+        sg_deferred_gmtoff = __local_gmtoff();
+    }
+
     memcpy(s_last_file_path, logfilepath, sizeof(s_last_file_path));
     s_last_tick = now_tick;
     s_last_time = now_time;
@@ -413,7 +480,7 @@ static void __closelogfile() {
     sg_logfile = NULL;
 }
 
-static void __log2file(const void* _data, size_t _len) {
+static void __log2file(const void* _data, size_t _len, uint32_t _line_count = 0, uint8_t _level_mask = 0) {
 	if (NULL == _data || 0 == _len || sg_logdir.empty()) {
 		return;
 	}
@@ -422,7 +489,7 @@ static void __log2file(const void* _data, size_t _len) {
 
 	if (sg_cache_logdir.empty()) {
         if (__openlogfile(sg_logdir)) {
-            __writefile(_data, _len, sg_logfile);
+            __writefile(_data, _len, sg_logfile, _line_count, _level_mask);
             if (kAppednerAsync == sg_mode) {
                 __closelogfile();
             }
@@ -437,7 +504,7 @@ static void __log2file(const void* _data, size_t _len) {
     __make_logfilename(tv, sg_cache_logdir, sg_logfileprefix.c_str(), LOG_EXT, logcachefilepath , 1024);
     
     if (boost::filesystem::exists(logcachefilepath) && __openlogfile(sg_cache_logdir)) {
-        __writefile(_data, _len, sg_logfile);
+        __writefile(_data, _len, sg_logfile, _line_count, _level_mask);
         if (kAppednerAsync == sg_mode) {
             __closelogfile();
         }
@@ -450,12 +517,13 @@ static void __log2file(const void* _data, size_t _len) {
                 __closelogfile();
             }
             remove(logcachefilepath);
+            LogIndex::Remove(logcachefilepath);
         }
     } else {
         bool write_sucess = false;
         bool open_success = __openlogfile(sg_logdir);
         if (open_success) {
-            write_sucess = __writefile(_data, _len, sg_logfile);
+            write_sucess = __writefile(_data, _len, sg_logfile, _line_count, _level_mask);
             if (kAppednerAsync == sg_mode) {
                 __closelogfile();
             }
@@ -467,7 +535,7 @@ static void __log2file(const void* _data, size_t _len) {
             }
 
             if (__openlogfile(sg_cache_logdir)) {
-                __writefile(_data, _len, sg_logfile);
+                __writefile(_data, _len, sg_logfile, _line_count, _level_mask);
                 if (kAppednerAsync == sg_mode) {
                     __closelogfile();
                 }
@@ -498,57 +566,406 @@ static void __writetips2file(const char* _tips_format, ...) {
     __log2file(tmp, len);
 }
 
-static void __async_log_thread() {
-    while (true) {
+static bool __is_buffer_full() {
+    return sg_log_buff->GetData().Length() >= kBufferBlockLength*4/5;
+}
+
+// lines that don't fit in the buffer are written like sync mode lines to <prefix>_<date>.spill.xlog.
+// the call site of a record in _data, NULL for a text line.
+static XLoggerCallSite* __deferred_callsite(const void* _data, size_t _len) {
+    uint32_t id = LogRecord::GetCallSiteId((const char*)_data, _len);
+    if (0 == id) return NULL;
+
+    ScopedLock lock(sg_mutex_deferred_callsites);
+    return id <= sg_deferred_callsites.size() ? sg_deferred_callsites[id - 1] : NULL;
+}
+
+// a sync line or a spilled line is a block of its own, a record takes the description of its call site along.
+static bool __describe_record(const void* _data, size_t _len, PtrBuffer& _out) {
+    XLoggerCallSite* callsite = __deferred_callsite(_data, _len);
+    if (NULL != callsite && !LogRecord::WriteCallSite(_out, callsite, xlogger_pid(), sg_deferred_gmtoff)) return false;
+    if (_out.MaxLength() - _out.Length() < _len) return false;
+
+    _out.Write(_data, _len);
+    return true;
+}
+
+/*
+ * must be called with sg_mutex_buffer_async locked.
+ * the line is only encoded into sg_spill_pending here, __spill2file writes it once the caller unlocked.
+ */
+static bool __spill2buffer(const void* _data, size_t _len) {
+    if (sg_logdir.empty()) return false;
+
+    char temp[16 * 1024];
+    PtrBuffer line(temp, 0, sizeof(temp));
+    if (!__describe_record(_data, _len, line)) return false;
+
+    char buffer_crypt[16 * 1024] = {0};
+    size_t len = sizeof(buffer_crypt);
+    if (!LogBuffer::Write(line.Ptr(), line.Length(), buffer_crypt, len)) return false;
+    if (sg_spill_pending.Length() + len > kMaxSpillPending) return false;
+
+    sg_spill_pending.Write(buffer_crypt, len);
+    ++sg_spill_pending_lines;
+    sg_spill_pending_bytes += _len;
+    return true;
+}
+
+// must be called with sg_mutex_spill_file locked.
+static bool __write_spill_file(const void* _data, size_t _len) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    if (NULL != sg_spill_file) {
+        time_t sec = tv.tv_sec;
+        tm tcur = *localtime((const time_t*)&sec);
+        tm filetm = *localtime(&sg_spill_file_time);
+
+        if (filetm.tm_year != tcur.tm_year || filetm.tm_mon != tcur.tm_mon || filetm.tm_mday != tcur.tm_mday) {
+            fclose(sg_spill_file);
+            sg_spill_file = NULL;
+        }
+    }
+
+    if (NULL == sg_spill_file) {
+        char spill_file_path[1024] = {0};
+        __make_logfilename(tv, sg_logdir, sg_logfileprefix.c_str(), "spill." LOG_EXT, spill_file_path, sizeof(spill_file_path));
+
+        sg_spill_file = fopen(spill_file_path, "ab");
+        sg_spill_file_time = tv.tv_sec;
+        if (NULL == sg_spill_file) return false;
+    }
+
+    if (1 != fwrite(_data, _len, 1, sg_spill_file)) return false;
+    fflush(sg_spill_file);
+    return true;
+}
+
+/*
+ * must be called with sg_mutex_buffer_async unlocked.
+ * takes the spilled lines out under the lock and writes them to the file after unlocking,
+ * they are counted once the write is done, lines lost on the way are counted as dropped.
+ */
+static void __spill2file() {
+    ScopedLock lock_file(sg_mutex_spill_file);
+    ScopedLock lock_buffer(sg_mutex_buffer_async);
+    if (0 == sg_spill_pending.Length()) return;
+
+    AutoBuffer spilled;
+    spilled.Attach(sg_spill_pending);
+    uint32_t lines = sg_spill_pending_lines;
+    uint64_t bytes = sg_spill_pending_bytes;
+    sg_spill_pending_lines = 0;
+    sg_spill_pending_bytes = 0;
+    lock_buffer.unlock();
+
+    bool written = __write_spill_file(spilled.Ptr(), spilled.Length());
+
+    lock_buffer.lock();
+    if (written) {
+        sg_block_spilled_lines += lines;
+        sg_backpressure_stat.spilled_lines += lines;
+        sg_backpressure_stat.spilled_bytes += bytes;
+    } else {
+        sg_block_dropped_lines += lines;
+        sg_backpressure_stat.dropped_lines += lines;
+        sg_backpressure_stat.dropped_bytes += bytes;
+    }
+}
+
+// waits until a flush swaps in an empty block, or sg_block_timeout.
+static void __wait_buffer_drained(ScopedLock& _lock) {
+    uint64_t begin_tick = gettickcount();
+
+    while (NULL != sg_log_buff && !sg_log_close && __is_buffer_full()) {
+        int64_t left = (int64_t)sg_block_timeout - gettickspan(begin_tick);
+        if (0 >= left) {
+            ++sg_backpressure_stat.block_timeouts;
+            break;
+        }
+
+        sg_cond_buffer_async.notifyAll();
+        sg_cond_buffer_drained.wait(_lock, (long)left);
+    }
+
+    ++sg_backpressure_stat.blocked_lines;
+    sg_backpressure_stat.blocked_ms += (uint64_t)gettickspan(begin_tick);
+}
+
+/*
+ * must be called with sg_mutex_buffer_async locked.
+ * the decoder needs the description of a call site before its records, it goes into the active block
+ * ahead of the first record of the call site in it, whichever thread or staging ring the record comes from.
+ */
+static bool __describe_in_block(const void* _data, size_t _len) {
+    XLoggerCallSite* callsite = __deferred_callsite(_data, _len);
+    if (NULL == callsite || sg_deferred_generation == callsite->generation) return true;
+
+    char temp[16 * 1024];
+    PtrBuffer description(temp, 0, sizeof(temp));
+    if (!LogRecord::WriteCallSite(description, callsite, xlogger_pid(), sg_deferred_gmtoff)
+            || !sg_log_buff->Write(description.Ptr(), (unsigned int)description.Length())) return false;
+
+    callsite->generation = sg_deferred_generation;
+    return true;
+}
+
+/*
+ * must be called with sg_mutex_buffer_async locked, _lock is NULL if the caller can't wait for a flush.
+ * the buffer is full at 4/5 of a block, the rest is kept for the stream end and the warning of lost lines.
+ * a spilled line waits in sg_spill_pending, the caller calls __spill2file after unlocking.
+ */
+static void __write_async_buffer(ScopedLock* _lock, const void* _data, size_t _len) {
+    if (NULL == sg_log_buff) return;
+
+    // the async thread is the one that would drain the buffer.
+    if (kBackpressureBlock == sg_backpressure_policy && NULL != _lock && __is_buffer_full()
+            && sg_thread_async.tid() != ThreadUtil::currentthreadid()) {
+        __wait_buffer_drained(*_lock);
+        if (NULL == sg_log_buff) return;
+    }
+
+    if (!__is_buffer_full() && __describe_in_block(_data, _len) && sg_log_buff->Write(_data, (unsigned int)_len)) return;
+
+    sg_cond_buffer_async.notifyAll();
+
+    if (kBackpressureSpill == sg_backpressure_policy && __spill2buffer(_data, _len)) return;
+
+    ++sg_block_dropped_lines;
+    ++sg_backpressure_stat.dropped_lines;
+    sg_backpressure_stat.dropped_bytes += _len;
+}
+
+// must be called with sg_mutex_buffer_async locked, it is the only consumer of the staging rings.
+static void __drain_staging_rings() {
+    ScopedLock lock(sg_mutex_staging);
+
+    char temp[16 * 1024];
+    for (std::list<LogStagingRing*>::iterator it = sg_staging_rings.begin(); it != sg_staging_rings.end();) {
+        LogStagingRing* ring = *it;
+        // read before popping, lines pushed before the owner thread exited must be drained too.
+        bool detached = ring->IsDetached();
+
+        size_t len = 0;
+        while (0 != (len = ring->Pop(temp, sizeof(temp)))) {
+            __write_async_buffer(NULL, temp, len);
+        }
+
+        if (detached) {
+            delete ring;
+            it = sg_staging_rings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// staged lines are not in the mmap cache until they are drained, so drain them periodically while waiting.
+static void __wait_async_flush() {
+    // a statement that went quiet still gets its report about one interval later.
+    uint64_t timeout = sg_rate_limiter.Pending() ? kSuppressedReportInterval : 15 * 60 * 1000;
+
+    if (!sg_staging_open) {
+        sg_cond_buffer_async.wait((long)timeout);
+        return;
+    }
+
+    uint64_t begin_tick = gettickcount();
+    while ((uint64_t)gettickspan(begin_tick) < timeout) {
+        if (0 == sg_cond_buffer_async.wait(kStagingDrainInterval)) return;
 
         ScopedLock lock_buffer(sg_mutex_buffer_async);
+        if (NULL == sg_log_buff || sg_log_close) return;
+
+        __drain_staging_rings();
+        if (sg_log_buff->GetData().Length() >= kBufferBlockLength*1/3) return;
+    }
+}
+
+/*
+ * the mmap cache is split into kBufferBlockCount blocks, writers append to the active one.
+ * a flush seals the active block and swaps in the next one which is always empty,
+ * then writes the sealed block to file straight from the cache without holding sg_mutex_buffer_async.
+ */
+static bool __flush_async_buffer() {
+    struct timeval begin;
+    gettimeofday(&begin, NULL);
+
+    ScopedLock lock_flush(sg_mutex_flush_async);
+    ScopedLock lock_buffer(sg_mutex_buffer_async);
+
+    if (NULL == sg_log_buff) return false;
+
+    __drain_staging_rings();
+
+    LogBuffer* sealed = sg_log_buff;
+    if (!sealed->Seal()) return true;
+
+    sg_active_buff = (sg_active_buff + 1) % kBufferBlockCount;
+    sg_log_buff = sg_log_buffs[sg_active_buff];
+    ++sg_deferred_generation;
+
+    // the lines lost while the sealed block was full are told at the head of the next one.
+    if (0 != sg_block_dropped_lines || 0 != sg_block_spilled_lines) {
+        char warning[256] = {0};
+        int len = snprintf(warning, sizeof(warning), "[F][ log buffer full, %u lines dropped, %u lines spilled, policy:%d\n",
+                           sg_block_dropped_lines, sg_block_spilled_lines, (int)sg_backpressure_policy);
+        sg_log_buff->Write(warning, (unsigned int)len);
+        sg_block_dropped_lines = 0;
+        sg_block_spilled_lines = 0;
+    }
+
+    sg_cond_buffer_drained.notifyAll(lock_buffer);
+    bool spilled = 0 != sg_spill_pending.Length();
+    lock_buffer.unlock();
+
+    size_t len = sealed->GetData().Length();
+    __log2file(sealed->GetData().Ptr(), len, sealed->GetLineCount(), sealed->GetLevelMask());
+    sealed->Clear();
+
+    if (spilled) __spill2file();
+
+    appender_flush_observer_t observer = sg_flush_observer;
+    if (NULL != observer) {
+        struct timeval end;
+        gettimeofday(&end, NULL);
+        observer((uint64_t)((int64_t)(end.tv_sec - begin.tv_sec) * 1000000 + (end.tv_usec - begin.tv_usec)), len);
+    }
+    return true;
+}
 
-        if (NULL == sg_log_buff) break;
+// flushes the blocks left in the cache by the last run, oldest first.
+static void __flush_recovered_buffers(AutoBuffer& _buff) {
+    std::vector<LogBuffer*> buffs;
+    for (unsigned int i = 0; i < kBufferBlockCount; ++i) {
+        if (0 != sg_log_buffs[i]->GetSeq()) buffs.push_back(sg_log_buffs[i]);
+    }
 
-        AutoBuffer tmp;
-        sg_log_buff->Flush(tmp);
-        lock_buffer.unlock();
+    // insertion sort by seq, which wraps around.
+    for (size_t i = 1; i < buffs.size(); ++i) {
+        for (size_t j = i; j > 0 && (int16_t)(buffs[j]->GetSeq() - buffs[j-1]->GetSeq()) < 0; --j) {
+            std::swap(buffs[j], buffs[j-1]);
+        }
+    }
 
-		if (NULL != tmp.Ptr())  __log2file(tmp.Ptr(), tmp.Length());
+    for (size_t i = 0; i < buffs.size(); ++i) {
+        buffs[i]->Flush(_buff);
+    }
+}
+
+static void __async_log_thread() {
+    while (true) {
+
+        if (!__flush_async_buffer()) break;
 
         if (sg_log_close) break;
 
-        sg_cond_buffer_async.wait(15 * 60 *1000);
+        // right after the flush there is room for it, it goes out with the next one.
+        __append_suppressed_report();
+
+        __wait_async_flush();
     }
 }
 
-static void __appender_sync(const XLoggerInfo* _info, const char* _log) {
+static void __append_sync(const void* _data, size_t _len) {
 
-    char temp[16 * 1024] = {0};     // tell perry,ray if you want modify size.
-    PtrBuffer log(temp, 0, sizeof(temp));
-    log_formater(_info, _log, log);
+    char temp[16 * 1024];
+    PtrBuffer line(temp, 0, sizeof(temp));
+    if (!__describe_record(_data, _len, line)) return;
 
     char buffer_crypt[16 * 1024] = {0};
     size_t len = 16 * 1024;
-    if (!LogBuffer::Write(log.Ptr(), log.Length(), buffer_crypt, len))   return;
+    if (!LogBuffer::Write(line.Ptr(), line.Length(), buffer_crypt, len))   return;
 
-    __log2file(buffer_crypt, len);
+    int level = LogIndex::GetLevel(_data, _len);
+    if (0 <= level) __log2file(buffer_crypt, len, 1, (uint8_t)(1 << level));
+    else __log2file(buffer_crypt, len);
 }
 
-static void __appender_async(const XLoggerInfo* _info, const char* _log) {
+static void __append_async(const void* _data, size_t _len, bool _is_fatal) {
     ScopedLock lock(sg_mutex_buffer_async);
     if (NULL == sg_log_buff) return;
 
-    char temp[16*1024] = {0};       //tell perry,ray if you want modify size.
-    PtrBuffer log_buff(temp, 0, sizeof(temp));
-    log_formater(_info, _log, log_buff);
+    LogStagingRing* ring = (LogStagingRing*)sg_tss_staging_ring.get();
+    if (NULL != ring && 0 != ring->Size()) __drain_staging_rings();  // keep this thread's lines in order after staging is closed
 
-    if (sg_log_buff->GetData().Length() >= kBufferBlockLength*4/5) {
-       int ret = snprintf(temp, sizeof(temp), "[F][ sg_buffer_async.Length() >= BUFFER_BLOCK_LENTH*4/5, len: %d\n", (int)sg_log_buff->GetData().Length());
-       log_buff.Length(ret, ret);
+    __write_async_buffer(&lock, _data, _len);
+    if (NULL == sg_log_buff) return;
+
+    if (sg_log_buff->GetData().Length() >= kBufferBlockLength*1/3 || _is_fatal) {
+       sg_cond_buffer_async.notifyAll();
     }
 
-    if (!sg_log_buff->Write(log_buff.Ptr(), (unsigned int)log_buff.Length())) return;
+    if (0 == sg_spill_pending.Length()) return;
 
-    if (sg_log_buff->GetData().Length() >= kBufferBlockLength*1/3 || (NULL!=_info && kLevelFatal == _info->level)) {
-       sg_cond_buffer_async.notifyAll();
+    lock.unlock();
+    __spill2file();
+}
+
+static void __append_async_staging(const void* _data, size_t _len, bool _is_fatal) {
+    LogStagingRing* ring = (LogStagingRing*)sg_tss_staging_ring.get();
+    if (NULL == ring) {
+        ring = new LogStagingRing(kStagingRingLength);
+
+        ScopedLock lock(sg_mutex_staging);
+        sg_staging_rings.push_back(ring);
+        lock.unlock();
+
+        sg_tss_staging_ring.set(ring);
+    }
+
+    uint32_t before_size = ring->Size();
+
+    if (!ring->Push(_data, (uint16_t)_len)) {
+        // ring is full, drain every ring under the buffer lock so lines of this thread stay in order.
+        ScopedLock lock(sg_mutex_buffer_async);
+        if (NULL == sg_log_buff) return;
+
+        __drain_staging_rings();
+        __write_async_buffer(&lock, _data, _len);
+        bool spilled = 0 != sg_spill_pending.Length();
+        lock.unlock();
+
+        sg_cond_buffer_async.notifyAll();
+        if (spilled) __spill2file();
+        return;
     }
 
+    if ((before_size < kStagingRingLength*1/3 && ring->Size() >= kStagingRingLength*1/3) || _is_fatal) {
+        sg_cond_buffer_async.notifyAll();
+    }
+}
+
+static void __append(const void* _data, size_t _len, bool _is_fatal) {
+    if (kAppednerSync == sg_mode)
+        __append_sync(_data, _len);
+    else if (sg_staging_open)
+        __append_async_staging(_data, _len, _is_fatal);
+    else
+        __append_async(_data, _len, _is_fatal);
+}
+
+// one line per rate limited statement, written behind the line that found the report due or by the async thread.
+static void __append_suppressed_report() {
+    std::vector<LogRateLimiter::Suppressed> suppressed;
+    if (!sg_rate_limiter.Report(kSuppressedReportInterval, suppressed)) return;
+
+    XLoggerInfo info = {kLevelWarn, "xlog", NULL, "", 0, {0, 0}, xlogger_pid(), xlogger_tid(), xlogger_maintid()};
+    gettimeofday(&info.timeval, NULL);
+
+    for (std::vector<LogRateLimiter::Suppressed>::iterator it = suppressed.begin(); it != suppressed.end(); ++it) {
+        info.filename = it->filename.c_str();
+        info.line = it->line;
+
+        char msg[128] = {0};
+        snprintf(msg, sizeof(msg), "rate limited, %u lines suppressed in %d s", it->count, (int)(kSuppressedReportInterval / 1000));
+
+        char temp[1024] = {0};
+        PtrBuffer log_buff(temp, 0, sizeof(temp));
+        log_formater(&info, msg, log_buff);
+        __append(log_buff.Ptr(), log_buff.Length(), false);
+    }
 }
 
 ////////////////////////////////////////////////////////////////////////////////////
@@ -556,6 +973,8 @@ static void __appender_async(const XLoggerInfo* _info, const char* _log) {
 void xlogger_appender(const XLoggerInfo* _info, const char* _log) {
     if (sg_log_close) return;
 
+    if (NULL != _info && kLevelFatal != _info->level && !sg_rate_limiter.Allow(_info->filename, _info->line)) return;
+
     SCOPE_ERRNO();
 
     DEFINE_SCOPERECURSIONLIMIT(recursion);
@@ -590,13 +1009,66 @@ void xlogger_appender(const XLoggerInfo* _info, const char* _log) {
             free(strrecursion);
         }
 
-        if (kAppednerSync == sg_mode)
-            __appender_sync(_info, _log);
-        else
-            __appender_async(_info, _log);
+        char temp[16*1024] = {0};       //tell perry,ray if you want modify size.
+        PtrBuffer log_buff(temp, 0, sizeof(temp));
+        log_formater(_info, _log, log_buff);
+
+        __append(log_buff.Ptr(), log_buff.Length(), NULL != _info && kLevelFatal == _info->level);
+        __append_suppressed_report();
     }
 }
 
+static int __local_gmtoff() {
+    time_t now = time(NULL);
+    tm tcur = *localtime((const time_t*)&now);
+#ifdef _WIN32
+    return -_timezone;
+#else
+    return (int)tcur.tm_gmtoff;
+#endif
+}
+
+// ids index sg_deferred_callsites, so a record leads back to the description of its call site.
+static void __register_callsite(XLoggerCallSite* _callsite) {
+    ScopedLock lock(sg_mutex_deferred_callsites);
+    if (0 != _callsite->id) return;
+
+    sg_deferred_callsites.push_back(_callsite);
+    atomic_write32(&_callsite->id, (uint32_t)sg_deferred_callsites.size());
+}
+
+void xlogger_appender_deferred(TLogLevel _level, XLoggerCallSite* _callsite, const void* _args, size_t _len) {
+    if (sg_log_close) return;
+
+    if (kLevelFatal != _level && !sg_rate_limiter.Allow(_callsite->filename, _callsite->line)) return;
+
+    SCOPE_ERRNO();
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    if (0 == atomic_read32(&_callsite->id)) __register_callsite(_callsite);
+
+    if (sg_consolelog_open) {
+        std::string body;
+        LogRecord::RenderBody(_callsite->format, (const char*)_args, _len, body);
+
+        XLoggerInfo info = {_level, _callsite->tag, _callsite->filename, _callsite->func_name, _callsite->line, tv, xlogger_pid(), xlogger_tid(), xlogger_maintid()};
+        ConsoleLog(&info, body.c_str());
+    }
+
+    char temp[16*1024];
+    PtrBuffer record(temp, 0, sizeof(temp));
+
+    // the description of the call site is added where the record is written into a block.
+    intmax_t tid = xlogger_tid();
+    if (!LogRecord::WriteLog(record, _callsite, _level, tv, xlogger_pid(), tid, tid == xlogger_maintid(), _args, _len)) return;
+
+    __append(record.Ptr(), record.Length(), kLevelFatal == _level);
+
+    __append_suppressed_report();
+}
+
 #define HEX_STRING  "0123456789abcdef"
 static unsigned int to_string(const void* signature, int len, char* str) {
     char* str_p = str;
@@ -694,7 +1166,31 @@ static void get_mark_info(char* _info, size_t _infoLen) {
 	snprintf(_info, _infoLen, "[%" PRIdMAX ",%" PRIdMAX "][%s]", xlogger_pid(), xlogger_tid(), tmp_time);
 }
 
-void appender_open(TAppenderMode _mode, const char* _dir, const char* _nameprefix) {
+// the single block mmap cache of the older versions, it is flushed once and removed.
+static void __flush_legacy_mmap_file(const char* _dir, const char* _nameprefix, AutoBuffer& _buff) {
+    char mmap_file_path[512] = {0};
+    snprintf(mmap_file_path, sizeof(mmap_file_path), "%s/%s.mmap2", sg_cache_logdir.empty()?_dir:sg_cache_logdir.c_str(), _nameprefix);
+
+    if (!boost::filesystem::exists(mmap_file_path)) return;
+
+    boost::iostreams::mapped_file mmap_file;
+    if (OpenMmapFile(mmap_file_path, kBufferBlockLength, mmap_file) && kBufferBlockLength <= mmap_file.size()) {
+        LogBuffer legacy_buff(mmap_file.data(), kBufferBlockLength, true);
+        legacy_buff.Flush(_buff);
+    }
+    CloseMmapFile(mmap_file);
+
+    boost::filesystem::remove(mmap_file_path);
+}
+
+static LogCompress* __new_compress() {
+#ifdef XLOG_USE_ZSTD
+    if (kCompressZstd == sg_compress_mode) return new LogZstdCompress(sg_compress_level, sg_compress_flush_every_line);
+#endif
+    return new LogZlibCompress(sg_compress_level, sg_compress_flush_every_line);
+}
+
+void appender_open(TAppenderMode _mode, const char* _dir, const char* _nameprefix, TBackpressurePolicy _policy, unsigned int _block_timeout) {
 	assert(_dir);
 	assert(_nameprefix);
     
@@ -704,6 +1200,8 @@ void appender_open(TAppenderMode _mode, const char* _dir, const char* _nameprefi
     }
 
     xlogger_SetAppender(&xlogger_appender);
+    xlogger_SetDeferredAppender(&xlogger_appender_deferred);
+    sg_deferred_gmtoff = __local_gmtoff();
     
 	//mkdir(_dir, S_IRWXU|S_IRWXG|S_IRWXO);
 	boost::filesystem::create_directories(_dir);
@@ -716,26 +1214,40 @@ void appender_open(TAppenderMode _mode, const char* _dir, const char* _nameprefi
     tick.gettickcount();
 
     char mmap_file_path[512] = {0};
-    snprintf(mmap_file_path, sizeof(mmap_file_path), "%s/%s.mmap2", sg_cache_logdir.empty()?_dir:sg_cache_logdir.c_str(), _nameprefix);
+    snprintf(mmap_file_path, sizeof(mmap_file_path), "%s/%s.mmap3", sg_cache_logdir.empty()?_dir:sg_cache_logdir.c_str(), _nameprefix);
+
+    AutoBuffer buffer;
+    __flush_legacy_mmap_file(_dir, _nameprefix, buffer);
 
     bool use_mmap = false;
-    if (OpenMmapFile(mmap_file_path, kBufferBlockLength, sg_mmmap_file))  {
-        sg_log_buff = new LogBuffer(sg_mmmap_file.data(), kBufferBlockLength, true);
+    char* cache = NULL;
+    if (OpenMmapFile(mmap_file_path, kBufferBlockLength * kBufferBlockCount, sg_mmmap_file))  {
+        cache = sg_mmmap_file.data();
         use_mmap = true;
     } else {
-        char* buffer = new char[kBufferBlockLength];
-        sg_log_buff = new LogBuffer(buffer, kBufferBlockLength, true);
+        cache = new char[kBufferBlockLength * kBufferBlockCount];
         use_mmap = false;
     }
 
-    if (NULL == sg_log_buff->GetData().Ptr()) {
+    if (NULL == cache) {
         if (use_mmap && sg_mmmap_file.is_open())  CloseMmapFile(sg_mmmap_file);
         return;
     }
 
+    for (unsigned int i = 0; i < kBufferBlockCount; ++i) {
+        sg_log_buffs[i] = new LogBuffer(cache + i * kBufferBlockLength, kBufferBlockLength, true);
+        sg_log_buffs[i]->SetCompress(__new_compress());
+    }
 
-    AutoBuffer buffer;
-    sg_log_buff->Flush(buffer);
+    __flush_recovered_buffers(buffer);
+
+    ScopedLock buffer_lock(sg_mutex_buffer_async);
+    sg_active_buff = 0;
+    sg_log_buff = sg_log_buffs[sg_active_buff];
+    ++sg_deferred_generation;
+    sg_backpressure_policy = _policy;
+    sg_block_timeout = _block_timeout;
+    buffer_lock.unlock();
 
 	ScopedLock lock(sg_mutex_log_file);
 	sg_logdir = _dir;
@@ -773,14 +1285,15 @@ void appender_open(TAppenderMode _mode, const char* _dir, const char* _nameprefi
     xlogger_appender(NULL, "MARS_BUILD_TIME: " MARS_BUILD_TIME);
     xlogger_appender(NULL, "MARS_BUILD_JOB: " MARS_TAG);
 
-    snprintf(logmsg, sizeof(logmsg), "log appender mode:%d, use mmap:%d", (int)_mode, use_mmap);
+    snprintf(logmsg, sizeof(logmsg), "log appender mode:%d, use mmap:%d, backpressure:%d", (int)_mode, use_mmap, (int)_policy);
     xlogger_appender(NULL, logmsg);
 
 	BOOT_RUN_EXIT(appender_close);
 
 }
 
-void appender_open_with_cache(TAppenderMode _mode, const std::string& _cachedir, const std::string& _logdir, const char* _nameprefix) {
+void appender_open_with_cache(TAppenderMode _mode, const std::string& _cachedir, const std::string& _logdir, const char* _nameprefix,
+                              TBackpressurePolicy _policy, unsigned int _block_timeout) {
     assert(!_cachedir.empty());
     assert(!_logdir.empty());
     assert(_nameprefix);
@@ -795,7 +1308,7 @@ void appender_open_with_cache(TAppenderMode _mode, const std::string& _cachedir,
         Thread(boost::bind(&__move_old_files, _cachedir, _logdir, std::string(_nameprefix))).start_after(3 * 60 * 1000);
     }
 
-    appender_open(_mode, _logdir.c_str(), _nameprefix);
+    appender_open(_mode, _logdir.c_str(), _nameprefix, _policy, _block_timeout);
 
 }
 
@@ -808,17 +1321,7 @@ void appender_flush_sync() {
         return;
     }
 
-    ScopedLock lock_buffer(sg_mutex_buffer_async);
-    
-    if (NULL == sg_log_buff) return;
-
-    AutoBuffer tmp;
-    sg_log_buff->Flush(tmp);
-
-    lock_buffer.unlock();
-
-	if (tmp.Ptr())  __log2file(tmp.Ptr(), tmp.Length());
-
+    __flush_async_buffer();
 }
 
 void appender_close() {
@@ -838,19 +1341,35 @@ void appender_close() {
         sg_thread_async.join();
 
 	
+    ScopedLock flush_lock(sg_mutex_flush_async);
     ScopedLock buffer_lock(sg_mutex_buffer_async);
     if (sg_mmmap_file.is_open()) {
-        if (!sg_mmmap_file.operator !()) memset(sg_mmmap_file.data(), 0, kBufferBlockLength);
+        if (!sg_mmmap_file.operator !()) memset(sg_mmmap_file.data(), 0, kBufferBlockLength * kBufferBlockCount);
 
 		CloseMmapFile(sg_mmmap_file);
-    } else {
-        delete[] (char*)((sg_log_buff->GetData()).Ptr());
+    } else if (NULL != sg_log_buffs[0]) {
+        delete[] (char*)((sg_log_buffs[0]->GetData()).Ptr());
     }
 
-    delete sg_log_buff;
+    for (unsigned int i = 0; i < kBufferBlockCount; ++i) {
+        delete sg_log_buffs[i];
+        sg_log_buffs[i] = NULL;
+    }
     sg_log_buff = NULL;
+    sg_cond_buffer_drained.notifyAll(buffer_lock);
     buffer_lock.unlock();
 
+    // nothing is spilled any more, the last spilled lines go out before the file is closed.
+    __spill2file();
+
+    ScopedLock spill_lock(sg_mutex_spill_file);
+    if (NULL != sg_spill_file) {
+        fclose(sg_spill_file);
+        sg_spill_file = NULL;
+    }
+    spill_lock.unlock();
+    flush_lock.unlock();
+
     ScopedLock lock(sg_mutex_log_file);
 	__closelogfile();
 }
@@ -888,6 +1407,49 @@ void appender_set_console_log(bool _is_open) {
     sg_consolelog_open = _is_open;
 }
 
+void appender_set_thread_staging(bool _is_open) {
+    sg_staging_open = _is_open;
+    sg_cond_buffer_async.notifyAll();
+}
+
+bool appender_set_compress(TCompressMode _mode, int _level, bool _flush_every_line) {
+    switch (_mode) {
+    case kCompressZlib:
+        if (Z_DEFAULT_COMPRESSION != _level && (Z_NO_COMPRESSION > _level || Z_BEST_COMPRESSION < _level)) return false;
+        break;
+#ifdef XLOG_USE_ZSTD
+    case kCompressZstd:
+        if (ZSTD_minCLevel() > _level || ZSTD_maxCLevel() < _level) return false;
+        break;
+#endif
+    default:
+        return false;
+    }
+
+    ScopedLock lock(sg_mutex_buffer_async);
+    sg_compress_mode = _mode;
+    sg_compress_level = _level;
+    sg_compress_flush_every_line = _flush_every_line;
+
+    for (unsigned int i = 0; i < kBufferBlockCount; ++i) {
+        if (NULL != sg_log_buffs[i]) sg_log_buffs[i]->SetCompress(__new_compress());
+    }
+    return true;
+}
+
+void appender_get_backpressure_stat(XLogBackpressureStat& _stat) {
+    ScopedLock lock(sg_mutex_buffer_async);
+    _stat = sg_backpressure_stat;
+}
+
+void appender_set_rate_limit(unsigned int _lines_per_sec, unsigned int _burst, unsigned int _sample_interval) {
+    sg_rate_limiter.SetLimit(_lines_per_sec, _burst, _sample_interval);
+}
+
+void appender_set_flush_observer(appender_flush_observer_t _observer) {
+    sg_flush_observer = _observer;
+}
+
 void appender_setExtraMSg(const char* _msg, unsigned int _len) {
     sg_log_extra_msg = std::string(_msg, _len);
 }
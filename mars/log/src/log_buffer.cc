@@ -28,6 +28,8 @@
 #include <assert.h>
 
 #include "log/crypt/log_crypt.h"
+#include "log_compress.h"
+#include "log_index.h"
 
 
 #ifdef WIN32
@@ -37,10 +39,25 @@
 
 LogCrypt* LogBuffer::s_log_crypt =  new LogCrypt();
 
+static const size_t kMaxChunkLen = 4096;
+static const size_t kChunkHeaderLen = sizeof(uint16_t);
+
+// compressed size of _len bytes at worst, for zlib and zstd, with the headers of the chunks holding them.
+static size_t __CompressBound(size_t _len) {
+    size_t bound = _len + (_len >> 8) + 128;
+    return bound + (bound / kMaxChunkLen + 1) * kChunkHeaderLen;
+}
+
 bool LogBuffer::GetPeriodLogs(const char* _log_path, int _begin_hour, int _end_hour, unsigned long& _begin_pos, unsigned long& _end_pos, std::string& _err_msg) {
+    if (LogIndex::GetPeriodLogs(_log_path, _begin_hour, _end_hour, _begin_pos, _end_pos, _err_msg)) return true;
+
     return s_log_crypt->GetPeriodLogs(_log_path, _begin_hour, _end_hour, _begin_pos, _end_pos, _err_msg);
 }
 
+bool LogBuffer::GetLevelLogs(const char* _log_path, int _min_level, std::vector<std::pair<unsigned long, unsigned long> >& _ranges) {
+    return LogIndex::GetLevelLogs(_log_path, _min_level, _ranges);
+}
+
 
 bool LogBuffer::Write(const void* _data, size_t _inputlen, void* _output, size_t& _len) {
     if (NULL == _data || NULL == _output || 0 == _inputlen || _len <= (size_t) s_log_crypt->GetHeaderLen()) {
@@ -53,17 +70,15 @@ bool LogBuffer::Write(const void* _data, size_t _inputlen, void* _output, size_t
 }
 
 LogBuffer::LogBuffer(void* _pbuffer, size_t _len, bool _isCompress)
-: is_compress_(_isCompress) {
+: is_compress_(_isCompress), compress_(new LogZlibCompress(Z_BEST_COMPRESSION, true)), pending_compress_(NULL)
+, line_count_(0), level_mask_(0) {
     buff_.Attach(_pbuffer, _len);
     __Fix();
-
-    memset(&cstream_, 0, sizeof(cstream_));
 }
 
 LogBuffer::~LogBuffer() {
-    if (Z_NULL != cstream_.state) {
-        deflateEnd(&cstream_);
-    }
+    delete compress_;
+    delete pending_compress_;
 }
 
 PtrBuffer& LogBuffer::GetData() {
@@ -71,22 +86,59 @@ PtrBuffer& LogBuffer::GetData() {
 }
 
 
+void LogBuffer::SetCompress(LogCompress* _compress) {
+    delete pending_compress_;
+    pending_compress_ = _compress;
+}
+
 void LogBuffer::Flush(AutoBuffer& _buff) {
     
-    if (Z_NULL != cstream_.state) {
-        deflateEnd(&cstream_);
+    if (Seal()) _buff.Write(buff_.Ptr(), buff_.Length());
+    __Clear();
+}
+
+bool LogBuffer::Seal() {
+    
+    if (is_compress_ && buff_.Length() >= s_log_crypt->GetHeaderLen()) {
+        bool finished = false;
+        while (!finished) {
+            size_t room = buff_.MaxLength() - buff_.Length() - s_log_crypt->GetTailerLen();
+            if (room <= kChunkHeaderLen) break;
+
+            size_t flush_len = std::min(room - kChunkHeaderLen, kMaxChunkLen);
+
+            finished = compress_->Flush(buff_.PosPtr(), flush_len);
+            if (0 == flush_len) break;
+            __WriteChunk(buff_.Length(), flush_len);
+        }
     }
+    compress_->End();
 
     if (s_log_crypt->GetLogLen((char*)buff_.Ptr(), buff_.Length()) == 0){
         __Clear();
-        return;
+        return false;
     }
     
     __Flush();
-    _buff.Write(buff_.Ptr(), buff_.Length());
+    return true;
+}
+
+void LogBuffer::Clear() {
     __Clear();
 }
 
+uint16_t LogBuffer::GetSeq() {
+    return s_log_crypt->GetLogSeq((char*)buff_.Ptr(), buff_.Length());
+}
+
+uint32_t LogBuffer::GetLineCount() const {
+    return line_count_;
+}
+
+uint8_t LogBuffer::GetLevelMask() const {
+    return level_mask_;
+}
+
 
 bool LogBuffer::Write(const void* _data, size_t _length) {
     if (NULL == _data || 0 == _length) {
@@ -101,59 +153,76 @@ bool LogBuffer::Write(const void* _data, size_t _length) {
     size_t write_len = _length;
     
     if (is_compress_) {
-        cstream_.avail_in = (uInt)_length;
-        cstream_.next_in = (Bytef*)_data;
-
-        uInt avail_out = (uInt)(buff_.MaxLength() - buff_.Length());
-        cstream_.next_out = (Bytef*)buff_.PosPtr();
-        cstream_.avail_out = avail_out;
-
-        if (Z_OK != deflate(&cstream_, Z_SYNC_FLUSH)) {
-            return false;
-        }
-
-        write_len = avail_out - cstream_.avail_out;
+        // keep room for the tailer, for the rest of the stream written by Flush and for the whole line,
+        // so a line is never cut off in the middle.
+        size_t reserved = s_log_crypt->GetTailerLen() + compress_->GetFlushReserve() + __CompressBound(_length);
+        if (buff_.MaxLength() <= buff_.Length() + reserved) return false;
+
+        // a chunk holds at most kMaxChunkLen, the output of a long line or of a flush of many goes out in several.
+        bool first = true;
+        do {
+            size_t pos = buff_.Length();
+            write_len = std::min(buff_.MaxLength() - pos - s_log_crypt->GetTailerLen() - kChunkHeaderLen, kMaxChunkLen);
+
+            bool ret = first ? compress_->Compress(_data, _length, buff_.PosPtr(), write_len) : compress_->Continue(buff_.PosPtr(), write_len);
+            if (!ret) return false;
+            first = false;
+
+            // the line may be buffered in the compress stream, it will be written out with a later line.
+            if (0 == write_len) break;
+            __WriteChunk(pos, write_len);
+        } while (compress_->Pending());
     } else {
         buff_.Write(_data, _length);
+        __WriteChunk(before_len, write_len);
     }
-    
 
-    char crypt_buffer[4096] = {0};
+    int level = LogIndex::GetLevel(_data, _length);
+    if (0 <= level) {
+        ++line_count_;
+        level_mask_ |= (uint8_t)(1 << level);
+    }
+
+    return true;
+}
+
+void LogBuffer::__WriteChunk(size_t _pos, size_t _len) {
+    char crypt_buffer[kMaxChunkLen] = {0};
     size_t crypt_buffer_len = sizeof(crypt_buffer);
     
     
-    s_log_crypt->CryptAsyncLog((char*)buff_.Ptr() + before_len, write_len, crypt_buffer, crypt_buffer_len);
+    s_log_crypt->CryptAsyncLog((char*)buff_.Ptr() + _pos, _len, crypt_buffer, crypt_buffer_len);
     
     uint16_t single_log_len = crypt_buffer_len;
-    buff_.Write(&single_log_len, sizeof(single_log_len), before_len);
+    buff_.Write(&single_log_len, sizeof(single_log_len), _pos);
     
-    before_len += sizeof(single_log_len);
-    buff_.Write(crypt_buffer, crypt_buffer_len, before_len);
+    _pos += sizeof(single_log_len);
+    buff_.Write(crypt_buffer, crypt_buffer_len, _pos);
     
-    before_len += crypt_buffer_len;
-    buff_.Length(before_len, before_len);
+    _pos += crypt_buffer_len;
+    buff_.Length(_pos, _pos);
    
     s_log_crypt->UpdateLogLen((char*)buff_.Ptr(), (uint32_t)crypt_buffer_len + sizeof(single_log_len));
-
-    return true;
 }
 
 bool LogBuffer::__Reset() {
     
     __Clear();
     
+    if (NULL != pending_compress_) {
+        delete compress_;
+        compress_ = pending_compress_;
+        pending_compress_ = NULL;
+    }
+
     if (is_compress_) {
-        cstream_.zalloc = Z_NULL;
-        cstream_.zfree = Z_NULL;
-        cstream_.opaque = Z_NULL;
-        
-        if (Z_OK != deflateInit2(&cstream_, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY)) {
+        if (!compress_->Reset()) {
             return false;
         }
         
     }
     
-    s_log_crypt->SetHeaderInfo((char*)buff_.Ptr(), is_compress_);
+    s_log_crypt->SetHeaderInfo((char*)buff_.Ptr(), is_compress_, is_compress_ && compress_->IsZstd());
     buff_.Length(s_log_crypt->GetHeaderLen(), s_log_crypt->GetHeaderLen());
 
     return true;
@@ -171,12 +240,15 @@ void LogBuffer::__Flush() {
 void LogBuffer::__Clear() {
     memset(buff_.Ptr(), 0, buff_.MaxLength());
     buff_.Length(0, 0);
+    line_count_ = 0;
+    level_mask_ = 0;
 }
 
 
 void LogBuffer::__Fix() {
     uint32_t raw_log_len = 0;
-    if (s_log_crypt->Fix((char*)buff_.Ptr(), buff_.Length(), is_compress_, raw_log_len)) {
+    if (s_log_crypt->Fix((char*)buff_.Ptr(), buff_.Length(), is_compress_, raw_log_len)
+            && raw_log_len + s_log_crypt->GetHeaderLen() + s_log_crypt->GetTailerLen() <= buff_.MaxLength()) {
         buff_.Length(raw_log_len + s_log_crypt->GetHeaderLen(), raw_log_len + s_log_crypt->GetHeaderLen());
     } else {
         buff_.Length(0, 0);
@@ -20,14 +20,16 @@
 #ifndef LOGBUFFER_H_
 #define LOGBUFFER_H_
 
-#include <zlib.h>
 #include <string>
+#include <vector>
+#include <utility>
 #include <stdint.h>
 
 #include "mars/comm/ptrbuffer.h"
 #include "mars/comm/autobuffer.h"
 
 class LogCrypt;
+class LogCompress;
 
 class LogBuffer {
 public:
@@ -36,6 +38,7 @@ public:
     
 public:
     static bool GetPeriodLogs(const char* _log_path, int _begin_hour, int _end_hour, unsigned long& _begin_pos, unsigned long& _end_pos, std::string& _err_msg);
+    static bool GetLevelLogs(const char* _log_path, int _min_level, std::vector<std::pair<unsigned long, unsigned long> >& _ranges);
     static bool Write(const void* _data, size_t _inputlen, void* _output, size_t& _len);
 
 public:
@@ -45,9 +48,22 @@ public:
     void Flush(AutoBuffer& _buff);
     bool Write(const void* _data, size_t _length);
 
+    // finishes the log block in place, it stays in GetData() until Clear(). returns false if there is no log.
+    bool Seal();
+    void Clear();
+    // seq of the log block in the buffer, 0 if there is no log.
+    uint16_t GetSeq();
+    // lines written to the log block, 0 if unknown, e.g. the block was left by the last run.
+    uint32_t GetLineCount() const;
+    uint8_t GetLevelMask() const;
+
+    // takes the ownership of _compress, it is used from the next log block.
+    void SetCompress(LogCompress* _compress);
+
 private:
     
     bool __Reset();
+    void __WriteChunk(size_t _pos, size_t _len);
     void __Flush();
     void __Clear();
     
@@ -56,7 +72,10 @@ private:
 private:
     PtrBuffer buff_;
     bool is_compress_;
-    z_stream cstream_;
+    LogCompress* compress_;
+    LogCompress* pending_compress_;
+    uint32_t line_count_;
+    uint8_t level_mask_;
     
     static class LogCrypt* s_log_crypt;
 
@@ -0,0 +1,223 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * log_compress.cc
+ */
+
+#include "log_compress.h"
+
+#include <string.h>
+
+const size_t LogCompress::kMaxPendingLen;
+
+LogZlibCompress::LogZlibCompress(int _level, bool _flush_every_line)
+: level_(_level), flush_every_line_(_flush_every_line), pending_len_(0), flush_(Z_NO_FLUSH), pending_(false) {
+    memset(&cstream_, 0, sizeof(cstream_));
+}
+
+LogZlibCompress::~LogZlibCompress() {
+    End();
+}
+
+bool LogZlibCompress::Reset() {
+    End();
+
+    cstream_.zalloc = Z_NULL;
+    cstream_.zfree = Z_NULL;
+    cstream_.opaque = Z_NULL;
+
+    return Z_OK == deflateInit2(&cstream_, level_, Z_DEFLATED, -MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+}
+
+bool LogZlibCompress::Compress(const void* _data, size_t _len, void* _output, size_t& _output_len) {
+    if (Z_NULL == cstream_.state) return false;
+
+    pending_len_ += _len;
+    flush_ = Z_NO_FLUSH;
+    if (flush_every_line_ || kMaxPendingLen <= pending_len_) {
+        flush_ = Z_SYNC_FLUSH;
+        pending_len_ = 0;
+    }
+
+    cstream_.avail_in = (uInt)_len;
+    cstream_.next_in = (Bytef*)_data;
+
+    return __Deflate(_output, _output_len);
+}
+
+bool LogZlibCompress::Continue(void* _output, size_t& _output_len) {
+    if (Z_NULL == cstream_.state) return false;
+    if (!pending_) {
+        _output_len = 0;
+        return true;
+    }
+
+    return __Deflate(_output, _output_len);
+}
+
+bool LogZlibCompress::__Deflate(void* _output, size_t& _output_len) {
+    uInt avail_out = (uInt)_output_len;
+    cstream_.next_out = (Bytef*)_output;
+    cstream_.avail_out = avail_out;
+
+    int ret = deflate(&cstream_, flush_);
+    _output_len = avail_out - cstream_.avail_out;
+
+    // Z_BUF_ERROR: no progress was possible, nothing is left to write.
+    if (Z_OK != ret && Z_BUF_ERROR != ret) {
+        cstream_.avail_in = 0;
+        pending_ = false;
+        return false;
+    }
+
+    // a full output may hide more of a flush.
+    pending_ = Z_OK == ret && (0 != cstream_.avail_in || (Z_NO_FLUSH != flush_ && 0 == cstream_.avail_out));
+    if (!pending_) {
+        cstream_.avail_in = 0;
+        cstream_.next_in = Z_NULL;
+    }
+    return true;
+}
+
+bool LogZlibCompress::Flush(void* _output, size_t& _output_len) {
+    if (Z_NULL == cstream_.state) {
+        _output_len = 0;
+        return true;
+    }
+
+    cstream_.avail_in = 0;
+    cstream_.next_in = Z_NULL;
+
+    uInt avail_out = (uInt)_output_len;
+    cstream_.next_out = (Bytef*)_output;
+    cstream_.avail_out = avail_out;
+
+    int ret = deflate(&cstream_, Z_SYNC_FLUSH);
+    _output_len = avail_out - cstream_.avail_out;
+    pending_len_ = 0;
+
+    // output left unfilled means deflate has nothing more to write.
+    return (Z_OK == ret || Z_BUF_ERROR == ret) && 0 != cstream_.avail_out;
+}
+
+void LogZlibCompress::End() {
+    if (Z_NULL != cstream_.state) {
+        deflateEnd(&cstream_);
+    }
+    memset(&cstream_, 0, sizeof(cstream_));
+    pending_len_ = 0;
+    pending_ = false;
+}
+
+size_t LogZlibCompress::GetFlushReserve() const {
+    // the bound of deflateBound() for raw deflate streams
+    return flush_every_line_ ? 4096 : kMaxPendingLen + (kMaxPendingLen >> 12) + (kMaxPendingLen >> 14) + 64;
+}
+
+#ifdef XLOG_USE_ZSTD
+
+LogZstdCompress::LogZstdCompress(int _level, bool _flush_every_line)
+: level_(_level), flush_every_line_(_flush_every_line), pending_len_(0), flush_(ZSTD_e_continue), pending_(false)
+, cctx_(ZSTD_createCCtx()), started_(false) {
+    memset(&input_, 0, sizeof(input_));
+}
+
+LogZstdCompress::~LogZstdCompress() {
+    ZSTD_freeCCtx(cctx_);
+}
+
+bool LogZstdCompress::Reset() {
+    End();
+    if (NULL == cctx_) return false;
+
+    if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, level_))) return false;
+
+    started_ = true;
+    return true;
+}
+
+bool LogZstdCompress::Compress(const void* _data, size_t _len, void* _output, size_t& _output_len) {
+    if (!started_) return false;
+
+    pending_len_ += _len;
+    flush_ = ZSTD_e_continue;
+    if (flush_every_line_ || kMaxPendingLen <= pending_len_) {
+        flush_ = ZSTD_e_flush;
+        pending_len_ = 0;
+    }
+
+    input_.src = _data;
+    input_.size = _len;
+    input_.pos = 0;
+
+    return __CompressStream(_output, _output_len);
+}
+
+bool LogZstdCompress::Continue(void* _output, size_t& _output_len) {
+    if (!started_) return false;
+    if (!pending_) {
+        _output_len = 0;
+        return true;
+    }
+
+    return __CompressStream(_output, _output_len);
+}
+
+bool LogZstdCompress::__CompressStream(void* _output, size_t& _output_len) {
+    ZSTD_outBuffer output = {_output, _output_len, 0};
+
+    size_t ret = ZSTD_compressStream2(cctx_, &output, &input_, flush_);
+    _output_len = output.pos;
+
+    if (ZSTD_isError(ret)) {
+        memset(&input_, 0, sizeof(input_));
+        pending_ = false;
+        return false;
+    }
+
+    // with ZSTD_e_flush, ret is what is left to flush.
+    pending_ = input_.pos != input_.size || (ZSTD_e_flush == flush_ && 0 != ret);
+    if (!pending_) memset(&input_, 0, sizeof(input_));
+    return true;
+}
+
+bool LogZstdCompress::Flush(void* _output, size_t& _output_len) {
+    if (!started_) {
+        _output_len = 0;
+        return true;
+    }
+
+    ZSTD_inBuffer input = {NULL, 0, 0};
+    ZSTD_outBuffer output = {_output, _output_len, 0};
+
+    // ends the frame, so every log block can be decompressed alone.
+    size_t ret = ZSTD_compressStream2(cctx_, &output, &input, ZSTD_e_end);
+    _output_len = output.pos;
+    pending_len_ = 0;
+
+    return !ZSTD_isError(ret) && 0 == ret;
+}
+
+void LogZstdCompress::End() {
+    if (NULL != cctx_) ZSTD_CCtx_reset(cctx_, ZSTD_reset_session_only);
+    started_ = false;
+    pending_len_ = 0;
+    pending_ = false;
+    memset(&input_, 0, sizeof(input_));
+}
+
+size_t LogZstdCompress::GetFlushReserve() const {
+    return flush_every_line_ ? 4096 : ZSTD_compressBound(kMaxPendingLen);
+}
+
+#endif
@@ -0,0 +1,124 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * log_compress.h
+ *
+ * streaming compressors of LogBuffer, one stream per log block.
+ * the zstd backend is only built with XLOG_USE_ZSTD defined and libzstd linked.
+ */
+
+#ifndef LOG_COMPRESS_H_
+#define LOG_COMPRESS_H_
+
+#include <stddef.h>
+#include <zlib.h>
+
+#ifdef XLOG_USE_ZSTD
+#include <zstd.h>
+#endif
+
+class LogCompress {
+  public:
+    virtual ~LogCompress() {}
+
+  public:
+    virtual bool IsZstd() const = 0;
+
+    // begins a new stream for a new log block
+    virtual bool Reset() = 0;
+    // _output_len: in, capacity of _output; out, bytes written. may write nothing if lines are not flushed one by one.
+    // returns false on error. if the output did not fit, Pending() is true and Continue() writes the rest,
+    // _data must stay valid until then.
+    virtual bool Compress(const void* _data, size_t _len, void* _output, size_t& _output_len) = 0;
+    virtual bool Continue(void* _output, size_t& _output_len) = 0;
+    virtual bool Pending() const = 0;
+    // writes out what is still buffered in the stream, returns true once nothing is left.
+    virtual bool Flush(void* _output, size_t& _output_len) = 0;
+    virtual void End() = 0;
+
+    // room the owner keeps free for Flush, the stream is flushed by itself every kMaxPendingLen bytes of input.
+    virtual size_t GetFlushReserve() const = 0;
+
+  protected:
+    static const size_t kMaxPendingLen = 16 * 1024;
+};
+
+class LogZlibCompress : public LogCompress {
+  public:
+    LogZlibCompress(int _level, bool _flush_every_line);
+    virtual ~LogZlibCompress();
+
+  public:
+    virtual bool IsZstd() const { return false; }
+
+    virtual bool Reset();
+    virtual bool Compress(const void* _data, size_t _len, void* _output, size_t& _output_len);
+    virtual bool Continue(void* _output, size_t& _output_len);
+    virtual bool Pending() const { return pending_; }
+    virtual bool Flush(void* _output, size_t& _output_len);
+    virtual void End();
+    virtual size_t GetFlushReserve() const;
+
+  private:
+    bool __Deflate(void* _output, size_t& _output_len);
+
+  private:
+    LogZlibCompress(const LogZlibCompress&);
+    LogZlibCompress& operator=(const LogZlibCompress&);
+
+  private:
+    int level_;
+    bool flush_every_line_;
+    size_t pending_len_;
+    int flush_;         // of the last Compress
+    bool pending_;
+    z_stream cstream_;
+};
+
+#ifdef XLOG_USE_ZSTD
+class LogZstdCompress : public LogCompress {
+  public:
+    LogZstdCompress(int _level, bool _flush_every_line);
+    virtual ~LogZstdCompress();
+
+  public:
+    virtual bool IsZstd() const { return true; }
+
+    virtual bool Reset();
+    virtual bool Compress(const void* _data, size_t _len, void* _output, size_t& _output_len);
+    virtual bool Continue(void* _output, size_t& _output_len);
+    virtual bool Pending() const { return pending_; }
+    virtual bool Flush(void* _output, size_t& _output_len);
+    virtual void End();
+    virtual size_t GetFlushReserve() const;
+
+  private:
+    bool __CompressStream(void* _output, size_t& _output_len);
+
+  private:
+    LogZstdCompress(const LogZstdCompress&);
+    LogZstdCompress& operator=(const LogZstdCompress&);
+
+  private:
+    int level_;
+    bool flush_every_line_;
+    size_t pending_len_;
+    ZSTD_EndDirective flush_;   // of the last Compress
+    ZSTD_inBuffer input_;       // rest of the last line
+    bool pending_;
+    ZSTD_CCtx* cctx_;
+    bool started_;
+};
+#endif
+
+#endif /* LOG_COMPRESS_H_ */
@@ -0,0 +1,439 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * log_index.cc
+ */
+
+#include "log_index.h"
+
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "mars/comm/xlogger/xloggerbase.h"
+#include "mars/comm/thread/lock.h"
+#include "log/crypt/log_crypt.h"
+#include "log_record.h"
+
+#ifdef _WIN32
+#define snprintf _snprintf
+#define fileno _fileno
+#endif
+
+/*
+ * |magic(char[4])|item|item|...
+ * item: |offset(uint32_t)|length(uint32_t)|seq(uint16_t)|begin hour(uint8_t)|end hour(uint8_t)|line count(uint32_t)|level mask(uint8_t)|reserved(char[3])|
+ */
+
+static const char kIndexMagic[4] = {'X', 'L', 'I', '\x01'};
+static const size_t kItemLen = 20;
+
+static LogCrypt sg_log_crypt;
+static Mutex sg_mutex_index;    // of every write to an index file, Load reads without it
+
+const uint8_t LogIndex::kLevelMaskAll;
+
+static void __EncodeItem(const LogIndex::Item& _item, char* _buff) {
+    memset(_buff, 0, kItemLen);
+    char* pos = _buff;
+    memcpy(pos, &_item.offset, sizeof(_item.offset));               pos += sizeof(_item.offset);
+    memcpy(pos, &_item.length, sizeof(_item.length));               pos += sizeof(_item.length);
+    memcpy(pos, &_item.seq, sizeof(_item.seq));                     pos += sizeof(_item.seq);
+    memcpy(pos, &_item.begin_hour, sizeof(_item.begin_hour));       pos += sizeof(_item.begin_hour);
+    memcpy(pos, &_item.end_hour, sizeof(_item.end_hour));           pos += sizeof(_item.end_hour);
+    memcpy(pos, &_item.line_count, sizeof(_item.line_count));       pos += sizeof(_item.line_count);
+    memcpy(pos, &_item.level_mask, sizeof(_item.level_mask));
+}
+
+static void __DecodeItem(const char* _buff, LogIndex::Item& _item) {
+    const char* pos = _buff;
+    memcpy(&_item.offset, pos, sizeof(_item.offset));               pos += sizeof(_item.offset);
+    memcpy(&_item.length, pos, sizeof(_item.length));               pos += sizeof(_item.length);
+    memcpy(&_item.seq, pos, sizeof(_item.seq));                     pos += sizeof(_item.seq);
+    memcpy(&_item.begin_hour, pos, sizeof(_item.begin_hour));       pos += sizeof(_item.begin_hour);
+    memcpy(&_item.end_hour, pos, sizeof(_item.end_hour));           pos += sizeof(_item.end_hour);
+    memcpy(&_item.line_count, pos, sizeof(_item.line_count));       pos += sizeof(_item.line_count);
+    memcpy(&_item.level_mask, pos, sizeof(_item.level_mask));
+}
+
+static void __FillItem(const char* _header, long _offset, uint32_t _log_len, LogIndex::Item& _item) {
+    int begin_hour = 0;
+    int end_hour = 0;
+    sg_log_crypt.GetLogHour(_header, sg_log_crypt.GetHeaderLen(), begin_hour, end_hour);
+    if (begin_hour > end_hour) begin_hour = end_hour;
+
+    _item.offset = (uint32_t)_offset;
+    _item.length = sg_log_crypt.GetHeaderLen() + _log_len + sg_log_crypt.GetTailerLen();
+    _item.seq = sg_log_crypt.GetLogSeq(_header, sg_log_crypt.GetHeaderLen());
+    _item.begin_hour = (uint8_t)begin_hour;
+    _item.end_hour = (uint8_t)end_hour;
+    _item.line_count = 0;
+    _item.level_mask = LogIndex::kLevelMaskAll;
+}
+
+static long __FileSize(FILE* _file) {
+    if (0 != fseek(_file, 0, SEEK_END)) return -1;
+    return ftell(_file);
+}
+
+int LogIndex::GetLevel(const void* _line, size_t _len) {
+    const char* line = (const char*)_line;
+    if (NULL == line || 0 == _len) return -1;
+
+    if (LogRecord::kMarker == line[0]) return LogRecord::GetLevel(line, _len);
+
+    // |[level]|... of log_formater, lines without it are tips of the appender.
+    if (3 > _len || '[' != line[0] || ']' != line[2]) return kLevelInfo;
+
+    switch (line[1]) {
+    case 'V': return kLevelVerbose;
+    case 'D': return kLevelDebug;
+    case 'I': return kLevelInfo;
+    case 'W': return kLevelWarn;
+    case 'E': return kLevelError;
+    case 'F': return kLevelFatal;
+    default: return kLevelInfo;
+    }
+}
+
+bool LogIndex::Append(const char* _log_path, long _offset, const void* _data, size_t _len, uint32_t _line_count, uint8_t _level_mask) {
+    if (NULL == _log_path || NULL == _data || 0 > _offset) return false;
+
+    ScopedLock lock(sg_mutex_index);
+
+    std::string index_path = __IndexPath(_log_path);
+    FILE* index_file = fopen(index_path.c_str(), "rb+");
+    if (NULL == index_file) index_file = fopen(index_path.c_str(), "wb+");
+    if (NULL == index_file) return false;
+
+    // only the last item is read, sync mode appends one block per line.
+    size_t count = 0;
+    Item last;
+    bool good = __ReadLastItem(index_file, count, last);
+
+    long covered = (!good || 0 == count) ? 0 : (long)last.offset + last.length;
+
+    // a Load between the write of the log file and this has indexed the blocks already, without their lines.
+    if (covered == _offset + (long)_len) {
+        bool ret = true;
+        if ((long)last.offset == _offset && 0 != _line_count && 0 == last.line_count) {
+            last.line_count = _line_count;
+            last.level_mask = _level_mask;
+
+            char buff[kItemLen];
+            __EncodeItem(last, buff);
+            ret = 0 == fseek(index_file, -(long)kItemLen, SEEK_END) && 1 == fwrite(buff, kItemLen, 1, index_file);
+        }
+        fclose(index_file);
+        return ret;
+    }
+
+    // the log file was replaced or truncated, rebuild it.
+    if (covered > _offset) {
+        covered = 0;
+        good = false;
+    }
+
+    // items behind the index, or of the whole log file if it is rebuilt.
+    std::vector<Item> items;
+
+    // blocks written behind the back of the appender, e.g. moved in from the cache dir.
+    if (covered < _offset) {
+        FILE* log_file = fopen(_log_path, "rb");
+        if (NULL != log_file) {
+            __ScanFile(log_file, covered, _offset, items);
+            fclose(log_file);
+        }
+    }
+
+    size_t block_begin = items.size();
+    __ParseBlocks((const char*)_data, _len, _offset, items);
+    if (items.size() == block_begin + 1 && 0 != _line_count) {
+        items.back().line_count = _line_count;
+        items.back().level_mask = _level_mask;
+    }
+
+    bool ret = true;
+    if (!good) {
+        ret = __WriteItems(index_file, items);
+    } else if (!items.empty()) {
+        fseek(index_file, 0, SEEK_END);
+        char buff[kItemLen];
+        for (size_t i = 0; i < items.size() && ret; ++i) {
+            __EncodeItem(items[i], buff);
+            ret = 1 == fwrite(buff, kItemLen, 1, index_file);
+        }
+    }
+
+    fclose(index_file);
+    return ret;
+}
+
+bool LogIndex::Load(const char* _log_path, std::vector<Item>& _items) {
+    _items.clear();
+    if (NULL == _log_path) return false;
+
+    FILE* log_file = fopen(_log_path, "rb");
+    if (NULL == log_file) return false;
+
+    // the appender indexes a block after writing it, so the index is read first and its items are within log_size.
+    std::string index_path = __IndexPath(_log_path);
+    long index_size = -1;
+    bool stale = true;
+    FILE* index_file = fopen(index_path.c_str(), "rb");
+    if (NULL != index_file) {
+        index_size = __FileSize(index_file);
+        stale = !__ReadItems(index_file, _items);
+        fclose(index_file);
+    }
+
+    long log_size = __FileSize(log_file);
+    if (0 > log_size) {
+        fclose(log_file);
+        _items.clear();
+        return false;
+    }
+
+    // the last item must still describe the block at its offset.
+    if (!stale && !_items.empty()) {
+        const Item& last = _items.back();
+        char header[64] = {0};
+        assert(sizeof(header) >= sg_log_crypt.GetHeaderLen());
+
+        stale = (long)last.offset + last.length > log_size
+                || 0 != fseek(log_file, last.offset, SEEK_SET)
+                || sg_log_crypt.GetHeaderLen() != fread(header, 1, sg_log_crypt.GetHeaderLen(), log_file)
+                || last.seq != sg_log_crypt.GetLogSeq(header, sg_log_crypt.GetHeaderLen())
+                || last.length != sg_log_crypt.GetHeaderLen() + sg_log_crypt.GetLogLen(header, sg_log_crypt.GetHeaderLen()) + sg_log_crypt.GetTailerLen();
+    }
+
+    if (stale) _items.clear();
+
+    size_t old_count = _items.size();
+    long covered = _items.empty() ? 0 : (long)_items.back().offset + _items.back().length;
+    if (covered < log_size) __ScanFile(log_file, covered, log_size, _items);
+    fclose(log_file);
+
+    if (stale || _items.size() > old_count) __RewriteItems(index_path, index_size, _items);
+    return true;
+}
+
+void LogIndex::Remove(const char* _log_path) {
+    if (NULL == _log_path) return;
+
+    ScopedLock lock(sg_mutex_index);
+    remove(__IndexPath(_log_path).c_str());
+}
+
+static bool __EndHourLess(const LogIndex::Item& _item, int _hour) {
+    return _item.end_hour < _hour;
+}
+
+bool LogIndex::GetPeriodLogs(const char* _log_path, int _begin_hour, int _end_hour, unsigned long& _begin_pos, unsigned long& _end_pos, std::string& _err_msg) {
+    char msg[1024] = {0};
+
+    if (NULL == _log_path || _end_hour <= _begin_hour) {
+        snprintf(msg, sizeof(msg), "NULL == _logPath || _endHour <= _beginHour, %d, %d", _begin_hour, _end_hour);
+        _err_msg += msg;
+        return false;
+    }
+
+    std::vector<Item> load_items;
+    if (!Load(_log_path, load_items)) {
+        snprintf(msg, sizeof(msg), "load index fail:%s", strerror(errno));
+        _err_msg += msg;
+        return false;
+    }
+    const std::vector<Item>& items = load_items;
+
+    _begin_pos = _end_pos = 0;
+
+    // the first block ending at or after _begin_hour, the same as the scan of LogCrypt::GetPeriodLogs.
+    std::vector<Item>::const_iterator begin = std::lower_bound(items.begin(), items.end(), _begin_hour, &__EndHourLess);
+    if (begin == items.end()) {
+        snprintf(msg, sizeof(msg), "no log after hour:%d, blocks:%d", _begin_hour, (int)items.size());
+        _err_msg += msg;
+        return false;
+    }
+    _begin_pos = begin->offset;
+
+    std::vector<Item>::const_iterator end = std::lower_bound(begin, items.end(), _end_hour, &__EndHourLess);
+    if (end == items.end()) {
+        _end_pos = items.back().offset + items.back().length;
+    } else if (end->begin_hour < _end_hour) {
+        _end_pos = end->offset + end->length;
+    } else if (end != begin) {
+        _end_pos = (end - 1)->offset + (end - 1)->length;
+    }
+
+    bool ret = _end_pos > _begin_pos;
+    if (!ret) {
+        snprintf(msg, sizeof(msg), "begintpos:%lu, endpos:%lu, blocks:%d.", _begin_pos, _end_pos, (int)items.size());
+        _err_msg += msg;
+    }
+    return ret;
+}
+
+bool LogIndex::GetLevelLogs(const char* _log_path, int _min_level, std::vector<std::pair<unsigned long, unsigned long> >& _ranges) {
+    _ranges.clear();
+
+    std::vector<Item> items;
+    if (!Load(_log_path, items)) return false;
+
+    uint8_t mask = (uint8_t)(kLevelMaskAll << std::max(0, std::min(_min_level, 7)));
+    for (std::vector<Item>::const_iterator it = items.begin(); it != items.end(); ++it) {
+        if (0 == (it->level_mask & mask)) continue;
+
+        if (!_ranges.empty() && _ranges.back().second == it->offset) {
+            _ranges.back().second = it->offset + it->length;
+        } else {
+            _ranges.push_back(std::make_pair((unsigned long)it->offset, (unsigned long)it->offset + it->length));
+        }
+    }
+    return true;
+}
+
+std::string LogIndex::__IndexPath(const char* _log_path) {
+    return std::string(_log_path) + ".idx";
+}
+
+void LogIndex::__ParseBlocks(const char* _data, size_t _len, long _offset, std::vector<Item>& _items) {
+    size_t header_len = sg_log_crypt.GetHeaderLen();
+    size_t tailer_len = sg_log_crypt.GetTailerLen();
+
+    size_t pos = 0;
+    while (pos + header_len + tailer_len <= _len) {
+        uint32_t log_len = sg_log_crypt.GetLogLen(_data + pos, _len - pos);
+        size_t end = pos + header_len + log_len;
+
+        if (0 == log_len || end + tailer_len > _len || '\0' != _data[end]) {
+            ++pos;
+            continue;
+        }
+
+        Item item;
+        __FillItem(_data + pos, _offset + (long)pos, log_len, item);
+        _items.push_back(item);
+
+        pos = end + tailer_len;
+    }
+}
+
+bool LogIndex::__ScanFile(FILE* _file, long _from, long _to, std::vector<Item>& _items) {
+    long header_len = sg_log_crypt.GetHeaderLen();
+    long tailer_len = sg_log_crypt.GetTailerLen();
+
+    char header[64] = {0};
+    assert(sizeof(header) >= (size_t)header_len);
+
+    long pos = _from;
+    while (pos + header_len + tailer_len <= _to) {
+        if (0 != fseek(_file, pos, SEEK_SET) || header_len != (long)fread(header, 1, header_len, _file)) return false;
+
+        uint32_t log_len = sg_log_crypt.GetLogLen(header, header_len);
+        long end = pos + header_len + (long)log_len;
+
+        char tailer = 1;
+        if (0 == log_len || end + tailer_len > _to
+                || 0 != fseek(_file, end, SEEK_SET) || 1 != fread(&tailer, 1, 1, _file) || '\0' != tailer) {
+            ++pos;
+            continue;
+        }
+
+        Item item;
+        __FillItem(header, pos, log_len, item);
+        _items.push_back(item);
+
+        pos = end + tailer_len;
+    }
+    return true;
+}
+
+bool LogIndex::__ReadItems(FILE* _file, std::vector<Item>& _items) {
+    _items.clear();
+
+    long size = __FileSize(_file);
+    if ((long)sizeof(kIndexMagic) > size || 0 != (size - sizeof(kIndexMagic)) % kItemLen) return false;
+
+    char magic[sizeof(kIndexMagic)] = {0};
+    if (0 != fseek(_file, 0, SEEK_SET) || 1 != fread(magic, sizeof(magic), 1, _file) || 0 != memcmp(magic, kIndexMagic, sizeof(magic))) return false;
+
+    size_t count = (size - sizeof(kIndexMagic)) / kItemLen;
+    _items.reserve(count);
+
+    char buff[kItemLen];
+    for (size_t i = 0; i < count; ++i) {
+        if (1 != fread(buff, kItemLen, 1, _file)) return false;
+
+        Item item;
+        __DecodeItem(buff, item);
+        _items.push_back(item);
+    }
+    return true;
+}
+
+bool LogIndex::__ReadLastItem(FILE* _file, size_t& _count, Item& _last) {
+    _count = 0;
+
+    long size = __FileSize(_file);
+    if ((long)sizeof(kIndexMagic) > size || 0 != (size - sizeof(kIndexMagic)) % kItemLen) return false;
+
+    char magic[sizeof(kIndexMagic)] = {0};
+    if (0 != fseek(_file, 0, SEEK_SET) || 1 != fread(magic, sizeof(magic), 1, _file) || 0 != memcmp(magic, kIndexMagic, sizeof(magic))) return false;
+
+    _count = (size - sizeof(kIndexMagic)) / kItemLen;
+    if (0 == _count) return true;
+
+    char buff[kItemLen];
+    if (0 != fseek(_file, size - (long)kItemLen, SEEK_SET) || 1 != fread(buff, kItemLen, 1, _file)) return false;
+
+    __DecodeItem(buff, _last);
+    return true;
+}
+
+bool LogIndex::__WriteItems(FILE* _file, const std::vector<Item>& _items) {
+    if (0 != fseek(_file, 0, SEEK_SET) || 1 != fwrite(kIndexMagic, sizeof(kIndexMagic), 1, _file)) return false;
+
+    char buff[kItemLen];
+    for (std::vector<Item>::const_iterator it = _items.begin(); it != _items.end(); ++it) {
+        __EncodeItem(*it, buff);
+        if (1 != fwrite(buff, kItemLen, 1, _file)) return false;
+    }
+
+    fflush(_file);
+    return 0 == ftruncate(fileno(_file), ftell(_file));
+}
+
+// _read_size is the size of the index when _items were read, -1 if there was none.
+bool LogIndex::__RewriteItems(const std::string& _index_path, long _read_size, const std::vector<Item>& _items) {
+    ScopedLock lock(sg_mutex_index);
+
+    FILE* index_file = fopen(_index_path.c_str(), "rb+");
+    if (NULL != index_file && __FileSize(index_file) != _read_size) {
+        // appended or rebuilt by the appender after it was read, it knows better.
+        fclose(index_file);
+        return false;
+    }
+
+    if (NULL == index_file) {
+        if (0 <= _read_size) return false;
+        index_file = fopen(_index_path.c_str(), "wb+");
+        if (NULL == index_file) return false;
+    }
+
+    bool ret = __WriteItems(index_file, _items);
+    fclose(index_file);
+    return ret;
+}
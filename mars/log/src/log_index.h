@@ -0,0 +1,73 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * log_index.h
+ *
+ * sidecar index of a log file, <log file>.idx, one item per log block.
+ * the appender appends to it as it writes blocks, it is rebuilt from the log file if it is missing or stale.
+ * readers run on the threads of their callers, the index file is only written under one lock.
+ */
+
+#ifndef LOG_INDEX_H_
+#define LOG_INDEX_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+class LogIndex {
+  public:
+    struct Item {
+        Item(): offset(0), length(0), seq(0), begin_hour(0), end_hour(0), line_count(0), level_mask(0) {}
+
+        uint32_t offset;        // of the block in the log file
+        uint32_t length;        // header, log data and tailer
+        uint16_t seq;
+        uint8_t begin_hour;
+        uint8_t end_hour;
+        uint32_t line_count;    // 0 if unknown
+        uint8_t level_mask;     // bit (1 << level), all set if unknown
+    };
+
+    static const uint8_t kLevelMaskAll = 0xFF;
+
+  public:
+    // level of a formatted line or a deferred log record, -1 if _line is not a log line.
+    static int GetLevel(const void* _line, size_t _len);
+
+    // _data, one or more blocks, has been written at _offset of the log file.
+    // _line_count and _level_mask describe the block if _data holds only one, _line_count 0 means unknown.
+    static bool Append(const char* _log_path, long _offset, const void* _data, size_t _len, uint32_t _line_count, uint8_t _level_mask);
+    // items of the whole log file, blocks the index is behind by are scanned.
+    // the index is brought up to date too, unless the appender has changed it meanwhile.
+    static bool Load(const char* _log_path, std::vector<Item>& _items);
+    static void Remove(const char* _log_path);
+
+    // hours of a log file never decrease, so the blocks are found by binary search.
+    static bool GetPeriodLogs(const char* _log_path, int _begin_hour, int _end_hour, unsigned long& _begin_pos, unsigned long& _end_pos, std::string& _err_msg);
+    // [begin, end) ranges of the log file holding lines of _min_level or higher.
+    static bool GetLevelLogs(const char* _log_path, int _min_level, std::vector<std::pair<unsigned long, unsigned long> >& _ranges);
+
+  private:
+    static std::string __IndexPath(const char* _log_path);
+    static void __ParseBlocks(const char* _data, size_t _len, long _offset, std::vector<Item>& _items);
+    static bool __ScanFile(FILE* _file, long _from, long _to, std::vector<Item>& _items);
+    static bool __ReadItems(FILE* _file, std::vector<Item>& _items);
+    static bool __ReadLastItem(FILE* _file, size_t& _count, Item& _last);
+    static bool __WriteItems(FILE* _file, const std::vector<Item>& _items);
+    static bool __RewriteItems(const std::string& _index_path, long _read_size, const std::vector<Item>& _items);
+};
+
+#endif /* LOG_INDEX_H_ */
@@ -0,0 +1,141 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * log_rate_limiter.cc
+ */
+
+#include "log_rate_limiter.h"
+
+#include <string.h>
+
+#include "mars/comm/thread/atomic_oper.h"
+#include "mars/comm/time_utils.h"
+
+/*
+ * GCRA form of the token bucket, one word per statement updated by cas:
+ * a line at now goes if max(tat, now) - now <= tolerance, then tat = max(tat, now) + interval.
+ * ticks wrap around, a tat further ahead than tolerance + interval can't be set by a line and is taken as stale.
+ */
+
+LogRateLimiter::LogRateLimiter()
+: interval_(0), tolerance_(0), sample_interval_(0), dirty_(0), reporting_(0), last_report_tick_(gettickcount()) {
+    memset((void*)slots_, 0, sizeof(slots_));
+}
+
+void LogRateLimiter::SetLimit(uint32_t _lines_per_sec, uint32_t _burst, uint32_t _sample_interval) {
+    uint32_t interval = 0;
+    if (0 != _lines_per_sec) {
+        interval = 1000 * kTicksPerMs / _lines_per_sec;
+        if (0 == interval) interval = 1;
+    }
+
+    atomic_write32(&sample_interval_, _sample_interval);
+    atomic_write32(&tolerance_, interval * (0 == _burst ? 0 : _burst - 1));
+    atomic_write32(&interval_, interval);
+}
+
+// fnv-1a of the name, not of the pointer, which is a buffer of its own per line for the logs from java.
+uint32_t LogRateLimiter::__Key(const char* _filename, int _line) {
+    uint32_t key = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)_filename; '\0' != *p; ++p) {
+        key = (key ^ *p) * 16777619u;
+    }
+
+    key ^= (uint32_t)_line * 2654435761u;
+    return 0 == key ? 1 : key;
+}
+
+LogRateLimiter::Slot* LogRateLimiter::__FindSlot(const char* _filename, int _line) {
+    uint32_t key = __Key(_filename, _line);
+
+    for (uint32_t i = 0; i < kMaxProbe; ++i) {
+        Slot& slot = slots_[(key + i) % kSlotCount];
+        uint32_t slot_key = atomic_read32(&slot.key);
+
+        if (key == slot_key) return &slot;
+        if (0 != slot_key) continue;
+
+        if (0 == atomic_cas32(&slot.key, key, 0)) {
+            size_t len = strlen(_filename);
+            const char* name = len < kMaxFilename ? _filename : _filename + len - (kMaxFilename - 1);
+            strncpy(slot.filename, name, kMaxFilename - 1);
+            slot.line = _line;
+            atomic_write32(&slot.named, 1);
+            return &slot;
+        }
+        if (key == atomic_read32(&slot.key)) return &slot;
+    }
+
+    return NULL;
+}
+
+bool LogRateLimiter::Allow(const char* _filename, int _line) {
+    uint32_t interval = atomic_read32(&interval_);
+    if (0 == interval || NULL == _filename) return true;
+
+    Slot* slot = __FindSlot(_filename, _line);
+    if (NULL == slot) return true;    // the table is crowded, don't limit rather than limit the wrong statement
+
+    uint32_t tolerance = atomic_read32(&tolerance_);
+    uint32_t now = (uint32_t)(gettickcount() * kTicksPerMs);
+
+    while (true) {
+        uint32_t tat = atomic_read32(&slot->tat);
+        int32_t ahead = (int32_t)(tat - now);
+        if (ahead < 0 || (uint32_t)ahead > tolerance + interval) ahead = 0;
+
+        if ((uint32_t)ahead > tolerance) break;
+
+        if (tat == atomic_cas32(&slot->tat, now + (uint32_t)ahead + interval, tat)) return true;
+    }
+
+    uint32_t sample_interval = atomic_read32(&sample_interval_);
+    if (0 != sample_interval && 0 == (atomic_inc32(&slot->denied) + 1) % sample_interval) return true;
+
+    atomic_inc32(&slot->suppressed);
+    if (0 == atomic_read32(&dirty_)) atomic_write32(&dirty_, 1);
+    return false;
+}
+
+bool LogRateLimiter::Pending() const {
+    return 0 != atomic_read32((volatile uint32_t*)&dirty_);
+}
+
+bool LogRateLimiter::Report(uint64_t _interval, std::vector<Suppressed>& _suppressed) {
+    if (0 == atomic_read32(&dirty_)) return false;
+    if (0 != atomic_cas32(&reporting_, 1, 0)) return false;
+
+    if ((uint64_t)gettickspan(last_report_tick_) < _interval) {
+        atomic_write32(&reporting_, 0);
+        return false;
+    }
+
+    last_report_tick_ = gettickcount();
+    atomic_write32(&dirty_, 0);
+
+    for (uint32_t i = 0; i < kSlotCount; ++i) {
+        Slot& slot = slots_[i];
+        if (0 == atomic_read32(&slot.suppressed) || 0 == atomic_read32(&slot.named)) continue;
+
+        uint32_t count = 0;
+        do {
+            count = atomic_read32(&slot.suppressed);
+        } while (count != atomic_cas32(&slot.suppressed, 0, count));
+
+        Suppressed suppressed = {slot.filename, slot.line, count};
+        _suppressed.push_back(suppressed);
+    }
+
+    atomic_write32(&reporting_, 0);
+    return !_suppressed.empty();
+}
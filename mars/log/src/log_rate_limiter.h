@@ -0,0 +1,88 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * log_rate_limiter.h
+ *
+ * token bucket per log statement, keyed by the name of its file and its line, so a statement logging
+ * in a tight loop can't crowd the lines of other modules out of the buffer.
+ * the state of a statement is a few atomic words in a fixed table, no lock is taken while logging.
+ */
+
+#ifndef LOG_RATE_LIMITER_H_
+#define LOG_RATE_LIMITER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class LogRateLimiter {
+  public:
+    struct Suppressed {
+        std::string filename;
+        int line;
+        uint32_t count;
+    };
+
+  public:
+    LogRateLimiter();
+
+  public:
+    // _lines_per_sec 0 turns the limit off, at most 1000 per second are told apart.
+    // a statement may log _burst lines at once, then every _sample_interval-th line over the limit still goes, 0 for none.
+    void SetLimit(uint32_t _lines_per_sec, uint32_t _burst, uint32_t _sample_interval);
+    bool Allow(const char* _filename, int _line);
+
+    // statements that have suppressed lines since the last report, at most once per _interval ms.
+    // false if nothing is suppressed, it is not time yet or another thread is reporting.
+    bool Report(uint64_t _interval, std::vector<Suppressed>& _suppressed);
+    // something is suppressed since the last report.
+    bool Pending() const;
+
+  private:
+    static const uint32_t kMaxFilename = 128;
+
+    struct Slot {
+        volatile uint32_t key;          // 0 if free
+        volatile uint32_t named;        // filename is written
+        volatile int line;
+        volatile uint32_t tat;          // theoretical arrival time of the next line, kTicksPerMs units
+        volatile uint32_t denied;       // lines over the limit, for sampling
+        volatile uint32_t suppressed;   // since the last report
+        char filename[kMaxFilename];    // a copy, the caller's may be freed once it has logged, the tail if too long
+    };
+
+    static const uint32_t kSlotCount = 1024;
+    static const uint32_t kMaxProbe = 8;
+    static const uint32_t kTicksPerMs = 16;
+
+  private:
+    static uint32_t __Key(const char* _filename, int _line);
+    Slot* __FindSlot(const char* _filename, int _line);
+
+  private:
+    LogRateLimiter(const LogRateLimiter&);
+    LogRateLimiter& operator=(const LogRateLimiter&);
+
+  private:
+    volatile uint32_t interval_;        // between two lines, kTicksPerMs units, 0 if off
+    volatile uint32_t tolerance_;       // (burst - 1) * interval_
+    volatile uint32_t sample_interval_;
+
+    volatile uint32_t dirty_;           // something is suppressed since the last report
+    volatile uint32_t reporting_;
+    uint64_t last_report_tick_;         // guarded by reporting_
+
+    Slot slots_[kSlotCount];
+};
+
+#endif /* LOG_RATE_LIMITER_H_ */
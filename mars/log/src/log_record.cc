@@ -0,0 +1,378 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * log_record.cc
+ */
+
+#include "log_record.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "mars/comm/xlogger/xlogger.h"
+#include "mars/comm/xlogger/loginfo_extract.h"
+
+#ifdef _WIN32
+#define PRIdMAX "lld"
+#define snprintf _snprintf
+#else
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#endif
+
+/*
+ * call site body: |id(uint32_t)|pid(int64_t)|gmtoff(int32_t)|line(int32_t)|tag\0|filename\0|func_name\0|format\0|
+ * log body: |id(uint32_t)|pid(int64_t)|tid(int64_t)|is_main(uint8_t)|level(uint8_t)|sec(int64_t)|usec(int32_t)|args|
+ */
+
+const char LogRecord::kMarker;
+
+static const size_t kLogBodyFixedLen = sizeof(uint32_t) + sizeof(int64_t) * 2 + sizeof(uint8_t) * 2 + sizeof(int64_t) + sizeof(int32_t);
+
+static const char* sg_level_strings[] = {
+    "V",
+    "D",  // debug
+    "I",  // info
+    "W",  // warn
+    "E",  // error
+    "F"  // fatal
+};
+
+static void __WriteHeader(PtrBuffer& _buff, uint8_t _kind, uint16_t _len) {
+    _buff.Write(&LogRecord::kMarker, sizeof(LogRecord::kMarker));
+    _buff.Write(&_kind, sizeof(_kind));
+    _buff.Write(&_len, sizeof(_len));
+}
+
+static void __WriteString(PtrBuffer& _buff, const char* _str) {
+    const char* str = NULL == _str ? "" : _str;
+    _buff.Write(str, strlen(str) + 1);
+}
+
+template <typename T>
+static bool __Read(const char*& _data, const char* _end, T& _val) {
+    if (_end - _data < (long)sizeof(_val)) return false;
+    memcpy(&_val, _data, sizeof(_val));
+    _data += sizeof(_val);
+    return true;
+}
+
+static bool __ReadString(const char*& _data, const char* _end, std::string& _str) {
+    const char* zero = (const char*)memchr(_data, '\0', _end - _data);
+    if (NULL == zero) return false;
+    _str.assign(_data, zero - _data);
+    _data = zero + 1;
+    return true;
+}
+
+uint32_t LogRecord::GetHeaderLen() {
+    return sizeof(kMarker) + sizeof(uint8_t) + sizeof(uint16_t);
+}
+
+int LogRecord::GetLevel(const char* _data, size_t _len) {
+    const char* current = _data;
+    const char* end = _data + _len;
+
+    while (current < end && kMarker == *current) {
+        const char* body = current + sizeof(kMarker);
+        uint8_t kind = 0;
+        uint16_t body_len = 0;
+        if (!__Read(body, end, kind) || !__Read(body, end, body_len) || end - body < body_len) return -1;
+
+        if (kKindLog == kind) {
+            if (body_len < kLogBodyFixedLen) return -1;
+            return (uint8_t)body[sizeof(uint32_t) + sizeof(int64_t) * 2 + sizeof(uint8_t)];
+        }
+        current = body + body_len;
+    }
+    return -1;
+}
+
+uint32_t LogRecord::GetCallSiteId(const char* _data, size_t _len) {
+    const char* current = _data;
+    const char* end = _data + _len;
+
+    while (current < end && kMarker == *current) {
+        const char* body = current + sizeof(kMarker);
+        uint8_t kind = 0;
+        uint16_t body_len = 0;
+        if (!__Read(body, end, kind) || !__Read(body, end, body_len) || end - body < body_len) return 0;
+
+        if (kKindLog == kind) {
+            uint32_t id = 0;
+            if (body_len < kLogBodyFixedLen || !__Read(body, end, id)) return 0;
+            return id;
+        }
+        current = body + body_len;
+    }
+    return 0;
+}
+
+bool LogRecord::WriteCallSite(PtrBuffer& _buff, const XLoggerCallSite* _callsite, intmax_t _pid, int _gmtoff) {
+    const char* tag = NULL == _callsite->tag ? "" : _callsite->tag;
+    const char* filename = NULL == _callsite->filename ? "" : _callsite->filename;
+    const char* func_name = NULL == _callsite->func_name ? "" : _callsite->func_name;
+    const char* format = NULL == _callsite->format ? "" : _callsite->format;
+
+    size_t body_len = sizeof(uint32_t) + sizeof(int64_t) + sizeof(int32_t) * 2
+                      + strlen(tag) + strlen(filename) + strlen(func_name) + strlen(format) + 4;
+    if (body_len > 0xFFFF || _buff.MaxLength() - _buff.Length() < GetHeaderLen() + body_len) return false;
+
+    __WriteHeader(_buff, kKindCallSite, (uint16_t)body_len);
+
+    uint32_t id = _callsite->id;
+    int64_t pid = _pid;
+    int32_t gmtoff = _gmtoff;
+    int32_t line = _callsite->line;
+    _buff.Write(&id, sizeof(id));
+    _buff.Write(&pid, sizeof(pid));
+    _buff.Write(&gmtoff, sizeof(gmtoff));
+    _buff.Write(&line, sizeof(line));
+    __WriteString(_buff, tag);
+    __WriteString(_buff, filename);
+    __WriteString(_buff, func_name);
+    __WriteString(_buff, format);
+    return true;
+}
+
+bool LogRecord::WriteLog(PtrBuffer& _buff, const XLoggerCallSite* _callsite, TLogLevel _level, const struct timeval& _tv,
+                         intmax_t _pid, intmax_t _tid, bool _is_main, const void* _args, size_t _len) {
+    size_t body_len = kLogBodyFixedLen + _len;
+    if (body_len > 0xFFFF || _buff.MaxLength() - _buff.Length() < GetHeaderLen() + body_len) return false;
+
+    __WriteHeader(_buff, kKindLog, (uint16_t)body_len);
+
+    uint32_t id = _callsite->id;
+    int64_t pid = _pid;
+    int64_t tid = _tid;
+    uint8_t is_main = _is_main ? 1 : 0;
+    uint8_t level = (uint8_t)_level;
+    int64_t sec = _tv.tv_sec;
+    int32_t usec = (int32_t)_tv.tv_usec;
+    _buff.Write(&id, sizeof(id));
+    _buff.Write(&pid, sizeof(pid));
+    _buff.Write(&tid, sizeof(tid));
+    _buff.Write(&is_main, sizeof(is_main));
+    _buff.Write(&level, sizeof(level));
+    _buff.Write(&sec, sizeof(sec));
+    _buff.Write(&usec, sizeof(usec));
+    if (0 < _len) _buff.Write(_args, _len);
+    return true;
+}
+
+static bool __RenderArg(const char*& _data, const char* _end, std::string& _out) {
+    uint8_t type = 0;
+    if (!__Read(_data, _end, type)) return false;
+
+    if (kDeferredArgString == type) {
+        uint16_t len = 0;
+        if (!__Read(_data, _end, len) || _end - _data < len) return false;
+        _out.append(_data, len);
+        _data += len;
+        return true;
+    }
+
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+    } value;
+    if (!__Read(_data, _end, value)) return false;
+
+    char temp[65] = {0};
+    switch (type) {
+    case kDeferredArgBool:
+        _out += 0 != value.u ? "true" : "false";
+        break;
+    case kDeferredArgChar:
+        _out += (char)value.i;
+        break;
+    case kDeferredArgInt:
+        _out += xlogger_itoa<10>(value.i, temp);
+        break;
+    case kDeferredArgUInt:
+        _out += xlogger_itoa<10>(value.u, temp);
+        break;
+    case kDeferredArgDouble:
+        snprintf(temp, sizeof(temp), "%E", value.d);
+        _out += temp;
+        break;
+    case kDeferredArgPointer:
+        _out += "0x";
+        _out += xlogger_itoa<16>(value.u, temp);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+void LogRecord::RenderBody(const char* _format, const char* _args, size_t _len, std::string& _body) {
+    const char* end = _args + _len;
+    uint8_t count = 0;
+    if (!__Read(_args, end, count)) {
+        _body += "{!!! LogRecord::RenderBody: bad args !!!}";
+        return;
+    }
+
+    std::string args[16];
+    for (int i = 0; i < count && i < 16; ++i) {
+        if (!__RenderArg(_args, end, args[i])) {
+            _body += "{!!! LogRecord::RenderBody: bad args !!!}";
+            return;
+        }
+    }
+
+    const char* current = NULL == _format ? "" : _format;
+    int index = 0;
+    while ('\0' != *current) {
+        if ('%' != *current) {
+            _body += *current;
+            ++current;
+            continue;
+        }
+
+        char nextch = *(current + 1);
+        if (('0' <= nextch && nextch <= '9') || nextch == '_') {
+            int arg_index = nextch == '_' ? index : nextch - '0';
+            if (arg_index < count) {
+                _body += args[arg_index];
+            } else {
+                _body += "(null)";
+            }
+            ++index;
+            current += 2;
+        } else if (nextch == '%') {
+            _body += '%';
+            current += 2;
+        } else {
+            _body += '%';
+            ++current;
+        }
+    }
+}
+
+void LogRecordDecoder::Decode(const char* _data, size_t _len, std::string& _out) {
+    const char* current = _data;
+    const char* end = _data + _len;
+
+    while (current < end) {
+        if (LogRecord::kMarker != *current) {
+            const char* marker = (const char*)memchr(current, LogRecord::kMarker, end - current);
+            if (NULL == marker) marker = end;
+            _out.append(current, marker - current);
+            current = marker;
+            continue;
+        }
+
+        size_t len = __DecodeRecord(current, end - current, _out);
+        current += 0 == len ? 1 : len;
+    }
+}
+
+size_t LogRecordDecoder::__DecodeRecord(const char* _data, size_t _len, std::string& _out) {
+    const char* current = _data + sizeof(LogRecord::kMarker);
+    const char* end = _data + _len;
+
+    uint8_t kind = 0;
+    uint16_t body_len = 0;
+    if (!__Read(current, end, kind) || !__Read(current, end, body_len) || end - current < body_len) return 0;
+
+    switch (kind) {
+    case LogRecord::kKindCallSite:
+        __DecodeCallSite(current, body_len);
+        break;
+    case LogRecord::kKindLog:
+        __DecodeLog(current, body_len, _out);
+        break;
+    default:
+        return 0;
+    }
+
+    return LogRecord::GetHeaderLen() + body_len;
+}
+
+void LogRecordDecoder::__DecodeCallSite(const char* _body, size_t _len) {
+    const char* end = _body + _len;
+
+    uint32_t id = 0;
+    int64_t pid = 0;
+    int32_t gmtoff = 0;
+    int32_t line = 0;
+    CallSite callsite;
+    if (!__Read(_body, end, id) || !__Read(_body, end, pid) || !__Read(_body, end, gmtoff) || !__Read(_body, end, line)
+        || !__ReadString(_body, end, callsite.tag) || !__ReadString(_body, end, callsite.filename)
+        || !__ReadString(_body, end, callsite.func_name) || !__ReadString(_body, end, callsite.format)) {
+        return;
+    }
+
+    callsite.line = line;
+    callsite.gmtoff = gmtoff;
+    callsites_[std::make_pair(pid, id)] = callsite;
+}
+
+void LogRecordDecoder::__DecodeLog(const char* _body, size_t _len, std::string& _out) {
+    const char* end = _body + _len;
+
+    uint32_t id = 0;
+    int64_t pid = 0;
+    int64_t tid = 0;
+    uint8_t is_main = 0;
+    uint8_t level = 0;
+    int64_t sec = 0;
+    int32_t usec = 0;
+    if (!__Read(_body, end, id) || !__Read(_body, end, pid) || !__Read(_body, end, tid) || !__Read(_body, end, is_main)
+        || !__Read(_body, end, level) || !__Read(_body, end, sec) || !__Read(_body, end, usec)) {
+        _out += "[F][ LogRecordDecoder: bad log record\n";
+        return;
+    }
+
+    if (level > kLevelFatal) level = kLevelFatal;
+
+    std::map<std::pair<int64_t, uint32_t>, CallSite>::const_iterator it = callsites_.find(std::make_pair(pid, id));
+    if (it == callsites_.end()) {
+        char msg[128] = {0};
+        snprintf(msg, sizeof(msg), "[%s][ LogRecordDecoder: unknown call site %u of pid %" PRIdMAX "][", sg_level_strings[level], id, (intmax_t)pid);
+        _out += msg;
+        LogRecord::RenderBody("%_ %_ %_ %_ %_ %_ %_ %_ %_ %_ %_ %_ %_ %_ %_ %_", _body, end - _body, _out);
+        _out += "\n";
+        return;
+    }
+
+    const CallSite& callsite = it->second;
+
+    time_t local_sec = (time_t)(sec + callsite.gmtoff);
+    struct tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &local_sec);
+#else
+    gmtime_r(&local_sec, &tm);
+#endif
+
+    char temp_time[64] = {0};
+    snprintf(temp_time, sizeof(temp_time), "%d-%02d-%02d %+.1f %02d:%02d:%02d.%.3d", 1900 + tm.tm_year, 1 + tm.tm_mon, tm.tm_mday,
+             callsite.gmtoff / 3600.0, tm.tm_hour, tm.tm_min, tm.tm_sec, (int)(usec / 1000));
+
+    char func_name[128] = {0};
+    ExtractFunctionName(callsite.func_name.c_str(), func_name, sizeof(func_name));
+
+    char header[1024] = {0};
+    snprintf(header, sizeof(header), "[%s][%s][%" PRIdMAX ", %" PRIdMAX "%s][%s][%s, %s, %d][",
+             sg_level_strings[level], temp_time, (intmax_t)pid, (intmax_t)tid, is_main ? "*" : "", callsite.tag.c_str(),
+             ExtractFileName(callsite.filename.c_str()), func_name, callsite.line);
+
+    _out += header;
+    LogRecord::RenderBody(callsite.format.c_str(), _body, end - _body, _out);
+    if (_out.empty() || '\n' != _out[_out.size() - 1]) _out += '\n';
+}
@@ -0,0 +1,86 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * log_record.h
+ *
+ * binary records of deferred log statements, they share the log buffer with formatted text lines.
+ * text lines never contain '\0', so a record starts with a '\0' marker:
+ * |marker(char)|kind(uint8_t)|len(uint16_t)|body(len)|
+ */
+
+#ifndef LOG_RECORD_H_
+#define LOG_RECORD_H_
+
+#include <stdint.h>
+#include <string>
+#include <map>
+
+#include "mars/comm/xlogger/xloggerbase.h"
+#include "mars/comm/ptrbuffer.h"
+
+class LogRecord {
+  public:
+    enum TKind {
+        kKindCallSite = 1,
+        kKindLog = 2,
+    };
+
+    static const char kMarker = '\0';
+
+  public:
+    static uint32_t GetHeaderLen();
+
+    static bool WriteCallSite(PtrBuffer& _buff, const XLoggerCallSite* _callsite, intmax_t _pid, int _gmtoff);
+    static bool WriteLog(PtrBuffer& _buff, const XLoggerCallSite* _callsite, TLogLevel _level, const struct timeval& _tv,
+                         intmax_t _pid, intmax_t _tid, bool _is_main, const void* _args, size_t _len);
+
+    // level of the first log record in _data, -1 if there is none.
+    static int GetLevel(const char* _data, size_t _len);
+    // call site id of the first log record in _data, 0 if there is none.
+    static uint32_t GetCallSiteId(const char* _data, size_t _len);
+
+    // renders the args of a record with the type safe format of its call site, the same way TVariant does.
+    static void RenderBody(const char* _format, const char* _args, size_t _len, std::string& _body);
+};
+
+class LogRecordDecoder {
+  public:
+    LogRecordDecoder() {}
+
+  public:
+    // _data is the uncompressed content of xlog blocks, text lines are copied and records are rendered.
+    void Decode(const char* _data, size_t _len, std::string& _out);
+
+  private:
+    size_t __DecodeRecord(const char* _data, size_t _len, std::string& _out);
+    void __DecodeCallSite(const char* _body, size_t _len);
+    void __DecodeLog(const char* _body, size_t _len, std::string& _out);
+
+  private:
+    LogRecordDecoder(const LogRecordDecoder&);
+    LogRecordDecoder& operator=(const LogRecordDecoder&);
+
+  private:
+    struct CallSite {
+        std::string tag;
+        std::string filename;
+        std::string func_name;
+        std::string format;
+        int line;
+        int gmtoff;
+    };
+
+    std::map<std::pair<int64_t, uint32_t>, CallSite> callsites_;
+};
+
+#endif /* LOG_RECORD_H_ */
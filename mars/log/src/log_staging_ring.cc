@@ -0,0 +1,98 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * log_staging_ring.cc
+ */
+
+#include "log_staging_ring.h"
+
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+
+#include "mars/comm/thread/atomic_oper.h"
+
+/*
+ * |len(uint16_t)|log line(len)|len(uint16_t)|log line(len)|...
+ * head_ and tail_ are free running counters, capacity_ must be power of 2.
+ */
+
+LogStagingRing::LogStagingRing(uint32_t _capacity)
+: buffer_(NULL), capacity_(_capacity), head_(0), tail_(0), detached_(0) {
+    assert(0 != _capacity && 0 == (_capacity & (_capacity - 1)));
+    buffer_ = new char[capacity_];
+}
+
+LogStagingRing::~LogStagingRing() {
+    delete[] buffer_;
+}
+
+bool LogStagingRing::Push(const void* _data, uint16_t _len) {
+    if (NULL == _data || 0 == _len) return false;
+
+    uint32_t head = head_;
+    uint32_t tail = atomic_read32(&tail_);
+
+    if (capacity_ - (head - tail) < sizeof(_len) + _len) return false;
+
+    __CopyIn(head, &_len, sizeof(_len));
+    __CopyIn(head + sizeof(_len), _data, _len);
+
+    atomic_write32(&head_, head + (uint32_t)sizeof(_len) + _len);
+    return true;
+}
+
+void LogStagingRing::Detach() {
+    atomic_write32(&detached_, 1);
+}
+
+size_t LogStagingRing::Pop(void* _buffer, size_t _len) {
+    uint32_t tail = tail_;
+    uint32_t head = atomic_read32(&head_);
+
+    if (head == tail) return 0;
+
+    uint16_t single_log_len = 0;
+    __CopyOut(tail, &single_log_len, sizeof(single_log_len));
+
+    assert(_len >= single_log_len);
+    size_t copy_len = std::min(_len, (size_t)single_log_len);
+    __CopyOut(tail + sizeof(single_log_len), _buffer, (uint32_t)copy_len);
+
+    atomic_write32(&tail_, tail + (uint32_t)sizeof(single_log_len) + single_log_len);
+    return copy_len;
+}
+
+bool LogStagingRing::IsDetached() {
+    return 0 != atomic_read32(&detached_);
+}
+
+uint32_t LogStagingRing::Size() {
+    return atomic_read32(&head_) - atomic_read32(&tail_);
+}
+
+void LogStagingRing::__CopyIn(uint32_t _pos, const void* _data, uint32_t _len) {
+    uint32_t offset = _pos & (capacity_ - 1);
+    uint32_t first = std::min(_len, capacity_ - offset);
+
+    memcpy(buffer_ + offset, _data, first);
+    if (first < _len) memcpy(buffer_, (const char*)_data + first, _len - first);
+}
+
+void LogStagingRing::__CopyOut(uint32_t _pos, void* _data, uint32_t _len) const {
+    uint32_t offset = _pos & (capacity_ - 1);
+    uint32_t first = std::min(_len, capacity_ - offset);
+
+    memcpy(_data, buffer_ + offset, first);
+    if (first < _len) memcpy((char*)_data + first, buffer_, _len - first);
+}
@@ -0,0 +1,59 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * log_staging_ring.h
+ *
+ * single producer / single consumer ring of formatted log lines.
+ * the producer is the logging thread owning the ring, the consumer is whoever holds sg_mutex_buffer_async.
+ */
+
+#ifndef LOG_STAGING_RING_H_
+#define LOG_STAGING_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+class LogStagingRing {
+  public:
+    explicit LogStagingRing(uint32_t _capacity);
+    ~LogStagingRing();
+
+  public:
+    // producer side
+    bool Push(const void* _data, uint16_t _len);
+    void Detach();
+
+    // consumer side
+    size_t Pop(void* _buffer, size_t _len);
+    bool IsDetached();
+
+    uint32_t Size();
+    uint32_t Capacity() const { return capacity_; }
+
+  private:
+    void __CopyIn(uint32_t _pos, const void* _data, uint32_t _len);
+    void __CopyOut(uint32_t _pos, void* _data, uint32_t _len) const;
+
+  private:
+    LogStagingRing(const LogStagingRing&);
+    LogStagingRing& operator=(const LogStagingRing&);
+
+  private:
+    char* buffer_;
+    uint32_t capacity_;
+    volatile uint32_t head_;    // written by producer only
+    volatile uint32_t tail_;    // written by consumer only
+    volatile uint32_t detached_;
+};
+
+#endif /* LOG_STAGING_RING_H_ */
@@ -114,4 +114,12 @@ const static unsigned int kLonglinkConnMax = 3;
 const static unsigned int kShortlinkConnTimeout = 10 * 1000;
 const static unsigned int kShortlinkConnInterval = 4 * 1000;
 
+//shortlink dns, threads shared by all the short links
+const static unsigned int kShortlinkResolverThreadCount = 4;
+
+//shortlink keep-alive pool
+const static unsigned int kShortlinkKeepaliveIdleTimeout = 30 * 1000;
+const static unsigned int kShortlinkKeepaliveMaxIdle = 8;
+const static unsigned int kShortlinkKeepaliveMaxIdlePerHost = 2;
+
 #endif /* stn_config_h */
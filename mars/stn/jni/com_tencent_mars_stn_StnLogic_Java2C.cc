@@ -177,6 +177,8 @@ JNIEXPORT void JNICALL Java_com_tencent_mars_stn_StnLogic_startTask
 	jint retrycount = JNU_GetField(_env, _task, "retryCount", "I").i;
 	jint server_process_cost = JNU_GetField(_env, _task, "serverProcessCost", "I").i;
 	jint total_timetout = JNU_GetField(_env, _task, "totalTimeout", "I").i;
+	jboolean shortlink_accept_encoding = JNU_GetField(_env, _task, "shortLinkAcceptEncoding", "Z").z;
+	jboolean shortlink_compress_body = JNU_GetField(_env, _task, "shortLinkCompressBody", "Z").z;
 	jstring report_arg = (jstring)JNU_GetField(_env, _task, "reportArg", "Ljava/lang/String;").l;
 
 	//init struct Task
@@ -198,6 +200,9 @@ JNIEXPORT void JNICALL Java_com_tencent_mars_stn_StnLogic_startTask
 	task.server_process_cost = server_process_cost;
 	task.total_timetout = total_timetout;
 
+	task.shortlink_accept_encoding = shortlink_accept_encoding;
+	task.shortlink_compress_body = shortlink_compress_body;
+
 	if (NULL != report_arg) {
 		task.report_arg = ScopedJstring(_env, report_arg).GetChar();
 	}
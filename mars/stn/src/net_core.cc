@@ -41,6 +41,7 @@
 #include "net_check_logic.h"
 #include "anti_avalanche.h"
 #include "shortlink_task_manager.h"
+#include "shortlink_keepalive_pool.h"
 #include "dynamic_timeout.h"
 
 #ifdef USE_LONG_LINK
@@ -434,6 +435,7 @@ void NetCore::OnNetworkChange() {
 #endif
 
     net_source_->ClearCache();
+    ShortLinkKeepAlivePool::Instance().Clear();
     
     dynamic_timeout_->ResetStatus();
 #ifdef USE_LONG_LINK
@@ -20,6 +20,8 @@
 
 #include "shortlink.h"
 
+#include <limits.h>
+
 #include <sstream>
 
 #include "boost/bind.hpp"
@@ -29,7 +31,6 @@
 #include "mars/comm/socket/unix_socket.h"
 #include "mars/comm/socket/socket_address.h"
 #include "mars/comm/socket/local_ipstack.h"
-#include "mars/comm/socket/block_socket.h"
 #include "mars/comm/xlogger/xlogger.h"
 #include "mars/comm/strutil.h"
 #include "mars/comm/time_utils.h"
@@ -41,6 +42,8 @@
 #endif
 #include "mars/stn/proto/shortlink_packer.h"
 
+#include "shortlink_keepalive_pool.h"
+
 
 
 #define AYNC_HANDLER asyncreg_.Get()
@@ -106,10 +109,20 @@ class ShortLinkConnectObserver : public MComplexConnect {
 ShortLink::ShortLink(MessageQueue::MessageQueue_t _messagequeueid, NetSource& _netsource, const std::vector<std::string>& _host_list, const std::string& _url, const int _taskid, bool _use_proxy)
     : asyncreg_(MessageQueue::InstallAsyncHandler(_messagequeueid))
 	, net_source_(_netsource)
-	, thread_(boost::bind(&ShortLink::__Run, this), XLOGGER_TAG "::shortlink")
 	, taskid_(_taskid)
     , url_(_url), use_proxy_(_use_proxy)
+    , accept_encoding_(false)
+    , compress_body_(false)
+    , send_body_gzip_(false)
     , status_code_(-1)
+    , status_(kStart)
+    , complex_connect_(kShortlinkConnTimeout, kShortlinkConnInterval)
+    , connect_observer_(NULL)
+    , startconnecttime_(0)
+    , socket_(INVALID_SOCKET)
+    , recv_pos_(0)
+    , parser_(NULL)
+    , reused_(false)
     {
     xdebug2(XTHIS);
     xassert2(breaker_.IsCreateSuc(), "Create Breaker Fail!!!");
@@ -121,6 +134,12 @@ ShortLink::ShortLink(MessageQueue::MessageQueue_t _messagequeueid, NetSource& _n
 ShortLink::~ShortLink() {
     xinfo_function(TSF"taskid:%_, cgi:%_, @%_", taskid_, url_, this);
     __CancelAndWaitWorkerThread();
+    ShortLinkReactor::Instance().Remove(this);
+
+    if (INVALID_SOCKET != socket_) socket_close(socket_);
+    delete parser_;
+    delete connect_observer_;
+
     asyncreg_.CancelAndWait();
 }
 
@@ -129,36 +148,50 @@ void ShortLink::SendRequest(AutoBuffer& _buf_req) {
     xdebug2(XTHIS)(TSF"bufReq.size:%_", _buf_req.Length());
     send_body_.Attach(_buf_req);
 
-    thread_.start();
+    // once for all the retries, and only when it gets smaller.
+    AutoBuffer compressed;
+    if (compress_body_ && http::Compress(send_body_.Ptr(), send_body_.Length(), http::kContentEncodingGzip, compressed)
+            && compressed.Length() < send_body_.Length()) {
+        xinfo2(TSF"gzip body %_ -> %_, taskid:%_", send_body_.Length(), compressed.Length(), taskid_);
+        send_body_.Attach(compressed);
+        send_body_gzip_ = true;
+    }
+
+    ShortLinkResolver::Instance().Add(this);
+}
+
+void ShortLink::ContentEncoding(bool _accept_encoding, bool _compress_body) {
+    accept_encoding_ = _accept_encoding;
+    compress_body_ = _compress_body;
+}
+
+void ShortLink::Resolve() {
+    __Run();
 }
 
 void ShortLink::__Run() {
     xmessage2_define(message, TSF"taskid:%_, cgi:%_, @%_", taskid_, url_, this);
     xinfo_function(TSF"%_, net:%_, body:%_", message.String(), getNetInfo(), buf_body_.Length());
 
-    ConnectProfile conn_profile;
-	getCurrNetLabel(conn_profile.net_type);
-	conn_profile.start_time = ::gettickcount();
-	conn_profile.tid = xlogger_tid();
-	__UpdateProfile(conn_profile);
+	getCurrNetLabel(run_profile_.net_type);
+	run_profile_.start_time = ::gettickcount();
+	run_profile_.tid = xlogger_tid();
+	__UpdateProfile(run_profile_);
 
-    SOCKET fd_socket = __RunConnect(conn_profile);
+    if (!__RunConnect(run_profile_)) return;
 
-    if (INVALID_SOCKET == fd_socket) return;
-    OnSend(this);
-
-    int errtype = 0;
-    int errcode = 0;
-    __RunReadWrite(fd_socket, errtype, errcode, conn_profile);
-
-    conn_profile.disconn_signal = ::getSignal(::getNetInfo() == kWifi);
-    __UpdateProfile(conn_profile);
+    // canceled while resolving, the destructor is waiting for us.
+    if (breaker_.IsBreak()) {
+        run_profile_.disconn_errtype = kEctCanceled;
+        __UpdateProfile(run_profile_);
+        return;
+    }
 
-    socket_close(fd_socket);
+    ShortLinkReactor::Instance().Add(this);
 }
 
 
-SOCKET ShortLink::__RunConnect(ConnectProfile& _conn_profile) {
+bool ShortLink::__RunConnect(ConnectProfile& _conn_profile) {
     xmessage2_define(message)(TSF"taskid:%_, cgi:%_, @%_", taskid_, url_, this);
 
     std::vector<socket_address> vecaddr;
@@ -193,7 +226,7 @@ SOCKET ShortLink::__RunConnect(ConnectProfile& _conn_profile) {
     if (vecaddr.empty()) {
         xerror2(TSF"task socket connect fail %_ vecaddr empty", message.String());
         __RunResponseError(kEctDns, kEctDnsMakeSocketPrepared, _conn_profile);
-        return INVALID_SOCKET;
+        return false;
     }
 
     _conn_profile.host = _conn_profile.ip_items[0].str_host;
@@ -208,189 +241,319 @@ SOCKET ShortLink::__RunConnect(ConnectProfile& _conn_profile) {
     // set the first ip info to the profiler, after connect, the ip info will be overwrriten by the real one
 
 
-    uint64_t startconnecttime = ::gettickcount();
-    ShortLinkConnectObserver connect_observer(*this);
+    startconnecttime_ = ::gettickcount();
+    connect_observer_ = new ShortLinkConnectObserver(*this);
+    vecaddr_ = vecaddr;
 
-    SOCKET sock = ComplexConnect(kShortlinkConnTimeout, kShortlinkConnInterval).ConnectImpatient(vecaddr, breaker_, &connect_observer);
+    if (kIPSourceProxy != _conn_profile.ip_type && __TakeKeepAlive(_conn_profile)) return true;
 
-    _conn_profile.conn_errcode = connect_observer.LastErrorCode();
-    _conn_profile.conn_rtt = connect_observer.Rtt();
-    _conn_profile.ip_index = connect_observer.Index();
-    __UpdateProfile(_conn_profile);
+    status_ = kConnecting;
+    return complex_connect_.Begin(vecaddr, connect_observer_);
+}
 
-    if (INVALID_SOCKET == sock) {
-        xwarn2(TSF"task socket connect fail sock %_, net:%_", message.String(), getNetInfo());
+bool ShortLink::__TakeKeepAlive(ConnectProfile& _conn_profile) {
+    for (unsigned int i = 0; i < _conn_profile.ip_items.size(); ++i) {
+        SOCKET sock = ShortLinkKeepAlivePool::Instance().Take(_conn_profile.ip_items[i].str_ip, _conn_profile.port, _conn_profile.ip_items[i].str_host);
+        if (INVALID_SOCKET == sock) continue;
+
+        _conn_profile.host = _conn_profile.ip_items[i].str_host;
+        _conn_profile.ip_type = _conn_profile.ip_items[i].source_type;
+        _conn_profile.ip = _conn_profile.ip_items[i].str_ip;
+        _conn_profile.ip_index = (int)i;
+        _conn_profile.conn_rtt = 0;
+        _conn_profile.conn_cost = 0;
+        _conn_profile.conn_time = gettickcount();
+        _conn_profile.local_ip = socket_address::getsockname(sock).ip();
+        __UpdateProfile(_conn_profile);
 
-        if (!breaker_.IsBreak()) {
-            __RunResponseError(kEctSocket, kEctSocketMakeSocketPrepared, _conn_profile, false);
-        }
-        else {
-        	_conn_profile.disconn_errtype = kEctCanceled;
-        	__UpdateProfile(_conn_profile);
-        }
+        xinfo2(TSF"task socket keep-alive sock:%_, taskid:%_, host:%_, ip:%_, port:%_", sock, taskid_, _conn_profile.host, _conn_profile.ip, _conn_profile.port);
+        reused_ = true;
+        __StartSend(sock);
+        return true;
+    }
 
-        return INVALID_SOCKET;
+    return false;
+}
+
+bool ShortLink::__ReconnectStale() {
+    // the server dropped a kept-alive socket before any of the response came, connect as if it was never reused.
+    if (!reused_ || 0 < recv_buf_.Length()) return false;
+
+    xwarn2(TSF"keep-alive sock:%_ failed before the response, connect again, taskid:%_, @%_", socket_, taskid_, this);
+    socket_close(socket_);
+    socket_ = INVALID_SOCKET;
+    reused_ = false;
+    delete parser_;
+    parser_ = NULL;
+
+    startconnecttime_ = ::gettickcount();
+    status_ = kConnecting;
+    return complex_connect_.Begin(vecaddr_, connect_observer_);
+}
+
+void ShortLink::PreSelect(SocketSelect& _sel, XLogger& _log) {
+    switch (status_) {
+    case kConnecting:
+        complex_connect_.PreSelect(_sel);
+        break;
+    case kSending:
+        _sel.Write_FD_SET(socket_);
+        _sel.Exception_FD_SET(socket_);
+        break;
+    case kRecving:
+        _sel.Read_FD_SET(socket_);
+        _sel.Exception_FD_SET(socket_);
+        break;
+    default:
+        break;
     }
+}
 
-    xassert2(0 <= connect_observer.Index() && (unsigned int)connect_observer.Index() < _conn_profile.ip_items.size());
+void ShortLink::AfterSelect(SocketSelect& _sel, XLogger& _log) {
+    // canceled between the dns and the add, the destructor removes us right after.
+    if (breaker_.IsBreak()) {
+        xinfo2(TSF"user cancel, taskid:%_, status:%_, @%_", taskid_, (int)status_, this) >> _log;
+        run_profile_.disconn_errtype = kEctCanceled;
+        __UpdateProfile(run_profile_);
+        if (INVALID_SOCKET != socket_) socket_close(socket_);
+        socket_ = INVALID_SOCKET;
+        status_ = kEnd;
+        return;
+    }
 
-    for (int i = 0; i < connect_observer.Index(); ++i) {
-        if (1 == connect_observer.ConnectingIndex[i])
-            func_network_report(__LINE__, kEctSocket, SOCKET_ERRNO(ETIMEDOUT), _conn_profile.ip_items[i].str_ip, _conn_profile.ip_items[i].str_host, _conn_profile.ip_items[i].port);
+    switch (status_) {
+    case kConnecting:
+        __AfterConnect(_sel);
+        break;
+    case kSending:
+        __AfterSend(_sel);
+        break;
+    case kRecving:
+        __AfterRecv(_sel);
+        break;
+    default:
+        break;
     }
+}
 
-    _conn_profile.host = _conn_profile.ip_items[connect_observer.Index()].str_host;
-    _conn_profile.ip_type = _conn_profile.ip_items[connect_observer.Index()].source_type;
-    _conn_profile.ip = _conn_profile.ip_items[connect_observer.Index()].str_ip;
-    _conn_profile.conn_cost = gettickspan(startconnecttime);
-    _conn_profile.conn_time = gettickcount();
-    _conn_profile.local_ip = socket_address::getsockname(sock).ip();
-    __UpdateProfile(_conn_profile);
+int ShortLink::Timeout() const {
+    return kConnecting == status_ ? complex_connect_.Timeout() : INT_MAX;
+}
+
+bool ShortLink::IsEndStatus() const {
+    return kEnd == status_;
+}
 
+void ShortLink::__AfterConnect(SocketSelect& _sel) {
+    complex_connect_.AfterSelect(_sel);
+    if (!complex_connect_.IsEnd()) return;
 
-    xinfo2(TSF"task socket connect success sock:%_, %_ host:%_, ip:%_, port:%_, iptype:%_, net:%_", sock, message.String(), _conn_profile.host, _conn_profile.ip, _conn_profile.port, IPSourceTypeString[_conn_profile.ip_type], _conn_profile.net_type);
+    __OnConnected(complex_connect_.End());
+}
 
+void ShortLink::__OnConnected(SOCKET _sock) {
+    xmessage2_define(message)(TSF"taskid:%_, cgi:%_, @%_", taskid_, url_, this);
+    ConnectProfile& conn_profile = run_profile_;
 
-//    struct linger so_linger;
-//    so_linger.l_onoff = 1;
-//    so_linger.l_linger = 0;
+    conn_profile.conn_errcode = connect_observer_->LastErrorCode();
+    conn_profile.conn_rtt = connect_observer_->Rtt();
+    conn_profile.ip_index = connect_observer_->Index();
+    __UpdateProfile(conn_profile);
+
+    if (INVALID_SOCKET == _sock) {
+        xwarn2(TSF"task socket connect fail sock %_, net:%_", message.String(), getNetInfo());
+        __RunResponseError(kEctSocket, kEctSocketMakeSocketPrepared, conn_profile, false);
+        status_ = kEnd;
+        return;
+    }
+
+    xassert2(0 <= connect_observer_->Index() && (unsigned int)connect_observer_->Index() < conn_profile.ip_items.size());
+
+    for (int i = 0; i < connect_observer_->Index(); ++i) {
+        if (1 == connect_observer_->ConnectingIndex[i])
+            func_network_report(__LINE__, kEctSocket, SOCKET_ERRNO(ETIMEDOUT), conn_profile.ip_items[i].str_ip, conn_profile.ip_items[i].str_host, conn_profile.ip_items[i].port);
+    }
+
+    conn_profile.host = conn_profile.ip_items[connect_observer_->Index()].str_host;
+    conn_profile.ip_type = conn_profile.ip_items[connect_observer_->Index()].source_type;
+    conn_profile.ip = conn_profile.ip_items[connect_observer_->Index()].str_ip;
+    conn_profile.conn_cost = gettickspan(startconnecttime_);
+    conn_profile.conn_time = gettickcount();
+    conn_profile.local_ip = socket_address::getsockname(_sock).ip();
+    __UpdateProfile(conn_profile);
 
-//    xerror2_if(0 != setsockopt(sock, SOL_SOCKET, SO_LINGER, (const char*)&so_linger, sizeof(so_linger)), TSF"SO_LINGER %_(%_)", socket_errno, socket_strerror(socket_errno));
-    return sock;
+    xinfo2(TSF"task socket connect success sock:%_, %_ host:%_, ip:%_, port:%_, iptype:%_, net:%_", _sock, message.String(), conn_profile.host, conn_profile.ip, conn_profile.port, IPSourceTypeString[conn_profile.ip_type], conn_profile.net_type);
+
+    __StartSend(_sock);
 }
 
-void ShortLink::__RunReadWrite(SOCKET _socket, int& _err_type, int& _err_code, ConnectProfile& _conn_profile) {
-	xmessage2_define(message)(TSF"taskid:%_, cgi:%_, @%_", taskid_, url_, this);
+void ShortLink::__StartSend(SOCKET _sock) {
+    socket_ = _sock;
+    OnSend(this);
 
     std::string url;
-    if (kIPSourceProxy==_conn_profile.ip_type) {
+    if (kIPSourceProxy==run_profile_.ip_type) {
         url +="http://";
-        url += _conn_profile.host;
+        url += run_profile_.host;
     }
 	url += url_;
 
-
 	std::map<std::string, std::string> headers;
-	headers[http::HeaderFields::KStringHost] = _conn_profile.host;
-	AutoBuffer out_buff;
+	headers[http::HeaderFields::KStringHost] = run_profile_.host;
+	if (kIPSourceProxy != run_profile_.ip_type) headers.insert(http::HeaderFields::MakeConnectionKeepalive());
+	if (accept_encoding_) headers.insert(http::HeaderFields::MakeAcceptEncodingGzipDeflate());
+	if (send_body_gzip_) headers.insert(http::HeaderFields::MakeContentEncoding(http::kContentEncodingGzip));
 
-	shortlink_pack(url, headers, send_body_,  out_buff);
+	send_buf_.Reset();
+	shortlink_pack(url, headers, send_body_, send_buf_);
+	send_buf_.Seek(0, AutoBuffer::ESeekStart);
 
-	// send request
-	xgroup2_define(group_send);
-	xinfo2(TSF"task socket send sock:%_, %_ http len:%_, ", _socket, message.String(), out_buff.Length()) >> group_send;
+	xinfo2(TSF"task socket send sock:%_, taskid:%_, cgi:%_, @%_ http len:%_, ", socket_, taskid_, url_, this, send_buf_.Length());
+	status_ = kSending;
+}
 
-	int send_ret = block_socket_send(_socket, (const unsigned char*)out_buff.Ptr(), (unsigned int)out_buff.Length(), breaker_, _err_code);
+void ShortLink::__AfterSend(SocketSelect& _sel) {
+    int err_code = 0;
 
-	if (send_ret < 0) {
-		xerror2(TSF"Send Request Error, ret:%0, errno:%1, nread:%_, nwrite:%_", send_ret, strerror(_err_code), socket_nread(_socket), socket_nwrite(_socket)) >> group_send;
-		__OnResponse(kEctSocket, (_err_code == 0) ? kEctSocketWritenWithNonBlock : _err_code, buf_body_, _conn_profile, false);
-		return;
-	}
-    
-    GetSignalOnNetworkDataChange()(XLOGGER_TAG, send_ret, 0);
+    if (_sel.Exception_FD_ISSET(socket_)) {
+        err_code = socket_error(socket_);
+    } else if (_sel.Write_FD_ISSET(socket_)) {
+        ssize_t nwrite = ::send(socket_, (const char*)send_buf_.PosPtr(), send_buf_.PosLength(), 0);
 
-    if (breaker_.IsBreak()) {
-        xwarn2(TSF"Send Request break, sent:%_ nread:%_, nwrite:%_", send_ret, socket_nread(_socket), socket_nwrite(_socket)) >> group_send;
+        if (0 < nwrite) {
+            send_buf_.Seek(nwrite, AutoBuffer::ESeekCur);
+            if (0 < send_buf_.PosLength()) return;
+        } else if (0 > nwrite && IS_NOBLOCK_SEND_ERRNO(socket_errno)) {
+            return;
+        } else {
+            err_code = (0 == nwrite) ? 0 : socket_errno;
+        }
+    } else {
         return;
     }
 
-	xgroup2() << group_send;
+    if (0 < send_buf_.PosLength()) {
+		if (__ReconnectStale()) return;
+		xerror2(TSF"Send Request Error, sent:%_, errno:%_, nread:%_, nwrite:%_", send_buf_.Pos(), strerror(err_code), socket_nread(socket_), socket_nwrite(socket_));
+		__OnResponse(kEctSocket, (err_code == 0) ? kEctSocketWritenWithNonBlock : err_code, buf_body_, run_profile_, false);
+		__End();
+		return;
+    }
 
-	xgroup2_define(group_close);
-	xgroup2_define(group_recv);
-    
-    xinfo2(TSF"task socket close sock:%_, %_, ", _socket, message.String()) >> group_close;
-	xinfo2(TSF"task socket recv sock:%_,  %_, ", _socket, message.String()) >> group_recv;
-
-	//recv response
-	AutoBuffer recv_buf;
-	off_t recv_pos = 0;
-    http::MemoryBodyReceiver* receiver = new http::MemoryBodyReceiver(buf_body_);
-	http::Parser parser(receiver, true);
-
-	while (true) {
-		int recv_ret = block_socket_recv(_socket, recv_buf, KBufferSize, breaker_, _err_code, 5000);
-
-		if (recv_ret < 0) {
-			xerror2(TSF"read block socket return false, error:%0, nread:%_, nwrite:%_", strerror(_err_code), socket_nread(_socket), socket_nwrite(_socket)) >> group_close;
-			__OnResponse(kEctSocket, (_err_code == 0) ? kEctSocketReadOnce : _err_code, buf_body_, _conn_profile, socket_nwrite(_socket) == 0);
-			break;
-		}
+    GetSignalOnNetworkDataChange()(XLOGGER_TAG, (ssize_t)send_buf_.Length(), 0);
 
-		if (breaker_.IsBreak()) {
-			xinfo2(TSF"user cancel, nread:%_, nwrite:%_", socket_nread(_socket), socket_nwrite(_socket)) >> group_close;
-        	_conn_profile.disconn_errtype = kEctCanceled;
-			break;
-		}
+	xinfo2(TSF"task socket recv sock:%_, taskid:%_, cgi:%_, @%_", socket_, taskid_, url_, this);
+    http::BodyReceiver* receiver = new http::MemoryBodyReceiver(buf_body_);
+    if (accept_encoding_) receiver = new http::InflateBodyReceiver(receiver, true);
+    parser_ = new http::Parser(receiver, true);
+    status_ = kRecving;
+}
 
-		if (recv_ret == 0 && SOCKET_ERRNO(ETIMEDOUT) == _err_code) {
-			xerror2(TSF"read timeout error:(%_,%_), nread:%_, nwrite:%_ ", _err_code, strerror(_err_code), socket_nread(_socket), socket_nwrite(_socket)) >> group_close;
-//			__OnResponse(kEctSocket, kEctSocketRecvErr, buf_body_, _conn_profile, socket_nwrite(_socket) == 0);
-//			break;
-            continue;
-		}
-		if (recv_ret == 0) {
-			xerror2(TSF"remote disconnect, nread:%_, nwrite:%_", _err_code, strerror(_err_code), socket_nread(_socket), socket_nwrite(_socket)) >> group_close;
-			__OnResponse(kEctSocket,  kEctSocketShutdown, buf_body_, _conn_profile, socket_nwrite(_socket) == 0);
-			break;
-		}
+void ShortLink::__AfterRecv(SocketSelect& _sel) {
+    if (_sel.Exception_FD_ISSET(socket_)) {
+        int err_code = socket_error(socket_);
+		if (__ReconnectStale()) return;
+		xerror2(TSF"read block socket return false, error:%_, nread:%_, nwrite:%_", strerror(err_code), socket_nread(socket_), socket_nwrite(socket_));
+		__OnResponse(kEctSocket, (err_code == 0) ? kEctSocketReadOnce : err_code, buf_body_, run_profile_, socket_nwrite(socket_) == 0);
+		__End();
+		return;
+    }
 
-		if (recv_ret > 0) {
-            GetSignalOnNetworkDataChange()(XLOGGER_TAG, 0, recv_ret);
-            
-			xinfo2(TSF"recv len:%_ ", recv_ret) >> group_recv;
-			OnRecv(this, (unsigned int)(recv_buf.Length() - recv_pos), (unsigned int)recv_buf.Length());
-			recv_pos = recv_buf.Pos();
-		}
+    if (!_sel.Read_FD_ISSET(socket_)) return;
 
-        http::Parser::TRecvStatus parse_status = parser.Recv(recv_buf.Ptr(recv_buf.Length() - recv_ret), recv_ret);
-        if (parser.FirstLineReady()) {
-            status_code_ = parser.Status().StatusCode();
-        }
+    if (recv_buf_.Capacity() - recv_buf_.Length() < KBufferSize) {
+        recv_buf_.AddCapacity(KBufferSize - (recv_buf_.Capacity() - recv_buf_.Length()));
+    }
 
-		if (parse_status == http::Parser::kFirstLineError) {
-			xerror2(TSF"http head not receive yet,but socket closed, length:%0, nread:%_, nwrite:%_ ", recv_buf.Length(), socket_nread(_socket), socket_nwrite(_socket)) >> group_close;
-			__OnResponse(kEctHttp, kEctHttpParseStatusLine, buf_body_, _conn_profile, socket_nwrite(_socket) == 0);
-			break;
-		}
-		else if (parse_status == http::Parser::kHeaderFieldsError) {
-			xerror2(TSF"parse http head failed, but socket closed, length:%0, nread:%_, nwrite:%_ ", recv_buf.Length(), socket_nread(_socket), socket_nwrite(_socket)) >> group_close;
-			__OnResponse(kEctHttp, kEctHttpSplitHttpHeadAndBody, buf_body_, _conn_profile);
-			break;
-		}
-		else if (parse_status == http::Parser::kBodyError) {
-			xerror2(TSF"content_length_ != buf_body_.Lenght(), Head:%0, http dump:%1 \n headers size:%2" , parser.Fields().ContentLength(), xdump(recv_buf.Ptr(), recv_buf.Length()), parser.Fields().GetHeaders().size()) >> group_close;
-			__OnResponse(kEctHttp, kEctHttpSplitHttpHeadAndBody, buf_body_, _conn_profile);
-			break;
-		}
-		else if (parse_status == http::Parser::kEnd) {
-			if (status_code_ != 200) {
-				xerror2(TSF"@%0, status_code_ != 200, code:%1, http dump:%2 \n headers size:%3", this, status_code_, xdump(recv_buf.Ptr(), recv_buf.Length()), parser.Fields().GetHeaders().size()) >> group_close;
-				__OnResponse(kEctHttp, status_code_, buf_body_, _conn_profile);
-			}
-			else {
-				xinfo2(TSF"@%0, headers size:%_, ", this, parser.Fields().GetHeaders().size()) >> group_recv;
-				__OnResponse(kEctOK, status_code_, buf_body_, _conn_profile);
-			}
-			break;
+    ssize_t recv_ret = ::recv(socket_, recv_buf_.Ptr(recv_buf_.Length()), KBufferSize, 0);
+
+    if (0 > recv_ret && IS_NOBLOCK_READ_ERRNO(socket_errno)) return;
+
+    if (0 > recv_ret) {
+        int err_code = socket_errno;
+		if (__ReconnectStale()) return;
+		xerror2(TSF"read block socket return false, error:%_, nread:%_, nwrite:%_", strerror(err_code), socket_nread(socket_), socket_nwrite(socket_));
+		__OnResponse(kEctSocket, (err_code == 0) ? kEctSocketReadOnce : err_code, buf_body_, run_profile_, socket_nwrite(socket_) == 0);
+		__End();
+		return;
+    }
+
+    if (0 == recv_ret) {
+		if (__ReconnectStale()) return;
+		xerror2(TSF"remote disconnect, nread:%_, nwrite:%_", socket_nread(socket_), socket_nwrite(socket_));
+		__OnResponse(kEctSocket,  kEctSocketShutdown, buf_body_, run_profile_, socket_nwrite(socket_) == 0);
+		__End();
+		return;
+    }
+
+    recv_buf_.Length(recv_buf_.Pos(), recv_buf_.Length() + recv_ret);
+    GetSignalOnNetworkDataChange()(XLOGGER_TAG, 0, recv_ret);
+
+	xinfo2(TSF"recv len:%_ ", recv_ret);
+	OnRecv(this, (unsigned int)(recv_buf_.Length() - recv_pos_), (unsigned int)recv_buf_.Length());
+	recv_pos_ = recv_buf_.Pos();
+
+    http::Parser::TRecvStatus parse_status = parser_->Recv(recv_buf_.Ptr(recv_buf_.Length() - recv_ret), recv_ret);
+    if (parser_->FirstLineReady()) {
+        status_code_ = parser_->Status().StatusCode();
+    }
+
+	if (parse_status == http::Parser::kFirstLineError) {
+		xerror2(TSF"http head not receive yet,but socket closed, length:%_, nread:%_, nwrite:%_ ", recv_buf_.Length(), socket_nread(socket_), socket_nwrite(socket_));
+		__OnResponse(kEctHttp, kEctHttpParseStatusLine, buf_body_, run_profile_, socket_nwrite(socket_) == 0);
+	}
+	else if (parse_status == http::Parser::kHeaderFieldsError) {
+		xerror2(TSF"parse http head failed, but socket closed, length:%_, nread:%_, nwrite:%_ ", recv_buf_.Length(), socket_nread(socket_), socket_nwrite(socket_));
+		__OnResponse(kEctHttp, kEctHttpSplitHttpHeadAndBody, buf_body_, run_profile_);
+	}
+	else if (parse_status == http::Parser::kBodyError) {
+		xerror2(TSF"content_length_ != buf_body_.Lenght(), Head:%0, http dump:%1 \n headers size:%2" , parser_->Fields().ContentLength(), xdump(recv_buf_.Ptr(), recv_buf_.Length()), parser_->Fields().GetHeaders().size());
+		__OnResponse(kEctHttp, kEctHttpSplitHttpHeadAndBody, buf_body_, run_profile_);
+	}
+	else if (parse_status == http::Parser::kEnd) {
+		if (status_code_ != 200) {
+			xerror2(TSF"@%0, status_code_ != 200, code:%1, http dump:%2 \n headers size:%3", this, status_code_, xdump(recv_buf_.Ptr(), recv_buf_.Length()), parser_->Fields().GetHeaders().size());
+			__OnResponse(kEctHttp, status_code_, buf_body_, run_profile_);
 		}
 		else {
-			xdebug2(TSF"http parser status:%_ ", parse_status);
+			xinfo2(TSF"@%0, headers size:%_, ", this, parser_->Fields().GetHeaders().size());
+			__OnResponse(kEctOK, status_code_, buf_body_, run_profile_);
 		}
+
+		// only what went out without a proxy asked for keep-alive.
+		__End(kIPSourceProxy != run_profile_.ip_type && parser_->KeepAlive());
+		return;
+	}
+	else {
+		xdebug2(TSF"http parser status:%_ ", parse_status);
+		return;
 	}
 
-	xdebug2(TSF"read with nonblock socket http response, length:%_, ", recv_buf.Length()) >> group_recv;
+	__End();
+}
 
-	xgroup2() << group_recv;
+void ShortLink::__End(bool _keepalive) {
+	xgroup2_define(group_close);
+    xinfo2(TSF"task socket close sock:%_, taskid:%_, cgi:%_, @%_, recv length:%_, ", socket_, taskid_, url_, this, recv_buf_.Length()) >> group_close;
 #if defined(__ANDROID__) || defined(__APPLE__)
 	struct tcp_info _info;
-	if (getsocktcpinfo(_socket, &_info) == 0) {
+	if (getsocktcpinfo(socket_, &_info) == 0) {
 		char tcp_info_str[1024] = {0};
 		xinfo2(TSF"task socket close getsocktcpinfo:%_", tcpinfo2str(&_info, tcp_info_str, sizeof(tcp_info_str))) >> group_close;
 	}
 #endif
 	xgroup2() << group_close;
+
+    run_profile_.disconn_signal = ::getSignal(::getNetInfo() == kWifi);
+    __UpdateProfile(run_profile_);
+
+    if (_keepalive) {
+        ShortLinkKeepAlivePool::Instance().Put(run_profile_.ip, run_profile_.port, run_profile_.host, socket_);
+    } else {
+        socket_close(socket_);
+    }
+    socket_ = INVALID_SOCKET;
+    status_ = kEnd;
 }
 
 void ShortLink::__UpdateProfile(const ConnectProfile& _conn_profile) {
@@ -422,15 +585,14 @@ void ShortLink::__OnResponse(ErrCmdType _errType, int _status, AutoBuffer& _body
 void ShortLink::__CancelAndWaitWorkerThread() {
     xdebug_function();
 
-    if (!thread_.isruning()) return;
-
     xassert2(breaker_.IsCreateSuc());
 
+    // the link may be waiting for a resolver thread, or resolving on one.
     if (!breaker_.Break()) {
         xassert2(false, "breaker fail");
         breaker_.Close();
     }
 
     dns_util_.Cancel();
-    thread_.join();
+    ShortLinkResolver::Instance().Remove(this);
 }
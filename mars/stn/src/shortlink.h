@@ -31,6 +31,8 @@
 #include "mars/comm/thread/thread.h"
 #include "mars/comm/autobuffer.h"
 #include "mars/comm/http.h"
+#include "mars/comm/socket/complexconnect.h"
+#include "mars/comm/socket/socket_address.h"
 #include "mars/comm/socket/socketselect.h"
 #include "mars/comm/messagequeue/message_queue.h"
 #include "mars/comm/messagequeue/message_queue_utils.h"
@@ -39,11 +41,16 @@
 
 #include "net_source.h"
 #include "shortlink_interface.h"
+#include "shortlink_reactor.h"
+#include "shortlink_resolver.h"
 
 namespace mars {
 namespace stn {
 
-class ShortLink : public ShortLinkInterface {
+class ShortLinkConnectObserver;
+
+// a thread of the shared ShortLinkResolver only resolves the hosts, connect, send and recv are steps run by the shared ShortLinkReactor.
+class ShortLink : public ShortLinkInterface, private ShortLinkReactor::Link, private ShortLinkResolver::Job {
   public:
     ShortLink(MessageQueue::MessageQueue_t _messagequeueid, NetSource& _netsource, const std::vector<std::string>& _host_list, const std::string& _url, const int _taskid, bool _use_proxy);
     virtual ~ShortLink();
@@ -52,12 +59,35 @@ class ShortLink : public ShortLinkInterface {
 
   protected:
     virtual void 	 SendRequest(AutoBuffer& _buf_req);
+    virtual void     ContentEncoding(bool _accept_encoding, bool _compress_body);
+
+    enum TStatus {
+        kStart,
+        kConnecting,
+        kSending,
+        kRecving,
+        kEnd,
+    };
 
+    virtual void     Resolve();
     virtual void     __Run();
-    virtual SOCKET   __RunConnect(ConnectProfile& _conn_profile);
-    virtual void     __RunReadWrite(SOCKET _sock, int& _errtype, int& _errcode, ConnectProfile& _conn_profile);
+    virtual bool     __RunConnect(ConnectProfile& _conn_profile);
+    bool             __TakeKeepAlive(ConnectProfile& _conn_profile);
+    bool             __ReconnectStale();
     void             __CancelAndWaitWorkerThread();
 
+    virtual void     PreSelect(SocketSelect& _sel, XLogger& _log);
+    virtual void     AfterSelect(SocketSelect& _sel, XLogger& _log);
+    virtual int      Timeout() const;
+    virtual bool     IsEndStatus() const;
+
+    void             __AfterConnect(SocketSelect& _sel);
+    void             __OnConnected(SOCKET _sock);
+    void             __StartSend(SOCKET _sock);
+    void             __AfterSend(SocketSelect& _sel);
+    void             __AfterRecv(SocketSelect& _sel);
+    void             __End(bool _keepalive = false);
+
     void			 __UpdateProfile(const ConnectProfile& _conn_profile);
 
     void 			 __RunResponseError(ErrCmdType _type, int _errcode, ConnectProfile& _conn_profile, bool _report = true);
@@ -66,7 +96,6 @@ class ShortLink : public ShortLinkInterface {
   protected:
     MessageQueue::ScopeRegister     asyncreg_;
     NetSource&                      net_source_;
-    Thread                          thread_;
 
     const uint32_t                  taskid_;
     SocketSelectBreaker             breaker_;
@@ -76,11 +105,28 @@ class ShortLink : public ShortLinkInterface {
     std::vector<std::string>        shortlink_hosts_;
     const std::string               url_;
     const bool                      use_proxy_;
+    bool                            accept_encoding_;
+    bool                            compress_body_;
     AutoBuffer                      send_body_;
+    bool                            send_body_gzip_;  // send_body_ is compressed already
 
     AutoBuffer                      buf_body_;
     int                             status_code_;
 
+    // touched by the resolver until the link is added to the reactor, then by the reactor only.
+    TStatus                         status_;
+    ConnectProfile                  run_profile_;
+    ComplexConnect                  complex_connect_;
+    ShortLinkConnectObserver*       connect_observer_;
+    uint64_t                        startconnecttime_;
+    SOCKET                          socket_;
+    AutoBuffer                      send_buf_;
+    AutoBuffer                      recv_buf_;
+    off_t                           recv_pos_;
+    http::Parser*                   parser_;
+    bool                            reused_;  // socket_ came from the keep-alive pool
+    std::vector<socket_address>     vecaddr_;
+
 };
         
 }}
@@ -33,6 +33,8 @@ class ShortLinkInterface {
 
 	virtual void            SendRequest(AutoBuffer& _buf_req) = 0;
 	virtual ConnectProfile  Profile() const { return ConnectProfile();}
+	// before SendRequest, a link that can't encode goes on without.
+	virtual void            ContentEncoding(bool, bool) {}
 
     boost::function<void (int _line, ErrCmdType _errtype, int _errcode, const std::string& _ip, const std::string& _host, uint16_t _port)> func_network_report;
     boost::function<void (ShortLinkInterface* _worker, ErrCmdType _err_type, int _status, AutoBuffer& _body, bool _cancel_retry, ConnectProfile& _conn_profile)> OnResponse;
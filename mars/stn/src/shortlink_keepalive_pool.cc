@@ -0,0 +1,141 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * shortlink_keepalive_pool.cc
+ */
+
+#include "shortlink_keepalive_pool.h"
+
+#include <stdio.h>
+#include <limits.h>
+
+#include "mars/comm/thread/lock.h"
+#include "mars/comm/time_utils.h"
+#include "mars/comm/xlogger/xlogger.h"
+#include "mars/stn/config.h"
+
+using namespace mars::stn;
+
+ShortLinkKeepAlivePool& ShortLinkKeepAlivePool::Instance() {
+    // never deleted, as the shortlink reactor.
+    static ShortLinkKeepAlivePool* pool = new ShortLinkKeepAlivePool(kShortlinkKeepaliveIdleTimeout, kShortlinkKeepaliveMaxIdle, kShortlinkKeepaliveMaxIdlePerHost);
+    return *pool;
+}
+
+ShortLinkKeepAlivePool::ShortLinkKeepAlivePool(unsigned int _idle_timeout, size_t _max_idle, size_t _max_idle_per_host)
+    : idle_timeout_(_idle_timeout), max_idle_(_max_idle), max_idle_per_host_(_max_idle_per_host) {}
+
+ShortLinkKeepAlivePool::~ShortLinkKeepAlivePool() {
+    Clear();
+}
+
+SOCKET ShortLinkKeepAlivePool::Take(const std::string& _ip, uint16_t _port, const std::string& _host) {
+    std::string key = __Key(_ip, _port, _host);
+
+    ScopedLock lock(mutex_);
+    __EvictExpired(::gettickcount());
+
+    for (std::list<IdleItem>::reverse_iterator it = idle_.rbegin(); it != idle_.rend();) {
+        if (key != it->key) { ++it; continue; }
+
+        SOCKET sock = it->sock;
+        it = std::list<IdleItem>::reverse_iterator(idle_.erase(--it.base()));
+
+        if (__IsHealthy(sock)) {
+            xinfo2(TSF"take keep-alive sock:%_, key:%_, idle:%_", sock, key, idle_.size());
+            return sock;
+        }
+
+        xinfo2(TSF"drop keep-alive sock:%_, key:%_, closed by remote", sock, key);
+        socket_close(sock);
+    }
+
+    return INVALID_SOCKET;
+}
+
+void ShortLinkKeepAlivePool::Put(const std::string& _ip, uint16_t _port, const std::string& _host, SOCKET _sock) {
+    if (INVALID_SOCKET == _sock) return;
+
+    std::string key = __Key(_ip, _port, _host);
+    uint64_t now = ::gettickcount();
+
+    ScopedLock lock(mutex_);
+    __EvictExpired(now);
+
+    IdleItem item = {key, _sock, now};
+    idle_.push_back(item);
+
+    size_t same_key = 0;
+    for (std::list<IdleItem>::iterator it = idle_.begin(); it != idle_.end(); ++it) {
+        if (key == it->key) ++same_key;
+    }
+
+    for (std::list<IdleItem>::iterator it = idle_.begin(); it != idle_.end() && (same_key > max_idle_per_host_ || idle_.size() > max_idle_);) {
+        if (idle_.size() <= max_idle_ && key != it->key) { ++it; continue; }
+
+        if (key == it->key) --same_key;
+        xdebug2(TSF"close keep-alive sock:%_, key:%_, over the limits", it->sock, it->key);
+        socket_close(it->sock);
+        it = idle_.erase(it);
+    }
+}
+
+void ShortLinkKeepAlivePool::Clear() {
+    ScopedLock lock(mutex_);
+
+    for (std::list<IdleItem>::iterator it = idle_.begin(); it != idle_.end(); ++it) {
+        socket_close(it->sock);
+    }
+
+    xinfo2_if(!idle_.empty(), TSF"clear keep-alive socks:%_", idle_.size());
+    idle_.clear();
+}
+
+size_t ShortLinkKeepAlivePool::Size() const {
+    ScopedLock lock(mutex_);
+    return idle_.size();
+}
+
+int ShortLinkKeepAlivePool::EvictExpired() {
+    uint64_t now = ::gettickcount();
+
+    ScopedLock lock(mutex_);
+    __EvictExpired(now);
+
+    if (idle_.empty()) return INT_MAX;
+    return (int)(idle_.front().idle_time + idle_timeout_ - now);
+}
+
+std::string ShortLinkKeepAlivePool::__Key(const std::string& _ip, uint16_t _port, const std::string& _host) {
+    char port[8] = {0};
+    snprintf(port, sizeof(port), "%u", (unsigned int)_port);
+    return _ip + ":" + port + "/" + _host;
+}
+
+bool ShortLinkKeepAlivePool::__IsHealthy(SOCKET _sock) {
+    if (0 != socket_error(_sock)) return false;
+
+    // an idle http connection has nothing to read, a fin or stray bytes mean it can't carry a request.
+    char c = 0;
+    ssize_t ret = ::recv(_sock, &c, 1, MSG_PEEK);
+    return 0 > ret && IS_NOBLOCK_READ_ERRNO(socket_errno);
+}
+
+void ShortLinkKeepAlivePool::__EvictExpired(uint64_t _now) {
+    while (!idle_.empty() && _now - idle_.front().idle_time >= idle_timeout_) {
+        xdebug2(TSF"close keep-alive sock:%_, key:%_, idle timeout", idle_.front().sock, idle_.front().key);
+        socket_close(idle_.front().sock);
+        idle_.pop_front();
+    }
+}
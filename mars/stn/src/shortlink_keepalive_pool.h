@@ -0,0 +1,76 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * shortlink_keepalive_pool.h
+ *
+ * idle keep-alive sockets of the short links, by ip, port and host.
+ * the ShortLinkReactor evicts the expired ones every round, so no socket stays idle much longer than the timeout.
+ */
+
+#ifndef STN_SRC_SHORTLINK_KEEPALIVE_POOL_H_
+#define STN_SRC_SHORTLINK_KEEPALIVE_POOL_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <string>
+
+#include "mars/comm/thread/mutex.h"
+#include "mars/comm/socket/unix_socket.h"
+
+namespace mars {
+namespace stn {
+
+class ShortLinkKeepAlivePool {
+  public:
+    static ShortLinkKeepAlivePool& Instance();
+
+    ShortLinkKeepAlivePool(unsigned int _idle_timeout /*ms*/, size_t _max_idle, size_t _max_idle_per_host);
+    ~ShortLinkKeepAlivePool();
+
+    // the socket put last for the key that is still open with nothing to read, or INVALID_SOCKET.
+    SOCKET Take(const std::string& _ip, uint16_t _port, const std::string& _host);
+    // the pool owns _sock from now on, and closes it when it is over the limits.
+    void   Put(const std::string& _ip, uint16_t _port, const std::string& _host, SOCKET _sock);
+    void   Clear();
+    size_t Size() const;
+    // closes the sockets idle for the timeout, returns ms until the next one expires, INT_MAX for none.
+    int    EvictExpired();
+
+  private:
+    ShortLinkKeepAlivePool(const ShortLinkKeepAlivePool&);
+    ShortLinkKeepAlivePool& operator=(const ShortLinkKeepAlivePool&);
+
+  private:
+    struct IdleItem {
+        std::string key;
+        SOCKET      sock;
+        uint64_t    idle_time;
+    };
+
+    static std::string __Key(const std::string& _ip, uint16_t _port, const std::string& _host);
+    static bool        __IsHealthy(SOCKET _sock);
+    void               __EvictExpired(uint64_t _now);
+
+  private:
+    const unsigned int      idle_timeout_;
+    const size_t            max_idle_;
+    const size_t            max_idle_per_host_;
+    mutable Mutex           mutex_;
+    std::list<IdleItem>     idle_;  // oldest first
+};
+
+}}
+
+#endif // STN_SRC_SHORTLINK_KEEPALIVE_POOL_H_
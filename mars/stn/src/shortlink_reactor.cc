@@ -0,0 +1,112 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * shortlink_reactor.cc
+ */
+
+#include "shortlink_reactor.h"
+
+#include <limits.h>
+
+#include <algorithm>
+
+#include "boost/bind.hpp"
+
+#include "mars/comm/thread/lock.h"
+#include "mars/comm/xlogger/xlogger.h"
+
+#include "shortlink_keepalive_pool.h"
+
+using namespace mars::stn;
+
+ShortLinkReactor& ShortLinkReactor::Instance() {
+    // never deleted, the links may outlive any static destructor.
+    static ShortLinkReactor* reactor = new ShortLinkReactor();
+    return *reactor;
+}
+
+ShortLinkReactor::ShortLinkReactor()
+    : thread_(boost::bind(&ShortLinkReactor::__Run, this), XLOGGER_TAG "::shortlink_reactor") {
+    xassert2(breaker_.IsCreateSuc(), "Create Breaker Fail!!!");
+}
+
+ShortLinkReactor::~ShortLinkReactor() {}
+
+void ShortLinkReactor::Add(Link* _link) {
+    xassert2(NULL != _link);
+
+    ScopedLock lock(mutex_);
+    xassert2(links_.end() == std::find(links_.begin(), links_.end(), _link));
+    links_.push_back(_link);
+
+    if (!thread_.isruning()) thread_.start();
+    breaker_.Break();
+}
+
+void ShortLinkReactor::Remove(Link* _link) {
+    ScopedLock lock(mutex_);
+    links_.erase(std::remove(links_.begin(), links_.end(), _link), links_.end());
+    std::replace(round_.begin(), round_.end(), _link, (Link*)NULL);
+}
+
+size_t ShortLinkReactor::Size() const {
+    ScopedLock lock(mutex_);
+    return links_.size();
+}
+
+void ShortLinkReactor::__Run() {
+    xinfo_function();
+
+    SocketSelect sel(breaker_, true);
+    ScopedLock lock(mutex_);
+
+    while (true) {
+        xgroup2_define(group);
+        sel.PreSelect();
+        round_.clear();
+
+        // idle keep-alive sockets are closed on time, also when no link takes or puts one.
+        int timeout = ShortLinkKeepAlivePool::Instance().EvictExpired();
+        for (std::vector<Link*>::iterator it = links_.begin(); it != links_.end(); ++it) {
+            (*it)->PreSelect(sel, group);
+            timeout = std::min(timeout, (*it)->Timeout());
+            round_.push_back(*it);
+        }
+
+        lock.unlock();
+        int ret = (INT_MAX == timeout) ? sel.Select() : sel.Select(std::max(0, timeout));
+        lock.lock();
+
+        if (ret < 0) {
+            xerror2(TSF"sel err ret:(%_, %_), links:%_", ret, sel.Errno(), round_.size()) >> group;
+            continue;
+        }
+
+        if (sel.IsException()) {
+            xerror2(TSF"breaker exp, links:%_", round_.size()) >> group;
+            breaker_.ReCreate();
+            continue;
+        }
+
+        // a break only wakes the loop for a new link, the sockets of this round are still served.
+        for (std::vector<Link*>::iterator it = round_.begin(); it != round_.end(); ++it) {
+            if (NULL == *it) continue;
+
+            (*it)->AfterSelect(sel, group);
+            if ((*it)->IsEndStatus()) links_.erase(std::remove(links_.begin(), links_.end(), *it), links_.end());
+        }
+
+        round_.clear();
+    }
+}
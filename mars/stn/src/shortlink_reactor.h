@@ -0,0 +1,74 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * shortlink_reactor.h
+ *
+ * one select loop that drives the sockets of all the short links, as TcpFSMHandler does for a list of fsm.
+ */
+
+#ifndef STN_SRC_SHORTLINK_REACTOR_H_
+#define STN_SRC_SHORTLINK_REACTOR_H_
+
+#include <vector>
+
+#include "mars/comm/thread/thread.h"
+#include "mars/comm/thread/mutex.h"
+#include "mars/comm/socket/socketselect.h"
+
+class XLogger;
+
+namespace mars {
+namespace stn {
+
+class ShortLinkReactor {
+  public:
+    // called on the reactor thread with the reactor locked, so a link must not Add or Remove itself from here.
+    class Link {
+      public:
+        virtual ~Link() {}
+
+        virtual void PreSelect(SocketSelect& _sel, XLogger& _log) = 0;
+        virtual void AfterSelect(SocketSelect& _sel, XLogger& _log) = 0;
+        virtual int  Timeout() const = 0;  // ms, INT_MAX for none
+        virtual bool IsEndStatus() const = 0;
+    };
+
+  public:
+    static ShortLinkReactor& Instance();
+
+    void   Add(Link* _link);
+    // once it returns the reactor never touches the link again.
+    void   Remove(Link* _link);
+    size_t Size() const;
+
+  private:
+    ShortLinkReactor();
+    ~ShortLinkReactor();
+    ShortLinkReactor(const ShortLinkReactor&);
+    ShortLinkReactor& operator=(const ShortLinkReactor&);
+
+  private:
+    void __Run();
+
+  private:
+    Thread                  thread_;
+    SocketSelectBreaker     breaker_;
+    mutable Mutex           mutex_;
+    std::vector<Link*>      links_;
+    std::vector<Link*>      round_;  // links in the select running now, NULL when removed meanwhile
+};
+
+}}
+
+#endif // STN_SRC_SHORTLINK_REACTOR_H_
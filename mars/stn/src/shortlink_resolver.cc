@@ -0,0 +1,87 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * shortlink_resolver.cc
+ */
+
+#include "shortlink_resolver.h"
+
+#include <algorithm>
+
+#include "boost/bind.hpp"
+
+#include "mars/comm/thread/lock.h"
+#include "mars/comm/xlogger/xlogger.h"
+#include "mars/stn/config.h"
+
+using namespace mars::stn;
+
+ShortLinkResolver& ShortLinkResolver::Instance() {
+    // never deleted, the links may outlive any static destructor.
+    static ShortLinkResolver* resolver = new ShortLinkResolver();
+    return *resolver;
+}
+
+ShortLinkResolver::ShortLinkResolver(): idle_(0) {}
+
+ShortLinkResolver::~ShortLinkResolver() {}
+
+void ShortLinkResolver::Add(Job* _job) {
+    xassert2(NULL != _job);
+
+    ScopedLock lock(mutex_);
+    xassert2(jobs_.end() == std::find(jobs_.begin(), jobs_.end(), _job));
+    jobs_.push_back(_job);
+
+    // threads are started as the jobs waiting outnumber the idle ones, up to kShortlinkResolverThreadCount.
+    if (idle_ < jobs_.size() && threads_.size() < kShortlinkResolverThreadCount) {
+        Thread* thread = new Thread(boost::bind(&ShortLinkResolver::__Run, this), XLOGGER_TAG "::shortlink_resolver");
+        threads_.push_back(thread);
+        thread->start();
+    }
+
+    cond_added_.notifyOne(lock);
+}
+
+void ShortLinkResolver::Remove(Job* _job) {
+    ScopedLock lock(mutex_);
+    jobs_.remove(_job);
+
+    while (running_.end() != std::find(running_.begin(), running_.end(), _job)) {
+        cond_done_.wait(lock);
+    }
+}
+
+void ShortLinkResolver::__Run() {
+    ScopedLock lock(mutex_);
+
+    while (true) {
+        while (jobs_.empty()) {
+            ++idle_;
+            cond_added_.wait(lock);
+            --idle_;
+        }
+
+        Job* job = jobs_.front();
+        jobs_.pop_front();
+        running_.push_back(job);
+
+        lock.unlock();
+        job->Resolve();
+        lock.lock();
+
+        running_.erase(std::find(running_.begin(), running_.end(), job));
+        cond_done_.notifyAll(lock);
+    }
+}
@@ -0,0 +1,72 @@
+// Tencent is pleased to support the open source community by making Mars available.
+// Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+// Licensed under the MIT License (the "License"); you may not use this file except in
+// compliance with the License. You may obtain a copy of the License at
+// http://opensource.org/licenses/MIT
+
+// Unless required by applicable law or agreed to in writing, software distributed under the License is
+// distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+// either express or implied. See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * shortlink_resolver.h
+ *
+ * a few threads shared by all the short links for the blocking part before the reactor, the dns.
+ */
+
+#ifndef STN_SRC_SHORTLINK_RESOLVER_H_
+#define STN_SRC_SHORTLINK_RESOLVER_H_
+
+#include <list>
+#include <vector>
+
+#include "mars/comm/thread/thread.h"
+#include "mars/comm/thread/mutex.h"
+#include "mars/comm/thread/condition.h"
+
+namespace mars {
+namespace stn {
+
+class ShortLinkResolver {
+  public:
+    class Job {
+      public:
+        virtual ~Job() {}
+
+        // called on a resolver thread without the resolver locked.
+        virtual void Resolve() = 0;
+    };
+
+  public:
+    static ShortLinkResolver& Instance();
+
+    void   Add(Job* _job);
+    // once it returns the resolver never touches the job again, a job resolving now is waited for,
+    // so it should be canceled first.
+    void   Remove(Job* _job);
+
+  private:
+    ShortLinkResolver();
+    ~ShortLinkResolver();
+    ShortLinkResolver(const ShortLinkResolver&);
+    ShortLinkResolver& operator=(const ShortLinkResolver&);
+
+  private:
+    void __Run();
+
+  private:
+    std::vector<Thread*>    threads_;
+    Mutex                   mutex_;
+    Condition               cond_added_;
+    Condition               cond_done_;
+    std::list<Job*>         jobs_;
+    std::vector<Job*>       running_;
+    size_t                  idle_;
+};
+
+}}
+
+#endif // STN_SRC_SHORTLINK_RESOLVER_H_
@@ -305,6 +305,7 @@ void ShortLinkTaskManager::__RunOnStartTask() {
 		}
 
         worker->func_network_report = fun_notify_network_err_;
+        worker->ContentEncoding(first->task.shortlink_accept_encoding, first->task.shortlink_compress_body);
         worker->SendRequest(bufreq);
 
         xinfo2(TSF"task add into shortlink readwrite cgi:%_, cmdid:%_, taskid:%_, work:%_, size:%_, timeout(firstpkg:%_, rw:%_, task:%_), retry:%_, useProxy:%_",
@@ -50,6 +50,8 @@ Task::Task() {
     retry_count = -1;
     server_process_cost = -1;
     total_timetout = -1;
+    shortlink_accept_encoding = false;
+    shortlink_compress_body = false;
     user_context = NULL;
 
 }
@@ -83,6 +83,9 @@ public:
     int32_t     server_process_cost;  // user
     int32_t     total_timetout;  // user ms
     
+    bool        shortlink_accept_encoding;  // user, ask for a gzip or deflate response body, inflated before the decode
+    bool        shortlink_compress_body;  // user, gzip the request body, only for a cgi that takes Content-Encoding
+    
     void*       user_context;  // user
     std::string report_arg;  // user for cgi report
     